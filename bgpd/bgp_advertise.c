@@ -154,12 +154,191 @@ bgp_advertise_unintern (struct hash *hash, struct bgp_advertise_attr *baa)
     }
 }
 
-/* BGP adjacency keeps minimal advertisement information.  */
+/* Adjacencies out in use, and the bytes of the arrays holding them.  */
+static unsigned long adj_out_count;
+static unsigned long adj_out_bytes;
+
+static size_t
+bgp_adj_out_array_bytes (unsigned int size)
+{
+  return sizeof (struct bgp_adj_out_array)
+    + size * sizeof (struct bgp_adj_out);
+}
+
+/* Whether COUNT entries, the highest with index MAX, had better go in
+   the slots of their peers' indexes.  */
+static int
+bgp_adj_out_direct (unsigned int count, unsigned int max)
+{
+  return count > BGP_ADJ_OUT_PACKED && max < 4 * count;
+}
+
+/* Move the node's adjacencies to an array of SIZE slots, laid out as
+   DIRECT says.  */
+static void
+bgp_adj_out_resize (struct bgp_node *rn, unsigned int size, int direct)
+{
+  struct bgp_adj_out_array *old = rn->adj_out;
+  struct bgp_adj_out_array *new;
+  struct bgp_adj_out *adj;
+  unsigned int i, n = 0;
+
+  new = XCALLOC (MTYPE_BGP_ADJ_OUT, bgp_adj_out_array_bytes (size));
+  new->size = size;
+  new->direct = direct;
+  adj_out_bytes += bgp_adj_out_array_bytes (size);
+
+  if (old)
+    {
+      for (i = 0; i < old->size; i++)
+	{
+	  if (! old->adj[i].peer)
+	    continue;
+	  adj = direct ? &new->adj[old->adj[i].peer->index] : &new->adj[n];
+	  *adj = old->adj[i];
+	  if (adj->adv)
+	    adj->adv->adj = adj;
+	  n++;
+	}
+      assert (n == old->count);
+      adj_out_bytes -= bgp_adj_out_array_bytes (old->size);
+      XFREE (MTYPE_BGP_ADJ_OUT, old);
+    }
+  new->count = n;
+  rn->adj_out = new;
+}
+
+/* The peer's adjacency out of the node, if it has one.  */
+struct bgp_adj_out *
+bgp_adj_out_get (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_adj_out_array *array = rn->adj_out;
+  unsigned int i;
+
+  if (! array)
+    return NULL;
+
+  if (array->direct)
+    {
+      if (peer->index < array->size && array->adj[peer->index].peer == peer)
+	return &array->adj[peer->index];
+      return NULL;
+    }
+
+  for (i = 0; i < array->count; i++)
+    if (array->adj[i].peer == peer)
+      return &array->adj[i];
+  return NULL;
+}
+
+/* The node's adjacency out after ADJ, or the first if ADJ is NULL.  */
+struct bgp_adj_out *
+bgp_adj_out_next (struct bgp_node *rn, struct bgp_adj_out *adj)
+{
+  struct bgp_adj_out_array *array = rn->adj_out;
+  unsigned int i;
+
+  if (! array)
+    return NULL;
+
+  for (i = adj ? adj - array->adj + 1 : 0; i < array->size; i++)
+    if (array->adj[i].peer)
+      return &array->adj[i];
+  return NULL;
+}
+
+/* Add an empty adjacency out of the node for the peer.  */
+static struct bgp_adj_out *
+bgp_adj_out_add (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_adj_out_array *array = rn->adj_out;
+  struct bgp_adj_out *adj;
+  unsigned int i, max = peer->index;
+
+  if (! array)
+    bgp_adj_out_resize (rn, 1, 0);
+  else if (array->direct)
+    {
+      if (peer->index >= array->size)
+	{
+	  if (bgp_adj_out_direct (array->count + 1, peer->index))
+	    bgp_adj_out_resize (rn, MIN (MAX (peer->index + 1, 2 * array->size),
+					 bm->peer_index_max), 1);
+	  else
+	    bgp_adj_out_resize (rn, 2 * (array->count + 1), 0);
+	}
+    }
+  else
+    {
+      for (i = 0; i < array->count; i++)
+	max = MAX (max, array->adj[i].peer->index);
+      if (bgp_adj_out_direct (array->count + 1, max))
+	bgp_adj_out_resize (rn, MIN (2 * (max + 1), bm->peer_index_max), 1);
+      else if (array->count == array->size)
+	bgp_adj_out_resize (rn, 2 * array->size, 0);
+    }
+
+  array = rn->adj_out;
+  if (array->direct)
+    adj = &array->adj[peer->index];
+  else
+    adj = &array->adj[array->count];
+  assert (adj->peer == NULL);
+  adj->peer = peer_lock (peer); /* adj_out peer reference */
+  array->count++;
+  adj_out_count++;
+  peer->adjcount[bgp_node_table (rn)->afi][bgp_node_table (rn)->safi]++;
+  bgp_node_peer_bit_set (rn, BGP_PEER_BITS_ADVERTISED, peer->index);
+  return adj;
+}
+
+/* Take the adjacency out of the node.  Other entries may move.  */
 static void
-bgp_adj_out_free (struct bgp_adj_out *adj)
+bgp_adj_out_del (struct bgp_node *rn, struct bgp_adj_out *adj)
 {
+  struct bgp_adj_out_array *array = rn->adj_out;
+  struct bgp_adj_out *last;
+
+  bgp_node_peer_bit_unset (rn, BGP_PEER_BITS_ADVERTISED, adj->peer->index);
+  adj->peer->adjcount[bgp_node_table (rn)->afi][bgp_node_table (rn)->safi]--;
   peer_unlock (adj->peer); /* adj_out peer reference */
-  XFREE (MTYPE_BGP_ADJ_OUT, adj);
+  adj_out_count--;
+
+  if (--array->count == 0)
+    {
+      adj_out_bytes -= bgp_adj_out_array_bytes (array->size);
+      XFREE (MTYPE_BGP_ADJ_OUT, array);
+      rn->adj_out = NULL;
+      return;
+    }
+
+  if (array->direct)
+    {
+      memset (adj, 0, sizeof (struct bgp_adj_out));
+      if (array->count <= BGP_ADJ_OUT_PACKED / 2)
+	bgp_adj_out_resize (rn, BGP_ADJ_OUT_PACKED, 0);
+      return;
+    }
+
+  last = &array->adj[array->count];
+  if (adj != last)
+    {
+      *adj = *last;
+      if (adj->adv)
+	adj->adv->adj = adj;
+    }
+  memset (last, 0, sizeof (struct bgp_adj_out));
+  if (array->size >= 8 && array->count <= array->size / 4)
+    bgp_adj_out_resize (rn, array->size / 2, 0);
+}
+
+/* Adjacencies out in use, and the bytes they take up.  */
+unsigned long
+bgp_adj_out_count (unsigned long *bytes)
+{
+  if (bytes)
+    *bytes = adj_out_bytes;
+  return adj_out_count;
 }
 
 int
@@ -168,10 +347,7 @@ bgp_adj_out_lookup (struct peer *peer, struct prefix *p,
 {
   struct bgp_adj_out *adj;
 
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
-
+  adj = bgp_adj_out_get (rn, peer);
   if (! adj)
     return 0;
 
@@ -219,30 +395,18 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
 		 struct attr *attr, afi_t afi, safi_t safi,
 		 struct bgp_info *binfo)
 {
-  struct bgp_adj_out *adj = NULL;
+  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
 
   if (DISABLE_BGP_ANNOUNCE)
     return;
 
   /* Look for adjacency information. */
-  if (rn)
-    {
-      for (adj = rn->adj_out; adj; adj = adj->next)
-	if (adj->peer == peer)
-	  break;
-    }
-
+  adj = bgp_adj_out_get (rn, peer);
   if (! adj)
     {
-      adj = XCALLOC (MTYPE_BGP_ADJ_OUT, sizeof (struct bgp_adj_out));
-      adj->peer = peer_lock (peer); /* adj_out peer reference */
-      
-      if (rn)
-        {
-          BGP_ADJ_OUT_ADD (rn, adj);
-          bgp_lock_node (rn);
-        }
+      adj = bgp_adj_out_add (rn, peer);
+      bgp_lock_node (rn);
     }
 
   if (adj->adv)
@@ -279,10 +443,7 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     return;
 
   /* Lookup existing adjacency, if it is not there return immediately.  */
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
-
+  adj = bgp_adj_out_get (rn, peer);
   if (! adj)
     return;
 
@@ -307,10 +468,7 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
   else
     {
       /* Remove myself from adjacency. */
-      BGP_ADJ_OUT_DEL (rn, adj);
-      
-      /* Free allocated information.  */
-      bgp_adj_out_free (adj);
+      bgp_adj_out_del (rn, adj);
 
       bgp_unlock_node (rn);
     }
@@ -326,8 +484,7 @@ bgp_adj_out_remove (struct bgp_node *rn, struct bgp_adj_out *adj,
   if (adj->adv)
     bgp_advertise_clean (peer, adj, afi, safi);
 
-  BGP_ADJ_OUT_DEL (rn, adj);
-  bgp_adj_out_free (adj);
+  bgp_adj_out_del (rn, adj);
 }
 
 void
@@ -335,23 +492,27 @@ bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
 {
   struct bgp_adj_in *adj;
 
-  for (adj = rn->adj_in; adj; adj = adj->next)
-    {
-      if (adj->peer == peer)
-	{
-	  if (adj->attr != attr)
-	    {
-	      bgp_attr_unintern (&adj->attr);
-	      adj->attr = bgp_attr_intern (attr);
-	    }
-	  return;
-	}
-    }
+  /* Nothing received from the peer, so no adjacency to look for.  */
+  if (bgp_node_peer_bit (rn, BGP_PEER_BITS_RECEIVED, peer->index))
+    for (adj = rn->adj_in; adj; adj = adj->next)
+      {
+	if (adj->peer == peer)
+	  {
+	    if (adj->attr != attr)
+	      {
+		bgp_attr_unintern (&adj->attr);
+		adj->attr = bgp_attr_intern (attr);
+	      }
+	    return;
+	  }
+      }
   adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
   adj->peer = peer_lock (peer); /* adj_in peer reference */
   adj->attr = bgp_attr_intern (attr);
   BGP_ADJ_IN_ADD (rn, adj);
   bgp_lock_node (rn);
+  peer->adjcount[bgp_node_table (rn)->afi][bgp_node_table (rn)->safi]++;
+  bgp_node_peer_bit_set (rn, BGP_PEER_BITS_RECEIVED, peer->index);
 }
 
 void
@@ -359,6 +520,8 @@ bgp_adj_in_remove (struct bgp_node *rn, struct bgp_adj_in *bai)
 {
   bgp_attr_unintern (&bai->attr);
   BGP_ADJ_IN_DEL (rn, bai);
+  bgp_node_received_check (rn, bai->peer);
+  bai->peer->adjcount[bgp_node_table (rn)->afi][bgp_node_table (rn)->safi]--;
   peer_unlock (bai->peer); /* adj_in peer reference */
   XFREE (MTYPE_BGP_ADJ_IN, bai);
 }
@@ -368,6 +531,9 @@ bgp_adj_in_unset (struct bgp_node *rn, struct peer *peer)
 {
   struct bgp_adj_in *adj;
 
+  if (! bgp_node_peer_bit (rn, BGP_PEER_BITS_RECEIVED, peer->index))
+    return;
+
   for (adj = rn->adj_in; adj; adj = adj->next)
     if (adj->peer == peer)
       break;
@@ -59,11 +59,7 @@ struct bgp_advertise
 /* BGP adjacency out.  */
 struct bgp_adj_out
 {
-  /* Lined list pointer.  */
-  struct bgp_adj_out *next;
-  struct bgp_adj_out *prev;
-
-  /* Advertised peer.  */
+  /* Advertised peer, NULL if the slot is free.  */
   struct peer *peer;
 
   /* Advertised attribute.  */
@@ -73,6 +69,29 @@ struct bgp_adj_out
   struct bgp_advertise *adv;
 };
 
+/* The adjacencies out of a node, held in the node's one array rather
+   than allocated one by one.  Up to BGP_ADJ_OUT_PACKED of them are
+   packed at the front and searched.  Past that, as long as it does not
+   leave too many slots free, each goes in the slot of its peer's index
+   instead, which is what a prefix sent to most of a route server's
+   peers ends up with.  Entries move when the array changes: anything
+   pointing at one, as a bgp_advertise does, is updated then.  */
+struct bgp_adj_out_array
+{
+  /* Entries in use.  */
+  unsigned int count;
+
+  /* Slots allocated.  */
+  unsigned int size;
+
+  /* Entries are in the slot of their peer's index.  */
+  int direct;
+
+  struct bgp_adj_out adj[];
+};
+
+#define BGP_ADJ_OUT_PACKED	8
+
 /* BGP adjacency in. */
 struct bgp_adj_in
 {
@@ -119,8 +138,6 @@ struct bgp_synchronize
 
 #define BGP_ADJ_IN_ADD(N,A)    BGP_INFO_ADD(N,A,adj_in)
 #define BGP_ADJ_IN_DEL(N,A)    BGP_INFO_DEL(N,A,adj_in)
-#define BGP_ADJ_OUT_ADD(N,A)   BGP_INFO_ADD(N,A,adj_out)
-#define BGP_ADJ_OUT_DEL(N,A)   BGP_INFO_DEL(N,A,adj_out)
 
 /* Prototypes.  */
 extern void bgp_adj_out_set (struct bgp_node *, struct peer *, struct prefix *,
@@ -131,6 +148,10 @@ extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *,
 			 struct peer *, afi_t, safi_t);
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
+extern struct bgp_adj_out *bgp_adj_out_get (struct bgp_node *, struct peer *);
+extern struct bgp_adj_out *bgp_adj_out_next (struct bgp_node *,
+					     struct bgp_adj_out *);
+extern unsigned long bgp_adj_out_count (unsigned long *);
 
 extern void bgp_adj_in_set (struct bgp_node *, struct peer *, struct attr *);
 extern void bgp_adj_in_unset (struct bgp_node *, struct peer *);
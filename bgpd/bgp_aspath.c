@@ -29,6 +29,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "stream.h"
 #include "jhash.h"
+#include "arena.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_aspath.h"
@@ -91,6 +92,17 @@ static struct hash *ashash = NULL;
 /* Stream for SNMP. See aspath_snmp_pathseg */
 static struct stream *snmp_stream;
 
+/* AS path strings are only wanted for show commands, debugs and
+   regular expressions, so they are made when asked for, and only the
+   last ASPATH_STR_CACHE_MAX of them are kept: making one drops the
+   string of the path which had the slot before.  A string from
+   aspath_print stays good until that many more have been made. */
+#define ASPATH_STR_CACHE_MAX 4096
+
+static struct aspath *aspath_str_cache[ASPATH_STR_CACHE_MAX];
+static unsigned int aspath_str_next;
+static unsigned long aspath_str_bytes;
+
 /* Callers are required to initialize the memory */
 static as_t *
 assegment_data_new (int num)
@@ -147,6 +159,32 @@ assegment_free_all (struct assegment *seg)
     }
 }
 
+/* Segments being parsed come out of the arena given, if any, and are
+   then freed with it rather than one by one. */
+static struct assegment *
+assegment_parse_new (struct arena *arena, u_char type, u_short length)
+{
+  struct assegment *new;
+
+  if (! arena)
+    return assegment_new (type, length);
+
+  new = arena_alloc (arena, sizeof (struct assegment));
+  new->next = NULL;
+  new->as = arena_alloc (arena, ASSEGMENT_DATA_SIZE (length, 1));
+  new->length = length;
+  new->type = type;
+
+  return new;
+}
+
+static void
+assegment_parse_free_all (struct arena *arena, struct assegment *seg)
+{
+  if (! arena)
+    assegment_free_all (seg);
+}
+
 /* Duplicate just the given assegment and its data */
 static struct assegment *
 assegment_dup (struct assegment *seg)
@@ -245,7 +283,7 @@ int_cmp (const void *p1, const void *p2)
  * representation - eg, so that our hashing actually works..
  */
 static struct assegment *
-assegment_normalise (struct assegment *head)
+assegment_normalise (struct assegment *head, struct arena *arena)
 {
   struct assegment *seg = head, *pin;
   struct assegment *tmp;
@@ -294,13 +332,28 @@ assegment_normalise (struct assegment *head)
           seg = pin->next;
           
           /* append the next sequence to the pinned sequence */
-          pin = assegment_append_asns (pin, seg->as, seg->length);
+          if (arena)
+            {
+              as_t *newas;
+
+              newas = arena_alloc (arena, ASSEGMENT_DATA_SIZE (pin->length
+                                                               + seg->length,
+                                                               1));
+              memcpy (newas, pin->as, ASSEGMENT_DATA_SIZE (pin->length, 1));
+              memcpy (newas + pin->length, seg->as,
+                      ASSEGMENT_DATA_SIZE (seg->length, 1));
+              pin->as = newas;
+              pin->length += seg->length;
+            }
+          else
+            pin = assegment_append_asns (pin, seg->as, seg->length);
           
           /* bypass the next sequence */
           pin->next = seg->next;
           
           /* get rid of the now referenceless segment */
-          assegment_free (tmp);
+          if (! arena)
+            assegment_free (tmp);
           
         }
 
@@ -309,6 +362,8 @@ assegment_normalise (struct assegment *head)
   return head;
 }
 
+static void aspath_str_update (struct aspath *);
+
 static struct aspath *
 aspath_new (void)
 {
@@ -323,8 +378,7 @@ aspath_free (struct aspath *aspath)
     return;
   if (aspath->segments)
     assegment_free_all (aspath->segments);
-  if (aspath->str)
-    XFREE (MTYPE_AS_STR, aspath->str);
+  aspath_str_update (aspath);
   XFREE (MTYPE_AS_PATH, aspath);
 }
 
@@ -506,6 +560,22 @@ aspath_has_as4 (struct aspath *aspath)
   return 0;
 }
 
+/* Give AS its string, taking the next slot in the cache from whoever
+   had it. */
+static void
+aspath_str_cache_add (struct aspath *as, char *str, int len)
+{
+  if (aspath_str_cache[aspath_str_next])
+    aspath_str_update (aspath_str_cache[aspath_str_next]);
+  aspath_str_cache[aspath_str_next] = as;
+  as->str_slot = aspath_str_next;
+  aspath_str_next = (aspath_str_next + 1) % ASPATH_STR_CACHE_MAX;
+
+  as->str = str;
+  as->str_len = len;
+  aspath_str_bytes += len + 1;
+}
+
 /* Convert aspath structure to string expression. */
 static void
 aspath_make_str_count (struct aspath *as)
@@ -518,9 +588,9 @@ aspath_make_str_count (struct aspath *as)
   /* Empty aspath. */
   if (!as->segments)
     {
-      as->str = XMALLOC (MTYPE_AS_STR, 1);
-      as->str[0] = '\0';
-      as->str_len = 0;
+      str_buf = XMALLOC (MTYPE_AS_STR, 1);
+      str_buf[0] = '\0';
+      aspath_str_cache_add (as, str_buf, 0);
       return;
     }
   
@@ -607,18 +677,23 @@ aspath_make_str_count (struct aspath *as)
   assert (len < str_size);
   
   str_buf[len] = '\0';
-  as->str = str_buf;
-  as->str_len = len;
-
-  return;
+  if (str_size > len + 1)
+    str_buf = XREALLOC (MTYPE_AS_STR, str_buf, len + 1);
+  aspath_str_cache_add (as, str_buf, len);
 }
 
+/* Forget the string of an AS path whose segments have changed, or
+   which is going away.  It is made again by aspath_print. */
 static void
 aspath_str_update (struct aspath *as)
 {
-  if (as->str)
-    XFREE (MTYPE_AS_STR, as->str);
-  aspath_make_str_count (as);
+  if (! as->str)
+    return;
+  aspath_str_cache[as->str_slot] = NULL;
+  aspath_str_bytes -= as->str_len + 1;
+  XFREE (MTYPE_AS_STR, as->str);
+  as->str = NULL;
+  as->str_len = 0;
 }
 
 /* Intern allocated AS path. */
@@ -627,10 +702,8 @@ aspath_intern (struct aspath *aspath)
 {
   struct aspath *find;
 
-  /* Assert this AS path structure is not interned and has the string
-     representation built. */
+  /* Assert this AS path structure is not interned. */
   assert (aspath->refcnt == 0);
-  assert (aspath->str);
 
   /* Check AS path hash. */
 //  find = hash_get (ashash, aspath, hash_alloc_intern);
@@ -648,7 +721,6 @@ aspath_intern (struct aspath *aspath)
 struct aspath *
 aspath_dup (struct aspath *aspath)
 {
-  unsigned short buflen = aspath->str_len + 1;
   struct aspath *new;
 
   new = XCALLOC (MTYPE_AS_PATH, sizeof (struct aspath));
@@ -656,18 +728,6 @@ aspath_dup (struct aspath *aspath)
   if (aspath->segments)
     new->segments = assegment_dup_all (aspath->segments);
 
-  if (!aspath->str)
-    return new;
-
-  new->str = XMALLOC (MTYPE_AS_STR, buflen);
-  new->str_len = aspath->str_len;
-
-  /* copy the string data */
-  if (aspath->str_len > 0)
-    memcpy (new->str, aspath->str, buflen);
-  else
-    new->str[0] = '\0';
-
   return new;
 }
 
@@ -677,27 +737,28 @@ aspath_hash_alloc (const void *arg)
   const struct aspath *aspath = arg;
   struct aspath *new;
 
-  /* Malformed AS path value. */
-  assert (aspath->str);
-  if (! aspath->str)
-    return NULL;
-
   /* New aspath structure is needed. */
-  new = XMALLOC (MTYPE_AS_PATH, sizeof (struct aspath));
+  new = XCALLOC (MTYPE_AS_PATH, sizeof (struct aspath));
 
-  /* Reuse segments and string representation */
+  /* Reuse segments; the string is made when it is wanted. */
   new->refcnt = 0;
   new->segments = aspath->segments;
-  new->str = aspath->str;
-  new->str_len = aspath->str_len;
 
   return new;
 }
 
+/* As aspath_hash_alloc, for segments in an arena: they are copied. */
+static void *
+aspath_hash_alloc_copy (const void *arg)
+{
+  return aspath_dup ((struct aspath *) arg);
+}
+
 /* parse as-segment byte stream in struct assegment */
 static int
 assegments_parse (struct stream *s, size_t length, 
-                  struct assegment **result, int use32bit)
+                  struct assegment **result, int use32bit,
+                  struct arena *arena)
 {
   struct assegment_header segh;
   struct assegment *seg, *prev = NULL, *head = NULL;
@@ -724,7 +785,7 @@ assegments_parse (struct stream *s, size_t length,
       if ((length - bytes) <= AS_HEADER_SIZE)
         {
           if (head)
-            assegment_free_all (head);
+            assegment_parse_free_all (arena, head);
           return -1;
         }
       
@@ -750,7 +811,7 @@ assegments_parse (struct stream *s, size_t length,
               && (0x10 + segh.length > 0x10 + AS_SEGMENT_MAX)))
         {
           if (head)
-            assegment_free_all (head);
+            assegment_parse_free_all (arena, head);
           return -1;
         }
       
@@ -763,12 +824,12 @@ assegments_parse (struct stream *s, size_t length,
             break;
           default:
             if (head)
-              assegment_free_all (head);
+              assegment_parse_free_all (arena, head);
             return -1;
         }
       
       /* now its safe to trust lengths */
-      seg = assegment_new (segh.type, segh.length);
+      seg = assegment_parse_new (arena, segh.type, segh.length);
       
       if (head)
         prev->next = seg;
@@ -787,18 +848,23 @@ assegments_parse (struct stream *s, size_t length,
       prev = seg;
     }
  
-  *result = assegment_normalise (head);
+  *result = assegment_normalise (head, arena);
   return 0;
 }
 
 /* AS path parse function.  pnt is a pointer to byte stream and length
    is length of byte stream.  If there is same AS path in the the AS
    path hash then return it else make new AS path structure. 
+
+   The segments are parsed into arena, if one is given, and only copied
+   out of it for a path not seen before; else they are malloc()ed and
+   freed again if the path is found.
    
    On error NULL is returned.
  */
 struct aspath *
-aspath_parse (struct stream *s, size_t length, int use32bit)
+aspath_parse (struct stream *s, size_t length, int use32bit,
+              struct arena *arena)
 {
   struct aspath as;
   struct aspath *find;
@@ -813,22 +879,19 @@ aspath_parse (struct stream *s, size_t length, int use32bit)
     return NULL;
 
   memset (&as, 0, sizeof (struct aspath));
-  if (assegments_parse (s, length, &as.segments, use32bit) < 0)
+  if (assegments_parse (s, length, &as.segments, use32bit, arena) < 0)
     return NULL;
 
   /* If already same aspath exist then return it. */
-  find = hash_get (ashash, &as, aspath_hash_alloc);
+  find = hash_get (ashash, &as,
+                   arena ? aspath_hash_alloc_copy : aspath_hash_alloc);
 
   /* bug! should not happen, let the daemon crash below */
   assert (find);
 
   /* if the aspath was already hashed free temporary memory. */
-  if (find->refcnt)
-    {
-      assegment_free_all (as.segments);
-      /* aspath_key_make() always updates the string */
-      XFREE (MTYPE_AS_STR, as.str);
-    }
+  if (find->refcnt && ! arena)
+    assegment_free_all (as.segments);
 
   find->refcnt++;
 
@@ -1087,7 +1150,7 @@ aspath_aggregate (struct aspath *as1, struct aspath *as2)
       seg2 = seg2->next;
     }
   
-  assegment_normalise (aspath->segments);
+  assegment_normalise (aspath->segments, NULL);
   aspath_str_update (aspath);
   return aspath;
 }
@@ -1494,7 +1557,7 @@ aspath_reconcile_as4 ( struct aspath *aspath, struct aspath *as4path)
   
   if ( BGP_DEBUG(as4, AS4))
     zlog_debug("[AS4] got AS_PATH %s and AS4_PATH %s synthesizing now",
-               aspath->str, as4path->str);
+               aspath_print (aspath), aspath_print (as4path));
 
   while (seg && hops > 0)
     {
@@ -1548,12 +1611,12 @@ aspath_reconcile_as4 ( struct aspath *aspath, struct aspath *as4path)
    */
   mergedpath = aspath_merge (newpath, aspath_dup(as4path));
   aspath_free (newpath);
-  mergedpath->segments = assegment_normalise (mergedpath->segments);
+  mergedpath->segments = assegment_normalise (mergedpath->segments, NULL);
   aspath_str_update (mergedpath);
   
   if ( BGP_DEBUG(as4, AS4))
     zlog_debug ("[AS4] result of synthesizing is %s",
-                mergedpath->str);
+                aspath_print (mergedpath));
   
   return mergedpath;
 }
@@ -1657,7 +1720,7 @@ aspath_segment_add (struct aspath *as, int type)
 struct aspath *
 aspath_empty (void)
 {
-  return aspath_parse (NULL, 0, 1); /* 32Bit ;-) */
+  return aspath_parse (NULL, 0, 1, NULL); /* 32Bit ;-) */
 }
 
 struct aspath *
@@ -1666,7 +1729,6 @@ aspath_empty_get (void)
   struct aspath *aspath;
 
   aspath = aspath_new ();
-  aspath_make_str_count (aspath);
   return aspath;
 }
 
@@ -1674,6 +1736,20 @@ unsigned long
 aspath_count (void)
 {
   return ashash->count;
+}
+
+/* How many AS path strings there are, and the bytes they take. */
+unsigned long
+aspath_str_count (unsigned long *bytes)
+{
+  unsigned long count = 0;
+  unsigned int i;
+
+  for (i = 0; i < ASPATH_STR_CACHE_MAX; i++)
+    if (aspath_str_cache[i])
+      count++;
+  *bytes = aspath_str_bytes;
+  return count;
 }     
 
 /* 
@@ -1825,8 +1901,6 @@ aspath_str2aspath (const char *str)
 	}
     }
 
-  aspath_make_str_count (aspath);
-
   return aspath;
 }
 
@@ -1835,17 +1909,15 @@ aspath_str2aspath (const char *str)
 unsigned int
 aspath_key_make (const void *p)
 {
-//	struct aspath *aspath = (const struct aspath *) p;
-	struct aspath *aspath = (struct aspath *) p;
-	unsigned int key = 0;
+  const struct aspath *aspath = p;
+  const struct assegment *seg;
+  unsigned int key = 2334325;
 
-	if (!aspath->str)
-		aspath_str_update (aspath);
+  for (seg = aspath->segments; seg; seg = seg->next)
+    key = jhash2 (seg->as, seg->length, key ^ (seg->type << 16));
 
-	key = jhash (aspath->str, aspath->str_len, 2334325);
-
-	return key;
-}// aspath_key_make
+  return key;
+}
 
 
 /* If two aspath have same value then return 1 else return 0 */
@@ -1877,7 +1949,7 @@ aspath_cmp (const void *arg1, const void *arg2)
 void
 aspath_init (void)
 {
-	ashash = hash_create_size (32768, aspath_key_make, aspath_cmp);
+	ashash = hash_create_open (32768, aspath_key_make, aspath_cmp);
 }
 
 void
@@ -1894,7 +1966,11 @@ aspath_finish (void)
 const char *
 aspath_print (struct aspath *as)
 {
-  return (as ? as->str : NULL);
+  if (! as)
+    return NULL;
+  if (! as->str)
+    aspath_make_str_count (as);
+  return as->str;
 }
 
 /* Printing functions */
@@ -1905,7 +1981,7 @@ void
 aspath_print_vty (struct vty *vty, const char *format, struct aspath *as, const char * suffix)
 {
   assert (format);
-  vty_out (vty, format, as->str);
+  vty_out (vty, format, aspath_print (as));
   if (as->str_len && strlen (suffix))
     vty_out (vty, "%s", suffix);
 }
@@ -1918,7 +1994,7 @@ aspath_show_all_iterator (struct hash_backet *backet, struct vty *vty)
   as = (struct aspath *) backet->data;
 
   vty_out (vty, "[%p:%u] (%ld) ", backet, backet->key, as->refcnt);
-  vty_out (vty, "%s%s", as->str, VTY_NEWLINE);
+  vty_out (vty, "%s%s", aspath_print (as), VTY_NEWLINE);
 }
 
 /* Print all aspath and hash information.  This function is used from
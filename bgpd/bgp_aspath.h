@@ -55,18 +55,25 @@ struct aspath
   /* segment data */
   struct assegment *segments;
   
-  /* String expression of AS path.  This string is used by vty output
-     and AS path regular expression match.  */
+  /* String expression of AS path, made by aspath_print when first
+     wanted and kept in a bounded cache, so that it may be thrown away
+     again to make room for others.  NULL when there is none.  */
   char *str;
   unsigned short str_len;
+
+  /* Its place in the string cache. */
+  unsigned int str_slot;
 };
 
 #define ASPATH_STR_DEFAULT_LEN 32
 
+struct arena;
+
 /* Prototypes. */
 extern void aspath_init (void);
 extern void aspath_finish (void);
-extern struct aspath *aspath_parse (struct stream *, size_t, int);
+extern struct aspath *aspath_parse (struct stream *, size_t, int,
+                                    struct arena *);
 extern struct aspath *aspath_dup (struct aspath *);
 extern struct aspath *aspath_aggregate (struct aspath *, struct aspath *);
 extern struct aspath *aspath_prepend (struct aspath *, struct aspath *);
@@ -95,6 +102,7 @@ extern int aspath_firstas_check (struct aspath *, as_t);
 extern int aspath_confed_check (struct aspath *);
 extern int aspath_left_confed_check (struct aspath *);
 extern unsigned long aspath_count (void);
+extern unsigned long aspath_str_count (unsigned long *);
 extern unsigned int aspath_count_hops (struct aspath *);
 extern unsigned int aspath_count_confeds (struct aspath *);
 extern unsigned int aspath_size (struct aspath *);
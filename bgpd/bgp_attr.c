@@ -29,6 +29,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "hash.h"
 #include "jhash.h"
+#include "routemap.h"
+#include "arena.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_attr.h"
@@ -210,6 +212,20 @@ cluster_finish (void)
   cluster_hash = NULL;
 }
 
+/* Temporaries of the UPDATE being parsed: AS path segments, sorted
+   communities and transit attributes.  Interning copies out what the
+   hashes do not have yet, and the rest goes all at once when
+   bgp_update_receive() is done with the UPDATE. */
+#define BGP_ATTR_ARENA_CHUNK 16384
+
+static struct arena *parse_arena;
+
+void
+bgp_attr_parse_reset (void)
+{
+  arena_reset (parse_arena);
+}
+
 /* Unknown transit attribute. */
 static struct hash *transit_hash;
 
@@ -221,36 +237,40 @@ transit_free (struct transit *transit)
   XFREE (MTYPE_TRANSIT, transit);
 }
 
-/*
 static void *
 transit_hash_alloc (const void *p)
 {
-	// Transit structure is already allocated
-	return p;
-}*/
+  const struct transit *transit = p;
+  struct transit *new;
+
+  new = XCALLOC (MTYPE_TRANSIT, sizeof (struct transit));
+  new->length = transit->length;
+  new->val = XMALLOC (MTYPE_TRANSIT_VAL, transit->length);
+  memcpy (new->val, transit->val, transit->length);
+  return new;
+}
 
-// not used
-/*
+/* Transit attributes are gathered in the parse arena, and copied out
+   of it only when the hash does not have them yet. */
 static struct transit *
 transit_intern (struct transit *transit)
 {
-	struct transit *find;
+  struct transit *find;
 
-//	find = hash_get (transit_hash, transit, transit_hash_alloc);
-	find = hash_get2 (transit_hash, transit, transit);
-	if (find != transit)
-		transit_free (transit);
-	find->refcnt++;
+  find = hash_get (transit_hash, transit, transit_hash_alloc);
+  find->refcnt++;
 
-	return find;
+  return find;
 }
-*/
 
 void
 transit_unintern (struct transit *transit)
 {
-  if (transit->refcnt)
-    transit->refcnt--;
+  /* Not interned, so still in the parse arena. */
+  if (! transit->refcnt)
+    return;
+
+  transit->refcnt--;
 
   if (transit->refcnt == 0)
     {
@@ -457,7 +477,8 @@ attrhash_cmp (const void *p1, const void *p2)
 static void
 attrhash_init (void)
 {
-  attrhash = hash_create (attrhash_key_make, attrhash_cmp);
+  attrhash = hash_create_open (HASH_INITIAL_SIZE, attrhash_key_make,
+			       attrhash_cmp);
 }
 
 static void
@@ -485,6 +506,21 @@ attr_show_all (struct vty *vty)
 		vty);
 }
 
+/* Next serial to give attributes.  Should it ever wrap, the route-map
+   caches are emptied, so that old serials are not taken for new. */
+static unsigned long
+bgp_attr_serial (void)
+{
+  static unsigned long serial;
+
+  if (++serial == 0)
+    {
+      route_map_cache_flush (NULL);
+      ++serial;
+    }
+  return serial;
+}
+
 static void *
 bgp_attr_hash_alloc (const void *p)
 {
@@ -500,6 +536,7 @@ bgp_attr_hash_alloc (const void *p)
 		*attr->extra = *val->extra;
 	}
 	attr->refcnt = 0;
+	attr->serial = bgp_attr_serial ();
 	return attr;
 }// bgp_attr_hash_alloc
 
@@ -546,20 +583,9 @@ bgp_attr_intern (struct attr *attr)
 		if (attre->transit)
 		{
 			if (! attre->transit->refcnt)
-			{
-			/**/
-				struct transit *t_find;
-//				t_find = hash_get (transit_hash, attre->transit, transit_hash_alloc);
-				t_find = hash_get2 (transit_hash, attre->transit, attre->transit);
-				if (t_find != attre->transit)
-					transit_free (attre->transit);
-				t_find->refcnt++;
-
-				attre->transit = t_find;
-//				attre->transit = transit_intern (attre->transit);
-			}else{
+				attre->transit = transit_intern (attre->transit);
+			else
 				attre->transit->refcnt++;
-			}
 		}
 	}
 
@@ -569,6 +595,32 @@ bgp_attr_intern (struct attr *attr)
 	return find;
 }// 
 
+/* Another reference to interned attributes, as interning their equal
+   would give, without hashing them again. */
+struct attr *
+bgp_attr_ref (struct attr *attr)
+{
+  assert (attr->refcnt);
+
+  attr->refcnt++;
+  if (attr->aspath)
+    attr->aspath->refcnt++;
+  if (attr->community)
+    attr->community->refcnt++;
+  if (attr->extra)
+    {
+      struct attr_extra *attre = attr->extra;
+
+      if (attre->ecommunity)
+        attre->ecommunity->refcnt++;
+      if (attre->cluster)
+        attre->cluster->refcnt++;
+      if (attre->transit)
+        attre->transit->refcnt++;
+    }
+  return attr;
+}
+
 
 /* Make network statement's attribute. */
 struct attr *
@@ -735,8 +787,7 @@ bgp_attr_flush (struct attr *attr)
         ecommunity_free (&attre->ecommunity);
       if (attre->cluster && ! attre->cluster->refcnt)
         cluster_free (attre->cluster);
-      if (attre->transit && ! attre->transit->refcnt)
-        transit_free (attre->transit);
+      /* A transit not interned is in the parse arena. */
     }
 }
 
@@ -1002,7 +1053,8 @@ bgp_attr_aspath (struct bgp_attr_parser_args *args)
    * otherwise, will get 16 Bit
    */
   attr->aspath = aspath_parse (peer->ibuf, length, 
-                               CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV));
+                               CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV),
+                               parse_arena);
 
   /* In case of IBGP, length will be zero. */
   if (! attr->aspath)
@@ -1078,7 +1130,7 @@ bgp_attr_as4_path (struct bgp_attr_parser_args *args, struct aspath **as4_path)
   struct attr *const attr = args->attr;
   const bgp_size_t length = args->length;
   
-  *as4_path = aspath_parse (peer->ibuf, length, 1);
+  *as4_path = aspath_parse (peer->ibuf, length, 1, parse_arena);
 
   /* In case of IBGP, length will be zero. */
   if (!*as4_path)
@@ -1413,7 +1465,8 @@ bgp_attr_community (struct bgp_attr_parser_args *args)
     }
   
   attr->community =
-    community_parse ((u_int32_t *)stream_pnt (peer->ibuf), length);
+    community_parse ((u_int32_t *)stream_pnt (peer->ibuf), length,
+                     parse_arena);
   
   /* XXX: fix community_parse to use stream API and remove this */
   stream_forward_getp (peer->ibuf, length);
@@ -1677,7 +1730,8 @@ bgp_attr_ext_communities (struct bgp_attr_parser_args *args)
     }
 
   (bgp_attr_extra_get (attr))->ecommunity =
-    ecommunity_parse ((u_int8_t *)stream_pnt (peer->ibuf), length);
+    ecommunity_parse ((u_int8_t *)stream_pnt (peer->ibuf), length,
+                      parse_arena);
   /* XXX: fix ecommunity_parse to use stream API */
   stream_forward_getp (peer->ibuf, length);
   
@@ -1739,17 +1793,25 @@ bgp_attr_unknown (struct bgp_attr_parser_args *args)
      is not set back to 0 by the current AS. */
   SET_FLAG (*startp, BGP_ATTR_FLAG_PARTIAL);
 
-  /* Store transitive attribute to the end of attr->transit. */
+  /* Store transitive attribute to the end of attr->transit, in the
+     parse arena until bgp_attr_parse interns it. */
   if (! ((attre = bgp_attr_extra_get(attr))->transit) )
-      attre->transit = XCALLOC (MTYPE_TRANSIT, sizeof (struct transit));
+    {
+      attre->transit = arena_alloc (parse_arena, sizeof (struct transit));
+      memset (attre->transit, 0, sizeof (struct transit));
+    }
 
   transit = attre->transit;
 
   if (transit->val)
-    transit->val = XREALLOC (MTYPE_TRANSIT_VAL, transit->val, 
-			     transit->length + total);
+    {
+      u_char *val = arena_alloc (parse_arena, transit->length + total);
+
+      memcpy (val, transit->val, transit->length);
+      transit->val = val;
+    }
   else
-    transit->val = XMALLOC (MTYPE_TRANSIT_VAL, total);
+    transit->val = arena_alloc (parse_arena, total);
 
   memcpy (transit->val + transit->length, startp, total);
   transit->length += total;
@@ -1829,6 +1891,9 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
   /* Initialize bitmap. */
   memset (seen, 0, BGP_ATTR_BITMAP_SIZE);
 
+  /* The attributes of this UPDATE are new, whatever they hold. */
+  attr->serial = bgp_attr_serial ();
+
   /* End pointer of BGP attribute. */
   endp = BGP_INPUT_PNT (peer) + size;
   
@@ -2122,20 +2187,204 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
     }
 
   /* Finally intern unknown attribute. */
-	if (attr->extra && attr->extra->transit)
-	{
-	/**/
-		struct transit *t_find;
-//		t_find = hash_get (transit_hash, attr->extra->transit, transit_hash_alloc);
-		t_find = hash_get2 (transit_hash, attr->extra->transit, attr->extra->transit);
-		if (t_find != attr->extra->transit)
-			transit_free (attr->extra->transit);
-		t_find->refcnt++;
-
-		attr->extra->transit = t_find;
-//		attr->extra->transit = transit_intern (attr->extra->transit);
-	}
-	return BGP_ATTR_PARSE_PROCEED;
+  if (attr->extra && attr->extra->transit)
+    attr->extra->transit = transit_intern (attr->extra->transit);
+
+  return BGP_ATTR_PARSE_PROCEED;
+}
+
+/* Most UPDATEs of a table carry the very attributes of another sent
+   not long before.  Each peer keeps those it sent last by their bytes
+   on the wire, in a table indexed by a hash of them, along with what
+   they were interned as, so that when they come again neither parsing
+   nor interning them is needed.  A block hashing to a slot in use puts
+   out what was there, but only once it is seen a second time: holding
+   on to every block, most never seen again, would cost more than the
+   cache saves when the peer seldom repeats itself.  Parsing depends on
+   the session, and a little on the configuration: the cache goes with
+   the session, and is flushed when "bgp enforce-first-as" is turned
+   on. */
+#define BGP_ATTR_CACHE_SIZE 1024
+
+/* Entries are sized in steps, so that most can take the place of
+   another without allocating. */
+#define BGP_ATTR_CACHE_ROUND(len) (((len) + 63) & ~63)
+
+struct bgp_attr_cache_entry
+{
+  unsigned int key;
+  bgp_size_t length;
+
+  /* Room there is for the attributes, kept for the next to take the
+     slot. */
+  bgp_size_t size;
+
+  /* Interned, holding a reference. */
+  struct attr *attr;
+
+  /* The attributes as received. */
+  u_char data[];
+};
+
+struct bgp_attr_cache
+{
+  struct bgp_attr_cache_entry *entries[BGP_ATTR_CACHE_SIZE];
+
+  /* Hash of the block last missed in each slot. */
+  unsigned int seen[BGP_ATTR_CACHE_SIZE];
+};
+
+/* What bgp_attr_cache_set is to store, as received: parsing may change
+   the flags of transit attributes in the buffer. */
+static struct
+{
+  struct peer *peer;
+  unsigned int key;
+  bgp_size_t length;
+  u_char *data;
+} attr_cache_pending;
+
+static unsigned long attr_cache_hits;
+static unsigned long attr_cache_misses;
+static unsigned long attr_cache_entries;
+static unsigned long attr_cache_bytes;
+
+static void
+bgp_attr_cache_entry_free (struct bgp_attr_cache_entry *entry)
+{
+  attr_cache_entries--;
+  attr_cache_bytes -= sizeof (struct bgp_attr_cache_entry) + entry->size;
+  bgp_attr_unintern (&entry->attr);
+  XFREE (MTYPE_BGP_ATTR_CACHE, entry);
+}
+
+/* The attributes of the UPDATE from peer, the next size bytes of its
+   input, if they are those of one before: they are then skipped, and
+   the caller has them without a reference of its own.  Otherwise NULL,
+   and they are to be parsed. */
+struct attr *
+bgp_attr_cache_get (struct peer *peer, bgp_size_t size)
+{
+  struct bgp_attr_cache *cache = peer->attr_cache;
+  struct bgp_attr_cache_entry *entry;
+  u_char *pnt = stream_pnt (peer->ibuf);
+  unsigned int key, i;
+
+  if (! cache)
+    {
+      cache = peer->attr_cache = XCALLOC (MTYPE_BGP_ATTR_CACHE,
+                                          sizeof (struct bgp_attr_cache));
+      attr_cache_bytes += sizeof (struct bgp_attr_cache);
+    }
+
+  key = jhash (pnt, size, 0);
+  i = key % BGP_ATTR_CACHE_SIZE;
+  entry = cache->entries[i];
+
+  if (entry && entry->key == key && entry->length == size
+      && memcmp (entry->data, pnt, size) == 0)
+    {
+      attr_cache_hits++;
+      attr_cache_pending.peer = NULL;
+      stream_forward_getp (peer->ibuf, size);
+      return entry->attr;
+    }
+
+  attr_cache_misses++;
+  if (cache->seen[i] != key)
+    {
+      cache->seen[i] = key;
+      attr_cache_pending.peer = NULL;
+      return NULL;
+    }
+
+  attr_cache_pending.peer = peer;
+  attr_cache_pending.key = key;
+  attr_cache_pending.length = size;
+  attr_cache_pending.data = arena_alloc (parse_arena, size);
+  memcpy (attr_cache_pending.data, pnt, size);
+  return NULL;
+}
+
+/* Attributes parsed from peer's input after bgp_attr_cache_get missed
+   them, interned and kept for next time if they were seen before.  The
+   interned attributes are returned, again without a reference for the
+   caller, or attr as it is if it is not to be kept: the MP_REACH_NLRI
+   and MP_UNREACH_NLRI attributes point into the input, and NLRI are not
+   cached. */
+struct attr *
+bgp_attr_cache_set (struct peer *peer, struct attr *attr)
+{
+  struct bgp_attr_cache_entry *entry;
+  struct bgp_attr_cache_entry **slot;
+
+  if (attr_cache_pending.peer != peer)
+    return attr;
+  attr_cache_pending.peer = NULL;
+
+  if (CHECK_FLAG (attr->flag, ATTR_FLAG_BIT (BGP_ATTR_MP_REACH_NLRI)
+                  | ATTR_FLAG_BIT (BGP_ATTR_MP_UNREACH_NLRI)))
+    return attr;
+
+  slot = &peer->attr_cache->entries[attr_cache_pending.key
+                                    % BGP_ATTR_CACHE_SIZE];
+  entry = *slot;
+  if (entry && entry->size < attr_cache_pending.length)
+    {
+      bgp_attr_cache_entry_free (entry);
+      entry = NULL;
+    }
+
+  if (entry)
+    bgp_attr_unintern (&entry->attr);
+  else
+    {
+      bgp_size_t size = BGP_ATTR_CACHE_ROUND (attr_cache_pending.length);
+
+      entry = XMALLOC (MTYPE_BGP_ATTR_CACHE,
+                       sizeof (struct bgp_attr_cache_entry) + size);
+      entry->size = size;
+      *slot = entry;
+      attr_cache_entries++;
+      attr_cache_bytes += sizeof (struct bgp_attr_cache_entry) + size;
+    }
+
+  entry->key = attr_cache_pending.key;
+  entry->length = attr_cache_pending.length;
+  entry->attr = bgp_attr_intern (attr);
+  memcpy (entry->data, attr_cache_pending.data, entry->length);
+  return entry->attr;
+}
+
+void
+bgp_attr_cache_flush (struct peer *peer)
+{
+  int i;
+
+  if (! peer->attr_cache)
+    return;
+
+  for (i = 0; i < BGP_ATTR_CACHE_SIZE; i++)
+    if (peer->attr_cache->entries[i])
+      bgp_attr_cache_entry_free (peer->attr_cache->entries[i]);
+  XFREE (MTYPE_BGP_ATTR_CACHE, peer->attr_cache);
+  peer->attr_cache = NULL;
+  attr_cache_bytes -= sizeof (struct bgp_attr_cache);
+
+  if (attr_cache_pending.peer == peer)
+    attr_cache_pending.peer = NULL;
+}
+
+/* Lookups that hit and missed, and the entries of all peers and the
+   memory they take with their tables. */
+void
+bgp_attr_cache_stats (unsigned long *hits, unsigned long *misses,
+                      unsigned long *entries, unsigned long *bytes)
+{
+  *hits = attr_cache_hits;
+  *misses = attr_cache_misses;
+  *entries = attr_cache_entries;
+  *bytes = attr_cache_bytes;
 }
 
 int stream_put_prefix (struct stream *, struct prefix *);
@@ -2645,6 +2894,7 @@ bgp_attr_init (void)
   ecommunity_init ();
   cluster_init ();
   transit_init ();
+  parse_arena = arena_new (MTYPE_BGP_ATTR_ARENA, BGP_ATTR_ARENA_CHUNK);
 }
 
 void
@@ -2656,6 +2906,8 @@ bgp_attr_finish (void)
   ecommunity_finish ();
   cluster_finish ();
   transit_finish ();
+  arena_free (parse_arena);
+  parse_arena = NULL;
 }
 
 /* Make attribute packet. */
@@ -112,6 +112,10 @@ struct attr
   
   /* Path origin attribute */
   u_char origin;
+
+  /* Never the same for two sets of attributes parsed or interned, nor
+     ever 0: the key route-maps remember their matches of these by. */
+  unsigned long serial;
 };
 
 /* Router Reflector related structure. */
@@ -147,10 +151,17 @@ extern void bgp_attr_finish (void);
 extern bgp_attr_parse_ret_t bgp_attr_parse (struct peer *, struct attr *,
                                            bgp_size_t, struct bgp_nlri *,
                                            struct bgp_nlri *);
+extern void bgp_attr_parse_reset (void);
+extern struct attr *bgp_attr_cache_get (struct peer *, bgp_size_t);
+extern struct attr *bgp_attr_cache_set (struct peer *, struct attr *);
+extern void bgp_attr_cache_flush (struct peer *);
+extern void bgp_attr_cache_stats (unsigned long *, unsigned long *,
+                                  unsigned long *, unsigned long *);
 extern struct attr_extra *bgp_attr_extra_get (struct attr *);
 extern void bgp_attr_extra_free (struct attr *);
 extern void bgp_attr_dup (struct attr *, struct attr *);
 extern struct attr *bgp_attr_intern (struct attr *attr);
+extern struct attr *bgp_attr_ref (struct attr *);
 extern void bgp_attr_unintern_sub (struct attr *);
 extern void bgp_attr_unintern (struct attr **);
 extern void bgp_attr_flush (struct attr *);
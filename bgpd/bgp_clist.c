@@ -23,6 +23,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "command.h"
 #include "prefix.h"
 #include "memory.h"
+#include "routemap.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_community.h"
@@ -255,6 +256,7 @@ community_list_delete (struct community_list *list)
     clist->head = list->next;
 
   community_list_free (list);
+  route_map_cache_flush (NULL);
 }
 
 static int
@@ -276,6 +278,9 @@ community_list_entry_add (struct community_list *list,
   else
     list->head = entry;
   list->tail = entry;
+
+  /* Route-maps remember what community matches made of attributes. */
+  route_map_cache_flush (NULL);
 }
 
 /* Delete community-list entry from the list.  */
@@ -294,6 +299,7 @@ community_list_entry_delete (struct community_list *list,
     list->head = entry->next;
 
   community_entry_free (entry);
+  route_map_cache_flush (NULL);
 
   if (community_list_empty_p (list))
     community_list_delete (list);
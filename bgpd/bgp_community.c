@@ -22,6 +22,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 #include "hash.h"
 #include "memory.h"
+#include "arena.h"
 
 #include "bgpd/bgp_community.h"
 
@@ -313,10 +314,7 @@ community_intern (struct community *com)
   /* Increment refrence counter.  */
   find->refcnt++;
 
-  /* Make string.  */
-  if (! find->str)
-    find->str = community_com2str (find);
-
+  /* The string is made by community_str, when it is wanted. */
   return find;
 }
 
@@ -341,24 +339,51 @@ community_unintern (struct community **com)
     }
 }
 
-/* Create new community attribute. */
+static void *
+community_hash_alloc (const void *arg)
+{
+  return community_dup ((struct community *) arg);
+}
+
+/* Create new community attribute.  With an arena the values are sorted
+   and uniqued in there, and copied out only if the hash does not have
+   them yet. */
 struct community *
-community_parse (u_int32_t *pnt, u_short length)
+community_parse (u_int32_t *pnt, u_short length, struct arena *arena)
 {
   struct community tmp;
   struct community *new;
+  int i, j;
 
   /* If length is malformed return NULL. */
   if (length % 4)
     return NULL;
 
   /* Make temporary community for hash look up. */
+  memset (&tmp, 0, sizeof (struct community));
   tmp.size = length / 4;
   tmp.val = pnt;
 
-  new = community_uniq_sort (&tmp);
+  if (! arena)
+    {
+      new = community_uniq_sort (&tmp);
+      return community_intern (new);
+    }
+
+  if (tmp.size)
+    {
+      tmp.val = arena_alloc (arena, length);
+      memcpy (tmp.val, pnt, length);
+      qsort (tmp.val, tmp.size, sizeof (u_int32_t), community_compare);
+      for (i = j = 1; i < tmp.size; i++)
+	if (tmp.val[i] != tmp.val[j - 1])
+	  tmp.val[j++] = tmp.val[i];
+      tmp.size = j;
+    }
 
-  return community_intern (new);
+  new = hash_get (comhash, &tmp, community_hash_alloc);
+  new->refcnt++;
+  return new;
 }
 
 struct community *
@@ -638,8 +663,9 @@ community_hash (void)
 void
 community_init (void)
 {
-  comhash = hash_create ((unsigned int (*) (const void *))community_hash_make,
-			 (int (*) (const void *, const void *))community_cmp);
+  comhash = hash_create_open (HASH_INITIAL_SIZE,
+			      (unsigned int (*) (const void *))community_hash_make,
+			      (int (*) (const void *, const void *))community_cmp);
 }
 
 void
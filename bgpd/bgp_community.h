@@ -50,12 +50,15 @@ struct community
 #define com_lastval(X)   ((X)->val + (X)->size - 1)
 #define com_nthval(X,n)  ((X)->val + (n))
 
+struct arena;
+
 /* Prototypes of communities attribute functions.  */
 extern void community_init (void);
 extern void community_finish (void);
 extern void community_free (struct community *);
 extern struct community *community_uniq_sort (struct community *);
-extern struct community *community_parse (u_int32_t *, u_short);
+extern struct community *community_parse (u_int32_t *, u_short,
+                                          struct arena *);
 extern struct community *community_intern (struct community *);
 extern void community_unintern (struct community **);
 extern char *community_str (struct community *);
@@ -346,6 +346,46 @@ bgp_damp_scan (struct bgp_info *binfo, afi_t afi, safi_t safi)
   return 0;
 }
 
+static void
+bgp_damp_scan_info (struct bgp_damp_info *bdi, struct bgp *bgp,
+		    afi_t afi, safi_t safi)
+{
+  struct bgp_info *binfo = bdi->binfo;
+  struct bgp_node *rn = bdi->rn;
+
+  if (bdi->afi != afi || bdi->safi != safi || binfo->peer->bgp != bgp)
+    return;
+
+  if (bgp_damp_scan (binfo, afi, safi))
+    bgp_aggregate_increment (bgp, &rn->p, binfo, afi, safi);
+
+  bgp_process (bgp, rn, afi, safi);
+}
+
+/* Run bgp_damp_scan over every dampened path of an address family.
+   Walks the dampening lists rather than the whole RIB.  */
+void
+bgp_damp_scan_all (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct bgp_damp_info *bdi, *next;
+  unsigned int i;
+
+  for (bdi = damp->no_reuse_list; bdi; bdi = next)
+    {
+      next = bdi->next;
+      bgp_damp_scan_info (bdi, bgp, afi, safi);
+    }
+
+  /* Paths released from here go to the head of no_reuse_list, which
+     has been done already. */
+  for (i = 0; i < damp->reuse_list_size; i++)
+    for (bdi = damp->reuse_list[i]; bdi; bdi = next)
+      {
+	next = bdi->next;
+	bgp_damp_scan_info (bdi, bgp, afi, safi);
+      }
+}
+
 void
 bgp_damp_info_free (struct bgp_damp_info *bdi, int withdraw)
 {
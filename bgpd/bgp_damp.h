@@ -136,6 +136,7 @@ extern int bgp_damp_withdraw (struct bgp_info *, struct bgp_node *,
 		       afi_t, safi_t, int);
 extern int bgp_damp_update (struct bgp_info *, struct bgp_node *, afi_t, safi_t);
 extern int bgp_damp_scan (struct bgp_info *, afi_t, safi_t);
+extern void bgp_damp_scan_all (struct bgp *, afi_t, safi_t);
 extern void bgp_damp_info_free (struct bgp_damp_info *, int);
 extern void bgp_damp_info_clean (void);
 extern int bgp_damp_decay (time_t, int);
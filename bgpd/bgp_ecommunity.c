@@ -24,6 +24,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "memory.h"
 #include "prefix.h"
 #include "command.h"
+#include "arena.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_ecommunity.h"
@@ -119,12 +120,27 @@ ecommunity_uniq_sort (struct ecommunity *ecom)
   return new;
 }
 
-/* Parse Extended Communites Attribute in BGP packet.  */
+static int
+ecommunity_val_cmp (const void *v1, const void *v2)
+{
+  return memcmp (v1, v2, ECOMMUNITY_SIZE);
+}
+
+static void *
+ecommunity_hash_alloc (const void *arg)
+{
+  return ecommunity_dup ((struct ecommunity *) arg);
+}
+
+/* Parse Extended Communites Attribute in BGP packet.  With an arena the
+   values are sorted and uniqued in there, and copied out only if the
+   hash does not have them yet.  */
 struct ecommunity *
-ecommunity_parse (u_int8_t *pnt, u_short length)
+ecommunity_parse (u_int8_t *pnt, u_short length, struct arena *arena)
 {
   struct ecommunity tmp;
   struct ecommunity *new;
+  int i, j;
 
   /* Length check.  */
   if (length % ECOMMUNITY_SIZE)
@@ -132,14 +148,34 @@ ecommunity_parse (u_int8_t *pnt, u_short length)
 
   /* Prepare tmporary structure for making a new Extended Communities
      Attribute.  */
+  memset (&tmp, 0, sizeof (struct ecommunity));
   tmp.size = length / ECOMMUNITY_SIZE;
   tmp.val = pnt;
 
-  /* Create a new Extended Communities Attribute by uniq and sort each
-     Extended Communities value  */
-  new = ecommunity_uniq_sort (&tmp);
+  if (! arena)
+    {
+      /* Create a new Extended Communities Attribute by uniq and sort
+	 each Extended Communities value  */
+      new = ecommunity_uniq_sort (&tmp);
+      return ecommunity_intern (new);
+    }
 
-  return ecommunity_intern (new);
+  if (tmp.size)
+    {
+      tmp.val = arena_alloc (arena, length);
+      memcpy (tmp.val, pnt, length);
+      qsort (tmp.val, tmp.size, ECOMMUNITY_SIZE, ecommunity_val_cmp);
+      for (i = j = 1; i < tmp.size; i++)
+	if (memcmp (tmp.val + i * ECOMMUNITY_SIZE,
+		    tmp.val + (j - 1) * ECOMMUNITY_SIZE, ECOMMUNITY_SIZE))
+	  memcpy (tmp.val + j++ * ECOMMUNITY_SIZE,
+		  tmp.val + i * ECOMMUNITY_SIZE, ECOMMUNITY_SIZE);
+      tmp.size = j;
+    }
+
+  new = hash_get (ecomhash, &tmp, ecommunity_hash_alloc);
+  new->refcnt++;
+  return new;
 }
 
 /* Duplicate the Extended Communities Attribute structure.  */
@@ -203,9 +239,6 @@ ecommunity_intern (struct ecommunity *ecom)
 
   find->refcnt++;
 
-  if (! find->str)
-    find->str = ecommunity_ecom2str (find, ECOMMUNITY_FORMAT_DISPLAY);
-
   return find;
 }
 
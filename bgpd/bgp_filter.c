@@ -24,6 +24,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "memory.h"
 #include "buffer.h"
+#include "prefix.h"
+#include "routemap.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_aspath.h"
@@ -63,6 +65,9 @@ struct as_filter
 
   regex_t *reg;
   char *reg_str;
+
+  /* The regex as a DFA on the path's segments, if it could be made. */
+  struct aspath_regex *dfa;
 };
 
 enum as_list_type
@@ -108,6 +113,8 @@ as_filter_free (struct as_filter *asfilter)
 {
   if (asfilter->reg)
     bgp_regex_free (asfilter->reg);
+  if (asfilter->dfa)
+    bgp_aspath_regfree (asfilter->dfa);
   if (asfilter->reg_str)
     XFREE (MTYPE_AS_FILTER_STR, asfilter->reg_str);
   XFREE (MTYPE_AS_FILTER, asfilter);
@@ -123,6 +130,7 @@ as_filter_make (regex_t *reg, const char *reg_str, enum as_filter_type type)
   asfilter->reg = reg;
   asfilter->type = type;
   asfilter->reg_str = XSTRDUP (MTYPE_AS_FILTER_STR, reg_str);
+  asfilter->dfa = bgp_aspath_regcomp (reg_str);
 
   return asfilter;
 }
@@ -150,6 +158,9 @@ as_list_filter_add (struct as_list *aslist, struct as_filter *asfilter)
   else
     aslist->head = asfilter;
   aslist->tail = asfilter;
+
+  /* Route-maps remember what as-path matches made of AS paths. */
+  route_map_cache_flush (NULL);
 }
 
 /* Lookup as_list from list of as_list by name. */
@@ -336,6 +347,7 @@ as_list_delete (struct as_list *aslist)
     list->head = aslist->next;
 
   as_list_free (aslist);
+  route_map_cache_flush (NULL);
 }
 
 static int
@@ -361,6 +373,7 @@ as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
     aslist->head = asfilter->next;
 
   as_filter_free (asfilter);
+  route_map_cache_flush (NULL);
 
   /* If access_list becomes empty delete it from access_master. */
   if (as_list_empty (aslist))
@@ -374,6 +387,8 @@ as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
 static int
 as_filter_match (struct as_filter *asfilter, struct aspath *aspath)
 {
+  if (asfilter->dfa)
+    return bgp_aspath_regexec (asfilter->dfa, aspath) != REG_NOMATCH;
   if (bgp_regexec (asfilter->reg, aspath) != REG_NOMATCH)
     return 1;
   return 0;
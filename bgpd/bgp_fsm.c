@@ -36,10 +36,12 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_fsm.h"
 #include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_updgrp.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -56,7 +58,6 @@ int bgp_event (struct thread *);
 static int bgp_start_timer (struct thread *);
 static int bgp_connect_timer (struct thread *);
 static int bgp_holdtime_timer (struct thread *);
-static int bgp_keepalive_timer (struct thread *);
 
 /* BGP FSM functions. */
 static int bgp_start (struct peer *);
@@ -99,7 +100,6 @@ bgp_timer_set (struct peer *peer)
 	}
       BGP_TIMER_OFF (peer->t_connect);
       BGP_TIMER_OFF (peer->t_holdtime);
-      BGP_TIMER_OFF (peer->t_keepalive);
       BGP_TIMER_OFF (peer->t_asorig);
       BGP_TIMER_OFF (peer->t_routeadv);
       break;
@@ -111,7 +111,6 @@ bgp_timer_set (struct peer *peer)
       BGP_TIMER_OFF (peer->t_start);
       BGP_TIMER_ON (peer->t_connect, bgp_connect_timer, peer->v_connect);
       BGP_TIMER_OFF (peer->t_holdtime);
-      BGP_TIMER_OFF (peer->t_keepalive);
       BGP_TIMER_OFF (peer->t_asorig);
       BGP_TIMER_OFF (peer->t_routeadv);
       break;
@@ -131,7 +130,6 @@ bgp_timer_set (struct peer *peer)
 	  BGP_TIMER_ON (peer->t_connect, bgp_connect_timer, peer->v_connect);
 	}
       BGP_TIMER_OFF (peer->t_holdtime);
-      BGP_TIMER_OFF (peer->t_keepalive);
       BGP_TIMER_OFF (peer->t_asorig);
       BGP_TIMER_OFF (peer->t_routeadv);
       break;
@@ -149,7 +147,6 @@ bgp_timer_set (struct peer *peer)
 	{
 	  BGP_TIMER_OFF (peer->t_holdtime);
 	}
-      BGP_TIMER_OFF (peer->t_keepalive);
       BGP_TIMER_OFF (peer->t_asorig);
       BGP_TIMER_OFF (peer->t_routeadv);
       break;
@@ -164,14 +161,13 @@ bgp_timer_set (struct peer *peer)
       if (peer->v_holdtime == 0)
 	{
 	  BGP_TIMER_OFF (peer->t_holdtime);
-	  BGP_TIMER_OFF (peer->t_keepalive);
+	  bgp_io_keepalive (peer, 0);
 	}
       else
 	{
 	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
 			peer->v_holdtime);
-	  BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer, 
-			peer->v_keepalive);
+	  bgp_io_keepalive (peer, peer->v_keepalive);
 	}
       BGP_TIMER_OFF (peer->t_asorig);
       BGP_TIMER_OFF (peer->t_routeadv);
@@ -188,14 +184,13 @@ bgp_timer_set (struct peer *peer)
       if (peer->v_holdtime == 0)
 	{
 	  BGP_TIMER_OFF (peer->t_holdtime);
-	  BGP_TIMER_OFF (peer->t_keepalive);
+	  bgp_io_keepalive (peer, 0);
 	}
       else
 	{
 	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
 			peer->v_holdtime);
-	  BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
-			peer->v_keepalive);
+	  bgp_io_keepalive (peer, peer->v_keepalive);
 	}
       BGP_TIMER_OFF (peer->t_asorig);
       break;
@@ -207,7 +202,6 @@ bgp_timer_set (struct peer *peer)
       BGP_TIMER_OFF (peer->t_start);
       BGP_TIMER_OFF (peer->t_connect);
       BGP_TIMER_OFF (peer->t_holdtime);
-      BGP_TIMER_OFF (peer->t_keepalive);
       BGP_TIMER_OFF (peer->t_asorig);
       BGP_TIMER_OFF (peer->t_routeadv);
     }
@@ -257,10 +251,20 @@ static int
 bgp_holdtime_timer (struct thread *thread)
 {
   struct peer *peer;
+  int remain;
 
   peer = THREAD_ARG (thread);
   peer->t_holdtime = NULL;
 
+  /* The I/O thread may have heard from the peer while we were busy
+     with other things and the message is still waiting for us. */
+  remain = bgp_io_hold_remain (peer, peer->v_holdtime);
+  if (remain > 0)
+    {
+      BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer, remain);
+      return 0;
+    }
+
   if (BGP_DEBUG (fsm, FSM))
     zlog (peer->log, LOG_DEBUG,
 	  "%s [FSM] Timer (holdtime timer expire)",
@@ -272,26 +276,6 @@ bgp_holdtime_timer (struct thread *thread)
   return 0;
 }
 
-/* BGP keepalive fire ! */
-static int
-bgp_keepalive_timer (struct thread *thread)
-{
-  struct peer *peer;
-
-  peer = THREAD_ARG (thread);
-  peer->t_keepalive = NULL;
-
-  if (BGP_DEBUG (fsm, FSM))
-    zlog (peer->log, LOG_DEBUG,
-	  "%s [FSM] Timer (keepalive timer expire)",
-	  peer->host);
-
-  THREAD_VAL (thread) = KeepAlive_timer_expired;
-  bgp_event (thread); /* bgp_event unlocks peer */
-
-  return 0;
-}
-
 static int
 bgp_routeadv_timer (struct thread *thread)
 {
@@ -504,7 +488,6 @@ bgp_stop (struct peer *peer)
   BGP_TIMER_OFF (peer->t_start);
   BGP_TIMER_OFF (peer->t_connect);
   BGP_TIMER_OFF (peer->t_holdtime);
-  BGP_TIMER_OFF (peer->t_keepalive);
   BGP_TIMER_OFF (peer->t_asorig);
   BGP_TIMER_OFF (peer->t_routeadv);
 
@@ -519,7 +502,14 @@ bgp_stop (struct peer *peer)
   if (peer->obuf)
     stream_fifo_clean (peer->obuf);
 
+  /* Attributes are parsed afresh in the next session. */
+  bgp_attr_cache_flush (peer);
+
+  /* Nothing more to send, drop out of the update-groups. */
+  bgp_updgrp_peer_leave_all (peer);
+
   /* Close of file descriptor. */
+  bgp_io_stop (peer);
   if (peer->fd >= 0)
     {
       close (peer->fd);
@@ -629,7 +619,7 @@ bgp_connect_success (struct peer *peer)
 		peer->fd);
       return -1;
     }
-  BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+  bgp_io_start (peer);
 
   if (! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
     bgp_getsockname (peer);
@@ -730,8 +720,10 @@ bgp_start (struct peer *peer)
 		    peer->fd);
 	  return -1;
 	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
-      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      THREAD_READ_ON (master, peer->t_read, bgp_connect_check, peer,
+		      peer->fd);
+      THREAD_WRITE_ON (master, peer->t_write, bgp_connect_check, peer,
+		       peer->fd);
       break;
     }
   return 0;
@@ -870,6 +862,12 @@ bgp_establish (struct peer *peer)
   /* Reset uptime, send keepalive, send current table. */
   peer->uptime = bgp_clock ();
 
+  /* Join the update-groups for the negotiated address families. */
+  for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
+    for (safi = SAFI_UNICAST ; safi < SAFI_MAX ; safi++)
+      if (peer->afc_nego[afi][safi])
+	bgp_updgrp_peer_update (peer, afi, safi);
+
   /* Send route-refresh when ORF is enabled */
   for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
     for (safi = SAFI_UNICAST ; safi < SAFI_MAX ; safi++)
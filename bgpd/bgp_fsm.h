@@ -22,11 +22,14 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #ifndef _QUAGGA_BGP_FSM_H
 #define _QUAGGA_BGP_FSM_H
 
-/* Macro for BGP read, write and timer thread.  */
+/* Macro for BGP read, write and timer thread.  The socket of a
+   connected peer belongs to the I/O thread, see bgp_io.c, and read and
+   write are events run when it has messages for us or room for more.
+   V is the peer's fd, unused.  */
 #define BGP_READ_ON(T,F,V)			\
   do {						\
     if (!(T) && (peer->status != Deleted))	\
-      THREAD_READ_ON(master,T,F,peer,V);	\
+      (T) = thread_add_event (master, (F), peer, 0); \
   } while (0)
 
 #define BGP_READ_OFF(T)				\
@@ -38,7 +41,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_WRITE_ON(T,F,V)			\
   do {						\
     if (!(T) && (peer->status != Deleted))	\
-      THREAD_WRITE_ON(master,(T),(F),peer,(V)); \
+      (T) = thread_add_event (master, (F), peer, 0); \
   } while (0)
     
 #define BGP_WRITE_OFF(T)			\
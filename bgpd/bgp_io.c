@@ -0,0 +1,834 @@
+/* BGP peer socket I/O thread.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Once a session is connected its socket belongs to a thread of its
+ * own.  That thread reads whatever the peer sends into a ring buffer
+ * and frames it into whole messages, writes the packets bgp_write
+ * handed over, as many to a writev as the socket takes, and sends
+ * KEEPALIVEs on its own clock, so that a long run of route processing
+ * neither delays our keepalives nor leaves the peer's sitting unread
+ * until the hold timer fires.
+ *
+ * The thread tells the main thread about new messages, room for more
+ * output, packets written and errors through a pipe read from the
+ * thread loop.  bgp_read then takes the messages out one at a time.
+ *
+ * Everything the two threads share is protected by one mutex, which
+ * the I/O thread holds while it services ready sockets but not while
+ * it sleeps in poll().  Only the main thread allocates or frees the
+ * connections and streams, and only it looks at struct peer.
+ */
+
+#include <zebra.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "thread.h"
+#include "stream.h"
+#include "memory.h"
+#include "network.h"
+#include "log.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
+
+/* Input ring, room for a good number of full size messages. */
+#define BGP_IO_IBUF_SIZE (BGP_MAX_PACKET_SIZE * 16)
+
+#define BGP_IO_IBYTE(C,O) \
+  ((C)->ibuf[((C)->ihead + (O)) % BGP_IO_IBUF_SIZE])
+
+/* Events for the main thread. */
+#define BGP_IO_EV_READ		(1 << 0)	/* message or error to read */
+#define BGP_IO_EV_WRITE		(1 << 1)	/* room for bgp_write */
+#define BGP_IO_EV_SENT		(1 << 2)	/* streams to free */
+#define BGP_IO_EV_KEEPALIVE	(1 << 3)	/* keepalives to count */
+
+struct bgp_io_conn
+{
+  /* Attached connections, and those with events for the main
+     thread. */
+  struct bgp_io_conn *next;
+  struct bgp_io_conn *prev;
+  struct bgp_io_conn *ready;
+  u_char events;
+
+  /* Main thread only. */
+  struct peer *peer;
+  struct bgp_io_conn *notify_next;
+  u_char notify_events;
+
+  int fd;
+
+  /* Slot in the poll set, I/O thread only. */
+  int pollidx;
+
+  /* Input ring.  The first iframed bytes from ihead are whole
+     messages, possibly ending in a header whose length could not be
+     framed, after which nothing more is read. */
+  u_char *ibuf;
+  size_t ihead;
+  size_t ilen;
+  size_t iframed;
+  u_char ibad;
+
+  /* Packets to write, the first maybe in part, and those written for
+     the main thread to free.  want_write is set when bgp_write found
+     no room. */
+  struct stream_fifo *out;
+  struct stream_fifo *sent;
+  u_char want_write;
+
+  /* Keepalive interval, when the next is due, what is left to write
+     of the current one and how many went out since the last count. */
+  int v_keepalive;
+  time_t ka_next;
+  u_char ka_pending;
+  int ka_left;
+  unsigned long ka_sent;
+
+  /* When the last whole message came in. */
+  time_t last_read;
+
+  /* Read or write failed, with errno or 0 if the peer closed. */
+  u_char failed;
+  u_char failed_reported;
+  int error;
+};
+
+static struct
+{
+  pthread_t thread;
+  int running;
+  pthread_mutex_t mtx;
+  int stop;
+
+  struct bgp_io_conn *conns;
+  unsigned int count;
+  struct bgp_io_conn *ready;
+
+  /* Main thread to I/O thread, and back. */
+  int wake[2];
+  int woken;
+  int notify[2];
+  struct thread *t_notify;
+} bgp_io = { .mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static const u_char bgp_io_keepalive_msg[BGP_HEADER_SIZE] =
+{
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0x00, BGP_HEADER_SIZE, BGP_MSG_KEEPALIVE
+};
+
+static time_t
+bgp_io_clock (void)
+{
+#ifdef HAVE_CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec;
+#endif /* HAVE_CLOCK_MONOTONIC */
+  return time (NULL);
+}
+
+/* Length of the message at off in the input ring, 0 if bogus. */
+static size_t
+bgp_io_msg_size (struct bgp_io_conn *conn, size_t off)
+{
+  size_t size;
+
+  size = (BGP_IO_IBYTE (conn, off + BGP_MARKER_SIZE) << 8)
+    | BGP_IO_IBYTE (conn, off + BGP_MARKER_SIZE + 1);
+
+  if (size < BGP_HEADER_SIZE || size > BGP_MAX_PACKET_SIZE)
+    return 0;
+  return size;
+}
+
+/* Wake up the I/O thread, with the lock held. */
+static void
+bgp_io_wake (void)
+{
+  u_char c = 0;
+
+  if (bgp_io.woken || ! bgp_io.running)
+    return;
+  bgp_io.woken = 1;
+  if (write (bgp_io.wake[1], &c, 1) < 0 && ! ERRNO_IO_RETRY (errno))
+    zlog_err ("%s: write: %s", __func__, safe_strerror (errno));
+}
+
+/* Hand events on a connection to the main thread, in the I/O thread
+   with the lock held.  The pipe is written only for the first
+   connection on the list; the main thread drains the pipe before it
+   takes the list. */
+static void
+bgp_io_post (struct bgp_io_conn *conn, u_char events)
+{
+  u_char c = 0;
+
+  if (! conn->events)
+    {
+      if (! bgp_io.ready && write (bgp_io.notify[1], &c, 1) < 0)
+	{
+	  /* Full, the main thread is on its way. */
+	}
+      conn->ready = bgp_io.ready;
+      bgp_io.ready = conn;
+    }
+  conn->events |= events;
+}
+
+static void
+bgp_io_fail (struct bgp_io_conn *conn, int error)
+{
+  conn->failed = 1;
+  conn->error = error;
+  bgp_io_post (conn, BGP_IO_EV_READ);
+}
+
+/* Read what the socket has into the ring and frame it. */
+static void
+bgp_io_do_read (struct bgp_io_conn *conn, time_t now)
+{
+  size_t tail, len, size, framed;
+  ssize_t nbytes;
+
+  while (conn->ilen < BGP_IO_IBUF_SIZE)
+    {
+      tail = (conn->ihead + conn->ilen) % BGP_IO_IBUF_SIZE;
+      len = BGP_IO_IBUF_SIZE - conn->ilen;
+      if (len > BGP_IO_IBUF_SIZE - tail)
+	len = BGP_IO_IBUF_SIZE - tail;
+
+      nbytes = read (conn->fd, conn->ibuf + tail, len);
+      if (nbytes < 0)
+	{
+	  if (! ERRNO_IO_RETRY (errno))
+	    bgp_io_fail (conn, errno);
+	  break;
+	}
+      if (nbytes == 0)
+	{
+	  bgp_io_fail (conn, 0);
+	  break;
+	}
+
+      conn->ilen += nbytes;
+      if ((size_t) nbytes < len)
+	break;
+    }
+
+  framed = conn->iframed;
+  while (! conn->ibad && conn->ilen - conn->iframed >= BGP_HEADER_SIZE)
+    {
+      size = bgp_io_msg_size (conn, conn->iframed);
+      if (! size)
+	{
+	  /* bgp_read rejects the header, stop here. */
+	  conn->ibad = 1;
+	  conn->iframed += BGP_HEADER_SIZE;
+	  break;
+	}
+      if (conn->ilen - conn->iframed < size)
+	break;
+      conn->iframed += size;
+    }
+
+  if (conn->iframed != framed)
+    {
+      conn->last_read = now;
+      bgp_io_post (conn, BGP_IO_EV_READ);
+    }
+}
+
+/* Write until the socket is full or there is nothing left. */
+static void
+bgp_io_do_write (struct bgp_io_conn *conn)
+{
+  struct stream *s;
+  ssize_t nbytes;
+  size_t sent;
+  int written = 0;
+
+  while (! conn->failed)
+    {
+      s = stream_fifo_head (conn->out);
+
+      /* Keepalives go out between two messages, ahead of the rest. */
+      if (conn->ka_pending && ! conn->ka_left
+	  && (! s || stream_get_getp (s) == 0))
+	{
+	  conn->ka_pending = 0;
+	  conn->ka_left = BGP_HEADER_SIZE;
+	}
+
+      if (conn->ka_left)
+	{
+	  nbytes = write (conn->fd,
+			  bgp_io_keepalive_msg + BGP_HEADER_SIZE
+			  - conn->ka_left, conn->ka_left);
+	  if (nbytes < 0)
+	    {
+	      if (! ERRNO_IO_RETRY (errno))
+		bgp_io_fail (conn, errno);
+	      break;
+	    }
+	  conn->ka_left -= nbytes;
+	  if (conn->ka_left)
+	    break;
+	  conn->ka_sent++;
+	  bgp_io_post (conn, BGP_IO_EV_KEEPALIVE);
+	  continue;
+	}
+
+      if (! s)
+	break;
+
+      /* As many queued packets as one writev takes. */
+      sent = conn->sent->count;
+      nbytes = stream_fifo_writev (conn->out, conn->fd, STREAM_WRITEV_MAX,
+				   conn->sent);
+      if (nbytes < 0)
+	{
+	  if (! ERRNO_IO_RETRY (errno))
+	    bgp_io_fail (conn, errno);
+	  break;
+	}
+      if (conn->sent->count != sent)
+	written = 1;
+
+      /* The socket is full. */
+      s = stream_fifo_head (conn->out);
+      if (s && stream_get_getp (s))
+	break;
+    }
+
+  if (! written)
+    return;
+
+  if (conn->want_write)
+    {
+      conn->want_write = 0;
+      bgp_io_post (conn, BGP_IO_EV_WRITE | BGP_IO_EV_SENT);
+    }
+  else if (! stream_fifo_head (conn->out)
+	   || conn->sent->count >= BGP_IO_OUT_MAX)
+    bgp_io_post (conn, BGP_IO_EV_SENT);
+}
+
+static void *
+bgp_io_thread_main (void *arg)
+{
+  struct bgp_io_conn *conn;
+  struct pollfd *fds = NULL, *nfds;
+  unsigned int size = 0, n;
+  u_char buf[64];
+  short events;
+  int timeout, wait;
+  time_t now;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  while (! bgp_io.stop)
+    {
+      now = bgp_io_clock ();
+
+      while (read (bgp_io.wake[0], buf, sizeof (buf)) > 0)
+	;
+      bgp_io.woken = 0;
+
+      /* The poll set is the thread's own, plain malloc is fine. */
+      if (size < bgp_io.count + 1)
+	{
+	  nfds = realloc (fds, (bgp_io.count + 1) * sizeof (struct pollfd));
+	  if (nfds)
+	    {
+	      fds = nfds;
+	      size = bgp_io.count + 1;
+	    }
+	}
+      if (! fds)
+	{
+	  pthread_mutex_unlock (&bgp_io.mtx);
+	  sleep (1);
+	  pthread_mutex_lock (&bgp_io.mtx);
+	  continue;
+	}
+
+      n = 0;
+      fds[n].fd = bgp_io.wake[0];
+      fds[n].events = POLLIN;
+      fds[n++].revents = 0;
+      timeout = -1;
+
+      for (conn = bgp_io.conns; conn; conn = conn->next)
+	{
+	  conn->pollidx = -1;
+	  if (conn->failed || n == size)
+	    continue;
+
+	  if (conn->v_keepalive)
+	    {
+	      if (now >= conn->ka_next)
+		{
+		  conn->ka_pending = 1;
+		  conn->ka_next = now + conn->v_keepalive;
+		}
+	      wait = (conn->ka_next - now) * 1000;
+	      if (timeout < 0 || wait < timeout)
+		timeout = wait;
+	    }
+
+	  events = 0;
+	  if (! conn->ibad && conn->ilen < BGP_IO_IBUF_SIZE)
+	    events |= POLLIN;
+	  if (conn->ka_pending || conn->ka_left || stream_fifo_head (conn->out))
+	    events |= POLLOUT;
+	  if (! events)
+	    continue;
+
+	  fds[n].fd = conn->fd;
+	  fds[n].events = events;
+	  fds[n].revents = 0;
+	  conn->pollidx = n++;
+	}
+      pthread_mutex_unlock (&bgp_io.mtx);
+
+      poll (fds, n, timeout);
+
+      pthread_mutex_lock (&bgp_io.mtx);
+      now = bgp_io_clock ();
+
+      /* Connections detached meanwhile are gone from the list, those
+         attached meanwhile have no slot. */
+      for (conn = bgp_io.conns; conn; conn = conn->next)
+	{
+	  if (conn->pollidx < 0 || conn->failed)
+	    continue;
+	  events = fds[conn->pollidx].revents;
+	  if (! events)
+	    continue;
+
+	  if (fds[conn->pollidx].events & POLLIN)
+	    {
+	      if (events & (POLLIN | POLLHUP | POLLERR))
+		bgp_io_do_read (conn, now);
+	    }
+	  else if (events & (POLLHUP | POLLERR | POLLNVAL))
+	    bgp_io_fail (conn, ECONNRESET);
+
+	  if (events & (POLLOUT | POLLERR))
+	    bgp_io_do_write (conn);
+	}
+    }
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  free (fds);
+  return NULL;
+}
+
+/* Messages and errors the I/O thread has for us. */
+static int
+bgp_io_notify (struct thread *thread)
+{
+  struct bgp_io_conn *conn, *next, *list = NULL;
+  struct peer *peer;
+  u_char buf[64];
+
+  bgp_io.t_notify = thread_add_read (master, bgp_io_notify, NULL,
+				     bgp_io.notify[0]);
+
+  while (read (bgp_io.notify[0], buf, sizeof (buf)) > 0)
+    ;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  while ((conn = bgp_io.ready) != NULL)
+    {
+      bgp_io.ready = conn->ready;
+      conn->ready = NULL;
+      conn->notify_events = conn->events;
+      conn->events = 0;
+      conn->notify_next = list;
+      list = conn;
+
+      if (CHECK_FLAG (conn->notify_events, BGP_IO_EV_KEEPALIVE))
+	{
+	  conn->peer->keepalive_out += conn->ka_sent;
+	  conn->ka_sent = 0;
+	}
+      if (CHECK_FLAG (conn->notify_events, BGP_IO_EV_SENT))
+	stream_fifo_clean (conn->sent);
+    }
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  for (conn = list; conn; conn = next)
+    {
+      next = conn->notify_next;
+      peer = conn->peer;
+
+      if (CHECK_FLAG (conn->notify_events, BGP_IO_EV_READ))
+	BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      if (CHECK_FLAG (conn->notify_events, BGP_IO_EV_WRITE))
+	BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+    }
+
+  return 0;
+}
+
+/* Try once to complete a message partly written. */
+static ssize_t
+bgp_io_flush_partial (struct bgp_io_conn *conn)
+{
+  struct stream *s;
+
+  if (conn->ka_left)
+    return write (conn->fd, bgp_io_keepalive_msg + BGP_HEADER_SIZE
+		  - conn->ka_left, conn->ka_left);
+
+  s = stream_fifo_head (conn->out);
+  if (s && stream_get_getp (s))
+    return write (conn->fd, STREAM_PNT (s),
+		  stream_get_endp (s) - stream_get_getp (s));
+  return 0;
+}
+
+/* Hand the peer's socket to the I/O thread. */
+void
+bgp_io_start (struct peer *peer)
+{
+  struct bgp_io_conn *conn;
+
+  if (peer->io)
+    bgp_io_stop (peer);
+
+  conn = XCALLOC (MTYPE_BGP_IO_CONN, sizeof (struct bgp_io_conn));
+  conn->ibuf = XMALLOC (MTYPE_BGP_IO_BUF, BGP_IO_IBUF_SIZE);
+  conn->out = stream_fifo_new ();
+  conn->sent = stream_fifo_new ();
+  conn->peer = peer;
+  conn->fd = peer->fd;
+  conn->pollidx = -1;
+  conn->last_read = bgp_io_clock ();
+  peer->io = conn;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  conn->next = bgp_io.conns;
+  if (bgp_io.conns)
+    bgp_io.conns->prev = conn;
+  bgp_io.conns = conn;
+  bgp_io.count++;
+  bgp_io_wake ();
+  pthread_mutex_unlock (&bgp_io.mtx);
+}
+
+/* Take the socket back, before it is closed or written directly.
+   Whatever was not written yet is dropped, except that a message
+   already partly written is completed if the socket takes it, so that
+   what follows on the socket is still framed right. */
+void
+bgp_io_stop (struct peer *peer)
+{
+  struct bgp_io_conn *conn, **prevp;
+
+  conn = peer->io;
+  if (! conn)
+    return;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  if (conn->prev)
+    conn->prev->next = conn->next;
+  else
+    bgp_io.conns = conn->next;
+  if (conn->next)
+    conn->next->prev = conn->prev;
+  bgp_io.count--;
+
+  if (conn->events)
+    for (prevp = &bgp_io.ready; *prevp; prevp = &(*prevp)->ready)
+      if (*prevp == conn)
+	{
+	  *prevp = conn->ready;
+	  break;
+	}
+
+  if (! conn->failed)
+    bgp_io_flush_partial (conn);
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  peer->io = NULL;
+  stream_fifo_free (conn->out);
+  stream_fifo_free (conn->sent);
+  XFREE (MTYPE_BGP_IO_BUF, conn->ibuf);
+  XFREE (MTYPE_BGP_IO_CONN, conn);
+}
+
+/* The accept peer's connection becomes the real peer's. */
+void
+bgp_io_transfer (struct peer *from, struct peer *peer)
+{
+  struct bgp_io_conn *conn;
+  int pending;
+
+  conn = from->io;
+  from->io = NULL;
+  if (! conn)
+    return;
+
+  if (peer->io)
+    bgp_io_stop (peer);
+  peer->io = conn;
+  conn->peer = peer;
+
+  /* The messages after the OPEN are the real peer's to read. */
+  pthread_mutex_lock (&bgp_io.mtx);
+  pending = conn->iframed || (conn->failed && ! conn->failed_reported);
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  if (pending)
+    BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+}
+
+/* Take the next message into s.  Returns 1 for a message, 0 if there
+   is none yet and -1, once, if the connection failed, with errno, or 0
+   if the peer closed it, in *error. */
+int
+bgp_io_read_packet (struct peer *peer, struct stream *s, int *error)
+{
+  struct bgp_io_conn *conn;
+  size_t size, first;
+  int ret = 0;
+
+  conn = peer->io;
+  if (! conn)
+    return 0;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  if (conn->iframed)
+    {
+      size = bgp_io_msg_size (conn, 0);
+      if (! size)
+	size = BGP_HEADER_SIZE;
+
+      /* Reading stopped on a full ring, there will be room now. */
+      if (conn->ilen == BGP_IO_IBUF_SIZE)
+	bgp_io_wake ();
+
+      first = BGP_IO_IBUF_SIZE - conn->ihead;
+      if (first > size)
+	first = size;
+
+      stream_reset (s);
+      stream_put (s, conn->ibuf + conn->ihead, first);
+      if (first < size)
+	stream_put (s, conn->ibuf, size - first);
+
+      conn->ihead = (conn->ihead + size) % BGP_IO_IBUF_SIZE;
+      conn->ilen -= size;
+      conn->iframed -= size;
+      ret = 1;
+    }
+  else if (conn->failed && ! conn->failed_reported)
+    {
+      conn->failed_reported = 1;
+      *error = conn->error;
+      ret = -1;
+    }
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  return ret;
+}
+
+/* How many more packets bgp_write may hand over.  If none, the I/O
+   thread asks for more once it has written some. */
+unsigned int
+bgp_io_write_room (struct peer *peer)
+{
+  struct bgp_io_conn *conn;
+  unsigned int room = 0;
+
+  conn = peer->io;
+  if (! conn)
+    return 0;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  if (conn->out->count < BGP_IO_OUT_MAX)
+    room = BGP_IO_OUT_MAX - conn->out->count;
+  else
+    conn->want_write = 1;
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  return room;
+}
+
+/* Queue the packets on fifo for writing, all under one lock so the I/O
+   thread finds them together and can writev them in one go.  It frees
+   them afterwards.  fifo is left empty. */
+void
+bgp_io_write_packets (struct peer *peer, struct stream_fifo *fifo)
+{
+  struct bgp_io_conn *conn;
+  struct stream *s;
+
+  conn = peer->io;
+  if (! conn)
+    {
+      stream_fifo_clean (fifo);
+      return;
+    }
+
+  for (s = stream_fifo_head (fifo); s; s = s->next)
+    stream_set_getp (s, 0);
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  if (! stream_fifo_head (conn->out))
+    bgp_io_wake ();
+  while ((s = stream_fifo_pop (fifo)) != NULL)
+    {
+      s->next = NULL;
+      stream_fifo_push (conn->out, s);
+    }
+  if (conn->out->count >= BGP_IO_OUT_MAX)
+    conn->want_write = 1;
+  if (conn->sent->count)
+    stream_fifo_clean (conn->sent);
+  pthread_mutex_unlock (&bgp_io.mtx);
+}
+
+/* Send a KEEPALIVE every interval seconds, none if 0.  The first is
+   due an interval from the first call with a new value. */
+void
+bgp_io_keepalive (struct peer *peer, int interval)
+{
+  struct bgp_io_conn *conn;
+
+  conn = peer->io;
+  if (! conn)
+    return;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  if (conn->v_keepalive != interval)
+    {
+      conn->v_keepalive = interval;
+      conn->ka_next = bgp_io_clock () + interval;
+      bgp_io_wake ();
+    }
+  pthread_mutex_unlock (&bgp_io.mtx);
+}
+
+/* Seconds left of holdtime since the I/O thread last heard from the
+   peer, which may be well before bgp_read got to the message. */
+int
+bgp_io_hold_remain (struct peer *peer, int holdtime)
+{
+  struct bgp_io_conn *conn;
+  time_t elapsed;
+
+  conn = peer->io;
+  if (! conn)
+    return 0;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  elapsed = bgp_io_clock () - conn->last_read;
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  return elapsed < holdtime ? holdtime - elapsed : 0;
+}
+
+void
+bgp_io_show_peer (struct vty *vty, struct peer *peer)
+{
+  struct bgp_io_conn *conn;
+  size_t ilen, iframed, out;
+
+  conn = peer->io;
+  if (! conn)
+    return;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  ilen = conn->ilen;
+  iframed = conn->iframed;
+  out = conn->out->count;
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  vty_out (vty, "I/O thread: %lu bytes read (%lu framed), %lu packets to write%s",
+	   (unsigned long) ilen, (unsigned long) iframed,
+	   (unsigned long) out, VTY_NEWLINE);
+}
+
+/* Start the I/O thread, after daemon(). */
+void
+bgp_io_init (void)
+{
+  sigset_t set, oset;
+  int ret;
+
+  if (pipe (bgp_io.wake) < 0 || pipe (bgp_io.notify) < 0)
+    {
+      zlog_err ("%s: pipe: %s", __func__, safe_strerror (errno));
+      exit (1);
+    }
+  set_nonblocking (bgp_io.wake[0]);
+  set_nonblocking (bgp_io.wake[1]);
+  set_nonblocking (bgp_io.notify[0]);
+  set_nonblocking (bgp_io.notify[1]);
+
+  /* Signals are for the main thread. */
+  sigfillset (&set);
+  pthread_sigmask (SIG_SETMASK, &set, &oset);
+  ret = pthread_create (&bgp_io.thread, NULL, bgp_io_thread_main, NULL);
+  pthread_sigmask (SIG_SETMASK, &oset, NULL);
+
+  if (ret)
+    {
+      zlog_err ("%s: pthread_create: %s", __func__, safe_strerror (ret));
+      exit (1);
+    }
+
+  bgp_io.running = 1;
+  bgp_io.t_notify = thread_add_read (master, bgp_io_notify, NULL,
+				     bgp_io.notify[0]);
+}
+
+void
+bgp_io_finish (void)
+{
+  if (! bgp_io.running)
+    return;
+
+  pthread_mutex_lock (&bgp_io.mtx);
+  bgp_io.stop = 1;
+  bgp_io_wake ();
+  pthread_mutex_unlock (&bgp_io.mtx);
+
+  pthread_join (bgp_io.thread, NULL);
+  bgp_io.running = 0;
+
+  THREAD_OFF (bgp_io.t_notify);
+  close (bgp_io.wake[0]);
+  close (bgp_io.wake[1]);
+  close (bgp_io.notify[0]);
+  close (bgp_io.notify[1]);
+}
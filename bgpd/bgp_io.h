@@ -0,0 +1,46 @@
+/* BGP peer socket I/O thread.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_IO_H
+#define _QUAGGA_BGP_IO_H
+
+#include "stream.h"
+#include "vty.h"
+
+/* Packets handed to the I/O thread and not yet written, per peer. */
+#define BGP_IO_OUT_MAX 64
+
+extern void bgp_io_init (void);
+extern void bgp_io_finish (void);
+
+extern void bgp_io_start (struct peer *);
+extern void bgp_io_stop (struct peer *);
+extern void bgp_io_transfer (struct peer *, struct peer *);
+
+extern int bgp_io_read_packet (struct peer *, struct stream *, int *);
+extern unsigned int bgp_io_write_room (struct peer *);
+extern void bgp_io_write_packets (struct peer *, struct stream_fifo *);
+
+extern void bgp_io_keepalive (struct peer *, int);
+extern int bgp_io_hold_remain (struct peer *, int);
+
+extern void bgp_io_show_peer (struct vty *, struct peer *);
+
+#endif /* _QUAGGA_BGP_IO_H */
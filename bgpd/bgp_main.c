@@ -49,6 +49,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_filter.h"
 #include "bgpd/bgp_zebra.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_workers.h"
 
 /* bgpd options, we use GNU getopt library. */
 static const struct option longopts[] = 
@@ -245,6 +247,12 @@ bgp_exit (int status)
     }
   list_delete (bm->listen_sockets);
 
+  /* reverse bgp_io_init */
+  bgp_io_finish ();
+
+  /* best path selection threads, started on first use */
+  bgp_workers_finish ();
+
   /* reverse bgp_zebra_init/if_init */
   if (retain_mode)
     if_add_hook (IF_DELETE_HOOK, NULL);
@@ -449,6 +457,9 @@ main (int argc, char **argv)
   /* Process ID file creation. */
   pid_output (pid_file);
 
+  /* Threads do not survive daemon(), start the I/O thread now. */
+  bgp_io_init ();
+
   /* Make bgp vty socket. */
   vty_serv_sock (vty_addr, vty_port, BGP_VTYSH_PATH);
 
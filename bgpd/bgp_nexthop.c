@@ -41,10 +41,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "zebra/rib.h"
 #include "zebra/zserv.h"	/* For ZEBRA_SERV_PATH. */
 
-struct bgp_nexthop_cache *zlookup_query (struct in_addr);
-#ifdef HAVE_IPV6
-struct bgp_nexthop_cache *zlookup_query_ipv6 (struct in6_addr *);
-#endif /* HAVE_IPV6 */
+extern struct zclient *zclient;
 
 /* Only one BGP scan thread are activated at the same time. */
 static struct thread *bgp_scan_thread = NULL;
@@ -58,10 +55,10 @@ static int bgp_scan_interval;
 /* BGP import interval. */
 static int bgp_import_interval;
 
-/* Route table for next-hop lookup cache. */
+/* Route table for next-hop lookup cache.  An entry lives as long as
+   some path depends on it, and is kept current by zebra through nexthop
+   tracking rather than by rescanning the RIB. */
 static struct bgp_table *bgp_nexthop_cache_table[AFI_MAX];
-static struct bgp_table *cache1_table[AFI_MAX];
-static struct bgp_table *cache2_table[AFI_MAX];
 
 /* Route table for connected route. */
 static struct bgp_table *bgp_connected_table[AFI_MAX];
@@ -219,78 +216,200 @@ bgp_nexthop_onlink (afi_t afi, struct attr *attr)
   return 0;
 }
 
-#ifdef HAVE_IPV6
-/* Check specified next-hop is reachable or not. */
+/* Nexthop (un)registrations not sent to zebra yet.  Those made while
+   processing one event, typically an UPDATE with many new nexthops or
+   a peer going down, go out together in as few messages as possible. */
+static struct stream *bgp_nexthop_reg_s;
+static uint16_t bgp_nexthop_reg_command;
+static struct thread *bgp_nexthop_reg_thread;
+
+static void
+bgp_nexthop_register_flush (void)
+{
+  struct stream *s = bgp_nexthop_reg_s;
+
+  if (stream_get_endp (s) <= ZEBRA_HEADER_SIZE)
+    return;
+
+  if (zclient && zclient->sock >= 0)
+    {
+      stream_putw_at (s, 0, stream_get_endp (s));
+      stream_reset (zclient->obuf);
+      stream_put (zclient->obuf, STREAM_DATA (s), stream_get_endp (s));
+      zclient_send_message (zclient);
+    }
+
+  stream_reset (s);
+}
+
 static int
-bgp_nexthop_lookup_ipv6 (struct peer *peer, struct bgp_info *ri, int *changed,
-			 int *metricchanged)
+bgp_nexthop_register_timer (struct thread *t)
 {
-  struct bgp_node *rn;
-  struct prefix p;
-  struct bgp_nexthop_cache *bnc;
-  struct attr *attr;
-  
-  /* If lookup is not enabled, return valid. */
-  if (zlookup->sock < 0)
+  bgp_nexthop_reg_thread = NULL;
+  bgp_nexthop_register_flush ();
+  return 0;
+}
+
+/* Queue a nexthop (un)registration for the address in P. */
+static void
+bgp_nexthop_register (uint16_t command, struct prefix *p)
+{
+  struct stream *s = bgp_nexthop_reg_s;
+
+  if (! zclient || zclient->sock < 0)
+    return;
+
+  /* Keep registrations and unregistrations in order. */
+  if (command != bgp_nexthop_reg_command
+      || STREAM_WRITEABLE (s) < 1 + sizeof (struct in6_addr))
+    bgp_nexthop_register_flush ();
+
+  if (! stream_get_endp (s))
     {
-      if (ri->extra)
-        ri->extra->igpmetric = 0;
-      return 1;
+      zclient_create_header (s, command);
+      bgp_nexthop_reg_command = command;
     }
-  
-  /* Only check IPv6 global address only nexthop. */
-  attr = ri->attr;
 
-  if (attr->extra->mp_nexthop_len != 16 
-      || IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
-    return 1;
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
 
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET6;
-  p.prefixlen = IPV6_MAX_BITLEN;
-  p.u.prefix6 = attr->extra->mp_nexthop_global;
+  if (! bgp_nexthop_reg_thread)
+    bgp_nexthop_reg_thread =
+      thread_add_event (master, bgp_nexthop_register_timer, NULL, 0);
+}
 
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bgp_nexthop_cache_table[AFI_IP6], &p);
+/* Address whose reachability decides the validity of a path with this
+   attribute.  Return 0 for nexthops which are not checked: IPv6 paths
+   with a link-local nexthop. */
+static int
+bgp_nexthop_prefix (afi_t afi, struct attr *attr, struct prefix *p)
+{
+  memset (p, 0, sizeof (struct prefix));
 
+  if (afi == AFI_IP)
+    {
+      p->family = AF_INET;
+      p->prefixlen = IPV4_MAX_BITLEN;
+      p->u.prefix4 = attr->nexthop;
+      return 1;
+    }
+#ifdef HAVE_IPV6
+  if (afi == AFI_IP6
+      && attr->extra
+      && attr->extra->mp_nexthop_len == 16
+      && ! IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
+    {
+      p->family = AF_INET6;
+      p->prefixlen = IPV6_MAX_BITLEN;
+      p->u.prefix6 = attr->extra->mp_nexthop_global;
+      return 1;
+    }
+#endif /* HAVE_IPV6 */
+  return 0;
+}
+
+/* Find the cache entry for nexthop P, creating it if this is the first
+   path to use it.  A new entry is unresolved until zebra answers its
+   registration with the current state, see bgp_nexthop_update. */
+static struct bgp_nexthop_cache *
+bgp_nexthop_cache_get (afi_t afi, struct prefix *p)
+{
+  struct bgp_node *rn;
+  struct bgp_nexthop_cache *bnc;
+
+  rn = bgp_node_get (bgp_nexthop_cache_table[afi], p);
   if (rn->info)
     {
-      bnc = rn->info;
       bgp_unlock_node (rn);
+      return rn->info;
     }
-  else
-    {
-      if (NULL == (bnc = zlookup_query_ipv6 (&attr->extra->mp_nexthop_global)))
-	bnc = bnc_new ();
-      else
-	{
-	  if (changed)
-	    {
-	      struct bgp_table *old;
-	      struct bgp_node *oldrn;
 
-	      if (bgp_nexthop_cache_table[AFI_IP6] == cache1_table[AFI_IP6])
-		old = cache2_table[AFI_IP6];
-	      else
-		old = cache1_table[AFI_IP6];
+  bnc = bnc_new ();
 
-	      oldrn = bgp_node_lookup (old, &p);
-	      if (oldrn)
-		{
-		  struct bgp_nexthop_cache *oldbnc = oldrn->info;
+  /* The node keeps the lock from bgp_node_get. */
+  bnc->node = rn;
+  bnc->last_change = bgp_clock ();
+  rn->info = bnc;
 
-		  bnc->changed = bgp_nexthop_cache_different (bnc, oldbnc);
+  bgp_nexthop_register (ZEBRA_NEXTHOP_REGISTER, &rn->p);
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
+  return bnc;
+}
 
-                  bgp_unlock_node (oldrn);
-		}
-	    }
-	}
-      rn->info = bnc;
+/* Last path gone: stop tracking the nexthop. */
+static void
+bgp_nexthop_cache_release (struct bgp_nexthop_cache *bnc)
+{
+  struct bgp_node *rn = bnc->node;
+
+  bgp_nexthop_register (ZEBRA_NEXTHOP_UNREGISTER, &rn->p);
+
+  rn->info = NULL;
+  bgp_unlock_node (rn);
+  bnc_free (bnc);
+}
+
+static void
+bnc_path_attach (struct bgp_nexthop_cache *bnc, struct bgp_info *ri)
+{
+  if (ri->nexthop == bnc)
+    return;
+
+  bgp_nexthop_detach (ri);
+
+  if (! bnc)
+    return;
+
+  ri->nh_prev = NULL;
+  ri->nh_next = bnc->path;
+  if (bnc->path)
+    bnc->path->nh_prev = ri;
+  bnc->path = ri;
+  bnc->path_count++;
+  ri->nexthop = bnc;
+}
+
+/* Path RI no longer depends on its nexthop, it is going away. */
+void
+bgp_nexthop_detach (struct bgp_info *ri)
+{
+  struct bgp_nexthop_cache *bnc = ri->nexthop;
+
+  if (! bnc)
+    return;
+
+  if (ri->nh_next)
+    ri->nh_next->nh_prev = ri->nh_prev;
+  if (ri->nh_prev)
+    ri->nh_prev->nh_next = ri->nh_next;
+  else
+    bnc->path = ri->nh_next;
+
+  ri->nexthop = NULL;
+  ri->nh_next = ri->nh_prev = NULL;
+
+  if (--bnc->path_count == 0)
+    bgp_nexthop_cache_release (bnc);
+}
+
+/* Check specified next-hop is reachable or not. */
+static int
+bgp_nexthop_lookup (struct bgp_info *ri, int *changed, int *metricchanged)
+{
+  struct bgp_nexthop_cache *bnc = ri->nexthop;
+
+  /* If lookup is not enabled, return valid. */
+  if (zlookup->sock < 0)
+    {
+      if (ri->extra)
+        ri->extra->igpmetric = 0;
+      return 1;
     }
 
+  /* Nexthops we do not track, see bgp_nexthop_prefix. */
+  if (! bnc)
+    return 1;
+
   if (changed)
     *changed = bnc->changed;
 
@@ -298,134 +417,313 @@ bgp_nexthop_lookup_ipv6 (struct peer *peer, struct bgp_info *ri, int *changed,
     *metricchanged = bnc->metricchanged;
 
   if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get (ri))->igpmetric = bnc->metric;
+    (bgp_info_extra_get(ri))->igpmetric = bnc->metric;
   else if (ri->extra)
     ri->extra->igpmetric = 0;
 
   return bnc->valid;
 }
-#endif /* HAVE_IPV6 */
 
-/* Check specified next-hop is reachable or not. */
+/* Is the nexthop of RI usable, according to what is known about it.
+   Single hop EBGP requires the nexthop to be on a connected network,
+   anything else requires it to be resolvable through the IGP. */
+static int
+bgp_nexthop_check (afi_t afi, struct bgp_info *ri, int *changed,
+		   int *metricchanged)
+{
+  struct peer *peer = ri->peer;
+
+  if (peer->sort == BGP_PEER_EBGP && peer->ttl == 1
+      && ! CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK))
+    return bgp_nexthop_onlink (afi, ri->attr);
+
+  return bgp_nexthop_lookup (ri, changed, metricchanged);
+}
+
+/* Make path RI, just received or changed, depend on the cache entry for
+   its nexthop and return whether the nexthop is reachable. */
 int
-bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_info *ri,
-		    int *changed, int *metricchanged)
+bgp_nexthop_track (afi_t afi, struct bgp_info *ri)
 {
+  struct prefix p;
+  struct bgp_nexthop_cache *bnc = NULL;
+
+  if (bgp_nexthop_prefix (afi, ri->attr, &p))
+    bnc = bgp_nexthop_cache_get (afi, &p);
+  bnc_path_attach (bnc, ri);
+
+  return bgp_nexthop_check (afi, ri, NULL, NULL);
+}
+
+/* Something about nexthop BNC changed: check the paths depending on it
+   again, and only those. */
+static void
+bgp_nexthop_cache_evaluate (afi_t afi, struct bgp_nexthop_cache *bnc)
+{
+  struct bgp_info *bi;
+  struct bgp_info *next;
   struct bgp_node *rn;
+  struct bgp *bgp;
+  safi_t safi;
+  int valid;
+  int current;
+  int changed;
+  int metricchanged;
+
+  for (bi = bnc->path; bi; bi = next)
+    {
+      next = bi->nh_next;
+      rn = bi->net;
+
+      if (! rn || CHECK_FLAG (bi->flags, BGP_INFO_REMOVED))
+	continue;
+
+      bgp = bi->peer->bgp;
+      safi = bgp_node_table (rn)->safi;
+
+      changed = 0;
+      metricchanged = 0;
+      valid = bgp_nexthop_check (afi, bi, &changed, &metricchanged);
+
+      current = CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0;
+
+      if (changed)
+	SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
+      else
+	UNSET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
+
+      if (valid != current)
+	{
+	  if (CHECK_FLAG (bi->flags, BGP_INFO_VALID))
+	    {
+	      bgp_aggregate_decrement (bgp, &rn->p, bi, afi, safi);
+	      bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
+	    }
+	  else
+	    {
+	      bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
+	      bgp_aggregate_increment (bgp, &rn->p, bi, afi, safi);
+	    }
+	}
+
+      bgp_process (bgp, rn, afi, safi);
+    }
+}
+
+/* A connected network came or went.  Single hop EBGP paths with a
+   nexthop inside it may have changed state. */
+static void
+bgp_nexthop_connected_change (afi_t afi, struct prefix *p)
+{
+  struct bgp_node *top, *rn;
+  struct bgp_nexthop_cache *bnc;
+
+  /* The nexthops inside p are the subtree under it. */
+  top = bgp_node_get (bgp_nexthop_cache_table[afi], p);
+  for (rn = bgp_lock_node (top); rn; rn = bgp_route_next_until (rn, top))
+    if ((bnc = rn->info) != NULL)
+      bgp_nexthop_cache_evaluate (afi, bnc);
+  bgp_unlock_node (top);
+}
+
+/* ZEBRA_NEXTHOP_UPDATE: how a registered nexthop resolves now. */
+int
+bgp_nexthop_update (int command, struct zclient *zclient, uint16_t length)
+{
+  struct stream *s;
   struct prefix p;
+  struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
-  struct in_addr addr;
-  
-  /* If lookup is not enabled, return valid. */
-  if (zlookup->sock < 0)
+  struct bgp_nexthop_cache *new;
+  struct nexthop *nexthop;
+  afi_t afi;
+  int changed;
+  int metricchanged;
+  int i;
+  char buf[INET6_ADDRSTRLEN];
+
+  s = zclient->ibuf;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = stream_getc (s);
+  if (p.family == AF_INET)
     {
-      if (ri->extra)
-        ri->extra->igpmetric = 0;
-      return 1;
+      afi = AFI_IP;
+      p.prefixlen = IPV4_MAX_BITLEN;
+      p.u.prefix4.s_addr = stream_get_ipv4 (s);
     }
-  
 #ifdef HAVE_IPV6
-  if (afi == AFI_IP6)
-    return bgp_nexthop_lookup_ipv6 (peer, ri, changed, metricchanged);
+  else if (p.family == AF_INET6)
+    {
+      afi = AFI_IP6;
+      p.prefixlen = IPV6_MAX_BITLEN;
+      stream_get (&p.u.prefix6, s, 16);
+    }
 #endif /* HAVE_IPV6 */
+  else
+    return -1;
 
-  addr = ri->attr->nexthop;
-
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_BITLEN;
-  p.u.prefix4 = addr;
+  /* Not interested any more. */
+  rn = bgp_node_lookup (bgp_nexthop_cache_table[afi], &p);
+  if (! rn)
+    return 0;
+  bnc = rn->info;
+  bgp_unlock_node (rn);
+  if (! bnc)
+    return 0;
 
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bgp_nexthop_cache_table[AFI_IP], &p);
+  new = bnc_new ();
+  new->metric = stream_getl (s);
+  new->nexthop_num = stream_getc (s);
+  new->valid = new->nexthop_num ? 1 : 0;
+  if (! new->valid)
+    new->metric = 0;
 
-  if (rn->info)
+  for (i = 0; i < new->nexthop_num; i++)
     {
-      bnc = rn->info;
-      bgp_unlock_node (rn);
+      nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      nexthop->type = stream_getc (s);
+      switch (nexthop->type)
+	{
+	case ZEBRA_NEXTHOP_IPV4:
+	  nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
+	  break;
+	case ZEBRA_NEXTHOP_IPV4_IFINDEX:
+	  nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#ifdef HAVE_IPV6
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#endif /* HAVE_IPV6 */
+	case ZEBRA_NEXTHOP_IFINDEX:
+	case ZEBRA_NEXTHOP_IFNAME:
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+	default:
+	  /* do nothing */
+	  break;
+	}
+      bnc_nexthop_add (new, nexthop);
     }
-  else
+
+  changed = bgp_nexthop_cache_different (bnc, new);
+  metricchanged = (bnc->metric != new->metric);
+
+  if (bnc->valid == new->valid && ! changed && ! metricchanged)
     {
-      if (NULL == (bnc = zlookup_query (addr)))
-	bnc = bnc_new ();
-      else
-	{
-	  if (changed)
-	    {
-	      struct bgp_table *old;
-	      struct bgp_node *oldrn;
+      bnc_free (new);
+      return 0;
+    }
 
-	      if (bgp_nexthop_cache_table[AFI_IP] == cache1_table[AFI_IP])
-		old = cache2_table[AFI_IP];
-	      else
-		old = cache1_table[AFI_IP];
+  /* Take over the new resolution, keeping the dependent paths. */
+  bnc_nexthop_free (bnc);
+  bnc->valid = new->valid;
+  bnc->metric = new->metric;
+  bnc->nexthop_num = new->nexthop_num;
+  bnc->nexthop = new->nexthop;
+  bnc->changed = changed;
+  bnc->metricchanged = metricchanged;
+  bnc->last_change = bgp_clock ();
+  new->nexthop = NULL;
+  bnc_free (new);
 
-	      oldrn = bgp_node_lookup (old, &p);
-	      if (oldrn)
-		{
-		  struct bgp_nexthop_cache *oldbnc = oldrn->info;
+  if (BGP_DEBUG (events, EVENTS))
+    zlog_debug ("nexthop %s %s, metric %u, %lu dependent paths",
+		inet_ntop (p.family, &p.u.prefix, buf, sizeof (buf)),
+		bnc->valid ? "reachable" : "unreachable", bnc->metric,
+		bnc->path_count);
 
-		  bnc->changed = bgp_nexthop_cache_different (bnc, oldbnc);
+  bgp_nexthop_cache_evaluate (afi, bnc);
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
+  return 0;
+}
 
-                  bgp_unlock_node (oldrn);
-		}
-	    }
-	}
-      rn->info = bnc;
-    }
+/* Connection to zebra (re)established: register every nexthop in use.
+   Zebra answers each registration with the current state. */
+void
+bgp_nexthop_zebra_connected (struct zclient *zclient)
+{
+  struct stream *s;
+  struct bgp_node *rn;
+  afi_t afi;
 
-  if (changed)
-    *changed = bnc->changed;
+  /* Superseded by the full registration below. */
+  stream_reset (bgp_nexthop_reg_s);
 
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  s = zclient->obuf;
+  stream_reset (s);
+  zclient_create_header (s, ZEBRA_NEXTHOP_REGISTER);
 
-  if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get(ri))->igpmetric = bnc->metric;
-  else if (ri->extra)
-    ri->extra->igpmetric = 0;
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    {
+      if (! bgp_nexthop_cache_table[afi])
+	continue;
 
-  return bnc->valid;
+      for (rn = bgp_table_top (bgp_nexthop_cache_table[afi]); rn;
+	   rn = bgp_route_next (rn))
+	{
+	  if (! rn->info)
+	    continue;
+
+	  if (STREAM_WRITEABLE (s) < 1 + sizeof (struct in6_addr))
+	    {
+	      stream_putw_at (s, 0, stream_get_endp (s));
+	      zclient_send_message (zclient);
+	      stream_reset (s);
+	      zclient_create_header (s, ZEBRA_NEXTHOP_REGISTER);
+	    }
+	  stream_putc (s, rn->p.family);
+	  stream_put (s, &rn->p.u.prefix, prefix_blen (&rn->p));
+	}
+    }
+
+  if (stream_get_endp (s) > ZEBRA_HEADER_SIZE)
+    {
+      stream_putw_at (s, 0, stream_get_endp (s));
+      zclient_send_message (zclient);
+    }
 }
 
-/* Reset and free all BGP nexthop cache. */
+/* Forget all BGP nexthop cache.  Paths still around stop being
+   tracked. */
 static void
 bgp_nexthop_cache_reset (struct bgp_table *table)
 {
   struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
+  struct bgp_info *bi;
+  struct bgp_info *next;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
     if ((bnc = rn->info) != NULL)
       {
+	for (bi = bnc->path; bi; bi = next)
+	  {
+	    next = bi->nh_next;
+	    bi->nexthop = NULL;
+	    bi->nh_next = bi->nh_prev = NULL;
+	  }
 	bnc_free (bnc);
 	rn->info = NULL;
 	bgp_unlock_node (rn);
       }
 }
 
+/* Periodic work which does not depend on nexthops: those are tracked
+   through zebra, see bgp_nexthop_update. */
 static void
 bgp_scan (afi_t afi, safi_t safi)
 {
-  struct bgp_node *rn;
   struct bgp *bgp;
-  struct bgp_info *bi;
-  struct bgp_info *next;
   struct peer *peer;
   struct listnode *node, *nnode;
-  int valid;
-  int current;
-  int changed;
-  int metricchanged;
-
-  /* Change cache. */
-  if (bgp_nexthop_cache_table[afi] == cache1_table[afi])
-    bgp_nexthop_cache_table[afi] = cache2_table[afi];
-  else
-    bgp_nexthop_cache_table[afi] = cache1_table[afi];
 
   /* Get default bgp. */
   bgp = bgp_get_default ();
@@ -446,64 +744,9 @@ bgp_scan (afi_t afi, safi_t safi)
 	bgp_maximum_prefix_overflow (peer, afi, SAFI_MPLS_VPN, 1);
     }
 
-  for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
-       rn = bgp_route_next (rn))
-    {
-      for (bi = rn->info; bi; bi = next)
-	{
-	  next = bi->next;
-
-	  if (bi->type == ZEBRA_ROUTE_BGP && bi->sub_type == BGP_ROUTE_NORMAL)
-	    {
-	      changed = 0;
-	      metricchanged = 0;
-
-	      if (bi->peer->sort == BGP_PEER_EBGP && bi->peer->ttl == 1
-		  && !CHECK_FLAG(bi->peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK))
-		valid = bgp_nexthop_onlink (afi, bi->attr);
-	      else
-		valid = bgp_nexthop_lookup (afi, bi->peer, bi,
-					    &changed, &metricchanged);
-
-	      current = CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0;
-
-	      if (changed)
-		SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-	      else
-		UNSET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-
-	      if (valid != current)
-		{
-		  if (CHECK_FLAG (bi->flags, BGP_INFO_VALID))
-		    {
-		      bgp_aggregate_decrement (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		      bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
-		    }
-		  else
-		    {
-		      bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
-		      bgp_aggregate_increment (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		    }
-		}
-
-              if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST],
-		  BGP_CONFIG_DAMPENING)
-                  &&  bi->extra && bi->extra->damp_info )
-                if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
-		  bgp_aggregate_increment (bgp, &rn->p, bi,
-					   afi, SAFI_UNICAST);
-	    }
-	}
-      bgp_process (bgp, rn, afi, SAFI_UNICAST);
-    }
-
-  /* Flash old cache. */
-  if (bgp_nexthop_cache_table[afi] == cache1_table[afi])
-    bgp_nexthop_cache_reset (cache2_table[afi]);
-  else
-    bgp_nexthop_cache_reset (cache1_table[afi]);
+  /* Dampening housekeeping, over the dampened paths only. */
+  if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST], BGP_CONFIG_DAMPENING))
+    bgp_damp_scan_all (bgp, afi, SAFI_UNICAST);
 
   if (BGP_DEBUG (events, EVENTS))
     {
@@ -670,6 +913,7 @@ bgp_connected_add (struct connected *ifc)
 	  bc->refcnt = 1;
 	  rn->info = bc;
 	}
+      bgp_nexthop_connected_change (AFI_IP, &p);
     }
 #ifdef HAVE_IPV6
   else if (addr->family == AF_INET6)
@@ -695,6 +939,7 @@ bgp_connected_add (struct connected *ifc)
 	  bc->refcnt = 1;
 	  rn->info = bc;
 	}
+      bgp_nexthop_connected_change (AFI_IP6, &p);
     }
 #endif /* HAVE_IPV6 */
 }
@@ -738,6 +983,8 @@ bgp_connected_delete (struct connected *ifc)
 	}
       bgp_unlock_node (rn);
       bgp_unlock_node (rn);
+
+      bgp_nexthop_connected_change (AFI_IP, &p);
     }
 #ifdef HAVE_IPV6
   else if (addr->family == AF_INET6)
@@ -764,6 +1011,8 @@ bgp_connected_delete (struct connected *ifc)
 	}
       bgp_unlock_node (rn);
       bgp_unlock_node (rn);
+
+      bgp_nexthop_connected_change (AFI_IP6, &p);
     }
 #endif /* HAVE_IPV6 */
 }
@@ -782,325 +1031,196 @@ bgp_nexthop_self (struct attr *attr)
   return 0;
 }
 
-static struct bgp_nexthop_cache *
-zlookup_read (void)
+/* Import check results are asked for on the lookup connection without
+   waiting for them.  All the queries of a bgp_import run are written
+   back to back and the replies are read from the thread loop as they
+   come.  Zebra answers the queries of one connection in order, so a
+   reply belongs to the oldest query still outstanding; the address
+   zebra echoes back is checked against it. */
+struct zlookup_query
 {
-  struct stream *s;
-  uint16_t length;
-  u_char marker;
-  u_char version;
-  uint16_t command __attribute__((unused));
-  int nbytes __attribute__((unused));
-  struct in_addr raddr __attribute__((unused));
-  uint32_t metric;
-  int i;
-  u_char nexthop_num;
-  struct nexthop *nexthop;
-  struct bgp_nexthop_cache *bnc;
+  u_int32_t seq;
+  struct prefix p;
+};
 
-  s = zlookup->ibuf;
-  stream_reset (s);
+/* Outstanding queries, oldest first. */
+static struct list *zlookup_queries;
 
-  /* nbytes not being checked */
-  nbytes = stream_read (s, zlookup->sock, 2);
-  length = stream_getw (s);
+/* Sequence number of the next query, and of the next expected reply. */
+static u_int32_t zlookup_seq_sent;
+static u_int32_t zlookup_seq_recv;
 
-  nbytes = stream_read (s, zlookup->sock, length - 2);
-  marker = stream_getc (s);
-  version = stream_getc (s);
-  
-  if (version != ZSERV_VERSION || marker != ZEBRA_HEADER_MARKER)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zlookup->sock, marker, version);
-      return NULL;
-    }
-  
-  /* XXX: not checking command */
-  command = stream_getw (s);
-  
-  /* XXX: not doing anything with raddr */
-  raddr.s_addr = stream_get_ipv4 (s);
-  metric = stream_getl (s);
-  nexthop_num = stream_getc (s);
+static int zlookup_read (struct thread *);
 
-  if (nexthop_num)
-    {
-      bnc = bnc_new ();
-      bnc->valid = 1;
-      bnc->metric = metric;
-      bnc->nexthop_num = nexthop_num;
+static void
+zlookup_query_free (void *q)
+{
+  XFREE (MTYPE_BGP_NEXTHOP_QUERY, q);
+}
 
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
-	  nexthop->type = stream_getc (s);
-	  switch (nexthop->type)
-	    {
-	    case ZEBRA_NEXTHOP_IPV4:
-	      nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV4_IFINDEX:
-	      nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	    case ZEBRA_NEXTHOP_IFNAME:
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-            default:
-              /* do nothing */
-              break;
-	    }
-	  bnc_nexthop_add (bnc, nexthop);
-	}
-    }
-  else
-    return NULL;
+/* Lookup connection failed.  Outstanding queries are lost, and like
+   before the connection stays down: import checks pass from now on. */
+static void
+zlookup_failed (void)
+{
+  zlog_err ("zlookup->sock connection closed");
 
-  return bnc;
+  zclient_stop (zlookup);
+  list_delete_all_node (zlookup_queries);
+  zlookup_seq_recv = zlookup_seq_sent;
 }
 
-struct bgp_nexthop_cache *
-zlookup_query (struct in_addr addr)
+/* Send the queries accumulated in the output stream. */
+static void
+zlookup_flush (void)
 {
-  int ret;
-  struct stream *s;
-
-  /* Check socket. */
-  if (zlookup->sock < 0)
-    return NULL;
+  if (zlookup->sock < 0 || ! stream_get_endp (zlookup->obuf))
+    return;
 
-  s = zlookup->obuf;
-  stream_reset (s);
-  zclient_create_header (s, ZEBRA_IPV4_NEXTHOP_LOOKUP);
-  stream_put_in_addr (s, &addr);
-  
-  stream_putw_at (s, 0, stream_get_endp (s));
-  
-  ret = writen (zlookup->sock, s->data, stream_get_endp (s));
-  if (ret < 0)
+  if (zclient_send_message (zlookup) < 0)
     {
-      zlog_err ("can't write to zlookup->sock");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
-    }
-  if (ret == 0)
-    {
-      zlog_err ("zlookup->sock connection closed");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
+      zlookup_failed ();
+      return;
     }
 
-  return zlookup_read ();
+  stream_reset (zlookup->obuf);
 }
 
-#ifdef HAVE_IPV6
-static struct bgp_nexthop_cache *
-zlookup_read_ipv6 (void)
+/* Queue an import check of P.  Queries are sent when the output stream
+   is full or at the end of the import run. */
+static void
+zlookup_import_query (struct prefix *p)
 {
-  struct stream *s;
-  uint16_t length;
-  u_char version, marker;
-  struct in6_addr raddr;
-  uint32_t metric;
-  int i;
-  u_char nexthop_num;
-  struct nexthop *nexthop;
-  struct bgp_nexthop_cache *bnc;
-
-  s = zlookup->ibuf;
-  stream_reset (s);
-
-  /* XXX: ignoring nbytes, see also zread_lookup */
-  stream_read (s, zlookup->sock, 2);
-  length = stream_getw (s);
-
-  stream_read (s, zlookup->sock, length - 2);
-  marker = stream_getc (s);
-  version = stream_getc (s);
-  
-  if (version != ZSERV_VERSION || marker != ZEBRA_HEADER_MARKER)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zlookup->sock, marker, version);
-      return NULL;
-    }
-  
-  /* XXX: ignoring command */  
-  stream_getw (s);
-  
-  /* XXX: not actually doing anything with raddr */
-  stream_get (&raddr, s, 16);
-
-  metric = stream_getl (s);
-  nexthop_num = stream_getc (s);
+  struct stream *s = zlookup->obuf;
+  struct zlookup_query *q;
+  size_t start;
 
-  if (nexthop_num)
-    {
-      bnc = bnc_new ();
-      bnc->valid = 1;
-      bnc->metric = metric;
-      bnc->nexthop_num = nexthop_num;
+  if (STREAM_WRITEABLE (s) < ZEBRA_HEADER_SIZE + 1 + IPV4_MAX_BYTELEN)
+    zlookup_flush ();
+  if (zlookup->sock < 0)
+    return;
 
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
-	  nexthop->type = stream_getc (s);
-	  switch (nexthop->type)
-	    {
-	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop->gate.ipv6, s, 16);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV6_IFINDEX:
-	    case ZEBRA_NEXTHOP_IPV6_IFNAME:
-	      stream_get (&nexthop->gate.ipv6, s, 16);
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	    case ZEBRA_NEXTHOP_IFNAME:
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-	    default:
-	      /* do nothing */
-	      break;
-	    }
-	  bnc_nexthop_add (bnc, nexthop);
-	}
-    }
-  else
-    return NULL;
+  start = stream_get_endp (s);
+  stream_putw (s, ZEBRA_HEADER_SIZE);
+  stream_putc (s, ZEBRA_HEADER_MARKER);
+  stream_putc (s, ZSERV_VERSION);
+  stream_putw (s, ZEBRA_IPV4_IMPORT_LOOKUP);
+  stream_putc (s, p->prefixlen);
+  stream_put_in_addr (s, &p->u.prefix4);
+  stream_putw_at (s, start, stream_get_endp (s) - start);
 
-  return bnc;
+  q = XCALLOC (MTYPE_BGP_NEXTHOP_QUERY, sizeof (struct zlookup_query));
+  q->seq = zlookup_seq_sent++;
+  prefix_copy (&q->p, p);
+  listnode_add (zlookup_queries, q);
 }
 
-struct bgp_nexthop_cache *
-zlookup_query_ipv6 (struct in6_addr *addr)
+/* Take the result of an import check of P: whether the network is in
+   the IGP and, if so, its metric and nexthop.  Announce or withdraw the
+   static route when this changes. */
+static void
+bgp_import_set (struct bgp *bgp, struct prefix *p,
+		struct bgp_static *bgp_static, afi_t afi, safi_t safi,
+		int valid, u_int32_t metric, struct in_addr nexthop)
 {
-  int ret;
-  struct stream *s;
+  int old_valid = bgp_static->valid;
+  u_int32_t old_metric = bgp_static->igpmetric;
+  struct in_addr old_nexthop = bgp_static->igpnexthop;
 
-  /* Check socket. */
-  if (zlookup->sock < 0)
-    return NULL;
+  bgp_static->valid = valid;
+  bgp_static->igpmetric = metric;
+  bgp_static->igpnexthop = nexthop;
 
-  s = zlookup->obuf;
-  stream_reset (s);
-  zclient_create_header (s, ZEBRA_IPV6_NEXTHOP_LOOKUP);
-  stream_put (s, addr, 16);
-  stream_putw_at (s, 0, stream_get_endp (s));
-  
-  ret = writen (zlookup->sock, s->data, stream_get_endp (s));
-  if (ret < 0)
+  if (bgp_static->valid != old_valid)
     {
-      zlog_err ("can't write to zlookup->sock");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
+      if (bgp_static->valid)
+	bgp_static_update (bgp, p, bgp_static, afi, safi);
+      else
+	bgp_static_withdraw (bgp, p, afi, safi);
     }
-  if (ret == 0)
+  else if (bgp_static->valid)
     {
-      zlog_err ("zlookup->sock connection closed");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
+      if (bgp_static->igpmetric != old_metric
+	  || bgp_static->igpnexthop.s_addr != old_nexthop.s_addr
+	  || bgp_static->rmap.name)
+	bgp_static_update (bgp, p, bgp_static, afi, safi);
     }
+}
+
+/* Reply to the import check of P. */
+static void
+bgp_import_reply (struct prefix *p, int valid, u_int32_t metric,
+		  struct in_addr nexthop)
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct bgp_static *bgp_static;
+  struct listnode *node, *nnode;
+
+  for (ALL_LIST_ELEMENTS (bm->bgp, node, nnode, bgp))
+    {
+      if (! bgp_flag_check (bgp, BGP_FLAG_IMPORT_CHECK))
+	continue;
+
+      rn = bgp_node_lookup (bgp->route[AFI_IP][SAFI_UNICAST], p);
+      if (! rn)
+	continue;
+      bgp_static = rn->info;
+      bgp_unlock_node (rn);
+
+      /* Unconfigured while the query was outstanding. */
+      if (! bgp_static || bgp_static->backdoor)
+	continue;
 
-  return zlookup_read_ipv6 ();
+      bgp_import_set (bgp, &rn->p, bgp_static, AFI_IP, SAFI_UNICAST,
+		      valid, metric, nexthop);
+    }
 }
-#endif /* HAVE_IPV6 */
 
+/* Match a reply read from the lookup connection with its query. */
 static int
-bgp_import_check (struct prefix *p, u_int32_t *igpmetric,
-                  struct in_addr *igpnexthop)
+zlookup_process (struct stream *s, uint16_t command)
 {
-  struct stream *s;
-  int ret;
-  u_int16_t length, command __attribute__((unused));
-  u_char version, marker;
-  int nbytes __attribute__((unused));
-  struct in_addr addr __attribute__((unused));
+  struct listnode *node;
+  struct zlookup_query *q;
+  struct in_addr addr;
   struct in_addr nexthop;
-  u_int32_t metric = 0;
+  u_int32_t metric;
   u_char nexthop_num;
-  u_char nexthop_type;
 
-  /* If lookup connection is not available return valid. */
-  if (zlookup->sock < 0)
+  if (command != ZEBRA_IPV4_IMPORT_LOOKUP)
     {
-      if (igpmetric)
-	*igpmetric = 0;
-      return 1;
+      zlog_err ("%s: unexpected command %u", __func__, command);
+      return -1;
     }
 
-  /* Send query to the lookup connection */
-  s = zlookup->obuf;
-  stream_reset (s);
-  zclient_create_header (s, ZEBRA_IPV4_IMPORT_LOOKUP);
-  
-  stream_putc (s, p->prefixlen);
-  stream_put_in_addr (s, &p->u.prefix4);
-  
-  stream_putw_at (s, 0, stream_get_endp (s));
-  
-  /* Write the packet. */
-  ret = writen (zlookup->sock, s->data, stream_get_endp (s));
-
-  if (ret < 0)
+  node = listhead (zlookup_queries);
+  if (! node)
     {
-      zlog_err ("can't write to zlookup->sock");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return 1;
-    }
-  if (ret == 0)
-    {
-      zlog_err ("zlookup->sock connection closed");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return 1;
+      zlog_err ("%s: reply %u without query", __func__, zlookup_seq_recv);
+      return -1;
     }
+  q = listgetdata (node);
 
-  /* Get result. */
-  stream_reset (s);
-
-  /* Fetch length. */
-  /* XXX: not using nbytes */
-  nbytes = stream_read (s, zlookup->sock, 2);
-  length = stream_getw (s);
-
-  /* Fetch whole data. */
-  nbytes = stream_read (s, zlookup->sock, length - 2);
-  marker = stream_getc (s);
-  version = stream_getc (s);
-
-  if (version != ZSERV_VERSION || marker != ZEBRA_HEADER_MARKER)
+  addr.s_addr = stream_get_ipv4 (s);
+  if (q->seq != zlookup_seq_recv
+      || ! IPV4_ADDR_SAME (&addr, &q->p.u.prefix4))
     {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zlookup->sock, marker, version);
-      return 0;
+      zlog_err ("%s: reply %u for %s does not match query %u",
+		__func__, zlookup_seq_recv, inet_ntoa (addr), q->seq);
+      return -1;
     }
-  
-  /* XXX: not using command */
-  command = stream_getw (s);
-  
-  /* XXX: not using addr */
-  addr.s_addr = stream_get_ipv4 (s);
+  list_delete_node (zlookup_queries, node);
+  zlookup_seq_recv++;
+
   metric = stream_getl (s);
   nexthop_num = stream_getc (s);
 
-  /* Set IGP metric value. */
-  if (igpmetric)
-    *igpmetric = metric;
-
   /* If there is nexthop then this is active route. */
+  nexthop.s_addr = 0;
   if (nexthop_num)
     {
-      nexthop.s_addr = 0;
-      nexthop_type = stream_getc (s);
-      switch (nexthop_type)
+      switch (stream_getc (s))
 	{
 	case ZEBRA_NEXTHOP_IPV4:
 	  nexthop.s_addr = stream_get_ipv4 (s);
@@ -1113,16 +1233,93 @@ bgp_import_check (struct prefix *p, u_int32_t *igpmetric,
 	  /* do nothing */
 	  break;
 	}
-      *igpnexthop = nexthop;
+    }
 
-      return 1;
+  bgp_import_reply (&q->p, nexthop_num ? 1 : 0, metric, nexthop);
+
+  XFREE (MTYPE_BGP_NEXTHOP_QUERY, q);
+  return 0;
+}
+
+/* Read replies from the lookup connection, without blocking. */
+static int
+zlookup_read (struct thread *thread)
+{
+  struct stream *s;
+  size_t already;
+  ssize_t nbyte;
+  uint16_t length, command;
+  u_char marker, version;
+
+  zlookup->t_read = NULL;
+  s = zlookup->ibuf;
+
+  /* Read header (if we don't have it already). */
+  if ((already = stream_get_endp (s)) < ZEBRA_HEADER_SIZE)
+    {
+      nbyte = stream_read_try (s, zlookup->sock, ZEBRA_HEADER_SIZE - already);
+      if (nbyte == 0 || nbyte == -1)
+	{
+	  zlookup_failed ();
+	  return -1;
+	}
+      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE - already))
+	goto again;
+      already = ZEBRA_HEADER_SIZE;
     }
-  else
-    return 0;
+
+  stream_set_getp (s, 0);
+  length = stream_getw (s);
+  marker = stream_getc (s);
+  version = stream_getc (s);
+  command = stream_getw (s);
+
+  if (version != ZSERV_VERSION || marker != ZEBRA_HEADER_MARKER)
+    {
+      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+               __func__, zlookup->sock, marker, version);
+      zlookup_failed ();
+      return -1;
+    }
+
+  if (length < ZEBRA_HEADER_SIZE || length > STREAM_SIZE (s))
+    {
+      zlog_err ("%s: socket %d bad message length %u",
+		__func__, zlookup->sock, length);
+      zlookup_failed ();
+      return -1;
+    }
+
+  /* Read rest of the reply. */
+  if (already < length)
+    {
+      nbyte = stream_read_try (s, zlookup->sock, length - already);
+      if (nbyte == 0 || nbyte == -1)
+	{
+	  zlookup_failed ();
+	  return -1;
+	}
+      if (nbyte != (ssize_t)(length - already))
+	goto again;
+    }
+
+  if (zlookup_process (s, command) < 0)
+    {
+      zlookup_failed ();
+      return -1;
+    }
+
+  stream_reset (s);
+
+ again:
+  zlookup->t_read = thread_add_read (master, zlookup_read, NULL,
+				     zlookup->sock);
+  return 0;
 }
 
 /* Scan all configured BGP route then check the route exists in IGP or
-   not. */
+   not.  Import checks are only queried here, bgp_import_reply applies
+   the results. */
 static int
 bgp_import (struct thread *t)
 {
@@ -1130,8 +1327,6 @@ bgp_import (struct thread *t)
   struct bgp_node *rn;
   struct bgp_static *bgp_static;
   struct listnode *node, *nnode;
-  int valid;
-  u_int32_t metric;
   struct in_addr nexthop;
   afi_t afi;
   safi_t safi;
@@ -1142,6 +1337,18 @@ bgp_import (struct thread *t)
   if (BGP_DEBUG (events, EVENTS))
     zlog_debug ("Import timer expired.");
 
+  /* Still waiting for the replies of the previous run: zebra is busy,
+     don't pile more queries up behind them. */
+  if (listcount (zlookup_queries))
+    {
+      if (BGP_DEBUG (events, EVENTS))
+	zlog_debug ("%u import checks outstanding, skipping",
+		    listcount (zlookup_queries));
+      return 0;
+    }
+
+  nexthop.s_addr = 0;
+
   for (ALL_LIST_ELEMENTS (bm->bgp, node, nnode, bgp))
     {
       for (afi = AFI_IP; afi < AFI_MAX; afi++)
@@ -1153,37 +1360,19 @@ bgp_import (struct thread *t)
 		if (bgp_static->backdoor)
 		  continue;
 
-		valid = bgp_static->valid;
-		metric = bgp_static->igpmetric;
-		nexthop = bgp_static->igpnexthop;
-
+		/* If lookup connection is not available, valid. */
 		if (bgp_flag_check (bgp, BGP_FLAG_IMPORT_CHECK)
-		    && afi == AFI_IP && safi == SAFI_UNICAST)
-		  bgp_static->valid = bgp_import_check (&rn->p, &bgp_static->igpmetric,
-						        &bgp_static->igpnexthop);
+		    && afi == AFI_IP && safi == SAFI_UNICAST
+		    && zlookup->sock >= 0)
+		  zlookup_import_query (&rn->p);
 		else
-		  {
-		    bgp_static->valid = 1;
-		    bgp_static->igpmetric = 0;
-		    bgp_static->igpnexthop.s_addr = 0;
-		  }
-
-		if (bgp_static->valid != valid)
-		  {
-		    if (bgp_static->valid)
-		      bgp_static_update (bgp, &rn->p, bgp_static, afi, safi);
-		    else
-		      bgp_static_withdraw (bgp, &rn->p, afi, safi);
-		  }
-		else if (bgp_static->valid)
-		  {
-		    if (bgp_static->igpmetric != metric
-			|| bgp_static->igpnexthop.s_addr != nexthop.s_addr
-			|| bgp_static->rmap.name)
-		      bgp_static_update (bgp, &rn->p, bgp_static, afi, safi);
-		  }
+		  bgp_import_set (bgp, &rn->p, bgp_static, afi, safi,
+				  1, 0, nexthop);
 	      }
     }
+
+  zlookup_flush ();
+
   return 0;
 }
 
@@ -1202,6 +1391,11 @@ zlookup_connect (struct thread *t)
   if (zclient_socket_connect (zlookup) < 0)
     return -1;
 
+  if (set_nonblocking (zlookup->sock) < 0)
+    zlog_warn ("%s: set_nonblocking(%d) failed", __func__, zlookup->sock);
+
+  zlookup->t_read = thread_add_read (master, zlookup_read, NULL,
+				     zlookup->sock);
   return 0;
 }
 
@@ -1297,13 +1491,57 @@ ALIAS (no_bgp_scan_time,
        "Configure background scanner interval\n"
        "Scanner interval (seconds)\n")
 
+static void
+show_ip_bgp_scan_nexthop (struct vty *vty, struct bgp_node *rn,
+			  struct bgp_nexthop_cache *bnc, const char detail)
+{
+  char buf[INET6_ADDRSTRLEN];
+  char timebuf[BGP_UPTIME_LEN];
+  struct nexthop *nexthop;
+
+  inet_ntop (rn->p.family, &rn->p.u.prefix, buf, INET6_ADDRSTRLEN);
+
+  if (bnc->valid)
+    {
+      vty_out (vty, " %s valid [IGP metric %d]%s", buf, bnc->metric,
+	       VTY_NEWLINE);
+      if (detail)
+	for (nexthop = bnc->nexthop; nexthop; nexthop = nexthop->next)
+	  switch (nexthop->type)
+	    {
+	    case NEXTHOP_TYPE_IPV4:
+	      vty_out (vty, "  gate %s%s", inet_ntop (AF_INET, &nexthop->gate.ipv4, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
+	      break;
+	    case NEXTHOP_TYPE_IPV4_IFINDEX:
+	      vty_out (vty, "  gate %s", inet_ntop (AF_INET, &nexthop->gate.ipv4, buf, INET6_ADDRSTRLEN));
+	      vty_out (vty, " ifidx %u%s", nexthop->ifindex, VTY_NEWLINE);
+	      break;
+#ifdef HAVE_IPV6
+	    case NEXTHOP_TYPE_IPV6:
+	      vty_out (vty, "  gate %s%s", inet_ntop (AF_INET6, &nexthop->gate.ipv6, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
+	      break;
+#endif /* HAVE_IPV6 */
+	    case NEXTHOP_TYPE_IFINDEX:
+	      vty_out (vty, "  ifidx %u%s", nexthop->ifindex, VTY_NEWLINE);
+	      break;
+	    default:
+	      vty_out (vty, "  invalid nexthop type %u%s", nexthop->type, VTY_NEWLINE);
+	    }
+    }
+  else
+    vty_out (vty, " %s invalid%s", buf, VTY_NEWLINE);
+
+  vty_out (vty, "  %lu dependent paths, last change %s%s", bnc->path_count,
+	   peer_uptime (bnc->last_change, timebuf, BGP_UPTIME_LEN),
+	   VTY_NEWLINE);
+}
+
 static int
 show_ip_bgp_scan_tables (struct vty *vty, const char detail)
 {
   struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
   char buf[INET6_ADDRSTRLEN];
-  u_char i;
 
   if (bgp_scan_thread)
     vty_out (vty, "BGP scan is running%s", VTY_NEWLINE);
@@ -1314,33 +1552,7 @@ show_ip_bgp_scan_tables (struct vty *vty, const char detail)
   vty_out (vty, "Current BGP nexthop cache:%s", VTY_NEWLINE);
   for (rn = bgp_table_top (bgp_nexthop_cache_table[AFI_IP]); rn; rn = bgp_route_next (rn))
     if ((bnc = rn->info) != NULL)
-      {
-	if (bnc->valid)
-	{
-	  vty_out (vty, " %s valid [IGP metric %d]%s",
-		   inet_ntop (AF_INET, &rn->p.u.prefix4, buf, INET6_ADDRSTRLEN), bnc->metric, VTY_NEWLINE);
-	  if (detail)
-	    for (i = 0; i < bnc->nexthop_num; i++)
-	      switch (bnc->nexthop[i].type)
-	      {
-	      case NEXTHOP_TYPE_IPV4:
-		vty_out (vty, "  gate %s%s", inet_ntop (AF_INET, &bnc->nexthop[i].gate.ipv4, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
-		break;
-	      case NEXTHOP_TYPE_IPV4_IFINDEX:
-		vty_out (vty, "  gate %s", inet_ntop (AF_INET, &bnc->nexthop[i].gate.ipv4, buf, INET6_ADDRSTRLEN));
-		vty_out (vty, " ifidx %u%s", bnc->nexthop[i].ifindex, VTY_NEWLINE);
-		break;
-	      case NEXTHOP_TYPE_IFINDEX:
-		vty_out (vty, "  ifidx %u%s", bnc->nexthop[i].ifindex, VTY_NEWLINE);
-		break;
-	      default:
-		vty_out (vty, "  invalid nexthop type %u%s", bnc->nexthop[i].type, VTY_NEWLINE);
-	      }
-	}
-	else
-	  vty_out (vty, " %s invalid%s",
-		   inet_ntop (AF_INET, &rn->p.u.prefix4, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
-      }
+      show_ip_bgp_scan_nexthop (vty, rn, bnc, detail);
 
 #ifdef HAVE_IPV6
   {
@@ -1348,31 +1560,7 @@ show_ip_bgp_scan_tables (struct vty *vty, const char detail)
          rn; 
          rn = bgp_route_next (rn))
       if ((bnc = rn->info) != NULL)
-	{
-	  if (bnc->valid)
-	  {
-	    vty_out (vty, " %s valid [IGP metric %d]%s",
-		     inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, INET6_ADDRSTRLEN),
-		     bnc->metric, VTY_NEWLINE);
-	    if (detail)
-	      for (i = 0; i < bnc->nexthop_num; i++)
-		switch (bnc->nexthop[i].type)
-		{
-		case NEXTHOP_TYPE_IPV6:
-		  vty_out (vty, "  gate %s%s", inet_ntop (AF_INET6, &bnc->nexthop[i].gate.ipv6, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
-		  break;
-		case NEXTHOP_TYPE_IFINDEX:
-		  vty_out (vty, "  ifidx %u%s", bnc->nexthop[i].ifindex, VTY_NEWLINE);
-		  break;
-		default:
-		  vty_out (vty, "  invalid nexthop type %u%s", bnc->nexthop[i].type, VTY_NEWLINE);
-		}
-	  }
-	  else
-	    vty_out (vty, " %s invalid%s",
-		     inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, INET6_ADDRSTRLEN),
-		     VTY_NEWLINE);
-	}
+	show_ip_bgp_scan_nexthop (vty, rn, bnc, detail);
   }
 #endif /* HAVE_IPV6 */
 
@@ -1438,19 +1626,20 @@ bgp_scan_init (void)
   zlookup->sock = -1;
   zlookup->t_connect = thread_add_event (master, zlookup_connect, zlookup, 0);
 
+  zlookup_queries = list_new ();
+  zlookup_queries->del = zlookup_query_free;
+
+  bgp_nexthop_reg_s = stream_new (ZEBRA_MAX_PACKET_SIZ);
+
   bgp_scan_interval = BGP_SCAN_INTERVAL_DEFAULT;
   bgp_import_interval = BGP_IMPORT_INTERVAL_DEFAULT;
 
-  cache1_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
-  cache2_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
-  bgp_nexthop_cache_table[AFI_IP] = cache1_table[AFI_IP];
+  bgp_nexthop_cache_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
 
   bgp_connected_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
 
 #ifdef HAVE_IPV6
-  cache1_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
-  cache2_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
-  bgp_nexthop_cache_table[AFI_IP6] = cache1_table[AFI_IP6];
+  bgp_nexthop_cache_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
   bgp_connected_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
 #endif /* HAVE_IPV6 */
 
@@ -1473,27 +1662,26 @@ bgp_scan_init (void)
 void
 bgp_scan_finish (void)
 {
-  /* Only the current one needs to be reset. */
-  bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP]);
+  list_delete (zlookup_queries);
+  zlookup_queries = NULL;
+
+  THREAD_OFF (bgp_nexthop_reg_thread);
+  stream_free (bgp_nexthop_reg_s);
+  bgp_nexthop_reg_s = NULL;
 
-  bgp_table_unlock (cache1_table[AFI_IP]);
-  cache1_table[AFI_IP] = NULL;
+  bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP]);
 
-  bgp_table_unlock (cache2_table[AFI_IP]);
-  cache2_table[AFI_IP] = NULL;
+  bgp_table_unlock (bgp_nexthop_cache_table[AFI_IP]);
+  bgp_nexthop_cache_table[AFI_IP] = NULL;
 
   bgp_table_unlock (bgp_connected_table[AFI_IP]);
   bgp_connected_table[AFI_IP] = NULL;
 
 #ifdef HAVE_IPV6
-  /* Only the current one needs to be reset. */
   bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP6]);
 
-  bgp_table_unlock (cache1_table[AFI_IP6]);
-  cache1_table[AFI_IP6] = NULL;
-
-  bgp_table_unlock (cache2_table[AFI_IP6]);
-  cache2_table[AFI_IP6] = NULL;
+  bgp_table_unlock (bgp_nexthop_cache_table[AFI_IP6]);
+  bgp_nexthop_cache_table[AFI_IP6] = NULL;
 
   bgp_table_unlock (bgp_connected_table[AFI_IP6]);
   bgp_connected_table[AFI_IP6] = NULL;
@@ -22,6 +22,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define _QUAGGA_BGP_NEXTHOP_H
 
 #include "if.h"
+#include "zclient.h"
 
 #define BGP_SCAN_INTERVAL_DEFAULT   60
 #define BGP_IMPORT_INTERVAL_DEFAULT 15
@@ -44,12 +45,24 @@ struct bgp_nexthop_cache
   /* Nexthop number and nexthop linked list.*/
   u_char nexthop_num;
   struct nexthop *nexthop;
+
+  /* Node in the nexthop cache table. */
+  struct bgp_node *node;
+
+  /* Paths depending on this nexthop, linked through bgp_info nh_next. */
+  struct bgp_info *path;
+  unsigned long path_count;
+
+  /* When reachability, IGP metric or IGP nexthops last changed. */
+  time_t last_change;
 };
 
 extern void bgp_scan_init (void);
 extern void bgp_scan_finish (void);
-extern int bgp_nexthop_lookup (afi_t, struct peer *peer, struct bgp_info *,
-			int *, int *);
+extern int bgp_nexthop_track (afi_t, struct bgp_info *);
+extern void bgp_nexthop_detach (struct bgp_info *);
+extern int bgp_nexthop_update (int, struct zclient *, uint16_t);
+extern void bgp_nexthop_zebra_connected (struct zclient *);
 extern void bgp_connected_add (struct connected *c);
 extern void bgp_connected_delete (struct connected *c);
 extern int bgp_multiaccess_check_v4 (struct in_addr, char *);
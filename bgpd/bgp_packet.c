@@ -39,6 +39,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_fsm.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
 #include "bgpd/bgp_open.h"
 #include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_community.h"
@@ -47,6 +48,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
@@ -92,22 +94,23 @@ bgp_packet_add (struct peer *peer, struct stream *s)
   stream_fifo_push (peer->obuf, s);
 }
 
-/* Free first packet. */
-static void
-bgp_packet_delete (struct peer *peer)
-{
-  stream_free (stream_fifo_pop (peer->obuf));
-}
-
-/* Check file descriptor whether connect is established. */
-static void
-bgp_connect_check (struct peer *peer)
+/* Check file descriptor whether connect is established.  Called for
+   whichever of readable or writable comes first. */
+int
+bgp_connect_check (struct thread *thread)
 {
+  struct peer *peer;
   int status;
   socklen_t slen;
   int ret;
 
+  peer = THREAD_ARG (thread);
+
   /* Anyway I have to reset read and write thread. */
+  if (peer->t_read == thread)
+    peer->t_read = NULL;
+  else
+    peer->t_write = NULL;
   BGP_READ_OFF (peer->t_read);
   BGP_WRITE_OFF (peer->t_write);
 
@@ -120,7 +123,7 @@ bgp_connect_check (struct peer *peer)
     {
       zlog (peer->log, LOG_INFO, "can't get sockopt for nonblocking connect");
       BGP_EVENT_ADD (peer, TCP_fatal_error);
-      return;
+      return 0;
     }      
 
   /* When status is 0 then TCP connection is established. */
@@ -135,6 +138,37 @@ bgp_connect_check (struct peer *peer)
 		     peer->host, safe_strerror (errno));
       BGP_EVENT_ADD (peer, TCP_connection_open_failed);
     }
+  return 0;
+}
+
+/* Bookkeeping once a prefix has been put into an UPDATE for the peer.
+   Returns the next advertisement with the same attribute, if any.  */
+static struct bgp_advertise *
+bgp_update_packet_sent (struct peer *peer, struct bgp_advertise *adv,
+			afi_t afi, safi_t safi)
+{
+  struct bgp_node *rn = adv->rn;
+  struct bgp_adj_out *adj = adv->adj;
+
+  if (BGP_DEBUG (update, UPDATE_OUT))
+    {
+      char buf[INET6_BUFSIZ];
+
+      zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
+	    peer->host,
+	    inet_ntop (rn->p.family, &(rn->p.u.prefix), buf, INET6_BUFSIZ),
+	    rn->p.prefixlen);
+    }
+
+  /* Synchnorize attribute.  */
+  if (adj->attr)
+    bgp_attr_unintern (&adj->attr);
+  else
+    peer->scount[afi][safi]++;
+
+  adj->attr = bgp_attr_intern (adv->baa->attr);
+
+  return bgp_advertise_clean (peer, adj, afi, safi);
 }
 
 /* Make BGP update packet.  */
@@ -143,28 +177,49 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
   struct stream *snlri;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct stream *packet;
   struct bgp_node *rn = NULL;
   struct bgp_info *binfo = NULL;
+  struct bgp_updgrp_pkt *pkt;
+  struct attr *attr = NULL;
+  struct peer *from = NULL;
   bgp_size_t total_attr_len = 0;
   unsigned long attrlen_pos = 0;
   size_t mpattrlen_pos = 0;
   size_t mpattr_pos = 0;
+  unsigned int count = 0;
+  unsigned int i;
+
+  adv = BGP_ADV_FIFO_HEAD (&peer->sync[afi][safi]->update);
+  if (! adv)
+    return NULL;
+
+  /* Another peer in the same update-group may already have built
+     exactly this UPDATE.  */
+  pkt = bgp_updgrp_pkt_lookup (peer, afi, safi, adv);
+  if (pkt)
+    {
+      for (i = 0; i < pkt->count; i++)
+	adv = bgp_update_packet_sent (peer, adv, afi, safi);
+
+      packet = bgp_updgrp_pkt_use (peer, afi, safi, pkt);
+      bgp_packet_add (peer, packet);
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return packet;
+    }
 
   s = peer->work;
   stream_reset (s);
   snlri = peer->scratch;
   stream_reset (snlri);
 
-  adv = BGP_ADV_FIFO_HEAD (&peer->sync[afi][safi]->update);
+  pkt = bgp_updgrp_pkt_new (peer, afi, safi);
 
   while (adv)
     {
       assert (adv->rn);
       rn = adv->rn;
-      adj = adv->adj;
       if (adv->binfo)
         binfo = adv->binfo;
 
@@ -176,10 +231,9 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
       /* If packet is empty, set attribute. */
       if (stream_empty (s))
 	{
-	  struct peer *from = NULL;
-
           if (binfo)
 	    from = binfo->peer;
+	  attr = adv->baa->attr;
 
 	  /* 1: Write the BGP message header - 16 bytes marker, 2 bytes length,
 	   * one byte message type.
@@ -224,25 +278,12 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 						    adv->baa->attr);
 	  bgp_packet_mpattr_prefix(snlri, afi, safi, &rn->p, prd, tag);
 	}
-      if (BGP_DEBUG (update, UPDATE_OUT))
-        {
-          char buf[INET6_BUFSIZ];
-
-          zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
-                peer->host,
-                inet_ntop (rn->p.family, &(rn->p.u.prefix), buf, INET6_BUFSIZ),
-                rn->p.prefixlen);
-        }
 
-      /* Synchnorize attribute.  */
-      if (adj->attr)
-	bgp_attr_unintern (&adj->attr);
-      else
-	peer->scount[afi][safi]++;
+      if (pkt)
+	bgp_updgrp_pkt_add_prefix (pkt, rn);
+      count++;
 
-      adj->attr = bgp_attr_intern (adv->baa->attr);
-
-      adv = bgp_advertise_clean (peer, adj, afi, safi);
+      adv = bgp_update_packet_sent (peer, adv, afi, safi);
     }
 
   if (! stream_empty (s))
@@ -261,12 +302,16 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
       else
 	packet = stream_dup (s);
       bgp_packet_set_size (packet);
+      bgp_updgrp_pkt_commit (peer, afi, safi, pkt, packet, attr, from, count);
       bgp_packet_add (peer, packet);
       BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
       stream_reset (s);
       stream_reset (snlri);
       return packet;
     }
+
+  if (pkt)
+    bgp_updgrp_pkt_discard (pkt);
   return NULL;
 }
 
@@ -673,63 +718,38 @@ bgp_write_proceed (struct peer *peer)
   return 0;
 }
 
-/* Write packet to the peer. */
+/* Hand packets to the I/O thread while it has room for them, as many
+   at a time as BGP_WRITE_PACKET_MAX. */
 int
 bgp_write (struct thread *thread)
 {
   struct peer *peer;
   u_char type;
   struct stream *s; 
-  int num;
-  unsigned int count = 0;
+  struct stream_fifo batch;
+  unsigned int room, max, count;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
   peer->t_write = NULL;
 
-  /* For non-blocking IO check. */
-  if (peer->status == Connect)
-    {
-      bgp_connect_check (peer);
-      return 0;
-    }
-
-  s = bgp_write_packet (peer);
-  if (!s)
-    return 0;	/* nothing to send */
+  /* Not connected yet.  bgp_connect_success starts the I/O. */
+  if (! peer->io)
+    return 0;
 
-  sockopt_cork (peer->fd, 1);
+  /* When full, the I/O thread asks for more once it wrote some. */
+  room = bgp_io_write_room (peer);
+  max = MIN (room, BGP_WRITE_PACKET_MAX);
 
-  /* Nonblocking write until TCP output buffer is full.  */
-  do
+  memset (&batch, 0, sizeof (struct stream_fifo));
+  while (batch.count < max)
     {
-      int writenum;
-
-      /* Number of bytes to be sent.  */
-      writenum = stream_get_endp (s) - stream_get_getp (s);
-
-      /* Call write() system call.  */
-      num = write (peer->fd, STREAM_PNT (s), writenum);
-      if (num < 0)
-	{
-	  /* write failed either retry needed or error */
-	  if (ERRNO_IO_RETRY(errno))
-		break;
-
-          BGP_EVENT_ADD (peer, TCP_fatal_error);
-	  return 0;
-	}
-
-      if (num != writenum)
-	{
-	  /* Partial write */
-	  stream_forward_getp (s, num);
-	  break;
-	}
+      s = bgp_write_packet (peer);
+      if (!s)
+	break;		/* nothing to send */
 
       /* Retrieve BGP packet type. */
-      stream_set_getp (s, BGP_MARKER_SIZE + 2);
-      type = stream_getc (s);
+      type = stream_getc_from (s, BGP_MARKER_SIZE + 2);
 
       switch (type)
 	{
@@ -739,19 +759,6 @@ bgp_write (struct thread *thread)
 	case BGP_MSG_UPDATE:
 	  peer->update_out++;
 	  break;
-	case BGP_MSG_NOTIFY:
-	  peer->notify_out++;
-	  /* Double start timer. */
-	  peer->v_start *= 2;
-
-	  /* Overflow check. */
-	  if (peer->v_start >= (60 * 2))
-	    peer->v_start = (60 * 2);
-
-	  /* Flush any existing events */
-	  BGP_EVENT_ADD (peer, BGP_Stop);
-	  goto done;
-
 	case BGP_MSG_KEEPALIVE:
 	  peer->keepalive_out++;
 	  break;
@@ -764,17 +771,24 @@ bgp_write (struct thread *thread)
 	  break;
 	}
 
-      /* OK we send packet so delete it. */
-      bgp_packet_delete (peer);
+      s = stream_fifo_pop (peer->obuf);
+      s->next = NULL;
+      stream_fifo_push (&batch, s);
     }
-  while (++count < BGP_WRITE_PACKET_MAX &&
-	 (s = bgp_write_packet (peer)) != NULL);
-  
-  if (bgp_write_proceed (peer))
+
+  count = batch.count;
+  if (! count)
+    return 0;
+
+  /* The I/O thread frees them once written, and empties the batch. */
+  bgp_io_write_packets (peer, &batch);
+
+  /* Let the others have their turn before the rest, unless the I/O
+     thread is full and will ask for more itself. */
+  if (count == BGP_WRITE_PACKET_MAX && room > count
+      && bgp_write_proceed (peer))
     BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 
- done:
-  sockopt_cork (peer->fd, 0);
   return 0;
 }
 
@@ -792,8 +806,9 @@ bgp_write_notify (struct peer *peer)
     return 0;
   assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
 
-  /* Stop collecting data within the socket */
-  sockopt_cork (peer->fd, 0);
+  /* Take the socket back from the I/O thread, this is the last we
+     write to it. */
+  bgp_io_stop (peer);
 
   /* socket is in nonblocking mode, if we can't deliver the NOTIFY, well,
    * we only care about getting a clean shutdown at this point. */
@@ -1450,6 +1465,7 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
       /* Transfer file descriptor. */
       realpeer->fd = peer->fd;
       peer->fd = -1;
+      bgp_io_transfer (peer, realpeer);
 
       /* Transfer input buffer. */
       stream_free (realpeer->ibuf);
@@ -1470,7 +1486,6 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
 		    peer->fd);
 	  return -1;
 	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
     }
 
   /* remote router-id check. */
@@ -1605,6 +1620,7 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   struct stream *s;
   struct attr attr;
   struct attr_extra extra;
+  struct attr *pattr = &attr;
   bgp_size_t attribute_len;
   bgp_size_t update_len;
   bgp_size_t withdraw_len;
@@ -1715,18 +1731,24 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   /* This define morphs the update case into a withdraw when lower levels
    * have signalled an error condition where this is best.
    */
-#define NLRI_ATTR_ARG (attr_parse_ret != BGP_ATTR_PARSE_WITHDRAW ? &attr : NULL)
+#define NLRI_ATTR_ARG (attr_parse_ret != BGP_ATTR_PARSE_WITHDRAW ? pattr : NULL)
 
-  /* Parse attribute when it exists. */
-  if (attribute_len)
+  /* Parse attribute when it exists, unless the peer sent the same
+     lately: then they are interned already, and attr stays empty. */
+  if (attribute_len
+      && (pattr = bgp_attr_cache_get (peer, attribute_len)) == NULL)
     {
+      pattr = &attr;
       attr_parse_ret = bgp_attr_parse (peer, &attr, attribute_len, 
 			    &mp_update, &mp_withdraw);
       if (attr_parse_ret == BGP_ATTR_PARSE_ERROR)
 	{
 	  bgp_attr_unintern_sub (&attr);
+	  bgp_attr_parse_reset ();
 	  return -1;
 	}
+      if (attr_parse_ret == BGP_ATTR_PARSE_PROCEED)
+	pattr = bgp_attr_cache_set (peer, &attr);
     }
   
   /* Logging the attribute. */
@@ -1736,7 +1758,7 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
       char attrstr[BUFSIZ];
       attrstr[0] = '\0';
 
-      ret= bgp_dump_attr (peer, &attr, attrstr, BUFSIZ);
+      ret= bgp_dump_attr (peer, pattr, attrstr, BUFSIZ);
       int lvl = (attr_parse_ret == BGP_ATTR_PARSE_WITHDRAW)
                  ? LOG_ERR : LOG_DEBUG;
       
@@ -1760,6 +1782,7 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
       if (ret < 0)
         {
           bgp_attr_unintern_sub (&attr);
+          bgp_attr_parse_reset ();
 	  return -1;
 	}
 
@@ -1919,8 +1942,10 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
     }
 
   /* Everything is done.  We unintern temporary structures which
-     interned in bgp_attr_parse(). */
+     interned in bgp_attr_parse(), and free the parse temporaries in one
+     go. */
   bgp_attr_unintern_sub (&attr);
+  bgp_attr_parse_reset ();
 
   /* If peering is stopped due to some reason, do not generate BGP
      event.  */
@@ -2375,74 +2400,32 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
-/* BGP read utility function. */
-static int
-bgp_read_packet (struct peer *peer)
+/* The connection is gone, error is errno or 0 if the peer closed. */
+static void
+bgp_read_error (struct peer *peer, int error)
 {
-  int nbytes;
-  int readsize;
-
-  readsize = peer->packet_size - stream_get_endp (peer->ibuf);
-
-  /* If size is zero then return. */
-  if (! readsize)
-    return 0;
-
-  /* Read packet from fd. */
-  nbytes = stream_read_try (peer->ibuf, peer->fd, readsize);
-
-  /* If read byte is smaller than zero then error occured. */
-  if (nbytes < 0) 
-    {
-      /* Transient error should retry */
-      if (nbytes == -2)
-	return -1;
-
-      plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
-		 peer->host, safe_strerror (errno));
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_fatal_error);
-      return -1;
-    }  
-
-  /* When read byte is zero : clear bgp peer and return */
-  if (nbytes == 0) 
+  if (error)
+    plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
+	      peer->host, safe_strerror (error));
+  else if (BGP_DEBUG (events, EVENTS))
+    plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
+		peer->host, peer->fd);
+
+  if (peer->status == Established) 
     {
-      if (BGP_DEBUG (events, EVENTS))
-	plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
-		   peer->host, peer->fd);
-
-      if (peer->status == Established) 
+      if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
 	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
+	  peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
+	  SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
 	}
-
-      BGP_EVENT_ADD (peer, TCP_connection_closed);
-      return -1;
+      else
+	peer->last_reset = PEER_DOWN_CLOSE_SESSION;
     }
 
-  /* We read partial packet. */
-  if (stream_get_endp (peer->ibuf) != peer->packet_size)
-    return -1;
-
-  return 0;
+  if (error)
+    BGP_EVENT_ADD (peer, TCP_fatal_error);
+  else
+    BGP_EVENT_ADD (peer, TCP_connection_closed);
 }
 
 /* Marker check. */
@@ -2467,11 +2450,14 @@ bgp_recent_clock (void)
   return recent_relative_time().tv_sec;
 }
 
-/* Starting point of packet process function. */
+/* Starting point of packet process function.  Takes one message the
+   I/O thread framed, and comes back for the next after other events
+   had their turn. */
 int
 bgp_read (struct thread *thread)
 {
   int ret;
+  int error = 0;
   u_char type = 0;
   struct peer *peer;
   bgp_size_t size;
@@ -2481,102 +2467,82 @@ bgp_read (struct thread *thread)
   peer = THREAD_ARG (thread);
   peer->t_read = NULL;
 
-  /* For non-blocking IO check. */
-  if (peer->status == Connect)
+  if (! peer->ibuf)
+    return 0;
+
+  ret = bgp_io_read_packet (peer, peer->ibuf, &error);
+  if (ret == 0)
+    return 0;
+  if (ret < 0)
     {
-      bgp_connect_check (peer);
+      bgp_read_error (peer, error);
       goto done;
     }
-  else
-    {
-      if (peer->fd < 0)
-	{
-	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
-	  return -1;
-	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
-    }
-
-  /* Read packet header to determine type of the packet */
-  if (peer->packet_size == 0)
-    peer->packet_size = BGP_HEADER_SIZE;
-
-  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
-    {
-      ret = bgp_read_packet (peer);
+  BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
 
-      /* Header read error or partial read packet. */
-      if (ret < 0) 
-	goto done;
+  /* Get size and type. */
+  stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
+  memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
+  size = stream_getw (peer->ibuf);
+  type = stream_getc (peer->ibuf);
 
-      /* Get size and type. */
-      stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
-      memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
-      size = stream_getw (peer->ibuf);
-      type = stream_getc (peer->ibuf);
-
-      if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
-	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
-		   peer->host, type, size - BGP_HEADER_SIZE);
-
-      /* Marker check */
-      if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
-	  && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
-	{
-	  bgp_notify_send (peer,
-			   BGP_NOTIFY_HEADER_ERR, 
-			   BGP_NOTIFY_HEADER_NOT_SYNC);
-	  goto done;
-	}
+  if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
+    zlog_debug ("%s rcv message type %d, length (excl. header) %d",
+	       peer->host, type, size - BGP_HEADER_SIZE);
 
-      /* BGP type check. */
-      if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
-	  && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
-	  && type != BGP_MSG_ROUTE_REFRESH_NEW
-	  && type != BGP_MSG_ROUTE_REFRESH_OLD
-	  && type != BGP_MSG_CAPABILITY)
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s unknown message type 0x%02x",
-		      peer->host, type);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			 	     BGP_NOTIFY_HEADER_BAD_MESTYPE,
-				     &type, 1);
-	  goto done;
-	}
-      /* Mimimum packet length check. */
-      if ((size < BGP_HEADER_SIZE)
-	  || (size > BGP_MAX_PACKET_SIZE)
-	  || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
-	  || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
-	  || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
-	  || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s bad message length - %d for %s",
-		      peer->host, size, 
-		      type == 128 ? "ROUTE-REFRESH" :
-		      bgp_type_str[(int) type]);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			  	     BGP_NOTIFY_HEADER_BAD_MESLEN,
-				     (u_char *) notify_data_length, 2);
-	  goto done;
-	}
+  /* Marker check */
+  if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
+      && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
+    {
+      bgp_notify_send (peer,
+		       BGP_NOTIFY_HEADER_ERR, 
+		       BGP_NOTIFY_HEADER_NOT_SYNC);
+      goto done;
+    }
 
-      /* Adjust size to message length. */
-      peer->packet_size = size;
+  /* BGP type check. */
+  if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
+      && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
+      && type != BGP_MSG_ROUTE_REFRESH_NEW
+      && type != BGP_MSG_ROUTE_REFRESH_OLD
+      && type != BGP_MSG_CAPABILITY)
+    {
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s unknown message type 0x%02x",
+		  peer->host, type);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESTYPE,
+				 &type, 1);
+      goto done;
+    }
+  /* Mimimum packet length check. */
+  if ((size < BGP_HEADER_SIZE)
+      || (size > BGP_MAX_PACKET_SIZE)
+      || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
+      || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
+      || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
+      || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
+    {
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s bad message length - %d for %s",
+		  peer->host, size, 
+		  type == 128 ? "ROUTE-REFRESH" :
+		  bgp_type_str[(int) type]);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESLEN,
+				 (u_char *) notify_data_length, 2);
+      goto done;
     }
 
-  ret = bgp_read_packet (peer);
-  if (ret < 0) 
-    goto done;
+  /* Adjust size to message length. */
+  peer->packet_size = size;
 
   /* Get size and type again. */
   size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
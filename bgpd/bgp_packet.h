@@ -24,7 +24,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_NLRI_LENGTH       1U
 #define BGP_TOTAL_ATTR_LEN    2U
 #define BGP_UNFEASIBLE_LEN    2U
-#define BGP_WRITE_PACKET_MAX 10U
+
+/* Packets bgp_write builds and hands to the I/O thread in one go. */
+#define BGP_WRITE_PACKET_MAX 32U
 
 /* When to refresh */
 #define REFRESH_IMMEDIATE 1
@@ -40,6 +42,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 /* Packet send and receive function prototypes. */
 extern int bgp_read (struct thread *);
 extern int bgp_write (struct thread *);
+extern int bgp_connect_check (struct thread *);
 
 extern void bgp_keepalive_send (struct peer *);
 extern void bgp_open_send (struct peer *);
@@ -23,6 +23,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "command.h"
 #include "memory.h"
+#include "hash.h"
+#include "jhash.h"
 
 #include "bgpd.h"
 #include "bgp_aspath.h"
@@ -33,8 +35,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
    (^|[,{}() ]|$) */
 
-regex_t *
-bgp_regcomp (const char *regstr)
+static char *
+bgp_regex_magic (const char *regstr)
 {
   /* Convert _ character to generic regular expression. */
   int i, j;
@@ -42,8 +44,6 @@ bgp_regcomp (const char *regstr)
   int magic = 0;
   char *magic_str;
   char magic_regexp[] = "(^|[,{}() ]|$)";
-  int ret;
-  regex_t *regex;
 
   len = strlen (regstr);
   for (i = 0; i < len; i++)
@@ -64,6 +64,18 @@ bgp_regcomp (const char *regstr)
     }
   magic_str[j] = '\0';
 
+  return magic_str;
+}
+
+regex_t *
+bgp_regcomp (const char *regstr)
+{
+  char *magic_str;
+  int ret;
+  regex_t *regex;
+
+  magic_str = bgp_regex_magic (regstr);
+
   regex = XMALLOC (MTYPE_BGP_REGEXP, sizeof (regex_t));
 
   ret = regcomp (regex, magic_str, REG_EXTENDED|REG_NOSUB);
@@ -82,7 +94,7 @@ bgp_regcomp (const char *regstr)
 int
 bgp_regexec (regex_t *regex, struct aspath *aspath)
 {
-  return regexec (regex, aspath->str, 0, NULL, 0);
+  return regexec (regex, aspath_print (aspath), 0, NULL, 0);
 }
 
 void
@@ -91,3 +103,894 @@ bgp_regex_free (regex_t *regex)
   regfree (regex);
   XFREE (MTYPE_BGP_REGEXP, regex);
 }
+
+/* AS path regular expressions, run on the segments.
+
+   An AS path prints as nothing but digits and the few characters in
+   asre_chars, so a regex over its string needs no more than that many
+   symbols.  bgp_aspath_regcomp parses the extended regex, `_' made
+   magic as above, into an NFA over those symbols, and
+   bgp_aspath_regexec runs it as a DFA over the characters of the path
+   as they would be printed, taken from the segments as it goes: no
+   string is made, and there is no backtracking.  DFA states are made
+   when first reached and kept, so that once the paths seen have been
+   through the automaton, each character is a table lookup.
+
+   What the parser is not sure of, back-references and GNU extensions
+   and the like, makes bgp_aspath_regcomp return NULL, and the caller
+   should use bgp_regexec instead. */
+
+static const char asre_chars[] = "0123456789 ,{}()[]";
+#define ASRE_SYMS	(sizeof (asre_chars) - 1)
+#define ASRE_ALL	((1U << ASRE_SYMS) - 1)
+
+#define ASRE_SYM_SPACE	10
+#define ASRE_SYM_COMMA	11
+
+/* Limits on the regex, beyond which bgp_regexec is left to do it. */
+#define ASRE_NODES_MAX	1024
+#define ASRE_STATES_MAX	2048
+#define ASRE_REPEAT_MAX	255
+
+/* DFA states kept before they are all thrown away to start again. */
+#define ASRE_DSTATES_MAX 4096
+
+/* Parse tree. */
+enum asre_op
+{
+  ASRE_EMPTY,
+  ASRE_SET,
+  ASRE_BOL,
+  ASRE_EOL,
+  ASRE_CAT,
+  ASRE_ALT,
+  ASRE_REPEAT
+};
+
+struct asre_node
+{
+  enum asre_op op;
+  u_int32_t set;
+  int min;
+  int max;			/* -1 for no limit. */
+  struct asre_node *left;
+  struct asre_node *right;
+};
+
+struct asre_parse
+{
+  const char *p;
+  struct asre_node node[ASRE_NODES_MAX];
+  int count;
+  int error;
+};
+
+/* NFA states. */
+enum asre_type
+{
+  ASRE_S_SET,
+  ASRE_S_SPLIT,
+  ASRE_S_BOL,
+  ASRE_S_EOL,
+  ASRE_S_MATCH
+};
+
+struct asre_state
+{
+  enum asre_type type;
+  u_int32_t set;
+  int out;
+  int out1;
+};
+
+/* DFA state: the NFA states it stands for, and where each symbol
+   takes it, -1 until worked out. */
+struct asre_dstate
+{
+  struct aspath_regex *re;
+  int index;
+  int next[ASRE_SYMS];
+
+  /* A match has been found by the time this state is reached. */
+  u_char accept;
+
+  /* A match if the path ends in this state. */
+  u_char accept_end;
+
+  /* No NFA states left, and none to come: nothing after can match. */
+  u_char dead;
+
+  u_int32_t set[];
+};
+
+struct aspath_regex
+{
+  struct asre_state *state;
+  int nstates;
+  int start;
+  int match;
+
+  /* Bitsets of NFA states are this many words. */
+  int nwords;
+
+  /* NFA states the start goes to anywhere but the beginning, which
+     every step adds, since the regex may match from any position. */
+  u_int32_t *restart;
+
+  /* Whether the empty path matches. */
+  int empty;
+
+  /* DFA states, by index and by NFA state set. */
+  struct asre_dstate **dstate;
+  int ndstates;
+  struct hash *dhash;
+  int initial;
+
+  /* Room for working out closures and steps. */
+  u_int32_t *visit;
+  u_int32_t *work;
+  u_int32_t *move;
+  int *stack;
+};
+
+#define ASRE_SET_BIT(set, i)	((set)[(i) / 32] |= 1U << ((i) % 32))
+#define ASRE_TEST_BIT(set, i)	((set)[(i) / 32] & (1U << ((i) % 32)))
+
+static int
+asre_sym (char c)
+{
+  const char *p;
+
+  if (c == '\0' || (p = strchr (asre_chars, c)) == NULL)
+    return -1;
+  return p - asre_chars;
+}
+
+static u_int32_t
+asre_char_set (char c)
+{
+  int sym = asre_sym (c);
+
+  /* Anything else never appears in an AS path. */
+  return sym < 0 ? 0 : 1U << sym;
+}
+
+static struct asre_node *
+asre_node (struct asre_parse *ps, enum asre_op op)
+{
+  struct asre_node *node;
+
+  if (ps->count == ASRE_NODES_MAX)
+    {
+      ps->error = 1;
+      return &ps->node[0];
+    }
+  node = &ps->node[ps->count++];
+  memset (node, 0, sizeof (struct asre_node));
+  node->op = op;
+  return node;
+}
+
+static struct asre_node *asre_parse_alt (struct asre_parse *);
+
+/* Character class, after the "[:". */
+static int
+asre_parse_class (struct asre_parse *ps, u_int32_t *set)
+{
+  static const struct
+  {
+    const char *name;
+    const char *chars;
+  } classes[] =
+  {
+    { "digit",  "0123456789" },
+    { "xdigit", "0123456789" },
+    { "alnum",  "0123456789" },
+    { "alpha",  "" },
+    { "upper",  "" },
+    { "lower",  "" },
+    { "cntrl",  "" },
+    { "space",  " " },
+    { "blank",  " " },
+    { "punct",  ",{}()[]" },
+    { "graph",  "0123456789,{}()[]" },
+    { "print",  "0123456789 ,{}()[]" },
+  };
+  const char *end;
+  size_t i, len;
+
+  end = strstr (ps->p, ":]");
+  if (end == NULL)
+    return -1;
+  len = end - ps->p;
+
+  for (i = 0; i < array_size (classes); i++)
+    if (strlen (classes[i].name) == len
+	&& strncmp (classes[i].name, ps->p, len) == 0)
+      {
+	const char *c;
+
+	for (c = classes[i].chars; *c; c++)
+	  *set |= asre_char_set (*c);
+	ps->p = end + 2;
+	return 0;
+      }
+  return -1;
+}
+
+/* Bracket expression, after the '['. */
+static struct asre_node *
+asre_parse_bracket (struct asre_parse *ps)
+{
+  struct asre_node *node;
+  u_int32_t set = 0;
+  int negate = 0;
+  int first = 1;
+
+  if (*ps->p == '^')
+    {
+      negate = 1;
+      ps->p++;
+    }
+
+  while (*ps->p != ']' || first)
+    {
+      char lo, hi;
+      const char *c;
+
+      first = 0;
+      if (*ps->p == '\0')
+	{
+	  ps->error = 1;
+	  return asre_node (ps, ASRE_EMPTY);
+	}
+
+      if (ps->p[0] == '[' && ps->p[1] == ':')
+	{
+	  ps->p += 2;
+	  if (asre_parse_class (ps, &set) < 0)
+	    {
+	      ps->error = 1;
+	      return asre_node (ps, ASRE_EMPTY);
+	    }
+	  continue;
+	}
+      if (ps->p[0] == '[' && (ps->p[1] == '.' || ps->p[1] == '='))
+	{
+	  ps->error = 1;
+	  return asre_node (ps, ASRE_EMPTY);
+	}
+
+      lo = hi = *ps->p++;
+      if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0')
+	{
+	  hi = ps->p[1];
+	  ps->p += 2;
+	  if ((unsigned char) lo > (unsigned char) hi || hi == '[')
+	    {
+	      ps->error = 1;
+	      return asre_node (ps, ASRE_EMPTY);
+	    }
+	}
+
+      for (c = asre_chars; *c; c++)
+	if ((unsigned char) *c >= (unsigned char) lo
+	    && (unsigned char) *c <= (unsigned char) hi)
+	  set |= asre_char_set (*c);
+    }
+  ps->p++;
+
+  node = asre_node (ps, ASRE_SET);
+  node->set = negate ? ASRE_ALL & ~set : set;
+  return node;
+}
+
+static struct asre_node *
+asre_parse_atom (struct asre_parse *ps)
+{
+  struct asre_node *node;
+  char c = *ps->p++;
+
+  switch (c)
+    {
+    case '(':
+      node = asre_parse_alt (ps);
+      if (*ps->p != ')')
+	ps->error = 1;
+      else
+	ps->p++;
+      return node;
+    case '[':
+      return asre_parse_bracket (ps);
+    case '.':
+      node = asre_node (ps, ASRE_SET);
+      node->set = ASRE_ALL;
+      return node;
+    case '^':
+      return asre_node (ps, ASRE_BOL);
+    case '$':
+      return asre_node (ps, ASRE_EOL);
+    case '\\':
+      c = *ps->p++;
+      /* Back-references and GNU's \w, \b, \< and so on. */
+      if (c == '\0' || isalnum ((unsigned char) c))
+	ps->error = 1;
+      break;
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+      /* Nothing to repeat. */
+      ps->error = 1;
+      break;
+    }
+
+  node = asre_node (ps, ASRE_SET);
+  node->set = asre_char_set (c);
+  return node;
+}
+
+/* Interval, after the '{'. */
+static int
+asre_parse_interval (struct asre_parse *ps, int *min, int *max)
+{
+  char *end;
+
+  *min = 0;
+  if (isdigit ((unsigned char) *ps->p))
+    {
+      *min = strtol (ps->p, &end, 10);
+      ps->p = end;
+    }
+  *max = *min;
+  if (*ps->p == ',')
+    {
+      ps->p++;
+      *max = -1;
+      if (isdigit ((unsigned char) *ps->p))
+	{
+	  *max = strtol (ps->p, &end, 10);
+	  ps->p = end;
+	}
+    }
+  if (*ps->p != '}' || *min > ASRE_REPEAT_MAX || *max > ASRE_REPEAT_MAX
+      || (*max >= 0 && *max < *min))
+    return -1;
+  ps->p++;
+  return 0;
+}
+
+/* Whether an anchor is somewhere in the subtree. */
+static int
+asre_has_anchor (struct asre_node *node)
+{
+  if (node == NULL)
+    return 0;
+  if (node->op == ASRE_BOL || node->op == ASRE_EOL)
+    return 1;
+  return asre_has_anchor (node->left) || asre_has_anchor (node->right);
+}
+
+static struct asre_node *
+asre_parse_repeat (struct asre_parse *ps)
+{
+  struct asre_node *node, *atom;
+  int min, max;
+
+  node = asre_parse_atom (ps);
+  while (! ps->error)
+    {
+      switch (*ps->p++)
+	{
+	case '*':
+	  min = 0, max = -1;
+	  break;
+	case '+':
+	  min = 1, max = -1;
+	  break;
+	case '?':
+	  min = 0, max = 1;
+	  break;
+	case '{':
+	  if (asre_parse_interval (ps, &min, &max) < 0)
+	    ps->error = 1;
+	  break;
+	default:
+	  ps->p--;
+	  return node;
+	}
+
+      /* Repeated anchors are left to the C library, and so is anything
+	 with an anchor in it repeated by copying it, as glibc does for
+	 '+' and intervals: it does not check the anchors in the copies,
+	 so "2( |^3){2}" matches "2 3". */
+      if (node->op == ASRE_BOL || node->op == ASRE_EOL
+	  || (asre_has_anchor (node) && (max < 0 ? min > 0 : max > 1)))
+	ps->error = 1;
+      if (ps->error)
+	return node;
+
+      atom = node;
+      node = asre_node (ps, ASRE_REPEAT);
+      node->left = atom;
+      node->min = min;
+      node->max = max;
+    }
+  return node;
+}
+
+static struct asre_node *
+asre_parse_cat (struct asre_parse *ps)
+{
+  struct asre_node *node = NULL, *cat;
+
+  while (*ps->p && *ps->p != '|' && *ps->p != ')' && ! ps->error)
+    {
+      struct asre_node *atom = asre_parse_repeat (ps);
+
+      if (node == NULL)
+	node = atom;
+      else
+	{
+	  cat = asre_node (ps, ASRE_CAT);
+	  cat->left = node;
+	  cat->right = atom;
+	  node = cat;
+	}
+    }
+  return node ? node : asre_node (ps, ASRE_EMPTY);
+}
+
+static struct asre_node *
+asre_parse_alt (struct asre_parse *ps)
+{
+  struct asre_node *node, *alt;
+
+  node = asre_parse_cat (ps);
+  while (*ps->p == '|' && ! ps->error)
+    {
+      ps->p++;
+      alt = asre_node (ps, ASRE_ALT);
+      alt->left = node;
+      alt->right = asre_parse_cat (ps);
+      node = alt;
+    }
+  return node;
+}
+
+static int
+asre_state_new (struct aspath_regex *re, enum asre_type type, int out,
+		int out1)
+{
+  struct asre_state *state;
+
+  if (re->nstates == ASRE_STATES_MAX)
+    return -1;
+  state = &re->state[re->nstates];
+  state->type = type;
+  state->set = 0;
+  state->out = out;
+  state->out1 = out1;
+  return re->nstates++;
+}
+
+/* Make the NFA states for NODE, to go on to NEXT, and return the first
+   of them, or -1 if there are too many.  Built from the end backwards,
+   nothing needs patching up later but loops. */
+static int
+asre_gen (struct aspath_regex *re, struct asre_node *node, int next)
+{
+  int state, split, i;
+
+  if (next < 0)
+    return -1;
+
+  switch (node->op)
+    {
+    case ASRE_EMPTY:
+      return next;
+    case ASRE_SET:
+      state = asre_state_new (re, ASRE_S_SET, next, -1);
+      if (state >= 0)
+	re->state[state].set = node->set;
+      return state;
+    case ASRE_BOL:
+      return asre_state_new (re, ASRE_S_BOL, next, -1);
+    case ASRE_EOL:
+      return asre_state_new (re, ASRE_S_EOL, next, -1);
+    case ASRE_CAT:
+      return asre_gen (re, node->left, asre_gen (re, node->right, next));
+    case ASRE_ALT:
+      state = asre_gen (re, node->left, next);
+      split = asre_gen (re, node->right, next);
+      if (state < 0 || split < 0)
+	return -1;
+      return asre_state_new (re, ASRE_S_SPLIT, state, split);
+    case ASRE_REPEAT:
+      state = next;
+      if (node->max < 0)
+	{
+	  split = asre_state_new (re, ASRE_S_SPLIT, -1, next);
+	  if (split < 0)
+	    return -1;
+	  re->state[split].out = asre_gen (re, node->left, split);
+	  if (re->state[split].out < 0)
+	    return -1;
+	  state = split;
+	}
+      else
+	for (i = node->min; i < node->max && state >= 0; i++)
+	  {
+	    int copy = asre_gen (re, node->left, state);
+
+	    if (copy < 0)
+	      return -1;
+	    state = asre_state_new (re, ASRE_S_SPLIT, copy, next);
+	  }
+      for (i = 0; i < node->min && state >= 0; i++)
+	state = asre_gen (re, node->left, state);
+      return state;
+    }
+  return -1;
+}
+
+/* Add to SET the states reached from STATE without reading anything.
+   Only those which read, or are waiting for the end, or match are kept
+   in the set; the beginning and end are passed if AT_START, AT_END. */
+static void
+asre_closure (struct aspath_regex *re, u_int32_t *set, int state,
+	      int at_start, int at_end)
+{
+  int sp = 0;
+
+  memset (re->visit, 0, re->nwords * sizeof (u_int32_t));
+  re->stack[sp++] = state;
+
+  while (sp)
+    {
+      struct asre_state *st;
+
+      state = re->stack[--sp];
+      if (ASRE_TEST_BIT (re->visit, state))
+	continue;
+      ASRE_SET_BIT (re->visit, state);
+      st = &re->state[state];
+
+      switch (st->type)
+	{
+	case ASRE_S_SPLIT:
+	  re->stack[sp++] = st->out1;
+	  re->stack[sp++] = st->out;
+	  break;
+	case ASRE_S_BOL:
+	  if (at_start)
+	    re->stack[sp++] = st->out;
+	  break;
+	case ASRE_S_EOL:
+	  ASRE_SET_BIT (set, state);
+	  if (at_end)
+	    re->stack[sp++] = st->out;
+	  break;
+	case ASRE_S_SET:
+	case ASRE_S_MATCH:
+	  ASRE_SET_BIT (set, state);
+	  break;
+	}
+    }
+}
+
+/* Whether SET has the match state in it, if the path ended now. */
+static int
+asre_accepts (struct aspath_regex *re, u_int32_t *set, int at_end)
+{
+  int i;
+
+  if (! at_end)
+    return ASRE_TEST_BIT (set, re->match) ? 1 : 0;
+
+  memset (re->work, 0, re->nwords * sizeof (u_int32_t));
+  for (i = 0; i < re->nstates; i++)
+    if (ASRE_TEST_BIT (set, i))
+      asre_closure (re, re->work, i, 0, 1);
+  return ASRE_TEST_BIT (re->work, re->match) ? 1 : 0;
+}
+
+static unsigned int
+asre_dstate_key (const void *p)
+{
+  const struct asre_dstate *ds = p;
+
+  return jhash2 (ds->set, ds->re->nwords, 0);
+}
+
+static int
+asre_dstate_cmp (const void *p1, const void *p2)
+{
+  const struct asre_dstate *ds1 = p1, *ds2 = p2;
+
+  return ! memcmp (ds1->set, ds2->set, ds1->re->nwords * sizeof (u_int32_t));
+}
+
+static void
+asre_dstate_free (void *ds)
+{
+  XFREE (MTYPE_BGP_REGEXP_DFA, ds);
+}
+
+/* Throw the DFA away, when it has grown too big. */
+static void
+asre_dfa_flush (struct aspath_regex *re)
+{
+  hash_clean (re->dhash, asre_dstate_free);
+  re->ndstates = 0;
+  re->initial = -1;
+}
+
+static void *
+asre_dstate_intern (const void *ds)
+{
+  return (void *) ds;
+}
+
+/* The DFA state for the NFA states in SET, made if need be, or -1 if
+   there are too many already. */
+static int
+asre_dstate_get (struct aspath_regex *re, u_int32_t *set)
+{
+  struct asre_dstate *ds, *found;
+  size_t size;
+  unsigned int i;
+
+  size = sizeof (struct asre_dstate) + re->nwords * sizeof (u_int32_t);
+  ds = XMALLOC (MTYPE_BGP_REGEXP_DFA, size);
+  ds->re = re;
+  memcpy (ds->set, set, re->nwords * sizeof (u_int32_t));
+
+  found = hash_lookup (re->dhash, ds);
+  if (found)
+    {
+      XFREE (MTYPE_BGP_REGEXP_DFA, ds);
+      return found->index;
+    }
+  if (re->ndstates == ASRE_DSTATES_MAX)
+    {
+      XFREE (MTYPE_BGP_REGEXP_DFA, ds);
+      return -1;
+    }
+
+  for (i = 0; i < ASRE_SYMS; i++)
+    ds->next[i] = -1;
+  ds->accept = asre_accepts (re, ds->set, 0);
+  ds->accept_end = asre_accepts (re, ds->set, 1);
+  ds->dead = 1;
+  for (i = 0; i < (unsigned int) re->nwords; i++)
+    if (ds->set[i])
+      ds->dead = 0;
+  ds->index = re->ndstates++;
+  re->dstate[ds->index] = ds;
+  hash_get (re->dhash, ds, asre_dstate_intern);
+  return ds->index;
+}
+
+static int
+asre_initial (struct aspath_regex *re)
+{
+  if (re->initial < 0)
+    {
+      memset (re->move, 0, re->nwords * sizeof (u_int32_t));
+      asre_closure (re, re->move, re->start, 1, 0);
+      re->initial = asre_dstate_get (re, re->move);
+    }
+  return re->initial;
+}
+
+/* Where reading symbol SYM takes DFA state CUR. */
+static int
+asre_step (struct aspath_regex *re, int cur, int sym)
+{
+  struct asre_dstate *ds = re->dstate[cur];
+  int i, next;
+
+  if (ds->next[sym] >= 0)
+    return ds->next[sym];
+
+  memcpy (re->move, re->restart, re->nwords * sizeof (u_int32_t));
+  for (i = 0; i < re->nstates; i++)
+    if (ASRE_TEST_BIT (ds->set, i)
+	&& re->state[i].type == ASRE_S_SET
+	&& (re->state[i].set & (1U << sym)))
+      asre_closure (re, re->move, re->state[i].out, 0, 0);
+
+  next = asre_dstate_get (re, re->move);
+  if (next >= 0)
+    {
+      ds->next[sym] = next;
+      return next;
+    }
+
+  /* Too many states: start the DFA again from this one.  Making a
+     state takes re->work, and the initial one re->move as well, so
+     the initial state comes after. */
+  asre_dfa_flush (re);
+  next = asre_dstate_get (re, re->move);
+  asre_initial (re);
+  return next;
+}
+
+struct aspath_regex *
+bgp_aspath_regcomp (const char *regstr)
+{
+  struct aspath_regex *re;
+  struct asre_parse *ps;
+  struct asre_node *node;
+  char *magic_str;
+  size_t words;
+  int i;
+
+  magic_str = bgp_regex_magic (regstr);
+  ps = XCALLOC (MTYPE_TMP, sizeof (struct asre_parse));
+  ps->p = magic_str;
+  node = asre_parse_alt (ps);
+  if (*ps->p != '\0')
+    ps->error = 1;
+
+  re = NULL;
+  if (! ps->error)
+    {
+      re = XCALLOC (MTYPE_BGP_REGEXP, sizeof (struct aspath_regex));
+      re->state = XMALLOC (MTYPE_BGP_REGEXP,
+			   ASRE_STATES_MAX * sizeof (struct asre_state));
+
+      re->match = asre_state_new (re, ASRE_S_MATCH, -1, -1);
+      re->start = asre_gen (re, node, re->match);
+    }
+
+  XFREE (MTYPE_TMP, magic_str);
+  XFREE (MTYPE_TMP, ps);
+
+  if (re == NULL)
+    return NULL;
+  if (re->start < 0)
+    {
+      XFREE (MTYPE_BGP_REGEXP, re->state);
+      XFREE (MTYPE_BGP_REGEXP, re);
+      return NULL;
+    }
+
+  re->nwords = (re->nstates + 31) / 32;
+  words = re->nwords * sizeof (u_int32_t);
+  re->restart = XCALLOC (MTYPE_BGP_REGEXP, words);
+  re->visit = XCALLOC (MTYPE_BGP_REGEXP, words);
+  re->work = XCALLOC (MTYPE_BGP_REGEXP, words);
+  re->move = XCALLOC (MTYPE_BGP_REGEXP, words);
+  re->stack = XMALLOC (MTYPE_BGP_REGEXP,
+			(2 * re->nstates + 1) * sizeof (int));
+  re->dstate = XMALLOC (MTYPE_BGP_REGEXP,
+			ASRE_DSTATES_MAX * sizeof (struct asre_dstate *));
+  re->dhash = hash_create_open (HASH_INITIAL_SIZE, asre_dstate_key,
+				asre_dstate_cmp);
+
+  asre_closure (re, re->restart, re->start, 0, 0);
+
+  memset (re->move, 0, words);
+  asre_closure (re, re->move, re->start, 1, 0);
+  memset (re->work, 0, words);
+  for (i = 0; i < re->nstates; i++)
+    if (ASRE_TEST_BIT (re->move, i))
+      asre_closure (re, re->work, i, 1, 1);
+  re->empty = ASRE_TEST_BIT (re->work, re->match) ? 1 : 0;
+
+  re->initial = -1;
+  asre_initial (re);
+  return re;
+}
+
+/* Like bgp_regexec, 0 if the path matches, REG_NOMATCH if not. */
+int
+bgp_aspath_regexec (struct aspath_regex *re, struct aspath *aspath)
+{
+  struct assegment *seg;
+  struct asre_dstate *ds;
+  int next;
+
+  /* Anchored regexes mostly fail on the first few characters, and
+     leave the DFA in its dead state. */
+#define ASRE_FEED(c)					\
+  do {							\
+    int sym = (c);					\
+    if ((next = ds->next[sym]) < 0)			\
+      next = asre_step (re, ds->index, sym);		\
+    ds = re->dstate[next];				\
+    if (ds->accept)					\
+      return 0;						\
+    if (ds->dead)					\
+      return REG_NOMATCH;				\
+  } while (0)
+
+  if (aspath->segments == NULL)
+    return re->empty ? 0 : REG_NOMATCH;
+
+  ds = re->dstate[asre_initial (re)];
+  if (ds->accept)
+    return 0;
+
+  for (seg = aspath->segments; seg; seg = seg->next)
+    {
+      int i, sep;
+
+      switch (seg->type)
+	{
+	case AS_SET:
+	  ASRE_FEED (asre_sym ('{'));
+	  sep = ASRE_SYM_COMMA;
+	  break;
+	case AS_CONFED_SEQUENCE:
+	  ASRE_FEED (asre_sym ('('));
+	  sep = ASRE_SYM_SPACE;
+	  break;
+	case AS_CONFED_SET:
+	  ASRE_FEED (asre_sym ('['));
+	  sep = ASRE_SYM_COMMA;
+	  break;
+	case AS_SEQUENCE:
+	  sep = ASRE_SYM_SPACE;
+	  break;
+	default:
+	  /* The path has no string to match. */
+	  return REG_NOMATCH;
+	}
+
+      for (i = 0; i < seg->length; i++)
+	{
+	  u_char digit[10];
+	  as_t as = seg->as[i];
+	  int n = 0;
+
+	  do
+	    {
+	      digit[n++] = as % 10;
+	      as /= 10;
+	    }
+	  while (as);
+	  while (n)
+	    ASRE_FEED (digit[--n]);
+
+	  if (i < seg->length - 1)
+	    ASRE_FEED (sep);
+	}
+
+      switch (seg->type)
+	{
+	case AS_SET:
+	  ASRE_FEED (asre_sym ('}'));
+	  break;
+	case AS_CONFED_SEQUENCE:
+	  ASRE_FEED (asre_sym (')'));
+	  break;
+	case AS_CONFED_SET:
+	  ASRE_FEED (asre_sym (']'));
+	  break;
+	}
+
+      if (seg->next)
+	ASRE_FEED (ASRE_SYM_SPACE);
+    }
+#undef ASRE_FEED
+
+  return ds->accept_end ? 0 : REG_NOMATCH;
+}
+
+void
+bgp_aspath_regfree (struct aspath_regex *re)
+{
+  hash_clean (re->dhash, asre_dstate_free);
+  hash_free (re->dhash);
+  XFREE (MTYPE_BGP_REGEXP, re->dstate);
+  XFREE (MTYPE_BGP_REGEXP, re->state);
+  XFREE (MTYPE_BGP_REGEXP, re->restart);
+  XFREE (MTYPE_BGP_REGEXP, re->visit);
+  XFREE (MTYPE_BGP_REGEXP, re->work);
+  XFREE (MTYPE_BGP_REGEXP, re->move);
+  XFREE (MTYPE_BGP_REGEXP, re->stack);
+  XFREE (MTYPE_BGP_REGEXP, re);
+}
@@ -37,4 +37,9 @@ extern void bgp_regex_free (regex_t *regex);
 extern regex_t *bgp_regcomp (const char *str);
 extern int bgp_regexec (regex_t *regex, struct aspath *aspath);
 
+struct aspath_regex;
+extern struct aspath_regex *bgp_aspath_regcomp (const char *str);
+extern int bgp_aspath_regexec (struct aspath_regex *re, struct aspath *aspath);
+extern void bgp_aspath_regfree (struct aspath_regex *re);
+
 #endif /* _QUAGGA_BGP_REGEX_H */
@@ -34,6 +34,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "thread.h"
 #include "workqueue.h"
+#include "vector.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -55,6 +56,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_workers.h"
 
 /* Extern from bgp_dump.c */
 extern const char *bgp_origin_str[];
@@ -142,6 +144,7 @@ bgp_info_free (struct bgp_info *binfo)
   
   bgp_info_extra_free (&binfo->extra);
   bgp_info_mpath_free (&binfo->mpath);
+  bgp_nexthop_detach (binfo);
 
   peer_unlock (binfo->peer); /* bgp_info peer reference */
 
@@ -186,6 +189,7 @@ void
 bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
 {
   struct bgp_info *top;
+  struct bgp_info **paths;
 
   top = rn->info;
   
@@ -194,10 +198,36 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
   if (top)
     top->prev = ri;
   rn->info = ri;
+  ri->net = rn;
+
+  paths = &ri->peer->paths[bgp_node_table (rn)->afi][bgp_node_table (rn)->safi];
+  ri->peer_next = *paths;
+  ri->peer_prev = NULL;
+  if (*paths)
+    (*paths)->peer_prev = ri;
+  *paths = ri;
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
   peer_lock (ri->peer); /* bgp_info peer reference */
+  bgp_node_peer_bit_set (rn, BGP_PEER_BITS_RECEIVED, ri->peer->index);
+}
+
+/* Take the peer out of the node's received set if it no longer has
+   any path or adjacency in there.  */
+void
+bgp_node_received_check (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_info *ri;
+  struct bgp_adj_in *ain;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer)
+      return;
+  for (ain = rn->adj_in; ain; ain = ain->next)
+    if (ain->peer == peer)
+      return;
+  bgp_node_peer_bit_unset (rn, BGP_PEER_BITS_RECEIVED, peer->index);
 }
 
 /* Do the actual removal of info from RIB, for use by bgp_process 
@@ -211,8 +241,19 @@ bgp_info_reap (struct bgp_node *rn, struct bgp_info *ri)
     ri->prev->next = ri->next;
   else
     rn->info = ri->next;
+
+  if (ri->peer_next)
+    ri->peer_next->peer_prev = ri->peer_prev;
+  if (ri->peer_prev)
+    ri->peer_prev->peer_next = ri->peer_next;
+  else
+    ri->peer->paths[bgp_node_table (rn)->afi][bgp_node_table (rn)->safi]
+      = ri->peer_next;
   
+  bgp_node_received_check (rn, ri->peer);
   bgp_info_mpath_dequeue (ri);
+  bgp_nexthop_detach (ri);
+  ri->net = NULL;
   bgp_info_unlock (ri);
   bgp_unlock_node (rn);
 }
@@ -707,8 +748,10 @@ bgp_input_modifier (struct peer *peer, struct prefix *p, struct attr *attr,
 
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_IN); 
 
-      /* Apply BGP route map to the attribute. */
-      ret = route_map_apply (ROUTE_MAP_IN (filter), p, RMAP_BGP, &info);
+      /* Apply BGP route map to the attribute.  The attributes are
+	 still as parsed or interned, so their serial stands for them. */
+      ret = route_map_apply_cached (ROUTE_MAP_IN (filter), p, RMAP_BGP,
+				    &info, attr->serial);
 
       peer->rmap_type = 0;
 
@@ -1086,10 +1129,14 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_OUT); 
 
+      /* What has been changed from riattr above is nothing the cached
+	 matches look at, unless private ASes were removed. */
       if (ri->extra && ri->extra->suppress)
 	ret = route_map_apply (UNSUPPRESS_MAP (filter), p, RMAP_BGP, &info);
       else
-	ret = route_map_apply (ROUTE_MAP_OUT (filter), p, RMAP_BGP, &info);
+	ret = route_map_apply_cached (ROUTE_MAP_OUT (filter), p, RMAP_BGP,
+				      &info, attr->aspath == riattr->aspath
+				      ? riattr->serial : 0);
 
       peer->rmap_type = 0;
 
@@ -1306,21 +1353,77 @@ struct bgp_info_pair
   struct bgp_info *new;
 };
 
+/* The steps of best path selection which change more than the node's
+   own bgp_info flags.  bgp_best_selection records them, so that it can
+   run in a worker thread, and bgp_best_apply carries them out in the
+   main thread, in the same order. */
+enum bgp_best_op_type
+{
+  BGP_BEST_MP_CLEAR,		/* bgp_mp_list_clear */
+  BGP_BEST_MP_ADD,		/* bgp_mp_list_add (ri) */
+  BGP_BEST_MP_UPDATE,		/* bgp_info_mpath_update (ri, old) */
+  BGP_BEST_DMED_DESELECT,	/* bgp_mp_dmed_deselect (ri) */
+  BGP_BEST_REAP,		/* bgp_info_reap (ri) */
+};
+
+struct bgp_best_op
+{
+  enum bgp_best_op_type type;
+  struct bgp_info *ri;
+  struct bgp_info *old;
+};
+
+/* Most steps bgp_best_selection can record for a node with N paths:
+   three for each path in the deterministic-med pass, three for each in
+   the final one, and the closing multipath update. */
+#define BGP_BEST_OPS_MAX(N) (6 * (N) + 2)
+
+/* A node to process, as queued by bgp_process. */
+struct bgp_process_queue 
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  afi_t afi;
+  safi_t safi;
+
+  /* Selection result, see bgp_best_selection. */
+  struct bgp_info_pair old_and_new;
+  struct bgp_best_op *ops;
+  unsigned int nops;
+  unsigned int maxops;
+};
+
 static void
-bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
-		    struct bgp_maxpaths_cfg *mpath_cfg,
-		    struct bgp_info_pair *result)
+bgp_best_op_add (struct bgp_process_queue *pq, enum bgp_best_op_type type,
+		 struct bgp_info *ri, struct bgp_info *old)
 {
+  struct bgp_best_op *op;
+
+  assert (pq->nops < pq->maxops);
+  op = &pq->ops[pq->nops++];
+  op->type = type;
+  op->ri = ri;
+  op->old = old;
+}
+
+/* Select the best path of a queued node.  This only decides: it may be
+   run in a worker thread, alongside selection for other nodes, so it
+   changes nothing but the DMED flags of the node's paths and leaves
+   everything else to bgp_best_apply. */
+static void
+bgp_best_selection (struct bgp_process_queue *pq)
+{
+  struct bgp *bgp = pq->bgp;
+  struct bgp_node *rn = pq->rn;
+  struct bgp_maxpaths_cfg *mpath_cfg = &bgp->maxpaths[pq->afi][pq->safi];
   struct bgp_info *new_select;
   struct bgp_info *old_select;
   struct bgp_info *ri;
   struct bgp_info *ri1;
   struct bgp_info *ri2;
-  struct bgp_info *nextri = NULL;
   int paths_eq, do_mpath;
-  struct list mp_list;
 
-  bgp_mp_list_init (&mp_list);
+  pq->nops = 0;
   do_mpath = (mpath_cfg->maxpaths_ebgp != BGP_DEFAULT_MAXPATHS ||
 	      mpath_cfg->maxpaths_ibgp != BGP_DEFAULT_MAXPATHS);
 
@@ -1336,7 +1439,7 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 
 	new_select = ri1;
 	if (do_mpath)
-	  bgp_mp_list_add (&mp_list, ri1);
+	  bgp_best_op_add (pq, BGP_BEST_MP_ADD, ri1, NULL);
 	old_select = CHECK_FLAG (ri1->flags, BGP_INFO_SELECTED) ? ri1 : NULL;
 	if (ri1->next)
 	  for (ri2 = ri1->next; ri2; ri2 = ri2->next)
@@ -1358,13 +1461,13 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 		      new_select = ri2;
 		      if (do_mpath && !paths_eq)
 			{
-			  bgp_mp_list_clear (&mp_list);
-			  bgp_mp_list_add (&mp_list, ri2);
+			  bgp_best_op_add (pq, BGP_BEST_MP_CLEAR, NULL, NULL);
+			  bgp_best_op_add (pq, BGP_BEST_MP_ADD, ri2, NULL);
 			}
 		    }
 
 		  if (do_mpath && paths_eq)
-		    bgp_mp_list_add (&mp_list, ri2);
+		    bgp_best_op_add (pq, BGP_BEST_MP_ADD, ri2, NULL);
 
 		  bgp_info_set_flag (rn, ri2, BGP_INFO_DMED_CHECK);
 		}
@@ -1372,14 +1475,16 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_CHECK);
 	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
 
-	bgp_info_mpath_update (rn, new_select, old_select, &mp_list, mpath_cfg);
-	bgp_mp_list_clear (&mp_list);
+	bgp_best_op_add (pq, BGP_BEST_MP_UPDATE, new_select, old_select);
+	if (do_mpath)
+	  bgp_best_op_add (pq, BGP_BEST_MP_CLEAR, NULL, NULL);
       }
 
-  /* Check old selected route and new selected route. */
+  /* Check old selected route and new selected route.  Reaping is left
+     to bgp_best_apply, so the list stays as it is while we walk it. */
   old_select = NULL;
   new_select = NULL;
-  for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
+  for (ri = rn->info; ri; ri = ri->next)
     {
       if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
 	old_select = ri;
@@ -1391,7 +1496,7 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
            */
           if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED)
               && (ri != old_select))
-              bgp_info_reap (rn, ri);
+            bgp_best_op_add (pq, BGP_BEST_REAP, ri, NULL);
           
           continue;
         }
@@ -1407,35 +1512,70 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 
       if (bgp_info_cmp (bgp, ri, new_select, &paths_eq))
 	{
-	  if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-	    bgp_mp_dmed_deselect (new_select);
+	  if (do_mpath && new_select
+	      && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+	    bgp_best_op_add (pq, BGP_BEST_DMED_DESELECT, new_select, NULL);
 
 	  new_select = ri;
 
 	  if (do_mpath && !paths_eq)
 	    {
-	      bgp_mp_list_clear (&mp_list);
-	      bgp_mp_list_add (&mp_list, ri);
+	      bgp_best_op_add (pq, BGP_BEST_MP_CLEAR, NULL, NULL);
+	      bgp_best_op_add (pq, BGP_BEST_MP_ADD, ri, NULL);
 	    }
 	}
       else if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-	bgp_mp_dmed_deselect (ri);
+	bgp_best_op_add (pq, BGP_BEST_DMED_DESELECT, ri, NULL);
 
       if (do_mpath && paths_eq)
-	bgp_mp_list_add (&mp_list, ri);
+	bgp_best_op_add (pq, BGP_BEST_MP_ADD, ri, NULL);
     }
     
 
   if (!bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-    bgp_info_mpath_update (rn, new_select, old_select, &mp_list, mpath_cfg);
+    bgp_best_op_add (pq, BGP_BEST_MP_UPDATE, new_select, old_select);
 
-  bgp_info_mpath_aggregate_update (new_select, old_select);
-  bgp_mp_list_clear (&mp_list);
+  pq->old_and_new.old = old_select;
+  pq->old_and_new.new = new_select;
+}
 
-  result->old = old_select;
-  result->new = new_select;
+/* Carry out what bgp_best_selection decided for a node. */
+static void
+bgp_best_apply (struct bgp_process_queue *pq)
+{
+  struct bgp_node *rn = pq->rn;
+  struct bgp_maxpaths_cfg *mpath_cfg = &pq->bgp->maxpaths[pq->afi][pq->safi];
+  struct bgp_best_op *op;
+  struct list mp_list;
+  unsigned int i;
 
-  return;
+  bgp_mp_list_init (&mp_list);
+
+  for (i = 0; i < pq->nops; i++)
+    {
+      op = &pq->ops[i];
+      switch (op->type)
+	{
+	case BGP_BEST_MP_CLEAR:
+	  bgp_mp_list_clear (&mp_list);
+	  break;
+	case BGP_BEST_MP_ADD:
+	  bgp_mp_list_add (&mp_list, op->ri);
+	  break;
+	case BGP_BEST_MP_UPDATE:
+	  bgp_info_mpath_update (rn, op->ri, op->old, &mp_list, mpath_cfg);
+	  break;
+	case BGP_BEST_DMED_DESELECT:
+	  bgp_mp_dmed_deselect (op->ri);
+	  break;
+	case BGP_BEST_REAP:
+	  bgp_info_reap (rn, op->ri);
+	  break;
+	}
+    }
+
+  bgp_info_mpath_aggregate_update (pq->old_and_new.new, pq->old_and_new.old);
+  bgp_mp_list_clear (&mp_list);
 }
 
 static int
@@ -1488,32 +1628,57 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
   return 0;
 }
 
-struct bgp_process_queue 
+/* Withdraw the node from the peers in its advertised set.  A peer only
+   leaves the set, and never another peer, while this goes. */
+static void
+bgp_process_withdraw_advertised (struct bgp_node *rn, afi_t afi, safi_t safi)
 {
-  struct bgp *bgp;
-  struct bgp_node *rn;
-  afi_t afi;
-  safi_t safi;
+  u_int32_t word;
+  unsigned int w, index;
+
+  for (w = 0; rn->peer_bits && w < rn->peer_bits->words; w++)
+    for (word = rn->peer_bits->bits[rn->peer_bits->words + w];
+	 word; word &= word - 1)
+      {
+	index = w * 32 + ffs (word) - 1;
+	bgp_process_announce_selected (bm->peer_by_index[index], NULL, rn,
+				       afi, safi);
+      }
+}
+
+/* bgp_process queues nodes in batches, so that best path selection for
+   a batch can be spread over the worker threads before the results are
+   applied, in queue order, in the main thread. */
+#define BGP_PROCESS_BATCH 256
+
+struct bgp_process_batch
+{
+  unsigned int count;
+  struct bgp_process_queue node[BGP_PROCESS_BATCH];
 };
 
-static wq_item_status
-bgp_process_rsclient (struct work_queue *wq, void *data)
+/* Batches still open for more nodes, one per queue. */
+static struct bgp_process_batch *bgp_process_main_tail;
+static struct bgp_process_batch *bgp_process_rsclient_tail;
+
+/* Room for the selection steps of a batch, reused from one to the
+   next. */
+static struct bgp_best_op *bgp_best_ops;
+static unsigned int bgp_best_ops_size;
+
+static void
+bgp_process_rsclient (struct bgp_process_queue *pq)
 {
-  struct bgp_process_queue *pq = data;
-  struct bgp *bgp = pq->bgp;
   struct bgp_node *rn = pq->rn;
   afi_t afi = pq->afi;
   safi_t safi = pq->safi;
   struct bgp_info *new_select;
   struct bgp_info *old_select;
-  struct bgp_info_pair old_and_new;
   struct listnode *node, *nnode;
   struct peer *rsclient = bgp_node_table (rn)->owner;
   
-  /* Best path selection. */
-  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new);
-  new_select = old_and_new.new;
-  old_select = old_and_new.old;
+  new_select = pq->old_and_new.new;
+  old_select = pq->old_and_new.old;
 
   if (CHECK_FLAG (rsclient->sflags, PEER_STATUS_GROUP))
     {
@@ -1555,13 +1720,11 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
     bgp_info_reap (rn, old_select);
   
   UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
-  return WQ_SUCCESS;
 }
 
-static wq_item_status
-bgp_process_main (struct work_queue *wq, void *data)
+static void
+bgp_process_main (struct bgp_process_queue *pq)
 {
-  struct bgp_process_queue *pq = data;
   struct bgp *bgp = pq->bgp;
   struct bgp_node *rn = pq->rn;
   afi_t afi = pq->afi;
@@ -1569,14 +1732,11 @@ bgp_process_main (struct work_queue *wq, void *data)
   struct prefix *p = &rn->p;
   struct bgp_info *new_select;
   struct bgp_info *old_select;
-  struct bgp_info_pair old_and_new;
   struct listnode *node, *nnode;
   struct peer *peer;
   
-  /* Best path selection. */
-  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new);
-  old_select = old_and_new.old;
-  new_select = old_and_new.new;
+  old_select = pq->old_and_new.old;
+  new_select = pq->old_and_new.new;
 
   /* Nothing to do. */
   if (old_select && old_select == new_select)
@@ -1587,9 +1747,10 @@ bgp_process_main (struct work_queue *wq, void *data)
 	      CHECK_FLAG (old_select->flags, BGP_INFO_MULTIPATH_CHG))
             bgp_zebra_announce (p, old_select, bgp, safi);
           
+	  UNSET_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED);
 	  UNSET_FLAG (old_select->flags, BGP_INFO_MULTIPATH_CHG);
           UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
-          return WQ_SUCCESS;
+          return;
         }
     }
 
@@ -1603,11 +1764,13 @@ bgp_process_main (struct work_queue *wq, void *data)
     }
 
 
-  /* Check each BGP peer. */
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-    {
+  /* Check each BGP peer.  With nothing to announce, only the peers the
+     prefix was advertised to have anything to do. */
+  if (new_select)
+    for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
       bgp_process_announce_selected (peer, new_select, rn, afi, safi);
-    }
+  else
+    bgp_process_withdraw_advertised (rn, afi, safi);
 
   /* FIB update. */
   if ((safi == SAFI_UNICAST || safi == SAFI_MULTICAST) && (! bgp->name &&
@@ -1632,24 +1795,116 @@ bgp_process_main (struct work_queue *wq, void *data)
     bgp_info_reap (rn, old_select);
   
   UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
+}
+
+/* Give each node of a batch its share of bgp_best_ops. */
+static void
+bgp_best_ops_alloc (struct bgp_process_batch *batch)
+{
+  struct bgp_process_queue *pq;
+  struct bgp_info *ri;
+  unsigned int i, n, total;
+
+  total = 0;
+  for (i = 0; i < batch->count; i++)
+    {
+      pq = &batch->node[i];
+      for (n = 0, ri = pq->rn->info; ri; ri = ri->next)
+	n++;
+      pq->maxops = BGP_BEST_OPS_MAX (n);
+      total += pq->maxops;
+    }
+
+  if (total > bgp_best_ops_size)
+    {
+      bgp_best_ops = XREALLOC (MTYPE_BGP_PROCESS_QUEUE, bgp_best_ops,
+			       total * sizeof (struct bgp_best_op));
+      bgp_best_ops_size = total;
+    }
+
+  total = 0;
+  for (i = 0; i < batch->count; i++)
+    {
+      pq = &batch->node[i];
+      pq->ops = bgp_best_ops + total;
+      total += pq->maxops;
+    }
+}
+
+static void
+bgp_best_selection_job (void *arg, unsigned int i)
+{
+  struct bgp_process_batch *batch = arg;
+
+  bgp_best_selection (&batch->node[i]);
+}
+
+static wq_item_status
+bgp_process_batch (struct work_queue *wq, void *data)
+{
+  struct bgp_process_batch *batch = data;
+  struct bgp_process_queue *pq;
+  unsigned int i;
+
+  /* Nodes queued from here on go in a new batch. */
+  if (batch == bgp_process_main_tail)
+    bgp_process_main_tail = NULL;
+  if (batch == bgp_process_rsclient_tail)
+    bgp_process_rsclient_tail = NULL;
+
+  /* Best path selection, for the whole batch at once. */
+  bgp_best_ops_alloc (batch);
+  bgp_workers_run (bgp_best_selection_job, batch, batch->count);
+
+  for (i = 0; i < batch->count; i++)
+    {
+      pq = &batch->node[i];
+      bgp_best_apply (pq);
+
+      switch (bgp_node_table (pq->rn)->type)
+	{
+	  case BGP_TABLE_MAIN:
+	    bgp_process_main (pq);
+	    break;
+	  case BGP_TABLE_RSCLIENT:
+	    bgp_process_rsclient (pq);
+	    break;
+	}
+    }
+
   return WQ_SUCCESS;
 }
 
 static void
 bgp_processq_del (struct work_queue *wq, void *data)
 {
-  struct bgp_process_queue *pq = data;
-  struct bgp_table *table = bgp_node_table (pq->rn);
-  
-  bgp_unlock (pq->bgp);
-  bgp_unlock_node (pq->rn);
-  bgp_table_unlock (table);
-  XFREE (MTYPE_BGP_PROCESS_QUEUE, pq);
+  struct bgp_process_batch *batch = data;
+  struct bgp_process_queue *pq;
+  struct bgp_table *table;
+  unsigned int i;
+
+  if (batch == bgp_process_main_tail)
+    bgp_process_main_tail = NULL;
+  if (batch == bgp_process_rsclient_tail)
+    bgp_process_rsclient_tail = NULL;
+
+  for (i = 0; i < batch->count; i++)
+    {
+      pq = &batch->node[i];
+      table = bgp_node_table (pq->rn);
+      bgp_unlock (pq->bgp);
+      bgp_unlock_node (pq->rn);
+      bgp_table_unlock (table);
+    }
+  XFREE (MTYPE_BGP_PROCESS_QUEUE, batch);
 }
 
 static void
 bgp_process_queue_init (void)
 {
+  struct work_queue *wq[2];
+  int i;
+
   bm->process_main_queue
     = work_queue_new (bm->master, "process_main_queue");
   bm->process_rsclient_queue
@@ -1661,21 +1916,23 @@ bgp_process_queue_init (void)
       exit (1);
     }
   
-  bm->process_main_queue->spec.workfunc = &bgp_process_main;
-  bm->process_main_queue->spec.del_item_data = &bgp_processq_del;
-  bm->process_main_queue->spec.max_retries = 0;
-  bm->process_main_queue->spec.hold = 50;
-  
-  memcpy (bm->process_rsclient_queue, bm->process_main_queue,
-          sizeof (struct work_queue));  // ???
-//          sizeof (struct work_queue *));
-  bm->process_rsclient_queue->spec.workfunc = &bgp_process_rsclient;
+  wq[0] = bm->process_main_queue;
+  wq[1] = bm->process_rsclient_queue;
+  for (i = 0; i < 2; i++)
+    {
+      wq[i]->spec.workfunc = &bgp_process_batch;
+      wq[i]->spec.del_item_data = &bgp_processq_del;
+      wq[i]->spec.max_retries = 0;
+      wq[i]->spec.hold = 50;
+    }
 }
 
 void
 bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
 {
   struct bgp_process_queue *pqnode;
+  struct bgp_process_batch **tail;
+  struct work_queue *wq;
   
   /* already scheduled for processing? */
   if (CHECK_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED))
@@ -1685,10 +1942,27 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
        (bm->process_rsclient_queue == NULL) )
     bgp_process_queue_init ();
   
-  pqnode = XCALLOC (MTYPE_BGP_PROCESS_QUEUE, 
-                    sizeof (struct bgp_process_queue));
-  if (!pqnode)
-    return;
+  switch (bgp_node_table (rn)->type)
+    {
+      case BGP_TABLE_MAIN:
+        wq = bm->process_main_queue;
+        tail = &bgp_process_main_tail;
+        break;
+      case BGP_TABLE_RSCLIENT:
+        wq = bm->process_rsclient_queue;
+        tail = &bgp_process_rsclient_tail;
+        break;
+      default:
+        return;
+    }
+
+  if (*tail == NULL || (*tail)->count == BGP_PROCESS_BATCH)
+    {
+      *tail = XCALLOC (MTYPE_BGP_PROCESS_QUEUE,
+                       sizeof (struct bgp_process_batch));
+      work_queue_add (wq, *tail);
+    }
+  pqnode = &(*tail)->node[(*tail)->count++];
 
   /* all unlocked in bgp_processq_del */
   bgp_table_lock (bgp_node_table (rn));
@@ -1698,16 +1972,6 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
   pqnode->afi = afi;
   pqnode->safi = safi;
   
-  switch (bgp_node_table (rn)->type)
-    {
-      case BGP_TABLE_MAIN:
-        work_queue_add (bm->process_main_queue, pqnode);
-        break;
-      case BGP_TABLE_RSCLIENT:
-        work_queue_add (bm->process_rsclient_queue, pqnode);
-        break;
-    }
-  
   SET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
   return;
 }
@@ -2179,7 +2443,12 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	}
     }
 
-  attr_new = bgp_attr_intern (&new_attr);
+  /* Attributes come interned from the attribute cache, and the
+     incoming policy mostly leaves them be. */
+  if (attr->refcnt && attrhash_cmp (&new_attr, attr))
+    attr_new = bgp_attr_ref (attr);
+  else
+    attr_new = bgp_attr_intern (&new_attr);
 
   /* If the update is implicit withdraw. */
   if (ri)
@@ -2293,14 +2562,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	}
 
       /* Nexthop reachability check. */
-      if ((afi == AFI_IP || afi == AFI_IP6)
-	  && safi == SAFI_UNICAST 
-	  && (peer->sort == BGP_PEER_IBGP
-              || peer->sort == BGP_PEER_CONFED
-	      || (peer->sort == BGP_PEER_EBGP && peer->ttl != 1)
-	      || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
+      if ((afi == AFI_IP || afi == AFI_IP6) && safi == SAFI_UNICAST)
 	{
-	  if (bgp_nexthop_lookup (afi, peer, ri, NULL, NULL))
+	  if (bgp_nexthop_track (afi, ri))
 	    bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
 	  else
 	    bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
@@ -2339,14 +2603,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
     memcpy ((bgp_info_extra_get (new))->tag, tag, 3);
 
   /* Nexthop reachability check. */
-  if ((afi == AFI_IP || afi == AFI_IP6)
-      && safi == SAFI_UNICAST
-      && (peer->sort == BGP_PEER_IBGP
-          || peer->sort == BGP_PEER_CONFED
-	  || (peer->sort == BGP_PEER_EBGP && peer->ttl != 1)
-	  || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
-    {
-      if (bgp_nexthop_lookup (afi, peer, new, NULL, NULL))
+  if ((afi == AFI_IP || afi == AFI_IP6) && safi == SAFI_UNICAST)
+    {
+      if (bgp_nexthop_track (afi, new))
 	bgp_info_set_flag (rn, new, BGP_INFO_VALID);
       else
         bgp_info_unset_flag (rn, new, BGP_INFO_VALID);
@@ -2797,15 +3056,29 @@ bgp_clear_node_queue_del (struct work_queue *wq, void *data)
   XFREE (MTYPE_BGP_CLEAR_NODE_QUEUE, cnq);
 }
 
+/* Nothing of the peer's is left in the RIBs.  */
+static void
+bgp_clear_route_done (struct peer *peer)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  peer->clear_usec = timeval_elapsed (now, peer->clear_start);
+
+  /* Tickle FSM to start moving again */
+  BGP_EVENT_ADD (peer, Clearing_Completed);
+}
+
 static void
 bgp_clear_node_complete (struct work_queue *wq)
 {
   struct peer *peer = wq->spec.data;
   
-  /* Tickle FSM to start moving again */
-  BGP_EVENT_ADD (peer, Clearing_Completed);
+  /* The Adj-RIBs may still wait on bgp_clear_adj_run.  */
+  if (! peer->clear_adj)
+    bgp_clear_route_done (peer);
 
-  peer_unlock (peer); /* bgp_clear_route */
+  peer_unlock (peer); /* bgp_clear_route_start */
 }
 
 static void
@@ -2832,100 +3105,348 @@ bgp_clear_node_queue_init (struct peer *peer)
 }
 
 static void
-bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
-                       struct bgp_table *table, struct peer *rsclient,
-                       enum bgp_clear_route_type purpose)
+bgp_clear_node_queue_add (struct peer *peer, struct bgp_node *rn,
+                          enum bgp_clear_route_type purpose)
+{
+  struct bgp_clear_node_queue *cnq;
+
+  /* both unlocked in bgp_clear_node_queue_del */
+  bgp_table_lock (bgp_node_table (rn));
+  bgp_lock_node (rn);
+  cnq = XCALLOC (MTYPE_BGP_CLEAR_NODE_QUEUE,
+                 sizeof (struct bgp_clear_node_queue));
+  cnq->rn = rn;
+  cnq->purpose = purpose;
+  work_queue_add (peer->clear_node_queue, cnq);
+  peer->clear_paths++;
+}
+
+/* Queue the nodes the peer has paths in, from its own list of them
+ * rather than by looking through the tables, so that clearing a peer
+ * costs what it sent, not the size of the RIB.
+ *
+ * Its entries in the Adj-RIBs are not on lists of their own.  They go
+ * in bgp_clear_adj_now, or, when the session is down and no more can
+ * be added, are left to bgp_clear_adj_run, which looks for those of
+ * all the peers that went down since it last ran in one go.
+ */
+static void
+bgp_clear_route_paths (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_info *ri, *first;
+
+  for (ri = peer->paths[afi][safi]; ri; ri = ri->peer_next)
+    {
+      /* bgp_clear_route_node takes the peer's first path in the node,
+         so the node goes in once however many the peer has there.  */
+      for (first = ri->net->info; first->peer != peer; first = first->next)
+        ;
+      if (first == ri)
+        bgp_clear_node_queue_add (peer, ri->net, BGP_CLEAR_ROUTE_NORMAL);
+    }
+}
+
+/* Lock and add to the vector the instance's tables for the address
+   family which can hold Adj-RIB entries: the main RIB, or the route
+   distinguishers' tables under it, and the route server clients'.  */
+static void
+bgp_clear_adj_tables (struct bgp *bgp, afi_t afi, safi_t safi, vector tables)
 {
   struct bgp_node *rn;
-  
-  
-  if (! table)
-    table = (rsclient) ? rsclient->rib[afi][safi] : peer->bgp->rib[afi][safi];
-  
-  /* If still no table => afi/safi isn't configured at all or smth. */
-  if (! table)
+  struct bgp_table *table;
+  struct peer *rsclient;
+  struct listnode *node;
+  unsigned int i = vector_active (tables);
+
+  if (safi != SAFI_MPLS_VPN)
+    {
+      if ((table = bgp->rib[afi][safi]) != NULL)
+        vector_set (tables, table);
+    }
+  else if (bgp->rib[afi][safi])
+    for (rn = bgp_table_top (bgp->rib[afi][safi]); rn;
+         rn = bgp_route_next (rn))
+      if ((table = rn->info) != NULL)
+        vector_set (tables, table);
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->rsclient, node, rsclient))
+    if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+        && (table = rsclient->rib[afi][safi]) != NULL)
+      vector_set (tables, table);
+
+  for (; i < vector_active (tables); i++)
+    bgp_table_lock (vector_slot (tables, i));
+}
+
+/* Take the Adj-RIB entries of the peers in the set, a bit each by
+   index, out of the node.  The caller holds a lock on the node.  */
+static void
+bgp_clear_adj_node (struct bgp_node *rn, const u_int32_t *set,
+                    unsigned int words)
+{
+  struct bgp_peer_bits *pb = rn->peer_bits;
+  afi_t afi = bgp_node_table (rn)->afi;
+  safi_t safi = bgp_node_table (rn)->safi;
+  unsigned int w;
+
+  if (! pb || (! rn->adj_in && ! rn->adj_out))
     return;
-  
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+
+  for (w = 0; w < MIN (words, pb->words); w++)
     {
-      struct bgp_info *ri;
-      struct bgp_adj_in *ain;
-      struct bgp_adj_out *aout;
+      u_int32_t bits = (pb->bits[w] | pb->bits[pb->words + w]) & set[w];
 
-      /* XXX:TODO: This is suboptimal, every non-empty route_node is
-       * queued for every clearing peer, regardless of whether it is
-       * relevant to the peer at hand.
-       *
-       * Overview: There are 3 different indices which need to be
-       * scrubbed, potentially, when a peer is removed:
-       *
-       * 1 peer's routes visible via the RIB (ie accepted routes)
-       * 2 peer's routes visible by the (optional) peer's adj-in index
-       * 3 other routes visible by the peer's adj-out index
-       *
-       * 3 there is no hurry in scrubbing, once the struct peer is
-       * removed from bgp->peer, we could just GC such deleted peer's
-       * adj-outs at our leisure.
-       *
-       * 1 and 2 must be 'scrubbed' in some way, at least made
-       * invisible via RIB index before peer session is allowed to be
-       * brought back up. So one needs to know when such a 'search' is
-       * complete.
-       *
-       * Ideally:
-       *
-       * - there'd be a single global queue or a single RIB walker
-       * - rather than tracking which route_nodes still need to be
-       *   examined on a peer basis, we'd track which peers still
-       *   aren't cleared
-       *
-       * Given that our per-peer prefix-counts now should be reliable,
-       * this may actually be achievable. It doesn't seem to be a huge
-       * problem at this time,
-       */
-      for (ain = rn->adj_in; ain; ain = ain->next)
-        if (ain->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-          {
-            bgp_adj_in_remove (rn, ain);
-            bgp_unlock_node (rn);
-            break;
-          }
-      for (aout = rn->adj_out; aout; aout = aout->next)
-        if (aout->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+      while (bits)
+        {
+          struct peer *peer = bm->peer_by_index[w * 32 + ffs (bits) - 1];
+          struct bgp_adj_in *ain;
+          struct bgp_adj_out *aout;
+
+          bits &= bits - 1;
+          for (ain = rn->adj_in; ain; ain = ain->next)
+            if (ain->peer == peer)
+              {
+                bgp_adj_in_remove (rn, ain);
+                bgp_unlock_node (rn);
+                break;
+              }
+          if ((aout = bgp_adj_out_get (rn, peer)) != NULL)
+            {
+              bgp_adj_out_remove (rn, aout, peer, afi, safi);
+              bgp_unlock_node (rn);
+            }
+        }
+    }
+}
+
+/* Take the peer's Adj-RIB entries for the address family out now, for
+   a session which stays up without it.  */
+static void
+bgp_clear_adj_now (struct peer *peer, afi_t afi, safi_t safi)
+{
+  vector tables;
+  u_int32_t *set;
+  unsigned int i, words = peer->index / 32 + 1;
+
+  if (! peer->adjcount[afi][safi])
+    return;
+
+  set = XCALLOC (MTYPE_TMP, words * sizeof (u_int32_t));
+  set[peer->index / 32] = 1U << (peer->index % 32);
+
+  tables = vector_init (VECTOR_MIN_SIZE);
+  bgp_clear_adj_tables (peer->bgp, afi, safi, tables);
+  for (i = 0; i < vector_active (tables); i++)
+    {
+      struct bgp_table *table = vector_slot (tables, i);
+      struct bgp_node *rn;
+
+      for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+        bgp_clear_adj_node (rn, set, words);
+      bgp_table_unlock (table);
+    }
+  vector_free (tables);
+  XFREE (MTYPE_TMP, set);
+}
+
+/* Peers whose Adj-RIB entries wait to be taken out, a bit each by
+ * index for every address family: those for the pass over the tables
+ * under way, and those which came after it started, for the next.
+ * The pass walks every table once for all of them, giving way to other
+ * threads as it goes, and holds locks on the tables and the node it is
+ * to carry on from.
+ */
+static struct
+{
+  u_int32_t *pending[AFI_MAX][SAFI_MAX];
+  u_int32_t *active[AFI_MAX][SAFI_MAX];
+  unsigned int words;
+  struct thread *thread;
+  vector tables;
+  unsigned int table;
+  struct bgp_node *rn;
+} clear_adj_pass;
+
+static int bgp_clear_adj_run (struct thread *);
+
+static int
+bgp_clear_adj_empty (const u_int32_t *set)
+{
+  unsigned int w;
+
+  for (w = 0; w < clear_adj_pass.words; w++)
+    if (set[w])
+      return 0;
+  return 1;
+}
+
+static void
+bgp_clear_adj_finish (struct peer *peer)
+{
+  if (--peer->clear_adj == 0 && ! peer->clear_node_queue->thread)
+    bgp_clear_route_done (peer);
+
+  peer_unlock (peer); /* bgp_clear_adj_defer */
+}
+
+/* Leave the peer's Adj-RIB entries for the address family to the next
+   pass.  */
+static void
+bgp_clear_adj_defer (struct peer *peer, afi_t afi, safi_t safi)
+{
+  unsigned int w = peer->index / 32;
+  u_int32_t bit = 1U << (peer->index % 32);
+
+  if (! peer->adjcount[afi][safi])
+    return;
+
+  if (w >= clear_adj_pass.words)
+    {
+      unsigned int words = MAX (w + 1, bm->peer_index_words);
+      size_t old = clear_adj_pass.words * sizeof (u_int32_t);
+      size_t new = words * sizeof (u_int32_t);
+      afi_t a;
+      safi_t s;
+
+      for (a = AFI_IP; a < AFI_MAX; a++)
+        for (s = SAFI_UNICAST; s < SAFI_MAX; s++)
           {
-            bgp_adj_out_remove (rn, aout, peer, afi, safi);
-            bgp_unlock_node (rn);
-            break;
+            clear_adj_pass.pending[a][s] = XREALLOC (MTYPE_BGP_PEER_BITS,
+                                                clear_adj_pass.pending[a][s], new);
+            clear_adj_pass.active[a][s] = XREALLOC (MTYPE_BGP_PEER_BITS,
+                                               clear_adj_pass.active[a][s], new);
+            memset ((char *) clear_adj_pass.pending[a][s] + old, 0, new - old);
+            memset ((char *) clear_adj_pass.active[a][s] + old, 0, new - old);
           }
+      clear_adj_pass.words = words;
+    }
 
-      for (ri = rn->info; ri; ri = ri->next)
-        if (ri->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+  if (clear_adj_pass.pending[afi][safi][w] & bit)
+    return;
+  clear_adj_pass.pending[afi][safi][w] |= bit;
+  peer->clear_adj++;
+  peer_lock (peer); /* bgp_clear_adj_finish */
+
+  if (! clear_adj_pass.thread)
+    clear_adj_pass.thread = thread_add_background (bm->master, bgp_clear_adj_run,
+                                              NULL, 0);
+}
+
+static int
+bgp_clear_adj_run (struct thread *thread)
+{
+  struct bgp_node *rn;
+  afi_t afi;
+  safi_t safi;
+  unsigned int w, done = 0;
+
+  clear_adj_pass.thread = NULL;
+
+  /* Start a pass, for the peers waiting on one.  */
+  if (! clear_adj_pass.tables)
+    {
+      struct listnode *node;
+      struct bgp *bgp;
+
+      clear_adj_pass.tables = vector_init (VECTOR_MIN_SIZE);
+      clear_adj_pass.table = 0;
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+        for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
           {
-            struct bgp_clear_node_queue *cnq;
-
-            /* both unlocked in bgp_clear_node_queue_del */
-            bgp_table_lock (bgp_node_table (rn));
-            bgp_lock_node (rn);
-            cnq = XCALLOC (MTYPE_BGP_CLEAR_NODE_QUEUE,
-                           sizeof (struct bgp_clear_node_queue));
-            cnq->rn = rn;
-            cnq->purpose = purpose;
-            work_queue_add (peer->clear_node_queue, cnq);
-            break;
+            u_int32_t *set = clear_adj_pass.active[afi][safi];
+
+            clear_adj_pass.active[afi][safi] = clear_adj_pass.pending[afi][safi];
+            clear_adj_pass.pending[afi][safi] = set;
+            if (bgp_clear_adj_empty (clear_adj_pass.active[afi][safi]))
+              continue;
+            for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+              bgp_clear_adj_tables (bgp, afi, safi, clear_adj_pass.tables);
           }
     }
-  return;
+
+  for (; clear_adj_pass.table < vector_active (clear_adj_pass.tables); clear_adj_pass.table++)
+    {
+      struct bgp_table *table = vector_slot (clear_adj_pass.tables,
+                                             clear_adj_pass.table);
+
+      rn = clear_adj_pass.rn ? clear_adj_pass.rn : bgp_table_top (table);
+      for (; rn; rn = bgp_route_next (rn))
+        {
+          if (done++ && thread_should_yield (thread))
+            {
+              clear_adj_pass.rn = rn;
+              clear_adj_pass.thread = thread_add_background (bm->master,
+                                                        bgp_clear_adj_run,
+                                                        NULL, 0);
+              return 0;
+            }
+          bgp_clear_adj_node (rn, clear_adj_pass.active[table->afi][table->safi],
+                              clear_adj_pass.words);
+        }
+      clear_adj_pass.rn = NULL;
+      bgp_table_unlock (table);
+    }
+  vector_free (clear_adj_pass.tables);
+  clear_adj_pass.tables = NULL;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      for (w = 0; w < clear_adj_pass.words; w++)
+        {
+          u_int32_t bits = clear_adj_pass.active[afi][safi][w];
+
+          clear_adj_pass.active[afi][safi][w] = 0;
+          while (bits)
+            {
+              bgp_clear_adj_finish (bm->peer_by_index[w * 32 + ffs (bits) - 1]);
+              bits &= bits - 1;
+            }
+        }
+
+  /* More went down while this pass was on.  */
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (! bgp_clear_adj_empty (clear_adj_pass.pending[afi][safi])
+          && ! clear_adj_pass.thread)
+        clear_adj_pass.thread = thread_add_background (bm->master,
+                                                  bgp_clear_adj_run, NULL, 0);
+  return 0;
 }
 
-void
-bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
-                 enum bgp_clear_route_type purpose)
+/* Clear the peer's routes for the address family from the rsclient
+   RIB it has of its own, which is about to go.  */
+static void
+bgp_clear_route_rsclient (struct peer *peer, afi_t afi, safi_t safi)
 {
+  struct bgp_table *table = peer->rib[afi][safi];
   struct bgp_node *rn;
-  struct bgp_table *table;
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
 
+  /* If no table => afi/safi isn't configured at all or smth. */
+  if (! table)
+    return;
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    {
+      struct bgp_adj_out *aout;
+
+      if (rn->adj_in)
+        {
+          bgp_adj_in_remove (rn, rn->adj_in);
+          bgp_unlock_node (rn);
+        }
+      if ((aout = bgp_adj_out_next (rn, NULL)) != NULL)
+        {
+          bgp_adj_out_remove (rn, aout, peer, afi, safi);
+          bgp_unlock_node (rn);
+        }
+      if (rn->info)
+        bgp_clear_node_queue_add (peer, rn, BGP_CLEAR_ROUTE_MY_RSCLIENT);
+    }
+}
+
+static void
+bgp_clear_route_start (struct peer *peer)
+{
   if (peer->clear_node_queue == NULL)
     bgp_clear_node_queue_init (peer);
   
@@ -2942,66 +3463,79 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
    *    to grow and grow.
    */
   if (!peer->clear_node_queue->thread)
-    peer_lock (peer); /* bgp_clear_node_complete */
+    {
+      peer_lock (peer); /* bgp_clear_node_complete */
+
+      /* Time it from here, unless the last clear is not over yet.  */
+      if (! peer->clear_adj)
+        {
+          quagga_gettime (QUAGGA_CLK_MONOTONIC, &peer->clear_start);
+          peer->clear_paths = 0;
+        }
+    }
+}
+
+static void
+bgp_clear_route_finish (struct peer *peer)
+{
+  /* If no routes were cleared, nothing was added to workqueue, the
+   * completion function won't be run by workqueue code - call it here.
+   *
+   * There is a presumption in FSM that clearing is only really needed
+   * if peer state is Established - peers in pre-Established states
+   * shouldn't have any route-update state associated with them (in or
+   * out).  We still can get here in pre-Established though, through
+   * peer_delete -> bgp_fsm_change_status, which then costs no more
+   * than walking the peer's (empty) list of paths.
+   */
+  if (!peer->clear_node_queue->thread)
+    bgp_clear_node_complete (peer->clear_node_queue);
+}
+
+void
+bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
+                 enum bgp_clear_route_type purpose)
+{
+  bgp_clear_route_start (peer);
 
   switch (purpose)
     {
     case BGP_CLEAR_ROUTE_NORMAL:
-      if (safi != SAFI_MPLS_VPN)
-        bgp_clear_route_table (peer, afi, safi, NULL, NULL, purpose);
-      else
-        for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-             rn = bgp_route_next (rn))
-          if ((table = rn->info) != NULL)
-            bgp_clear_route_table (peer, afi, safi, table, NULL, purpose);
-
-      for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, rsclient))
-        if (CHECK_FLAG(rsclient->af_flags[afi][safi],
-                       PEER_FLAG_RSERVER_CLIENT))
-          bgp_clear_route_table (peer, afi, safi, NULL, rsclient, purpose);
+      bgp_clear_route_paths (peer, afi, safi);
+      bgp_clear_adj_now (peer, afi, safi);
       break;
 
     case BGP_CLEAR_ROUTE_MY_RSCLIENT:
-      bgp_clear_route_table (peer, afi, safi, NULL, peer, purpose);
+      bgp_clear_route_rsclient (peer, afi, safi);
       break;
 
     default:
       assert (0);
       break;
     }
-  
-  /* If no routes were cleared, nothing was added to workqueue, the
-   * completion function won't be run by workqueue code - call it here. 
-   * XXX: Actually, this assumption doesn't hold, see
-   * bgp_clear_route_table(), we queue all non-empty nodes.
-   *
-   * Additionally, there is a presumption in FSM that clearing is only
-   * really needed if peer state is Established - peers in
-   * pre-Established states shouldn't have any route-update state
-   * associated with them (in or out).
-   *
-   * We still can get here in pre-Established though, through
-   * peer_delete -> bgp_fsm_change_status, so this is a useful sanity
-   * check to ensure the assumption above holds.
-   *
-   * At some future point, this check could be move to the top of the
-   * function, and do a quick early-return when state is
-   * pre-Established, avoiding above list and table scans. Once we're
-   * sure it is safe..
-   */
-  if (!peer->clear_node_queue->thread)
-    bgp_clear_node_complete (peer->clear_node_queue);
+
+  bgp_clear_route_finish (peer);
 }
-  
+
+/* The session is going down: clear everything, leaving the Adj-RIB
+   entries to be taken out together with those of other peers going
+   down at about the same time.  */
 void
 bgp_clear_route_all (struct peer *peer)
 {
   afi_t afi;
   safi_t safi;
 
+  bgp_clear_route_start (peer);
+
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
-      bgp_clear_route (peer, afi, safi, BGP_CLEAR_ROUTE_NORMAL);
+      {
+        bgp_clear_route_paths (peer, afi, safi);
+        bgp_clear_adj_defer (peer, afi, safi);
+      }
+
+  bgp_clear_route_finish (peer);
 }
 
 void
@@ -3014,34 +3548,24 @@ bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
   table = peer->bgp->rib[afi][safi];
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain ; ain = ain->next)
-      if (ain->peer == peer)
-	{
-          bgp_adj_in_remove (rn, ain);
-          bgp_unlock_node (rn);
-          break;
-	}
+    if (bgp_node_peer_bit (rn, BGP_PEER_BITS_RECEIVED, peer->index))
+      for (ain = rn->adj_in; ain ; ain = ain->next)
+	if (ain->peer == peer)
+	  {
+	    bgp_adj_in_remove (rn, ain);
+	    bgp_unlock_node (rn);
+	    break;
+	  }
 }
 
 void
 bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_node *rn;
   struct bgp_info *ri;
-  struct bgp_table *table;
-
-  table = peer->bgp->rib[afi][safi];
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    {
-      for (ri = rn->info; ri; ri = ri->next)
-	if (ri->peer == peer)
-	  {
-	    if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
-	      bgp_rib_remove (rn, ri, peer, afi, safi);
-	    break;
-	  }
-    }
+  for (ri = peer->paths[afi][safi]; ri; ri = ri->peer_next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
+      bgp_rib_remove (ri->net, ri, peer, afi, safi);
 }
 
 /* Delete all kernel routes. */
@@ -6078,13 +6602,13 @@ route_vty_out_detail (struct vty *vty, struct bgp *bgp, struct prefix *p,
 	  
       /* Line 4 display Community */
       if (attr->community)
-	vty_out (vty, "      Community: %s%s", attr->community->str,
+	vty_out (vty, "      Community: %s%s", community_str (attr->community),
 		 VTY_NEWLINE);
 	  
       /* Line 5 display Extended-community */
       if (attr->flag & ATTR_FLAG_BIT(BGP_ATTR_EXT_COMMUNITIES))
 	vty_out (vty, "      Extended Community: %s%s", 
-	         attr->extra->ecommunity->str, VTY_NEWLINE);
+	         ecommunity_str (attr->extra->ecommunity), VTY_NEWLINE);
 	  
       /* Line 6 display Originator, Cluster-id */
       if ((attr->flag & ATTR_FLAG_BIT(BGP_ATTR_ORIGINATOR_ID)) ||
@@ -9891,27 +10415,26 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
       }
     else
       {
-	for (adj = rn->adj_out; adj; adj = adj->next)
-	  if (adj->peer == peer)
-	    {
-	      if (header1)
-		{
-		  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  header1 = 0;
-		}
-	      if (header2)
-		{
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		  header2 = 0;
-		}
-	      if (adj->attr)
-		{	
-		  route_vty_out_tmp (vty, &rn->p, adj->attr, safi);
-		  output_count++;
-		}
-	    }
+	if ((adj = bgp_adj_out_get (rn, peer)) != NULL)
+	  {
+	    if (header1)
+	      {
+		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		header1 = 0;
+	      }
+	    if (header2)
+	      {
+		vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+		header2 = 0;
+	      }
+	    if (adj->attr)
+	      {
+		route_vty_out_tmp (vty, &rn->p, adj->attr, safi);
+		output_count++;
+	      }
+	  }
       }
   
   if (output_count != 0)
@@ -13133,4 +13656,8 @@ bgp_route_finish (void)
 {
   bgp_table_unlock (bgp_distance_table);
   bgp_distance_table = NULL;
+
+  if (bgp_best_ops)
+    XFREE (MTYPE_BGP_PROCESS_QUEUE, bgp_best_ops);
+  bgp_best_ops_size = 0;
 }
@@ -61,6 +61,20 @@ struct bgp_info
   /* Multipath information */
   struct bgp_info_mpath *mpath;
 
+  /* Route node this path is on. */
+  struct bgp_node *net;
+
+  /* Nexthop cache entry this path depends on, and the other paths
+     depending on it. */
+  struct bgp_nexthop_cache *nexthop;
+  struct bgp_info *nh_next;
+  struct bgp_info *nh_prev;
+
+  /* Other paths from the same peer in the same address family, see
+     peer->paths.  */
+  struct bgp_info *peer_next;
+  struct bgp_info *peer_prev;
+
   /* Uptime.  */
   time_t uptime;
 
@@ -188,6 +202,7 @@ extern void bgp_clear_stale_route (struct peer *, afi_t, safi_t);
 extern struct bgp_info *bgp_info_lock (struct bgp_info *);
 extern struct bgp_info *bgp_info_unlock (struct bgp_info *);
 extern void bgp_info_add (struct bgp_node *rn, struct bgp_info *ri);
+extern void bgp_node_received_check (struct bgp_node *, struct peer *);
 extern void bgp_info_delete (struct bgp_node *rn, struct bgp_info *ri);
 extern struct bgp_info_extra *bgp_info_extra_get (struct bgp_info *);
 extern void bgp_info_set_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
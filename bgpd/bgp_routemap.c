@@ -621,7 +621,8 @@ struct route_map_rule_cmd route_match_aspath_cmd =
   "as-path",
   route_match_aspath,
   route_match_aspath_compile,
-  route_match_aspath_free
+  route_match_aspath_free,
+  RMAP_RULE_ATTR
 };
 
 /* `match community COMMUNIY' */
@@ -705,7 +706,8 @@ struct route_map_rule_cmd route_match_community_cmd =
   "community",
   route_match_community,
   route_match_community_compile,
-  route_match_community_free
+  route_match_community_free,
+  RMAP_RULE_ATTR
 };
 
 /* Match function for extcommunity match. */
@@ -754,7 +756,8 @@ struct route_map_rule_cmd route_match_ecommunity_cmd =
   "extcommunity",
   route_match_ecommunity,
   route_match_ecommunity_compile,
-  route_match_ecommunity_free
+  route_match_ecommunity_free,
+  RMAP_RULE_ATTR
 };
 
 /* `match nlri` and `set nlri` are replaced by `address-family ipv4`
@@ -810,7 +813,8 @@ struct route_map_rule_cmd route_match_origin_cmd =
   "origin",
   route_match_origin,
   route_match_origin_compile,
-  route_match_origin_free
+  route_match_origin_free,
+  RMAP_RULE_ATTR
 };
 
 /* match probability  { */
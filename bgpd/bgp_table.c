@@ -67,6 +67,74 @@ bgp_table_finish (struct bgp_table **rt)
     }
 }
 
+/* Nodes' peer bitmaps, and the bytes they take up.  */
+static unsigned long peer_bits_count;
+static unsigned long peer_bits_bytes;
+
+static size_t
+bgp_peer_bits_size (unsigned int words)
+{
+  return sizeof (struct bgp_peer_bits) + 2 * words * sizeof (u_int32_t);
+}
+
+static void
+bgp_peer_bits_free (struct bgp_peer_bits *pb)
+{
+  peer_bits_count--;
+  peer_bits_bytes -= bgp_peer_bits_size (pb->words);
+  XFREE (MTYPE_BGP_PEER_BITS, pb);
+}
+
+/* Put the peer with the given index in one of the node's sets.  */
+void
+bgp_node_peer_bit_set (struct bgp_node *node, int set, unsigned int index)
+{
+  struct bgp_peer_bits *pb = node->peer_bits;
+
+  if (! pb || index / 32 >= pb->words)
+    {
+      struct bgp_peer_bits *new;
+      unsigned int words;
+
+      /* Room for every index handed out so far, it being likely the
+         peers with them will come along too.  */
+      words = MAX (index / 32 + 1, (bm->peer_index_max + 31) / 32);
+      new = XCALLOC (MTYPE_BGP_PEER_BITS, bgp_peer_bits_size (words));
+      new->words = words;
+      peer_bits_count++;
+      peer_bits_bytes += bgp_peer_bits_size (words);
+      if (pb)
+	{
+	  memcpy (new->bits, pb->bits, pb->words * sizeof (u_int32_t));
+	  memcpy (new->bits + words, pb->bits + pb->words,
+		  pb->words * sizeof (u_int32_t));
+	  bgp_peer_bits_free (pb);
+	}
+      node->peer_bits = pb = new;
+    }
+
+  pb->bits[set * pb->words + index / 32] |= 1U << (index % 32);
+}
+
+/* Take the peer with the given index out of one of the node's sets.  */
+void
+bgp_node_peer_bit_unset (struct bgp_node *node, int set, unsigned int index)
+{
+  struct bgp_peer_bits *pb = node->peer_bits;
+
+  if (pb && index / 32 < pb->words)
+    pb->bits[set * pb->words + index / 32] &= ~(1U << (index % 32));
+}
+
+/* Nodes' peer bitmaps, and the bytes they take up.  */
+unsigned long
+bgp_peer_bits_count (unsigned long *bytes)
+{
+  if (bytes)
+    *bytes = peer_bits_bytes;
+  return peer_bits_count;
+}
+
 /*
  * bgp_node_create
  */
@@ -87,6 +155,8 @@ bgp_node_destroy (route_table_delegate_t *delegate,
 {
   struct bgp_node *bgp_node;
   bgp_node = bgp_node_from_rnode (node);
+  if (bgp_node->peer_bits)
+    bgp_peer_bits_free (bgp_node->peer_bits);
   XFREE (MTYPE_BGP_NODE, bgp_node);
 }
 
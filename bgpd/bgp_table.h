@@ -45,6 +45,22 @@ struct bgp_table
   struct route_table *route_table;
 };
 
+/* The peers a node has something from or for, a bit each by peer
+   index: those it has paths or adjacencies in received from, and those
+   it has adjacencies out advertised to.  Grown as peers with higher
+   indexes come along.  */
+struct bgp_peer_bits
+{
+  /* Words in each set.  */
+  unsigned int words;
+
+  /* The received set, then the advertised.  */
+  u_int32_t bits[];
+};
+
+#define BGP_PEER_BITS_RECEIVED   0
+#define BGP_PEER_BITS_ADVERTISED 1
+
 struct bgp_node
 {
   /*
@@ -57,10 +73,12 @@ struct bgp_node
    */
   ROUTE_NODE_FIELDS;
 
-  struct bgp_adj_out *adj_out;
+  struct bgp_adj_out_array *adj_out;
 
   struct bgp_adj_in *adj_in;
 
+  struct bgp_peer_bits *peer_bits;
+
   struct bgp_node *prn;
 
   u_char flags;
@@ -82,6 +100,9 @@ extern struct bgp_table *bgp_table_init (afi_t, safi_t);
 extern void bgp_table_lock (struct bgp_table *);
 extern void bgp_table_unlock (struct bgp_table *);
 extern void bgp_table_finish (struct bgp_table **);
+extern void bgp_node_peer_bit_set (struct bgp_node *, int, unsigned int);
+extern void bgp_node_peer_bit_unset (struct bgp_node *, int, unsigned int);
+extern unsigned long bgp_peer_bits_count (unsigned long *);
 
 
 /*
@@ -117,6 +138,21 @@ bgp_node_table (struct bgp_node *node)
   return bgp_node_to_rnode (node)->table->info;
 }
 
+/*
+ * bgp_node_peer_bit
+ *
+ * Whether the peer with the given index is in one of the node's sets
+ * of peers, BGP_PEER_BITS_RECEIVED or BGP_PEER_BITS_ADVERTISED.
+ */
+static inline int
+bgp_node_peer_bit (const struct bgp_node *node, int set, unsigned int index)
+{
+  const struct bgp_peer_bits *pb = node->peer_bits;
+
+  return pb && index / 32 < pb->words
+    && (pb->bits[set * pb->words + index / 32] & (1U << (index % 32)));
+}
+
 /*
  * bgp_node_info
  *
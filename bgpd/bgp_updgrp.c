@@ -0,0 +1,539 @@
+/* BGP update-groups
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Peers whose outbound policy and capabilities are the same get exactly
+ * the same bytes on the wire for the same advertisements.  Such peers are
+ * put into an update-group.  The first member to get round to sending a
+ * given UPDATE encodes it as usual and leaves it in the group; the
+ * others check that their own advertisement list would produce the same
+ * packet (same interned attribute, same originating peer, same prefixes
+ * in the same order) and, if so, queue the same packet data instead of
+ * encoding it again.  Only one copy of the data exists however many
+ * members it is queued to.
+ *
+ * Membership is re-checked every time a peer builds an UPDATE, so
+ * configuration changes simply move the peer to another group.
+ */
+
+#include <zebra.h>
+
+#include "command.h"
+#include "prefix.h"
+#include "linklist.h"
+#include "memory.h"
+#include "stream.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+
+/* af_flags which change either what gets advertised to a peer or how it
+ * is encoded. */
+#define BGP_UPDGRP_AF_FLAGS \
+  (PEER_FLAG_SEND_COMMUNITY | PEER_FLAG_SEND_EXT_COMMUNITY \
+   | PEER_FLAG_NEXTHOP_SELF | PEER_FLAG_NEXTHOP_SELF_ALL \
+   | PEER_FLAG_REFLECTOR_CLIENT | PEER_FLAG_RSERVER_CLIENT \
+   | PEER_FLAG_AS_PATH_UNCHANGED | PEER_FLAG_NEXTHOP_UNCHANGED \
+   | PEER_FLAG_MED_UNCHANGED | PEER_FLAG_REMOVE_PRIVATE_AS \
+   | PEER_FLAG_NEXTHOP_LOCAL_UNCHANGED)
+
+#define BGP_UPDGRP_FLAGS (PEER_FLAG_LOCAL_AS_REPLACE_AS)
+
+static unsigned int bgp_updgrp_id;
+
+static void
+bgp_updgrp_key_make (struct peer *peer, afi_t afi, safi_t safi,
+                     struct bgp_updgrp_key *key)
+{
+  struct bgp_filter *filter = &peer->filter[afi][safi];
+  struct bgp *bgp = peer->bgp;
+
+  memset (key, 0, sizeof (struct bgp_updgrp_key));
+
+  key->bgp = bgp;
+  key->afi = afi;
+  key->safi = safi;
+  key->sort = peer->sort;
+  key->as4 = CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV) ? 1 : 0;
+  key->local_as = peer->local_as;
+  key->change_local_as = peer->change_local_as;
+  key->flags = peer->flags & BGP_UPDGRP_FLAGS;
+  key->af_flags = peer->af_flags[afi][safi] & BGP_UPDGRP_AF_FLAGS;
+
+  key->bgp_config = bgp->config;
+  key->router_id = bgp->router_id;
+  key->cluster_id = bgp->cluster_id;
+  key->confed_id = bgp->confed_id;
+
+  key->dlist = filter->dlist[FILTER_OUT].name;
+  key->plist = filter->plist[FILTER_OUT].name;
+  key->aslist = filter->aslist[FILTER_OUT].name;
+  key->rmap = filter->map[RMAP_OUT].name;
+  key->usmap = filter->usmap.name;
+  key->orf_plist = peer->orf_plist[afi][safi];
+}
+
+static int
+bgp_updgrp_str_same (const char *s1, const char *s2)
+{
+  if (s1 == NULL || s2 == NULL)
+    return s1 == s2;
+  return strcmp (s1, s2) == 0;
+}
+
+static int
+bgp_updgrp_key_same (const struct bgp_updgrp_key *k1,
+                     const struct bgp_updgrp_key *k2)
+{
+  return k1->bgp == k2->bgp
+    && k1->afi == k2->afi
+    && k1->safi == k2->safi
+    && k1->sort == k2->sort
+    && k1->as4 == k2->as4
+    && k1->local_as == k2->local_as
+    && k1->change_local_as == k2->change_local_as
+    && k1->flags == k2->flags
+    && k1->af_flags == k2->af_flags
+    && k1->bgp_config == k2->bgp_config
+    && k1->router_id.s_addr == k2->router_id.s_addr
+    && k1->cluster_id.s_addr == k2->cluster_id.s_addr
+    && k1->confed_id == k2->confed_id
+    && k1->orf_plist == k2->orf_plist
+    && bgp_updgrp_str_same (k1->dlist, k2->dlist)
+    && bgp_updgrp_str_same (k1->plist, k2->plist)
+    && bgp_updgrp_str_same (k1->aslist, k2->aslist)
+    && bgp_updgrp_str_same (k1->rmap, k2->rmap)
+    && bgp_updgrp_str_same (k1->usmap, k2->usmap);
+}
+
+static char *
+bgp_updgrp_strdup (const char *str)
+{
+  return str ? XSTRDUP (MTYPE_BGP_UPDGRP, str) : NULL;
+}
+
+static void
+bgp_updgrp_pkt_free (struct bgp_updgrp_pkt *pkt)
+{
+  unsigned int i;
+
+  for (i = 0; i < pkt->count; i++)
+    bgp_unlock_node (pkt->rn[i]);
+
+  if (pkt->s)
+    stream_free (pkt->s);
+  if (pkt->attr)
+    bgp_attr_unintern (&pkt->attr);
+  if (pkt->from)
+    peer_unlock (pkt->from);
+
+  XFREE (MTYPE_BGP_UPDGRP_PKT, pkt->rn);
+  XFREE (MTYPE_BGP_UPDGRP_PKT, pkt);
+}
+
+static struct bgp_update_group *
+bgp_updgrp_new (struct bgp_updgrp_key *key)
+{
+  struct bgp_update_group *group;
+
+  group = XCALLOC (MTYPE_BGP_UPDGRP, sizeof (struct bgp_update_group));
+
+  group->id = ++bgp_updgrp_id;
+  group->key = *key;
+  group->key.dlist = bgp_updgrp_strdup (key->dlist);
+  group->key.plist = bgp_updgrp_strdup (key->plist);
+  group->key.aslist = bgp_updgrp_strdup (key->aslist);
+  group->key.rmap = bgp_updgrp_strdup (key->rmap);
+  group->key.usmap = bgp_updgrp_strdup (key->usmap);
+  group->peer = list_new ();
+  group->uptime = bgp_clock ();
+
+  listnode_add (key->bgp->update_groups, group);
+
+  return group;
+}
+
+static void
+bgp_updgrp_free (struct bgp_update_group *group)
+{
+  unsigned int i;
+
+  listnode_delete (group->key.bgp->update_groups, group);
+
+  for (i = 0; i < BGP_UPDGRP_PKT_MAX; i++)
+    if (group->pkt[i])
+      bgp_updgrp_pkt_free (group->pkt[i]);
+
+  if (group->key.dlist)
+    XFREE (MTYPE_BGP_UPDGRP, group->key.dlist);
+  if (group->key.plist)
+    XFREE (MTYPE_BGP_UPDGRP, group->key.plist);
+  if (group->key.aslist)
+    XFREE (MTYPE_BGP_UPDGRP, group->key.aslist);
+  if (group->key.rmap)
+    XFREE (MTYPE_BGP_UPDGRP, group->key.rmap);
+  if (group->key.usmap)
+    XFREE (MTYPE_BGP_UPDGRP, group->key.usmap);
+
+  list_delete (group->peer);
+  XFREE (MTYPE_BGP_UPDGRP, group);
+}
+
+void
+bgp_updgrp_peer_leave (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_update_group *group = peer->updgrp[afi][safi];
+
+  if (! group)
+    return;
+
+  peer->updgrp[afi][safi] = NULL;
+  listnode_delete (group->peer, peer);
+
+  if (list_isempty (group->peer))
+    bgp_updgrp_free (group);
+}
+
+void
+bgp_updgrp_peer_leave_all (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      bgp_updgrp_peer_leave (peer, afi, safi);
+}
+
+/* Make sure the peer is in the update-group matching its current
+ * configuration, moving it if need be. */
+void
+bgp_updgrp_peer_update (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_updgrp_key key;
+  struct bgp_update_group *group;
+  struct listnode *node;
+
+  bgp_updgrp_key_make (peer, afi, safi, &key);
+
+  group = peer->updgrp[afi][safi];
+  if (group && bgp_updgrp_key_same (&group->key, &key))
+    return;
+
+  bgp_updgrp_peer_leave (peer, afi, safi);
+
+  for (ALL_LIST_ELEMENTS_RO (peer->bgp->update_groups, node, group))
+    if (bgp_updgrp_key_same (&group->key, &key))
+      break;
+
+  if (! node)
+    group = bgp_updgrp_new (&key);
+
+  listnode_add (group->peer, peer);
+  peer->updgrp[afi][safi] = group;
+}
+
+/* Check whether the advertisements queued on the peer, starting at adv,
+ * are the ones the packet was built from.  This follows the order used
+ * by bgp_update_packet: the FIFO head first, then whatever else hangs
+ * off the same advertise attribute. */
+static int
+bgp_updgrp_pkt_match (struct bgp_updgrp_pkt *pkt, struct bgp_advertise *adv)
+{
+  struct bgp_advertise *next;
+  unsigned int i;
+
+  next = adv->baa->adv;
+  for (i = 1; i < pkt->count; i++)
+    {
+      if (next == adv)
+	next = next->next;
+      if (! next || next->rn != pkt->rn[i])
+	return 0;
+      next = next->next;
+    }
+  return 1;
+}
+
+/* Find an UPDATE built by another member of the peer's update-group that
+ * is exactly what the peer would build itself from adv onwards. */
+struct bgp_updgrp_pkt *
+bgp_updgrp_pkt_lookup (struct peer *peer, afi_t afi, safi_t safi,
+                       struct bgp_advertise *adv)
+{
+  struct bgp_update_group *group;
+  struct bgp_updgrp_pkt *pkt;
+  struct peer *from;
+  unsigned int i;
+
+  bgp_updgrp_peer_update (peer, afi, safi);
+  group = peer->updgrp[afi][safi];
+
+  if (listcount (group->peer) < 2 || ! adv->baa || ! adv->baa->attr)
+    return NULL;
+
+  from = adv->binfo ? adv->binfo->peer : NULL;
+
+  for (i = 0; i < BGP_UPDGRP_PKT_MAX; i++)
+    {
+      pkt = group->pkt[i];
+      if (pkt
+	  && pkt->rn[0] == adv->rn
+	  && pkt->attr == adv->baa->attr
+	  && pkt->from == from
+	  && bgp_updgrp_pkt_match (pkt, adv))
+	return pkt;
+    }
+  return NULL;
+}
+
+/* Hand a shared packet to the peer.  The caller must already have
+ * consumed the pkt->count advertisements it stands for. */
+struct stream *
+bgp_updgrp_pkt_use (struct peer *peer, afi_t afi, safi_t safi,
+                    struct bgp_updgrp_pkt *pkt)
+{
+  struct bgp_update_group *group = peer->updgrp[afi][safi];
+  struct stream *s;
+  unsigned int i;
+
+  group->shared++;
+  group->pfx_shared += pkt->count;
+
+  s = stream_share (pkt->s);
+
+  /* Everyone had it, no need to keep it around. */
+  if (pkt->pending && --pkt->pending == 0)
+    {
+      for (i = 0; i < BGP_UPDGRP_PKT_MAX; i++)
+	if (group->pkt[i] == pkt)
+	  group->pkt[i] = NULL;
+      bgp_updgrp_pkt_free (pkt);
+    }
+
+  return s;
+}
+
+/* Start recording the prefixes of an UPDATE about to be encoded, so that
+ * other members can reuse it.  Returns NULL if nobody else would. */
+struct bgp_updgrp_pkt *
+bgp_updgrp_pkt_new (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_update_group *group = peer->updgrp[afi][safi];
+  struct bgp_updgrp_pkt *pkt;
+
+  /* The VPN encoding depends on per-path labels and the peer's own
+   * nexthop, which the group key does not cover. */
+  if (! group || listcount (group->peer) < 2 || safi == SAFI_MPLS_VPN)
+    return NULL;
+
+  pkt = XCALLOC (MTYPE_BGP_UPDGRP_PKT, sizeof (struct bgp_updgrp_pkt));
+  pkt->size = 64;
+  pkt->rn = XMALLOC (MTYPE_BGP_UPDGRP_PKT,
+                     pkt->size * sizeof (struct bgp_node *));
+  return pkt;
+}
+
+void
+bgp_updgrp_pkt_add_prefix (struct bgp_updgrp_pkt *pkt, struct bgp_node *rn)
+{
+  if (pkt->count == pkt->size)
+    {
+      pkt->size *= 2;
+      pkt->rn = XREALLOC (MTYPE_BGP_UPDGRP_PKT, pkt->rn,
+                          pkt->size * sizeof (struct bgp_node *));
+    }
+  pkt->rn[pkt->count++] = bgp_lock_node (rn);
+}
+
+/* Account for an UPDATE encoded for the peer and, when pkt is given,
+ * leave it for the rest of the group to share. */
+void
+bgp_updgrp_pkt_commit (struct peer *peer, afi_t afi, safi_t safi,
+                       struct bgp_updgrp_pkt *pkt, struct stream *packet,
+                       struct attr *attr, struct peer *from,
+                       unsigned int count)
+{
+  struct bgp_update_group *group = peer->updgrp[afi][safi];
+
+  if (! group)
+    {
+      if (pkt)
+	bgp_updgrp_pkt_discard (pkt);
+      return;
+    }
+
+  group->encoded++;
+  group->pfx_encoded += count;
+
+  if (! pkt)
+    return;
+
+  if (! pkt->count)
+    {
+      bgp_updgrp_pkt_discard (pkt);
+      return;
+    }
+
+  pkt->s = stream_share (packet);
+  pkt->attr = bgp_attr_intern (attr);
+  pkt->from = from ? peer_lock (from) : NULL;
+  pkt->pending = listcount (group->peer) - 1;
+
+  if (group->pkt[group->pkt_next])
+    bgp_updgrp_pkt_free (group->pkt[group->pkt_next]);
+  group->pkt[group->pkt_next] = pkt;
+  group->pkt_next = (group->pkt_next + 1) % BGP_UPDGRP_PKT_MAX;
+}
+
+void
+bgp_updgrp_pkt_discard (struct bgp_updgrp_pkt *pkt)
+{
+  bgp_updgrp_pkt_free (pkt);
+}
+
+static void
+bgp_show_updgrp_policy (struct vty *vty, const char *what, const char *name,
+                        int *first)
+{
+  if (! name)
+    return;
+  vty_out (vty, "%s%s %s", *first ? "  Outbound policy: " : ", ", what, name);
+  *first = 0;
+}
+
+static void
+bgp_show_updgrp (struct vty *vty, struct bgp_update_group *group)
+{
+  struct bgp_updgrp_key *key = &group->key;
+  struct listnode *node;
+  struct peer *peer;
+  char timebuf[BGP_UPTIME_LEN];
+  unsigned int i, queued;
+  int first = 1;
+
+  vty_out (vty, "Update-group %u, %s, %s%s%s", group->id,
+	   afi_safi_print (key->afi, key->safi),
+	   key->sort == BGP_PEER_IBGP ? "internal"
+	   : key->sort == BGP_PEER_CONFED ? "confed-external" : "external",
+	   key->as4 ? ", 4-octet AS" : "", VTY_NEWLINE);
+  vty_out (vty, "  Created %s ago%s",
+	   peer_uptime (group->uptime, timebuf, BGP_UPTIME_LEN), VTY_NEWLINE);
+
+  if (key->change_local_as)
+    vty_out (vty, "  Local AS %u%s%s", key->change_local_as,
+	     CHECK_FLAG (key->flags, PEER_FLAG_LOCAL_AS_REPLACE_AS)
+	     ? " replace-as" : "", VTY_NEWLINE);
+
+  bgp_show_updgrp_policy (vty, "route-map", key->rmap, &first);
+  bgp_show_updgrp_policy (vty, "unsuppress-map", key->usmap, &first);
+  bgp_show_updgrp_policy (vty, "prefix-list", key->plist, &first);
+  bgp_show_updgrp_policy (vty, "distribute-list", key->dlist, &first);
+  bgp_show_updgrp_policy (vty, "filter-list", key->aslist, &first);
+  if (key->orf_plist)
+    bgp_show_updgrp_policy (vty, "ORF", "prefix-list", &first);
+  if (! first)
+    vty_out (vty, "%s", VTY_NEWLINE);
+
+  for (queued = 0, i = 0; i < BGP_UPDGRP_PKT_MAX; i++)
+    if (group->pkt[i])
+      queued++;
+
+  vty_out (vty, "  UPDATEs encoded %lu (%lu prefixes), "
+	   "shared %lu (%lu prefixes)%s",
+	   group->encoded, group->pfx_encoded,
+	   group->shared, group->pfx_shared, VTY_NEWLINE);
+  vty_out (vty, "  UPDATEs held for reuse %u%s", queued, VTY_NEWLINE);
+
+  vty_out (vty, "  %d member%s:", listcount (group->peer),
+	   listcount (group->peer) == 1 ? "" : "s");
+  for (ALL_LIST_ELEMENTS_RO (group->peer, node, peer))
+    vty_out (vty, " %s", peer->host);
+  vty_out (vty, "%s%s", VTY_NEWLINE, VTY_NEWLINE);
+}
+
+static int
+bgp_show_updgrp_vty (struct vty *vty, const char *name)
+{
+  struct bgp *bgp;
+  struct bgp_update_group *group;
+  struct listnode *node;
+
+  if (name)
+    {
+      bgp = bgp_lookup_by_name (name);
+      if (bgp == NULL)
+	{
+	  vty_out (vty, "%% No such BGP instance exist%s", VTY_NEWLINE);
+	  return CMD_WARNING;
+	}
+    }
+  else
+    {
+      bgp = bgp_get_default ();
+      if (bgp == NULL)
+	{
+	  vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+	  return CMD_WARNING;
+	}
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->update_groups, node, group))
+    bgp_show_updgrp (vty, group);
+
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_ip_bgp_update_groups,
+       show_ip_bgp_update_groups_cmd,
+       "show ip bgp update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Update-groups of peers sharing outbound UPDATEs\n")
+{
+  return bgp_show_updgrp_vty (vty, NULL);
+}
+
+DEFUN (show_ip_bgp_instance_update_groups,
+       show_ip_bgp_instance_update_groups_cmd,
+       "show ip bgp view WORD update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "BGP view\n"
+       "View name\n"
+       "Update-groups of peers sharing outbound UPDATEs\n")
+{
+  return bgp_show_updgrp_vty (vty, argv[0]);
+}
+
+void
+bgp_updgrp_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (VIEW_NODE, &show_ip_bgp_instance_update_groups_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_instance_update_groups_cmd);
+}
@@ -0,0 +1,128 @@
+/* BGP update-groups
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_UPDGRP_H
+#define _QUAGGA_BGP_UPDGRP_H
+
+#include "bgpd/bgp_advertise.h"
+
+/* Number of recently built UPDATEs an update-group keeps around for
+ * the other members to pick up.
+ */
+#define BGP_UPDGRP_PKT_MAX 64
+
+/* Everything that goes into the encoding of an UPDATE for a peer, apart
+ * from the (interned) attribute and the prefixes themselves.  Peers with
+ * equal keys produce byte-identical UPDATEs for the same advertisements.
+ */
+struct bgp_updgrp_key
+{
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  bgp_peer_sort_t sort;
+  int as4;
+  as_t local_as;
+  as_t change_local_as;
+  u_int32_t flags;
+  u_int32_t af_flags;
+
+  /* Instance wide values copied into ORIGINATOR_ID/CLUSTER_LIST and
+   * AS_PATH. */
+  u_int16_t bgp_config;
+  struct in_addr router_id;
+  struct in_addr cluster_id;
+  as_t confed_id;
+
+  /* Outbound policy, by name. */
+  char *dlist;
+  char *plist;
+  char *aslist;
+  char *rmap;
+  char *usmap;
+  struct prefix_list *orf_plist;
+};
+
+/* An UPDATE built for one member, waiting to be reused by the others. */
+struct bgp_updgrp_pkt
+{
+  /* Encoded packet, header length already set.  Shared with the
+   * output queues of the members it was handed to. */
+  struct stream *s;
+
+  /* What went into it: attribute, originating peer and prefixes, in the
+   * order they were taken off the advertisement list. */
+  struct attr *attr;
+  struct peer *from;
+  struct bgp_node **rn;
+  unsigned int count;
+  unsigned int size;
+
+  /* Members that have not picked this packet up yet. */
+  unsigned int pending;
+};
+
+struct bgp_update_group
+{
+  /* Sequence number, for display. */
+  unsigned int id;
+
+  struct bgp_updgrp_key key;
+
+  /* Member peers. */
+  struct list *peer;
+
+  /* Ring of recently built packets. */
+  struct bgp_updgrp_pkt *pkt[BGP_UPDGRP_PKT_MAX];
+  unsigned int pkt_next;
+
+  time_t uptime;
+
+  /* Statistics. */
+  unsigned long encoded;	/* UPDATEs encoded from scratch */
+  unsigned long shared;		/* UPDATEs reused from another member */
+  unsigned long pfx_encoded;	/* prefixes in encoded UPDATEs */
+  unsigned long pfx_shared;	/* prefixes in reused UPDATEs */
+};
+
+extern void bgp_updgrp_init (void);
+
+extern void bgp_updgrp_peer_update (struct peer *, afi_t, safi_t);
+extern void bgp_updgrp_peer_leave (struct peer *, afi_t, safi_t);
+extern void bgp_updgrp_peer_leave_all (struct peer *);
+
+extern struct bgp_updgrp_pkt *bgp_updgrp_pkt_lookup (struct peer *, afi_t,
+                                                     safi_t,
+                                                     struct bgp_advertise *);
+extern struct stream *bgp_updgrp_pkt_use (struct peer *, afi_t, safi_t,
+                                          struct bgp_updgrp_pkt *);
+
+extern struct bgp_updgrp_pkt *bgp_updgrp_pkt_new (struct peer *, afi_t,
+                                                  safi_t);
+extern void bgp_updgrp_pkt_add_prefix (struct bgp_updgrp_pkt *,
+                                       struct bgp_node *);
+extern void bgp_updgrp_pkt_commit (struct peer *, afi_t, safi_t,
+                                   struct bgp_updgrp_pkt *, struct stream *,
+                                   struct attr *, struct peer *,
+                                   unsigned int);
+extern void bgp_updgrp_pkt_discard (struct bgp_updgrp_pkt *);
+
+#endif /* _QUAGGA_BGP_UPDGRP_H */
@@ -40,6 +40,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_damp.h"
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_io.h"
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_nexthop.h"
 #include "bgpd/bgp_open.h"
@@ -49,6 +50,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_workers.h"
 
 extern struct in_addr router_id_zebra;
 
@@ -286,6 +288,37 @@ DEFUN (no_bgp_config_type,
   return CMD_SUCCESS;
 }
 
+DEFUN (bgp_worker_threads,
+       bgp_worker_threads_cmd,
+       "bgp worker-threads <1-64>",
+       BGP_STR
+       "Threads to spread best path selection over\n"
+       "Number of threads, counting the main one\n")
+{
+  VTY_GET_INTEGER_RANGE ("worker threads", bm->workers, argv[0],
+                         1, BGP_WORKERS_MAX);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_worker_threads,
+       no_bgp_worker_threads_cmd,
+       "no bgp worker-threads",
+       NO_STR
+       BGP_STR
+       "Threads to spread best path selection over\n")
+{
+  bm->workers = BGP_WORKERS_DEFAULT;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_bgp_worker_threads,
+       no_bgp_worker_threads_val_cmd,
+       "no bgp worker-threads <1-64>",
+       NO_STR
+       BGP_STR
+       "Threads to spread best path selection over\n"
+       "Number of threads, counting the main one\n")
+
 DEFUN (no_synchronization,
        no_synchronization_cmd,
        "no synchronization",
@@ -1046,9 +1079,15 @@ DEFUN (bgp_enforce_first_as,
        "Enforce the first AS for EBGP routes\n")
 {
   struct bgp *bgp;
+  struct peer *peer;
+  struct listnode *node;
 
   bgp = vty->index;
   bgp_flag_set (bgp, BGP_FLAG_ENFORCE_FIRST_AS);
+
+  /* Attributes cached were not checked. */
+  for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
+    bgp_attr_cache_flush (peer);
   return CMD_SUCCESS;
 }
 
@@ -6798,7 +6837,7 @@ DEFUN (show_bgp_memory,
        "Global BGP memory statistics\n")
 {
   char memstrbuf[MTYPE_MEMSTR_LEN];
-  unsigned long count;
+  unsigned long count, bytes;
   
   /* RIB related usage stats */
   count = mtype_stats_alloc (MTYPE_BGP_NODE);
@@ -6830,10 +6869,13 @@ DEFUN (show_bgp_memory,
              mtype_memstr (memstrbuf, sizeof (memstrbuf),
                            count * sizeof (struct bgp_adj_in)),
              VTY_NEWLINE);
-  if ((count = mtype_stats_alloc (MTYPE_BGP_ADJ_OUT)))
+  if ((count = bgp_adj_out_count (&bytes)))
     vty_out (vty, "%ld Adj-Out entries, using %s of memory%s", count,
-             mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                           count * sizeof (struct bgp_adj_out)),
+             mtype_memstr (memstrbuf, sizeof (memstrbuf), bytes),
+             VTY_NEWLINE);
+  if ((count = bgp_peer_bits_count (&bytes)))
+    vty_out (vty, "%ld Node peer bitmaps, using %s of memory%s", count,
+             mtype_memstr (memstrbuf, sizeof (memstrbuf), bytes),
              VTY_NEWLINE);
   
   if ((count = mtype_stats_alloc (MTYPE_BGP_NEXTHOP_CACHE)))
@@ -6875,6 +6917,18 @@ DEFUN (show_bgp_memory,
            mtype_memstr (memstrbuf, sizeof (memstrbuf),
                          count * sizeof (struct assegment)),
            VTY_NEWLINE);
+
+  /* AS_PATH strings are only made when wanted, see aspath_print. */
+  count = aspath_str_count (&bytes);
+  vty_out (vty, "%ld BGP AS-PATH strings, using %s of memory%s", count,
+           mtype_memstr (memstrbuf, sizeof (memstrbuf), bytes),
+           VTY_NEWLINE);
+  if (count && aspath_count () > count)
+    vty_out (vty, "%ld BGP AS-PATH strings not made, saving about %s%s",
+             aspath_count () - count,
+             mtype_memstr (memstrbuf, sizeof (memstrbuf),
+                           (aspath_count () - count) * (bytes / count)),
+             VTY_NEWLINE);
   
   /* Other attributes */
   if ((count = community_count ()))
@@ -6882,6 +6936,8 @@ DEFUN (show_bgp_memory,
              mtype_memstr (memstrbuf, sizeof (memstrbuf),
                          count * sizeof (struct community)),
              VTY_NEWLINE);
+  if ((count = mtype_stats_alloc (MTYPE_COMMUNITY_STR)))
+    vty_out (vty, "%ld BGP community strings%s", count, VTY_NEWLINE);
   if ((count = mtype_stats_alloc (MTYPE_ECOMMUNITY)))
     vty_out (vty, "%ld BGP community entries, using %s of memory%s", count,
              mtype_memstr (memstrbuf, sizeof (memstrbuf),
@@ -7839,6 +7895,19 @@ bgp_show_peer (struct vty *vty, struct peer *p)
             peer_uptime (p->resettime, timebuf, BGP_UPTIME_LEN),
             peer_down_str[(int) p->last_reset], VTY_NEWLINE);
 
+  if (p->status == Clearing)
+    {
+      struct timeval now;
+
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+      vty_out (vty, "  Clearing %lu routes, for %lu ms so far%s",
+	       p->clear_paths, timeval_elapsed (now, p->clear_start) / 1000,
+	       VTY_NEWLINE);
+    }
+  else if (p->clear_start.tv_sec)
+    vty_out (vty, "  Last clear of %lu routes took %lu ms%s",
+	     p->clear_paths, p->clear_usec / 1000, VTY_NEWLINE);
+
   if (CHECK_FLAG (p->sflags, PEER_STATUS_PREFIX_OVERFLOW))
     {
       vty_out (vty, "  Peer had exceeded the max. no. of prefixes configured.%s", VTY_NEWLINE);
@@ -7918,6 +7987,7 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 	   p->t_read ? "on" : "off",
 	   p->t_write ? "on" : "off",
 	   VTY_NEWLINE);
+  bgp_io_show_peer (vty, p);
 
   if (p->notify.code == BGP_NOTIFY_OPEN_ERR
       && p->notify.subcode == BGP_NOTIFY_OPEN_UNSUP_CAPBL)
@@ -8266,6 +8336,14 @@ DEFUN (show_ip_bgp_attr_info,
        BGP_STR
        "List all bgp attribute information\n")
 {
+  unsigned long hits, misses, entries, bytes;
+
+  bgp_attr_cache_stats (&hits, &misses, &entries, &bytes);
+  vty_out (vty, "Attribute cache: %lu hits, %lu misses (%lu%% hit), "
+	   "%lu entries, %lu bytes%s", hits, misses,
+	   hits + misses ? hits * 100 / (hits + misses) : 0,
+	   entries, bytes, VTY_NEWLINE);
+
   attr_show_all (vty);
   return CMD_SUCCESS;
 }
@@ -9125,6 +9203,11 @@ bgp_vty_init (void)
   install_element (CONFIG_NODE, &bgp_config_type_cmd);
   install_element (CONFIG_NODE, &no_bgp_config_type_cmd);
 
+  /* "bgp worker-threads" commands. */
+  install_element (CONFIG_NODE, &bgp_worker_threads_cmd);
+  install_element (CONFIG_NODE, &no_bgp_worker_threads_cmd);
+  install_element (CONFIG_NODE, &no_bgp_worker_threads_val_cmd);
+
   /* Dummy commands (Currently not supported) */
   install_element (BGP_NODE, &no_synchronization_cmd);
   install_element (BGP_NODE, &no_auto_summary_cmd);
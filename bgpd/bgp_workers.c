@@ -0,0 +1,202 @@
+/* BGP best path selection worker threads.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* bgp_workers_run calls a function for each of a number of items,
+ * spreading the calls over "bgp worker-threads" threads, and returns
+ * once all of them are done.  The main thread takes its share of the
+ * items too, so nothing else runs in the main thread meanwhile.
+ *
+ * The function must only look at, or change, what belongs to its own
+ * item: it must not allocate through the MTYPE counters, log, or
+ * touch anything another item could.
+ *
+ * The threads are started the first time they are needed, which is
+ * after bgpd has daemonized, and restarted when the configured number
+ * changes.
+ */
+
+#include <zebra.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_workers.h"
+
+/* Items handed out at a time. */
+#define BGP_WORKERS_CHUNK 8
+
+static struct
+{
+  pthread_mutex_t mtx;
+  pthread_cond_t work;
+  pthread_cond_t done;
+
+  pthread_t thread[BGP_WORKERS_MAX];
+  unsigned int nthreads;
+  unsigned int wanted;
+  int stop;
+
+  /* Current job. */
+  void (*func) (void *, unsigned int);
+  void *arg;
+  unsigned int count;
+  unsigned int next;
+  unsigned int finished;
+} bgp_workers =
+{
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+};
+
+/* Work through the current job's items until none are left to hand
+   out.  Called, and returns, with the lock held. */
+static void
+bgp_workers_take (void)
+{
+  void (*func) (void *, unsigned int);
+  void *arg;
+  unsigned int i, start, end;
+
+  while (bgp_workers.next < bgp_workers.count)
+    {
+      func = bgp_workers.func;
+      arg = bgp_workers.arg;
+      start = bgp_workers.next;
+      end = MIN (start + BGP_WORKERS_CHUNK, bgp_workers.count);
+      bgp_workers.next = end;
+
+      pthread_mutex_unlock (&bgp_workers.mtx);
+      for (i = start; i < end; i++)
+	func (arg, i);
+      pthread_mutex_lock (&bgp_workers.mtx);
+
+      bgp_workers.finished += end - start;
+      if (bgp_workers.finished == bgp_workers.count)
+	pthread_cond_signal (&bgp_workers.done);
+    }
+}
+
+static void *
+bgp_workers_thread_main (void *arg)
+{
+  pthread_mutex_lock (&bgp_workers.mtx);
+  while (! bgp_workers.stop)
+    {
+      if (bgp_workers.next < bgp_workers.count)
+	bgp_workers_take ();
+      else
+	pthread_cond_wait (&bgp_workers.work, &bgp_workers.mtx);
+    }
+  pthread_mutex_unlock (&bgp_workers.mtx);
+
+  return NULL;
+}
+
+static void
+bgp_workers_stop (void)
+{
+  unsigned int i;
+
+  if (! bgp_workers.nthreads)
+    return;
+
+  pthread_mutex_lock (&bgp_workers.mtx);
+  bgp_workers.stop = 1;
+  pthread_cond_broadcast (&bgp_workers.work);
+  pthread_mutex_unlock (&bgp_workers.mtx);
+
+  for (i = 0; i < bgp_workers.nthreads; i++)
+    pthread_join (bgp_workers.thread[i], NULL);
+
+  bgp_workers.nthreads = 0;
+  bgp_workers.stop = 0;
+}
+
+static void
+bgp_workers_start (unsigned int wanted)
+{
+  sigset_t set, oset;
+  int ret;
+
+  bgp_workers_stop ();
+  bgp_workers.wanted = wanted;
+
+  /* Signals are for the main thread. */
+  sigfillset (&set);
+  pthread_sigmask (SIG_SETMASK, &set, &oset);
+  while (bgp_workers.nthreads + 1 < wanted)
+    {
+      ret = pthread_create (&bgp_workers.thread[bgp_workers.nthreads], NULL,
+			    bgp_workers_thread_main, NULL);
+      if (ret)
+	{
+	  zlog_warn ("%s: pthread_create: %s, using %u worker threads",
+		     __func__, safe_strerror (ret), bgp_workers.nthreads + 1);
+	  break;
+	}
+      bgp_workers.nthreads++;
+    }
+  pthread_sigmask (SIG_SETMASK, &oset, NULL);
+}
+
+void
+bgp_workers_run (void (*func) (void *, unsigned int), void *arg,
+		 unsigned int count)
+{
+  unsigned int i;
+
+  if (bm->workers != bgp_workers.wanted)
+    bgp_workers_start (bm->workers);
+
+  /* Not worth waking anyone for. */
+  if (! bgp_workers.nthreads || count <= BGP_WORKERS_CHUNK)
+    {
+      for (i = 0; i < count; i++)
+	func (arg, i);
+      return;
+    }
+
+  pthread_mutex_lock (&bgp_workers.mtx);
+  bgp_workers.func = func;
+  bgp_workers.arg = arg;
+  bgp_workers.count = count;
+  bgp_workers.next = 0;
+  bgp_workers.finished = 0;
+  pthread_cond_broadcast (&bgp_workers.work);
+
+  bgp_workers_take ();
+  while (bgp_workers.finished < bgp_workers.count)
+    pthread_cond_wait (&bgp_workers.done, &bgp_workers.mtx);
+
+  bgp_workers.func = NULL;
+  bgp_workers.arg = NULL;
+  bgp_workers.count = bgp_workers.next = 0;
+  pthread_mutex_unlock (&bgp_workers.mtx);
+}
+
+void
+bgp_workers_finish (void)
+{
+  bgp_workers_stop ();
+  bgp_workers.wanted = 0;
+}
@@ -0,0 +1,33 @@
+/* BGP best path selection worker threads.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_WORKERS_H
+#define _QUAGGA_BGP_WORKERS_H
+
+/* Number of threads best path selection is spread over, counting the
+   main thread. */
+#define BGP_WORKERS_DEFAULT 1
+#define BGP_WORKERS_MAX    64
+
+extern void bgp_workers_run (void (*) (void *, unsigned int), void *,
+			     unsigned int);
+extern void bgp_workers_finish (void);
+
+#endif /* _QUAGGA_BGP_WORKERS_H */
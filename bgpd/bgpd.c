@@ -48,6 +48,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_clist.h"
 #include "bgpd/bgp_fsm.h"
 #include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_open.h"
 #include "bgpd/bgp_filter.h"
@@ -58,6 +59,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_workers.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -705,6 +708,51 @@ peer_sort (struct peer *peer)
   return peer->sort;
 }
 
+/* Give the peer the lowest index not in use.  */
+static void
+peer_index_get (struct peer *peer)
+{
+  unsigned int i, bit;
+
+  for (i = 0; i < bm->peer_index_words; i++)
+    if (bm->peer_index_map[i] != 0xffffffff)
+      break;
+
+  if (i == bm->peer_index_words)
+    {
+      unsigned int words = MAX (4, 2 * bm->peer_index_words);
+
+      bm->peer_index_map = XREALLOC (MTYPE_BGP_PEER_INDEX,
+				     bm->peer_index_map,
+				     words * sizeof (u_int32_t));
+      memset (bm->peer_index_map + bm->peer_index_words, 0,
+	      (words - bm->peer_index_words) * sizeof (u_int32_t));
+      bm->peer_by_index = XREALLOC (MTYPE_BGP_PEER_INDEX,
+				    bm->peer_by_index,
+				    words * 32 * sizeof (struct peer *));
+      memset (bm->peer_by_index + bm->peer_index_words * 32, 0,
+	      (words - bm->peer_index_words) * 32 * sizeof (struct peer *));
+      bm->peer_index_words = words;
+    }
+
+  for (bit = 0; bm->peer_index_map[i] & (1U << bit); bit++)
+    ;
+  bm->peer_index_map[i] |= 1U << bit;
+  peer->index = i * 32 + bit;
+  bm->peer_by_index[peer->index] = peer;
+  bm->peer_index_max = MAX (bm->peer_index_max, peer->index + 1);
+}
+
+static void
+peer_index_put (struct peer *peer)
+{
+  unsigned int index = peer->index;
+
+  assert (bm->peer_by_index[index] == peer);
+  bm->peer_index_map[index / 32] &= ~(1U << (index % 32));
+  bm->peer_by_index[index] = NULL;
+}
+
 static void
 peer_free (struct peer *peer)
 {
@@ -719,6 +767,7 @@ peer_free (struct peer *peer)
   BGP_READ_OFF (peer->t_read);
   BGP_WRITE_OFF (peer->t_write);
   BGP_EVENT_FLUSH (peer);
+  bgp_io_stop (peer);
   
   if (peer->desc)
     XFREE (MTYPE_PEER_DESC, peer->desc);
@@ -736,8 +785,11 @@ peer_free (struct peer *peer)
     
   if (peer->clear_node_queue)
     work_queue_free (peer->clear_node_queue);
+
+  bgp_attr_cache_flush (peer);
   
   bgp_sync_delete (peer);
+  peer_index_put (peer);
   memset (peer, 0, sizeof (struct peer));
   
   XFREE (MTYPE_BGP_PEER, peer);
@@ -812,6 +864,7 @@ peer_new (struct bgp *bgp)
   peer->weight = 0;
   peer->password = NULL;
   peer->bgp = bgp;
+  peer_index_get (peer);
   peer = peer_lock (peer); /* initial reference */
   bgp_lock (bgp);
 
@@ -1963,6 +2016,8 @@ bgp_create (as_t *as, const char *name)
   bgp->rsclient = list_new ();
   bgp->rsclient->cmp = (int (*)(void*, void*)) peer_cmp;
 
+  bgp->update_groups = list_new ();
+
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       {
@@ -2182,6 +2237,7 @@ bgp_free (struct bgp *bgp)
   list_delete (bgp->group);
   list_delete (bgp->peer);
   list_delete (bgp->rsclient);
+  list_delete (bgp->update_groups);
 
   if (bgp->name)
     free (bgp->name);
@@ -5222,6 +5278,13 @@ bgp_config_write (struct vty *vty)
       write++;
     }
 
+  /* Best path selection threads. */
+  if (bm->workers != BGP_WORKERS_DEFAULT)
+    {
+      vty_out (vty, "bgp worker-threads %u%s", bm->workers, VTY_NEWLINE);
+      write++;
+    }
+
   /* BGP Config type. */
   if (bgp_option_check (BGP_OPT_CONFIG_CISCO))
     {    
@@ -5413,6 +5476,7 @@ bgp_master_init (void)
   bm->port = BGP_PORT_DEFAULT;
   bm->master = thread_master_create ();
   bm->start_time = bgp_clock ();
+  bm->workers = BGP_WORKERS_DEFAULT;
 }
 
 
@@ -5434,6 +5498,7 @@ bgp_init (void)
   bgp_address_init ();
   bgp_scan_init ();
   bgp_mplsvpn_init ();
+  bgp_updgrp_init ();
 
   /* Access list initialize. */
   access_list_init ();
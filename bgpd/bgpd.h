@@ -54,6 +54,16 @@ struct bgp_master
   /* BGP start time.  */
   time_t start_time;
 
+  /* Threads best path selection runs in, counting the main thread.  */
+  unsigned int workers;
+
+  /* Peer indexes in use, a bit each, the peers that have them, and
+     one past the highest handed out so far.  */
+  u_int32_t *peer_index_map;
+  struct peer **peer_by_index;
+  unsigned int peer_index_words;
+  unsigned int peer_index_max;
+
   /* Various BGP global configuration.  */
   u_char options;
 #define BGP_OPT_NO_FIB                   (1 << 0)
@@ -86,6 +96,9 @@ struct bgp
   /* BGP route-server-clients. */
   struct list *rsclient;
 
+  /* Update-groups of peers sharing outbound UPDATEs. */
+  struct list *update_groups;
+
   /* BGP configuration.  */
   u_int16_t config;
 #define BGP_CONFIG_ROUTER_ID              (1 << 0)
@@ -286,6 +299,10 @@ struct peer
    */
   int lock;
 
+  /* Small number no other peer has at the time, for indexing per-peer
+     state in arrays.  */
+  unsigned int index;
+
   /* BGP peer group.  */
   struct peer_group *group;
   u_char af_group[AFI_MAX][SAFI_MAX];
@@ -330,6 +347,7 @@ struct peer
 
   /* Peer information */
   int fd;			/* File descriptor */
+  struct bgp_io_conn *io;	/* Socket as handed to the I/O thread. */
   int ttl;			/* TTL of TCP connection to the peer. */
   int gtsm_hops;		/* minimum hopcount to peer */
   char *desc;			/* Description of the peer. */
@@ -476,7 +494,6 @@ struct peer
   struct thread *t_start;
   struct thread *t_connect;
   struct thread *t_holdtime;
-  struct thread *t_keepalive;
   struct thread *t_asorig;
   struct thread *t_routeadv;
   struct thread *t_pmax_restart;
@@ -485,6 +502,22 @@ struct peer
   
   /* workqueues */
   struct work_queue *clear_node_queue;
+
+  /* Paths from the peer, linked through bgp_info peer_next, and the
+     entries it has in Adj-RIBs-In and -Out.  */
+  struct bgp_info *paths[AFI_MAX][SAFI_MAX];
+  unsigned long adjcount[AFI_MAX][SAFI_MAX];
+
+  /* Address families whose Adj-RIBs wait on bgp_clear_adj_run, and how
+     the clear in progress, or the last one, went.  */
+  unsigned int clear_adj;
+  struct timeval clear_start;
+  unsigned long clear_paths;
+  unsigned long clear_usec;
+
+  /* Attributes lately received, by their bytes on the wire, see
+     bgp_attr_cache_get.  */
+  struct bgp_attr_cache *attr_cache;
   
   /* Statistics field */
   u_int32_t open_in;		/* Open message input count */
@@ -515,6 +548,9 @@ struct peer
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
+  /* Update-group the peer currently belongs to.  */
+  struct bgp_update_group *updgrp[AFI_MAX][SAFI_MAX];
+
   /* Notify data. */
   struct bgp_notify notify;
 
@@ -0,0 +1,104 @@
+/*
+ * Arena allocator, for temporaries freed all at once.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "memory.h"
+#include "arena.h"
+
+/* Chunk headers are padded so what follows them is aligned. */
+#define ARENA_HEADER_SIZE \
+  ((sizeof (struct arena_chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static struct arena_chunk *
+arena_chunk_new (struct arena *arena, size_t size)
+{
+  struct arena_chunk *chunk;
+
+  chunk = XMALLOC (arena->mtype, ARENA_HEADER_SIZE + size);
+  chunk->size = size;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+  arena->pnt = (char *) chunk + ARENA_HEADER_SIZE;
+  arena->end = arena->pnt + size;
+  return chunk;
+}
+
+/* An arena whose chunks are chunk_size bytes, of memory type mtype. */
+struct arena *
+arena_new (int mtype, size_t chunk_size)
+{
+  struct arena *arena;
+
+  arena = XCALLOC (mtype, sizeof (struct arena));
+  arena->mtype = mtype;
+  arena->chunk_size = chunk_size;
+  arena_chunk_new (arena, chunk_size);
+  return arena;
+}
+
+void
+arena_free (struct arena *arena)
+{
+  struct arena_chunk *chunk, *next;
+
+  for (chunk = arena->chunks; chunk; chunk = next)
+    {
+      next = chunk->next;
+      XFREE (arena->mtype, chunk);
+    }
+  XFREE (arena->mtype, arena);
+}
+
+/* Take back everything handed out, keeping only the first chunk. */
+void
+arena_reset (struct arena *arena)
+{
+  struct arena_chunk *chunk;
+
+  while (arena->chunks->next)
+    {
+      chunk = arena->chunks;
+      arena->chunks = chunk->next;
+      XFREE (arena->mtype, chunk);
+    }
+  chunk = arena->chunks;
+  arena->pnt = (char *) chunk + ARENA_HEADER_SIZE;
+  arena->end = arena->pnt + chunk->size;
+
+  if (arena->used > arena->peak)
+    arena->peak = arena->used;
+  arena->used = 0;
+}
+
+/* The slow path of arena_alloc: the newest chunk is too full for size
+   bytes, already rounded up, so start another big enough for them. */
+void *
+arena_alloc_chunk (struct arena *arena, size_t size)
+{
+  char *p;
+
+  arena_chunk_new (arena, size > arena->chunk_size ? size : arena->chunk_size);
+  p = arena->pnt;
+  arena->pnt = p + size;
+  arena->used += size;
+  return p;
+}
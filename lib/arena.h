@@ -0,0 +1,75 @@
+/*
+ * Arena allocator, for temporaries freed all at once.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_ARENA_H
+#define _QUAGGA_ARENA_H
+
+/* Everything handed out is aligned to this. */
+#define ARENA_ALIGN 8
+
+struct arena_chunk
+{
+  struct arena_chunk *next;
+  size_t size;
+};
+
+/* An arena hands out memory by moving a pointer along a chunk, and
+   takes it all back at once with arena_reset.  Nothing is freed on its
+   own.  The first chunk is kept over resets, so an arena sized for its
+   usual load allocates nothing after the first use; more chunks are
+   added as they are wanted and freed by the next reset. */
+struct arena
+{
+  int mtype;
+  size_t chunk_size;
+
+  /* Newest first, the first chunk last. */
+  struct arena_chunk *chunks;
+
+  /* Free space in the newest chunk. */
+  char *pnt;
+  char *end;
+
+  /* Bytes handed out since the last reset, and the most there were. */
+  size_t used;
+  size_t peak;
+};
+
+extern struct arena *arena_new (int mtype, size_t chunk_size);
+extern void arena_free (struct arena *);
+extern void arena_reset (struct arena *);
+extern void *arena_alloc_chunk (struct arena *, size_t);
+
+/* Memory for size bytes, good until the next arena_reset. */
+static inline void *
+arena_alloc (struct arena *arena, size_t size)
+{
+  char *p = arena->pnt;
+
+  size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+  if ((size_t) (arena->end - p) < size)
+    return arena_alloc_chunk (arena, size);
+  arena->pnt = p + size;
+  arena->used += size;
+  return p;
+}
+
+#endif /* _QUAGGA_ARENA_H */
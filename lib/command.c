@@ -708,6 +708,9 @@ config_write_host (struct vty *vty)
     vty_out (vty, "log timestamp precision %d%s",
 	     zlog_default->timestamp_precision, VTY_NEWLINE);
 
+  if (zlog_default->async)
+    vty_out (vty, "log async%s", VTY_NEWLINE);
+
   if (host.advanced)
     vty_out (vty, "service advanced-vty%s", VTY_NEWLINE);
 
@@ -3584,6 +3587,19 @@ DEFUN (show_logging,
   vty_out (vty, "Timestamp precision: %d%s",
 	   zl->timestamp_precision, VTY_NEWLINE);
 
+  vty_out (vty, "Asynchronous logging: ");
+  if (! zl->async)
+    vty_out (vty, "disabled");
+  else
+    {
+      unsigned long written, dropped;
+
+      zlog_async_stats (&written, &dropped);
+      vty_out (vty, "enabled, %lu messages written, %lu dropped",
+	       written, dropped);
+    }
+  vty_out (vty, "%s", VTY_NEWLINE);
+
   return CMD_SUCCESS;
 }
 
@@ -3938,6 +3954,31 @@ DEFUN (no_config_log_timestamp_precision,
   return CMD_SUCCESS;
 }
 
+DEFUN (config_log_async,
+       config_log_async_cmd,
+       "log async",
+       "Logging control\n"
+       "Write the log from a thread of its own\n")
+{
+  if (zlog_set_async (NULL, 1) < 0)
+    {
+      vty_out (vty, "Cannot start the log writer%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_config_log_async,
+       no_config_log_async_cmd,
+       "no log async",
+       NO_STR
+       "Logging control\n"
+       "Write the log from the thread logging it\n")
+{
+  zlog_set_async (NULL, 0);
+  return CMD_SUCCESS;
+}
+
 DEFUN (banner_motd_file,
        banner_motd_file_cmd,
        "banner motd file [FILE]",
@@ -4112,6 +4153,8 @@ cmd_init (int terminal)
       install_element (CONFIG_NODE, &no_config_log_record_priority_cmd);
       install_element (CONFIG_NODE, &config_log_timestamp_precision_cmd);
       install_element (CONFIG_NODE, &no_config_log_timestamp_precision_cmd);
+      install_element (CONFIG_NODE, &config_log_async_cmd);
+      install_element (CONFIG_NODE, &no_config_log_async_cmd);
       install_element (CONFIG_NODE, &service_password_encrypt_cmd);
       install_element (CONFIG_NODE, &no_service_password_encrypt_cmd);
       install_element (CONFIG_NODE, &banner_motd_default_cmd);
@@ -28,6 +28,9 @@
 #include "sockunion.h"
 #include "buffer.h"
 #include "log.h"
+#include "table.h"
+#include "hash.h"
+#include "jhash.h"
 
 struct filter_cisco
 {
@@ -66,6 +69,11 @@ struct filter
       struct filter_cisco cfilter;
       struct filter_zebra zfilter;
     } u;
+
+  /* Position in the access list, and the next filter, by position,
+     indexed under the same key. */
+  unsigned long seq;
+  struct filter *same;
 };
 
 /* List of access_list. */
@@ -158,33 +166,6 @@ filter_type_str (struct filter *filter)
     }
 }
 
-/* If filter match to the prefix then return 1. */
-static int
-filter_match_cisco (struct filter *mfilter, struct prefix *p)
-{
-  struct filter_cisco *filter;
-  struct in_addr mask;
-  u_int32_t check_addr;
-  u_int32_t check_mask;
-
-  filter = &mfilter->u.cfilter;
-  check_addr = p->u.prefix4.s_addr & ~filter->addr_mask.s_addr;
-
-  if (filter->extended)
-    {
-      masklen2ip (p->prefixlen, &mask);
-      check_mask = mask.s_addr & ~filter->mask_mask.s_addr;
-
-      if (memcmp (&check_addr, &filter->addr.s_addr, 4) == 0
-          && memcmp (&check_mask, &filter->mask.s_addr, 4) == 0)
-	return 1;
-    }
-  else if (memcmp (&check_addr, &filter->addr.s_addr, 4) == 0)
-    return 1;
-
-  return 0;
-}
-
 /* If filter match to the prefix then return 1. */
 static int
 filter_match_zebra (struct filter *mfilter, struct prefix *p)
@@ -209,6 +190,239 @@ filter_match_zebra (struct filter *mfilter, struct prefix *p)
     return 0;
 }
 
+/* Access list indexes.
+
+   Filters are numbered in list order as they are added, and indexed,
+   so that access_list_apply finds the first one to match as the
+   lowest numbered of the few the indexes turn up, rather than by
+   trying them all in turn.
+
+   Zebra-style filters go in a route table per address family, by
+   prefix, chained in list order where several share one: only those
+   on the path from the root to a prefix can match it.
+
+   Cisco-style filters are grouped by their wildcard masks, both of
+   them for extended filters.  Within a group a prefix matches the
+   filters whose address (and mask) equal its own with the wildcard
+   bits cleared, so each group is a hash by those, and a lookup costs
+   one probe per group however many filters there are.  Lists rarely
+   have more than a handful of distinct wildcard masks. */
+
+struct filter_group
+{
+  struct filter_group *next;
+
+  int extended;
+  struct in_addr addr_mask;
+  struct in_addr mask_mask;
+
+  /* First filter, in list order, of each address (and mask). */
+  struct hash *hash;
+};
+
+static unsigned int
+filter_group_key (const void *arg)
+{
+  const struct filter_cisco *filter = &((const struct filter *) arg)->u.cfilter;
+
+  return jhash_2words (filter->addr.s_addr,
+		       filter->extended ? filter->mask.s_addr : 0, 0);
+}
+
+static int
+filter_group_cmp (const void *arg1, const void *arg2)
+{
+  const struct filter_cisco *f1 = &((const struct filter *) arg1)->u.cfilter;
+  const struct filter_cisco *f2 = &((const struct filter *) arg2)->u.cfilter;
+
+  return f1->addr.s_addr == f2->addr.s_addr
+	 && (! f1->extended || f1->mask.s_addr == f2->mask.s_addr);
+}
+
+static struct filter_group *
+filter_group_lookup (struct access_list *access, struct filter_cisco *filter)
+{
+  struct filter_group *group;
+
+  for (group = access->groups; group; group = group->next)
+    if (group->extended == filter->extended
+	&& group->addr_mask.s_addr == filter->addr_mask.s_addr
+	&& (! group->extended
+	    || group->mask_mask.s_addr == filter->mask_mask.s_addr))
+      return group;
+  return NULL;
+}
+
+static struct route_table **
+filter_trie (struct access_list *access, u_char family)
+{
+  switch (family)
+    {
+    case AF_INET:
+      return &access->trie[0];
+#ifdef HAVE_IPV6
+    case AF_INET6:
+      return &access->trie[1];
+#endif /* HAVE_IPV6 */
+    default:
+      return NULL;
+    }
+}
+
+/* Insert a filter into a chain, in list order, returning its head. */
+static struct filter *
+filter_chain_add (struct filter *head, struct filter *filter)
+{
+  struct filter *prev;
+
+  if (head == NULL || head->seq > filter->seq)
+    {
+      filter->same = head;
+      return filter;
+    }
+  for (prev = head; prev->same && prev->same->seq < filter->seq;
+       prev = prev->same)
+    ;
+  filter->same = prev->same;
+  prev->same = filter;
+  return head;
+}
+
+static struct filter *
+filter_chain_delete (struct filter *head, struct filter *filter)
+{
+  struct filter *prev;
+
+  if (head == filter)
+    head = filter->same;
+  else
+    {
+      for (prev = head; prev->same != filter; prev = prev->same)
+	;
+      prev->same = filter->same;
+    }
+  filter->same = NULL;
+  return head;
+}
+
+/* Zebra-style filters indexed under this filter's prefix. */
+static struct route_node *
+filter_trie_node (struct access_list *access, struct filter *filter,
+		  int create)
+{
+  struct route_table **trie;
+  struct prefix p;
+
+  trie = filter_trie (access, filter->u.zfilter.prefix.family);
+  if (trie == NULL)
+    return NULL;
+
+  prefix_copy (&p, &filter->u.zfilter.prefix);
+  apply_mask (&p);
+
+  if (! create)
+    return *trie ? route_node_lookup (*trie, &p) : NULL;
+
+  if (*trie == NULL)
+    *trie = route_table_init ();
+  return route_node_get (*trie, &p);
+}
+
+static void
+filter_index_add (struct access_list *access, struct filter *filter)
+{
+  struct filter_group *group;
+  struct route_node *rn;
+  struct filter *head;
+
+  filter->seq = ++access->seq;
+
+  if (! filter->cisco)
+    {
+      rn = filter_trie_node (access, filter, 1);
+      if (rn == NULL)
+	return;
+
+      /* The node keeps one lock for all its filters. */
+      if (rn->info)
+	route_unlock_node (rn);
+      rn->info = filter_chain_add (rn->info, filter);
+      return;
+    }
+
+  group = filter_group_lookup (access, &filter->u.cfilter);
+  if (group == NULL)
+    {
+      group = XCALLOC (MTYPE_ACCESS_INDEX, sizeof (struct filter_group));
+      group->extended = filter->u.cfilter.extended;
+      group->addr_mask = filter->u.cfilter.addr_mask;
+      group->mask_mask = filter->u.cfilter.mask_mask;
+      group->hash = hash_create_open (HASH_INITIAL_SIZE, filter_group_key,
+				      filter_group_cmp);
+      group->next = access->groups;
+      access->groups = group;
+    }
+
+  head = hash_release (group->hash, filter);
+  hash_get2 (group->hash, filter, filter_chain_add (head, filter));
+}
+
+static void
+filter_index_delete (struct access_list *access, struct filter *filter)
+{
+  struct filter_group *group, **gp;
+  struct route_node *rn;
+  struct filter *head;
+
+  if (! filter->cisco)
+    {
+      rn = filter_trie_node (access, filter, 0);
+      if (rn == NULL)
+	return;
+
+      rn->info = filter_chain_delete (rn->info, filter);
+      route_unlock_node (rn);
+      if (rn->info == NULL)
+	route_unlock_node (rn);
+      return;
+    }
+
+  group = filter_group_lookup (access, &filter->u.cfilter);
+  if (group == NULL)
+    return;
+
+  head = filter_chain_delete (hash_release (group->hash, filter), filter);
+  if (head)
+    hash_get2 (group->hash, head, head);
+  else if (group->hash->count == 0)
+    {
+      for (gp = &access->groups; *gp != group; gp = &(*gp)->next)
+	;
+      *gp = group->next;
+      hash_free (group->hash);
+      XFREE (MTYPE_ACCESS_INDEX, group);
+    }
+}
+
+static void
+filter_index_free (struct access_list *access)
+{
+  struct filter_group *group;
+
+  if (access->trie[0])
+    route_table_finish (access->trie[0]);
+  if (access->trie[1])
+    route_table_finish (access->trie[1]);
+
+  while ((group = access->groups) != NULL)
+    {
+      access->groups = group->next;
+      hash_clean (group->hash, NULL);
+      hash_free (group->hash);
+      XFREE (MTYPE_ACCESS_INDEX, group);
+    }
+}
+
 /* Allocate new access list structure. */
 static struct access_list *
 access_list_new (void)
@@ -238,6 +452,7 @@ access_list_delete (struct access_list *access)
       next = filter->next;
       filter_free (filter);
     }
+  filter_index_free (access);
 
   master = access->master;
 
@@ -400,6 +615,12 @@ enum filter_type
 access_list_apply (struct access_list *access, void *object)
 {
   struct filter *filter;
+  struct filter *match;
+  struct filter key;
+  struct filter_group *group;
+  struct route_table **trie;
+  struct route_node *rn, *node;
+  struct in_addr mask;
   struct prefix *p;
 
   p = (struct prefix *) object;
@@ -407,21 +628,42 @@ access_list_apply (struct access_list *access, void *object)
   if (access == NULL)
     return FILTER_DENY;
 
-  for (filter = access->head; filter; filter = filter->next)
+  match = NULL;
+
+  trie = filter_trie (access, p->family);
+  if (trie && *trie && (rn = route_node_match (*trie, p)) != NULL)
     {
-      if (filter->cisco)
-	{
-	  if (filter_match_cisco (filter, p))
-	    return filter->type;
-	}
-      else
+      for (node = rn; node; node = node->parent)
+	for (filter = node->info; filter; filter = filter->same)
+	  {
+	    if (match && filter->seq > match->seq)
+	      break;
+	    if (filter_match_zebra (filter, p))
+	      {
+		match = filter;
+		break;
+	      }
+	  }
+      route_unlock_node (rn);
+    }
+
+  for (group = access->groups; group; group = group->next)
+    {
+      key.u.cfilter.extended = group->extended;
+      key.u.cfilter.addr.s_addr = p->u.prefix4.s_addr
+				  & ~group->addr_mask.s_addr;
+      if (group->extended)
 	{
-	  if (filter_match_zebra (filter, p))
-	    return filter->type;
+	  masklen2ip (p->prefixlen, &mask);
+	  key.u.cfilter.mask.s_addr = mask.s_addr & ~group->mask_mask.s_addr;
 	}
+
+      filter = hash_lookup (group->hash, &key);
+      if (filter && (match == NULL || filter->seq < match->seq))
+	match = filter;
     }
 
-  return FILTER_DENY;
+  return match ? match->type : FILTER_DENY;
 }
 
 /* Add hook function. */
@@ -457,6 +699,8 @@ access_list_filter_add (struct access_list *access, struct filter *filter)
     access->head = filter;
   access->tail = filter;
 
+  filter_index_add (access, filter);
+
   /* Run hook function. */
   if (access->master->add_hook)
     (*access->master->add_hook) (access);
@@ -491,6 +735,7 @@ access_list_filter_delete (struct access_list *access, struct filter *filter)
   else
     access->head = filter->next;
 
+  filter_index_delete (access, filter);
   filter_free (filter);
 
   /* If access_list becomes empty delete it from access_master. */
@@ -518,32 +763,16 @@ static struct filter *
 filter_lookup_cisco (struct access_list *access, struct filter *mnew)
 {
   struct filter *mfilter;
-  struct filter_cisco *filter;
-  struct filter_cisco *new;
-
-  new = &mnew->u.cfilter;
+  struct filter_group *group;
 
-  for (mfilter = access->head; mfilter; mfilter = mfilter->next)
-    {
-      filter = &mfilter->u.cfilter;
+  group = filter_group_lookup (access, &mnew->u.cfilter);
+  if (group == NULL)
+    return NULL;
 
-      if (filter->extended)
-	{
-	  if (mfilter->type == mnew->type
-	      && filter->addr.s_addr == new->addr.s_addr
-	      && filter->addr_mask.s_addr == new->addr_mask.s_addr
-	      && filter->mask.s_addr == new->mask.s_addr
-	      && filter->mask_mask.s_addr == new->mask_mask.s_addr)
-	    return mfilter;
-	}
-      else
-	{
-	  if (mfilter->type == mnew->type
-	      && filter->addr.s_addr == new->addr.s_addr
-	      && filter->addr_mask.s_addr == new->addr_mask.s_addr)
-	    return mfilter;
-	}
-    }
+  for (mfilter = hash_lookup (group->hash, mnew); mfilter;
+       mfilter = mfilter->same)
+    if (mfilter->type == mnew->type)
+      return mfilter;
 
   return NULL;
 }
@@ -551,13 +780,19 @@ filter_lookup_cisco (struct access_list *access, struct filter *mnew)
 static struct filter *
 filter_lookup_zebra (struct access_list *access, struct filter *mnew)
 {
+  struct route_node *rn;
   struct filter *mfilter;
   struct filter_zebra *filter;
   struct filter_zebra *new;
 
   new = &mnew->u.zfilter;
 
-  for (mfilter = access->head; mfilter; mfilter = mfilter->next)
+  rn = filter_trie_node (access, mnew, 0);
+  if (rn == NULL)
+    return NULL;
+  route_unlock_node (rn);
+
+  for (mfilter = rn->info; mfilter; mfilter = mfilter->same)
     {
       filter = &mfilter->u.zfilter;
 
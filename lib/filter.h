@@ -39,6 +39,9 @@ enum access_type
   ACCESS_TYPE_NUMBER
 };
 
+struct route_table;
+struct filter_group;
+
 /* Access list */
 struct access_list
 {
@@ -54,6 +57,13 @@ struct access_list
 
   struct filter *head;
   struct filter *tail;
+
+  /* The filters indexed, see filter.c. */
+  struct route_table *trie[2];
+  struct filter_group *groups;
+
+  /* Number given to the last filter added. */
+  unsigned long seq;
 };
 
 /* Prototypes for access-list. */
@@ -39,6 +39,12 @@ hash_create_size (unsigned int size, unsigned int (*hash_key) (const void *),
 	hash->hash_key = hash_key;
 	hash->hash_cmp = hash_cmp;
 	hash->count = 0;
+	hash->slot = NULL;
+	hash->used = 0;
+	hash->old = NULL;
+	hash->old_size = 0;
+	hash->moved = 0;
+	hash->iterating = 0;
 
 	return hash;
 }// hash_create_size
@@ -51,6 +57,240 @@ hash_create (unsigned int (*hash_key) (const void *),
 	return hash_create_size (HASH_INITIAL_SIZE, hash_key, hash_cmp);
 }
 
+/* Open addressing.
+
+   A hash made by hash_create_open keeps its entries in a flat array of
+   key and data pairs rather than in chains of backets allocated one by
+   one, and probes linearly from the slot its (remixed) key picks, so a
+   lookup mostly reads a single cache line.  Removal leaves a dead
+   slot behind.
+
+   When live and dead slots fill 3/4 of the array, a new one is
+   allocated, twice the size unless it was mostly dead slots, and the
+   entries move over a few old slots at a time with each operation
+   that follows, rather than in one go: until they all have, lookups
+   search both arrays.
+
+   Nothing moves while hash_iterate runs, so the iteration sees each
+   entry once, even if the function it calls releases entries or adds
+   a few, but it can't add more than the hash holds. */
+
+/* Old slots moved per operation; enough to be done long before the
+   new array fills. */
+#define HASH_OPEN_MOVE		16
+#define HASH_OPEN_MIN_SIZE	16
+#define HASH_OPEN_FULL(S)	((S) - (S) / 4)
+
+/* Data of released slots. */
+static char hash_open_dead;
+#define HASH_OPEN_DEAD		((void *) &hash_open_dead)
+#define HASH_OPEN_LIVE(S)	((S)->data && (S)->data != HASH_OPEN_DEAD)
+
+/* Many hash functions are weak in their low bits. */
+static inline unsigned int
+hash_open_index (unsigned int key, unsigned int size)
+{
+  key *= 2654435769U;
+  return (key ^ (key >> 16)) & (size - 1);
+}
+
+struct hash *
+hash_create_open (unsigned int size, unsigned int (*hash_key) (const void *),
+		  int (*hash_cmp) (const void *, const void *))
+{
+  struct hash *hash;
+
+  size = MAX (size, HASH_OPEN_MIN_SIZE);
+  hash = hash_create_size (1, hash_key, hash_cmp);
+  XFREE (MTYPE_HASH_INDEX, hash->index);
+  hash->slot = XCALLOC (MTYPE_HASH_INDEX, sizeof (struct hash_slot) * size);
+  hash->size = size;
+
+  return hash;
+}
+
+/* Slot in the array holding data, or NULL. */
+static struct hash_slot *
+hash_open_find (struct hash *hash, struct hash_slot *slot, unsigned int size,
+		unsigned int key, const void *data)
+{
+  unsigned int i;
+
+  for (i = hash_open_index (key, size); slot[i].data; i = (i + 1) & (size - 1))
+    if (slot[i].key == key && slot[i].data != HASH_OPEN_DEAD
+	&& (*hash->hash_cmp) (slot[i].data, data))
+      return &slot[i];
+  return NULL;
+}
+
+/* Put an entry which isn't in the hash in the current array. */
+static void
+hash_open_place (struct hash *hash, unsigned int key, void *data)
+{
+  unsigned int i;
+
+  i = hash_open_index (key, hash->size);
+  while (HASH_OPEN_LIVE (&hash->slot[i]))
+    i = (i + 1) & (hash->size - 1);
+
+  if (! hash->slot[i].data)
+    hash->used++;
+  hash->slot[i].key = key;
+  hash->slot[i].data = data;
+}
+
+/* Move up to n old slots' entries to the current array. */
+static void
+hash_open_move (struct hash *hash, unsigned int n)
+{
+  struct hash_slot *s;
+
+  if (! hash->old || hash->iterating)
+    return;
+
+  for (; n && hash->moved < hash->old_size; n--, hash->moved++)
+    {
+      s = &hash->old[hash->moved];
+      if (HASH_OPEN_LIVE (s))
+	{
+	  hash_open_place (hash, s->key, s->data);
+	  s->data = HASH_OPEN_DEAD;
+	}
+    }
+
+  if (hash->moved == hash->old_size)
+    {
+      XFREE (MTYPE_HASH_INDEX, hash->old);
+      hash->old_size = hash->moved = 0;
+    }
+}
+
+/* Start moving to a new array, if the current one is full. */
+static void
+hash_open_grow (struct hash *hash)
+{
+  unsigned int size;
+
+  if (hash->used < HASH_OPEN_FULL (hash->size))
+    return;
+
+  /* Only while hash_iterate is walking the old array. */
+  if (hash->old && hash->iterating)
+    {
+      assert (hash->used < hash->size - 1);
+      return;
+    }
+  hash_open_move (hash, hash->old_size);
+
+  size = hash->size;
+  if (hash->count >= size / 2)
+    size *= 2;
+
+  hash->old = hash->slot;
+  hash->old_size = hash->size;
+  hash->moved = 0;
+  hash->slot = XCALLOC (MTYPE_HASH_INDEX, sizeof (struct hash_slot) * size);
+  hash->size = size;
+  hash->used = 0;
+}
+
+static void *
+hash_open_get (struct hash *hash, const void *data,
+	       void * (*alloc_func) (const void *), void *newdata)
+{
+  struct hash_slot *s;
+  unsigned int key;
+
+  hash_open_move (hash, HASH_OPEN_MOVE);
+
+  key = (*hash->hash_key) (data);
+  s = hash_open_find (hash, hash->slot, hash->size, key, data);
+  if (! s && hash->old)
+    s = hash_open_find (hash, hash->old, hash->old_size, key, data);
+  if (s)
+    return s->data;
+
+  if (alloc_func)
+    newdata = (*alloc_func) (data);
+  if (! newdata)
+    return NULL;
+
+  hash_open_grow (hash);
+  hash_open_place (hash, key, newdata);
+  hash->count++;
+  return newdata;
+}
+
+static void *
+hash_open_release (struct hash *hash, void *data)
+{
+  struct hash_slot *s;
+  unsigned int key;
+
+  hash_open_move (hash, HASH_OPEN_MOVE);
+
+  key = (*hash->hash_key) (data);
+  s = hash_open_find (hash, hash->slot, hash->size, key, data);
+  if (! s && hash->old)
+    s = hash_open_find (hash, hash->old, hash->old_size, key, data);
+  if (! s)
+    return NULL;
+
+  data = s->data;
+  s->data = HASH_OPEN_DEAD;
+  hash->count--;
+  return data;
+}
+
+static void
+hash_open_iterate (struct hash *hash,
+		   void (*func) (struct hash_backet *, void *), void *arg)
+{
+  struct hash_slot *array[2];
+  unsigned int size[2];
+  struct hash_backet hb;
+  unsigned int i, j;
+
+  /* Settle on one array, unless an outer iteration is walking both. */
+  if (! hash->iterating)
+    hash_open_move (hash, hash->old_size);
+  hash->iterating++;
+
+  array[0] = hash->old;
+  size[0] = hash->old ? hash->old_size : 0;
+  array[1] = hash->slot;
+  size[1] = hash->size;
+
+  hb.next = NULL;
+  for (j = 0; j < 2; j++)
+    for (i = 0; i < size[j]; i++)
+      if (HASH_OPEN_LIVE (&array[j][i]))
+	{
+	  hb.key = array[j][i].key;
+	  hb.data = array[j][i].data;
+	  (*func) (&hb, arg);
+	}
+
+  hash->iterating--;
+}
+
+static void
+hash_open_clean (struct hash *hash, void (*free_func) (void *))
+{
+  unsigned int i;
+
+  hash_open_move (hash, hash->old_size);
+
+  if (free_func)
+    for (i = 0; i < hash->size; i++)
+      if (HASH_OPEN_LIVE (&hash->slot[i]))
+	(*free_func) (hash->slot[i].data);
+
+  memset (hash->slot, 0, sizeof (struct hash_slot) * hash->size);
+  hash->used = 0;
+  hash->count = 0;
+}
+
 /* Utility function for hash_get().  When this function is specified
    as alloc_func, return arugment as it is.  This function is used for
    intern already allocated value.  */
@@ -118,6 +358,9 @@ hash_get (struct hash *hash, const void *data, void * (*alloc_func) (const void
 	unsigned int len;
 	struct hash_backet *backet;
 
+	if (hash->slot)
+		return hash_open_get (hash, data, alloc_func, NULL);
+
 	key = (*hash->hash_key) (data);
 	index = key & (hash->size - 1);
 	len = 0;
@@ -165,6 +408,9 @@ hash_get2 (struct hash *hash, const void *data, void * newdata)
 	unsigned int len;
 	struct hash_backet *backet;
 
+	if (hash->slot)
+		return hash_open_get (hash, data, NULL, newdata);
+
 	key = (*hash->hash_key) (data);
 	index = key & (hash->size - 1);
 	len = 0;
@@ -226,6 +472,9 @@ hash_release (struct hash *hash, void *data)
   struct hash_backet *backet;
   struct hash_backet *pp;
 
+  if (hash->slot)
+    return hash_open_release (hash, data);
+
   key = (*hash->hash_key) (data);
   index = key & (hash->size - 1);
 
@@ -257,6 +506,12 @@ hash_iterate (struct hash *hash,
   struct hash_backet *hb;
   struct hash_backet *hbnext;
 
+  if (hash->slot)
+    {
+      hash_open_iterate (hash, func, arg);
+      return;
+    }
+
   for (i = 0; i < hash->size; i++)
     for (hb = hash->index[i]; hb; hb = hbnext)
       {
@@ -276,6 +531,12 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
   struct hash_backet *hb;
   struct hash_backet *next;
 
+  if (hash->slot)
+    {
+      hash_open_clean (hash, free_func);
+      return;
+    }
+
   for (i = 0; i < hash->size; i++)
     {
       for (hb = hash->index[i]; hb; hb = next)
@@ -297,6 +558,11 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 void
 hash_free (struct hash *hash)
 {
+  if (hash->slot)
+    {
+      XFREE (MTYPE_HASH_INDEX, hash->old);
+      XFREE (MTYPE_HASH_INDEX, hash->slot);
+    }
   XFREE (MTYPE_HASH_INDEX, hash->index);
   XFREE (MTYPE_HASH, hash);
 }
@@ -37,6 +37,13 @@ struct hash_backet
   void *data;
 };
 
+/* Entry of a hash made with hash_create_open. */
+struct hash_slot
+{
+  unsigned int key;
+  void *data;
+};
+
 struct hash
 {
   /* Hash backet. */
@@ -56,12 +63,29 @@ struct hash
 
   /* Backet alloc. */
   unsigned long count;
+
+  /* Open addressing, see hash_create_open: entries are kept in a flat
+     array instead of chained backets, and index is NULL. */
+  struct hash_slot *slot;
+
+  /* Slots live or dead. */
+  unsigned int used;
+
+  /* Array being emptied into slot, and how far that has got. */
+  struct hash_slot *old;
+  unsigned int old_size;
+  unsigned int moved;
+
+  /* Depth of hash_iterate calls. */
+  int iterating;
 };
 
 extern struct hash *hash_create (unsigned int (*) (const void *), 
 				 int (*) (const void *, const void *));
 extern struct hash *hash_create_size (unsigned int, unsigned int (*) (const void *), 
                                              int (*) (const void *, const void *));
+extern struct hash *hash_create_open (unsigned int, unsigned int (*) (const void *),
+                                      int (*) (const void *, const void *));
 
 extern void *hash_get (struct hash *, const void *, void * (*) (const void *));
 extern void *hash_get2 (struct hash *, const void *, void *);
@@ -23,6 +23,7 @@
 #define QUAGGA_DEFINE_DESC_TABLE
 
 #include <zebra.h>
+#include <pthread.h>
 
 #include "log.h"
 #include "memory.h"
@@ -72,44 +73,69 @@ const char *zlog_priority[] =
   
 
 
+/* The thread that opened the log.  Only it may touch a vty, or the
+   timestamp cache. */
+static pthread_t zlog_main_thread;
+static int zlog_main_thread_set;
+
+static int
+zlog_on_main_thread (void)
+{
+  return (! zlog_main_thread_set
+	  || pthread_equal (pthread_self (), zlog_main_thread));
+}
+
+struct timestamp_cache
+{
+  time_t last;
+  size_t len;
+  char buf[28];
+};
+
 /* For time string format. */
 
 size_t
 quagga_timestamp(int timestamp_precision, char *buf, size_t buflen)
 {
-  static struct {
-    time_t last;
-    size_t len;
-    char buf[28];
-  } cache;
+  static struct timestamp_cache main_cache;
+  struct timestamp_cache own, *cache;
   struct timeval clock;
 
   /* would it be sufficient to use global 'recent_time' here?  I fear not... */
   gettimeofday(&clock, NULL);
 
+  /* other threads log too, and get a cache of their own for the call */
+  if (zlog_on_main_thread())
+    cache = &main_cache;
+  else
+    {
+      own.last = 0;
+      cache = &own;
+    }
+
   /* first, we update the cache if the time has changed */
-  if (cache.last != clock.tv_sec)
+  if (cache->last != clock.tv_sec)
     {
-      struct tm *tm;
-      cache.last = clock.tv_sec;
-      tm = localtime(&cache.last);
-      cache.len = strftime(cache.buf, sizeof(cache.buf),
-      			   "%Y/%m/%d %H:%M:%S", tm);
+      struct tm tm;
+      cache->last = clock.tv_sec;
+      localtime_r(&cache->last, &tm);
+      cache->len = strftime(cache->buf, sizeof(cache->buf),
+      			    "%Y/%m/%d %H:%M:%S", &tm);
     }
   /* note: it's not worth caching the subsecond part, because
      chances are that back-to-back calls are not sufficiently close together
      for the clock not to have ticked forward */
 
-  if (buflen > cache.len)
+  if (buflen > cache->len)
     {
-      memcpy(buf, cache.buf, cache.len);
+      memcpy(buf, cache->buf, cache->len);
       if ((timestamp_precision > 0) &&
-	  (buflen > cache.len+1+timestamp_precision))
+	  (buflen > cache->len+1+timestamp_precision))
 	{
 	  /* should we worry about locale issues? */
 	  static const int divisor[] = {0, 100000, 10000, 1000, 100, 10, 1};
 	  int prec;
-	  char *p = buf+cache.len+1+(prec = timestamp_precision);
+	  char *p = buf+cache->len+1+(prec = timestamp_precision);
 	  *p-- = '\0';
 	  while (prec > 6)
 	    /* this is unlikely to happen, but protect anyway */
@@ -125,10 +151,10 @@ quagga_timestamp(int timestamp_precision, char *buf, size_t buflen)
 	    }
 	  while (--prec > 0);
 	  *p = '.';
-	  return cache.len+1+timestamp_precision;
+	  return cache->len+1+timestamp_precision;
 	}
-      buf[cache.len] = '\0';
-      return cache.len;
+      buf[cache->len] = '\0';
+      return cache->len;
     }
   if (buflen > 0)
     buf[0] = '\0';
@@ -148,6 +174,395 @@ time_print(FILE *fp, struct timestamp_control *ctl)
 }
   
 
+/* Asynchronous logging.
+
+   With "log async", vzlog formats a message once, into a line for the
+   file and stdout of which the message part also goes to syslog, and
+   puts it in a ring from which a thread of its own writes it out.  The
+   ring takes whole records only, and when there is no room for one it
+   is counted as dropped, which the writer notes in the log when it next
+   gets to write.  The writer takes everything there is each time it
+   wakes, and flushes the file once per batch.
+
+   The ring is shared under a mutex, held only to copy a record in or
+   to take a batch out, never while writing.  Other threads of a daemon
+   log too, which is why it is not single producer.  Terminal monitors
+   are still written from vzlog itself, as only the main thread may
+   touch a vty, and other threads' messages skip them.  So are crash
+   messages and backtraces, which do not
+   wait for the writer: zlog_signal writes out what is in the ring
+   first, without locking, and an assertion turns async logging off
+   before logging the failure. */
+
+/* A record, followed by its text, in units the size of a record. */
+struct zlog_async_rec
+{
+  struct zlog *zl;
+  u_int32_t units;	/* taken in the ring, this one included */
+  u_int16_t len;	/* of the text, ending in '\n' */
+  u_int16_t msg;	/* where the message starts in it */
+  u_char priority;
+  u_char dests;		/* ZLOG_DEST_* bits, none if it is padding */
+};
+
+#define ZLOG_ASYNC_UNITS	32768
+#define ZLOG_ASYNC_LINE_MAX	1024
+
+static struct
+{
+  pthread_t thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;		/* records to write, or stop */
+  pthread_cond_t drained;	/* none left */
+
+  /* Writes to the files, so that they are not changed under it. */
+  pthread_mutex_t out_mtx;
+
+  int running;
+  int stop;
+  int busy;			/* writing a batch */
+
+  struct zlog_async_rec *ring;
+  unsigned int head;
+  unsigned int len;
+
+  unsigned long written;
+  unsigned long dropped;
+  unsigned long dropped_noted;
+} zlog_async =
+{
+  .mtx = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+  .drained = PTHREAD_COND_INITIALIZER,
+  .out_mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+#define ZLOG_ASYNC_REC_UNITS(L) \
+  (1 + ((L) + sizeof (struct zlog_async_rec) - 1) \
+	/ sizeof (struct zlog_async_rec))
+
+/* Write out one record, with the out mutex held. */
+static void
+zlog_async_write (struct zlog_async_rec *rec)
+{
+  const char *text = (const char *) (rec + 1);
+
+  if ((rec->dests & (1 << ZLOG_DEST_FILE)) && rec->zl->fp)
+    fwrite (text, 1, rec->len, rec->zl->fp);
+  if (rec->dests & (1 << ZLOG_DEST_STDOUT))
+    fwrite (text, 1, rec->len, stdout);
+  if (rec->dests & (1 << ZLOG_DEST_SYSLOG))
+    syslog (rec->priority | rec->zl->facility, "%.*s",
+	    rec->len - rec->msg - 1, text + rec->msg);
+}
+
+/* Note messages dropped since the last batch, with the out mutex
+   held. */
+static void
+zlog_async_note_dropped (unsigned long dropped)
+{
+  struct zlog *zl = zlog_default;
+  char buf[64];
+
+  if (zl == NULL)
+    return;
+  quagga_timestamp (zl->timestamp_precision, buf, sizeof (buf));
+  if (zl->fp && zl->maxlvl[ZLOG_DEST_FILE] >= LOG_WARNING)
+    fprintf (zl->fp, "%s %s: %lu log messages dropped\n", buf,
+	     zlog_proto_names[zl->protocol], dropped);
+  if (zl->maxlvl[ZLOG_DEST_STDOUT] >= LOG_WARNING)
+    fprintf (stdout, "%s %s: %lu log messages dropped\n", buf,
+	     zlog_proto_names[zl->protocol], dropped);
+}
+
+static void *
+zlog_async_main (void *arg)
+{
+  pthread_mutex_lock (&zlog_async.mtx);
+  for (;;)
+    {
+      unsigned int head, len, done;
+      unsigned long count, dropped;
+
+      while (zlog_async.len == 0 && ! zlog_async.stop)
+	pthread_cond_wait (&zlog_async.cond, &zlog_async.mtx);
+      if (zlog_async.len == 0)
+	break;
+
+      /* Producers only add after head + len, so the batch can be read
+	 without the lock. */
+      head = zlog_async.head;
+      len = zlog_async.len;
+      dropped = zlog_async.dropped - zlog_async.dropped_noted;
+      zlog_async.dropped_noted = zlog_async.dropped;
+      zlog_async.busy = 1;
+      pthread_mutex_unlock (&zlog_async.mtx);
+
+      pthread_mutex_lock (&zlog_async.out_mtx);
+      if (dropped)
+	zlog_async_note_dropped (dropped);
+      for (done = 0, count = 0; done < len; )
+	{
+	  struct zlog_async_rec *rec;
+
+	  rec = &zlog_async.ring[(head + done) % ZLOG_ASYNC_UNITS];
+	  if (rec->dests)
+	    {
+	      zlog_async_write (rec);
+	      count++;
+	    }
+	  done += rec->units;
+	}
+      if (zlog_default && zlog_default->fp)
+	fflush (zlog_default->fp);
+      fflush (stdout);
+      pthread_mutex_unlock (&zlog_async.out_mtx);
+
+      pthread_mutex_lock (&zlog_async.mtx);
+      zlog_async.head = (head + len) % ZLOG_ASYNC_UNITS;
+      zlog_async.len -= len;
+      zlog_async.written += count;
+      zlog_async.busy = 0;
+      if (zlog_async.len == 0)
+	pthread_cond_broadcast (&zlog_async.drained);
+    }
+  zlog_async.busy = 0;
+  pthread_cond_broadcast (&zlog_async.drained);
+  pthread_mutex_unlock (&zlog_async.mtx);
+  return NULL;
+}
+
+/* Wait for the writer to have written all there is, with the mutex
+   held. */
+static void
+zlog_async_wait (void)
+{
+  while (zlog_async.running && (zlog_async.len || zlog_async.busy))
+    pthread_cond_wait (&zlog_async.drained, &zlog_async.mtx);
+}
+
+/* A fork, as daemon() does after the configuration has been read,
+   leaves the child without the writer: write out everything before
+   it, and let the child start its own. */
+static void
+zlog_async_prefork (void)
+{
+  pthread_mutex_lock (&zlog_async.mtx);
+  zlog_async_wait ();
+  pthread_mutex_lock (&zlog_async.out_mtx);
+}
+
+static void
+zlog_async_postfork_parent (void)
+{
+  pthread_mutex_unlock (&zlog_async.out_mtx);
+  pthread_mutex_unlock (&zlog_async.mtx);
+}
+
+static void
+zlog_async_postfork_child (void)
+{
+  pthread_mutex_init (&zlog_async.mtx, NULL);
+  pthread_mutex_init (&zlog_async.out_mtx, NULL);
+  pthread_cond_init (&zlog_async.cond, NULL);
+  pthread_cond_init (&zlog_async.drained, NULL);
+  zlog_async.running = 0;
+  zlog_async.stop = 0;
+  zlog_async.busy = 0;
+}
+
+/* Start the writer if it is not running, with the mutex held. */
+static int
+zlog_async_start (void)
+{
+  static int atfork;
+  sigset_t set, oset;
+  int ret;
+
+  if (zlog_async.running)
+    return 0;
+
+  /* Not XCALLOC, as this may be on any thread. */
+  if (zlog_async.ring == NULL)
+    zlog_async.ring = calloc (ZLOG_ASYNC_UNITS,
+			      sizeof (struct zlog_async_rec));
+  if (zlog_async.ring == NULL)
+    return -1;
+
+  if (! atfork)
+    {
+      pthread_atfork (zlog_async_prefork, zlog_async_postfork_parent,
+		      zlog_async_postfork_child);
+      atfork = 1;
+    }
+
+  /* Signals are for the main thread. */
+  sigfillset (&set);
+  pthread_sigmask (SIG_SETMASK, &set, &oset);
+  zlog_async.stop = 0;
+  ret = pthread_create (&zlog_async.thread, NULL, zlog_async_main, NULL);
+  pthread_sigmask (SIG_SETMASK, &oset, NULL);
+  if (ret != 0)
+    return -1;
+  zlog_async.running = 1;
+  return 0;
+}
+
+/* Put a record in the ring for the writer, or count it as dropped.
+   Returns -1 if the writer could not be started, for the caller to
+   write it itself. */
+static int
+zlog_async_put (struct zlog *zl, int priority, u_char dests,
+		const char *text, int len, int msg)
+{
+  struct zlog_async_rec *rec;
+  unsigned int tail, units, room;
+  int wake;
+
+  units = ZLOG_ASYNC_REC_UNITS (len);
+
+  pthread_mutex_lock (&zlog_async.mtx);
+  if (! zlog_async.running && zlog_async_start () < 0)
+    {
+      pthread_mutex_unlock (&zlog_async.mtx);
+      return -1;
+    }
+
+  /* The writer sleeps only when there is nothing. */
+  wake = (zlog_async.len == 0);
+
+  /* Records do not wrap: pad to the end of the ring if need be. */
+  tail = (zlog_async.head + zlog_async.len) % ZLOG_ASYNC_UNITS;
+  room = ZLOG_ASYNC_UNITS - zlog_async.len;
+  if (tail + units > ZLOG_ASYNC_UNITS)
+    {
+      if (room < ZLOG_ASYNC_UNITS - tail + units)
+	{
+	  zlog_async.dropped++;
+	  pthread_mutex_unlock (&zlog_async.mtx);
+	  return 0;
+	}
+      rec = &zlog_async.ring[tail];
+      rec->units = ZLOG_ASYNC_UNITS - tail;
+      rec->dests = 0;
+      zlog_async.len += rec->units;
+      tail = 0;
+    }
+  else if (room < units)
+    {
+      zlog_async.dropped++;
+      pthread_mutex_unlock (&zlog_async.mtx);
+      return 0;
+    }
+
+  rec = &zlog_async.ring[tail];
+  rec->zl = zl;
+  rec->units = units;
+  rec->len = len;
+  rec->msg = msg;
+  rec->priority = priority;
+  rec->dests = dests;
+  memcpy (rec + 1, text, len);
+
+  zlog_async.len += units;
+  if (wake)
+    pthread_cond_signal (&zlog_async.cond);
+  pthread_mutex_unlock (&zlog_async.mtx);
+  return 0;
+}
+
+/* Format a message for the ring, and hand it over. */
+static int
+vzlog_async (struct zlog *zl, int priority, u_char dests,
+	     const char *format, va_list args)
+{
+  char buf[ZLOG_ASYNC_LINE_MAX];
+  int len, msg, n;
+
+  len = quagga_timestamp (zl->timestamp_precision, buf, sizeof (buf));
+  len += snprintf (buf + len, sizeof (buf) - len, " %s%s%s: ",
+		   zl->record_priority ? zlog_priority[priority] : "",
+		   zl->record_priority ? ": " : "",
+		   zlog_proto_names[zl->protocol]);
+  msg = len;
+  n = vsnprintf (buf + len, sizeof (buf) - len, format, args);
+  if (n < 0)
+    n = 0;
+  len = MIN (len + n, (int) sizeof (buf) - 1);
+  buf[len++] = '\n';
+
+  return zlog_async_put (zl, priority, dests, buf, len, msg);
+}
+
+/* Write out what is in the ring, from a signal handler.  Only the file
+   and stdout get it, as they do the rest of zlog_signal's messages. */
+static void
+zlog_async_dump_sigsafe (void)
+{
+  unsigned int head = zlog_async.head, len = zlog_async.len, done;
+
+  if (! zlog_async.running || zlog_async.ring == NULL)
+    return;
+  for (done = 0; done < len; )
+    {
+      struct zlog_async_rec *rec;
+
+      rec = &zlog_async.ring[(head + done) % ZLOG_ASYNC_UNITS];
+      if ((rec->dests & (1 << ZLOG_DEST_FILE)) && logfile_fd >= 0)
+	write (logfile_fd, rec + 1, rec->len);
+      if (rec->dests & (1 << ZLOG_DEST_STDOUT))
+	write (STDOUT_FILENO, rec + 1, rec->len);
+      if (rec->units == 0)
+	break;
+      done += rec->units;
+    }
+}
+
+/* Turn asynchronous logging on or off.  Turning it off waits for the
+   writer to write out what it has. */
+int
+zlog_set_async (struct zlog *zl, int async)
+{
+  int ret = 0;
+
+  if (zl == NULL)
+    zl = zlog_default;
+
+  pthread_mutex_lock (&zlog_async.mtx);
+  if (async)
+    ret = zlog_async_start ();
+  else if (zlog_async.running)
+    {
+      zlog_async.stop = 1;
+      pthread_cond_signal (&zlog_async.cond);
+      pthread_mutex_unlock (&zlog_async.mtx);
+      pthread_join (zlog_async.thread, NULL);
+      pthread_mutex_lock (&zlog_async.mtx);
+      zlog_async.running = 0;
+    }
+  zl->async = (async && ret == 0);
+  pthread_mutex_unlock (&zlog_async.mtx);
+  return ret;
+}
+
+/* Wait until all messages logged so far have been written. */
+void
+zlog_async_flush (void)
+{
+  pthread_mutex_lock (&zlog_async.mtx);
+  zlog_async_wait ();
+  pthread_mutex_unlock (&zlog_async.mtx);
+}
+
+void
+zlog_async_stats (unsigned long *written, unsigned long *dropped)
+{
+  pthread_mutex_lock (&zlog_async.mtx);
+  *written = zlog_async.written;
+  *dropped = zlog_async.dropped;
+  pthread_mutex_unlock (&zlog_async.mtx);
+}
+
 /* va_list version of zlog. */
 static void
 vzlog (struct zlog *zl, int priority, const char *format, va_list args)
@@ -174,6 +589,31 @@ vzlog (struct zlog *zl, int priority, const char *format, va_list args)
     }
   tsctl.precision = zl->timestamp_precision;
 
+  if (zl->async)
+    {
+      u_char dests = 0;
+      va_list ac;
+
+      if (priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
+	dests |= (1 << ZLOG_DEST_SYSLOG);
+      if ((priority <= zl->maxlvl[ZLOG_DEST_FILE]) && zl->fp)
+	dests |= (1 << ZLOG_DEST_FILE);
+      if (priority <= zl->maxlvl[ZLOG_DEST_STDOUT])
+	dests |= (1 << ZLOG_DEST_STDOUT);
+
+      va_copy (ac, args);
+      if (dests == 0 || vzlog_async (zl, priority, dests, format, ac) == 0)
+	{
+	  va_end (ac);
+	  if (priority <= zl->maxlvl[ZLOG_DEST_MONITOR]
+	      && zlog_on_main_thread ())
+	    vty_log ((zl->record_priority ? zlog_priority[priority] : NULL),
+		     zlog_proto_names[zl->protocol], format, &tsctl, args);
+	  return;
+	}
+      va_end (ac);
+    }
+
   /* Syslog output */
   if (priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
     {
@@ -213,8 +653,8 @@ vzlog (struct zlog *zl, int priority, const char *format, va_list args)
       fflush (stdout);
     }
 
-  /* Terminal monitor. */
-  if (priority <= zl->maxlvl[ZLOG_DEST_MONITOR])
+  /* Terminal monitor, which other threads' messages do not reach. */
+  if (priority <= zl->maxlvl[ZLOG_DEST_MONITOR] && zlog_on_main_thread ())
     vty_log ((zl->record_priority ? zlog_priority[priority] : NULL),
 	     zlog_proto_names[zl->protocol], format, &tsctl, args);
 }
@@ -370,6 +810,9 @@ zlog_signal(int signo, const char *action
   char *msgstart = buf;
 #define LOC s,buf+sizeof(buf)-s
 
+  /* What the writer has not got to yet comes first. */
+  zlog_async_dump_sigsafe ();
+
   time(&now);
   if (zlog_default)
     {
@@ -654,6 +1097,10 @@ void
 _zlog_assert_failed (const char *assertion, const char *file,
 		     unsigned int line, const char *function)
 {
+  /* Log it and the backtrace before returning to abort. */
+  if (zlog_default && zlog_default->async)
+    zlog_set_async (zlog_default, 0);
+
   /* Force fallback file logging? */
   if (zlog_default && !zlog_default->fp &&
       ((logfile_fd = open_crashlog()) >= 0) &&
@@ -677,6 +1124,9 @@ openzlog (const char *progname, zlog_proto_t protocol,
 
   zl = XCALLOC(MTYPE_ZLOG, sizeof (struct zlog));
 
+  zlog_main_thread = pthread_self ();
+  zlog_main_thread_set = 1;
+
   zl->ident = progname;
   zl->protocol = protocol;
   zl->facility = syslog_facility;
@@ -696,6 +1146,9 @@ openzlog (const char *progname, zlog_proto_t protocol,
 void
 closezlog (struct zlog *zl)
 {
+  if (zl->async)
+    zlog_set_async (zl, 0);
+
   closelog();
 
   if (zl->fp != NULL)
@@ -738,10 +1191,12 @@ zlog_set_file (struct zlog *zl, const char *filename, int log_level)
     return 0;
 
   /* Set flags. */
+  pthread_mutex_lock (&zlog_async.out_mtx);
   zl->filename = strdup (filename);
   zl->maxlvl[ZLOG_DEST_FILE] = log_level;
   zl->fp = fp;
   logfile_fd = fileno(fp);
+  pthread_mutex_unlock (&zlog_async.out_mtx);
 
   return 1;
 }
@@ -753,6 +1208,7 @@ zlog_reset_file (struct zlog *zl)
   if (zl == NULL)
     zl = zlog_default;
 
+  pthread_mutex_lock (&zlog_async.out_mtx);
   if (zl->fp)
     fclose (zl->fp);
   zl->fp = NULL;
@@ -762,6 +1218,7 @@ zlog_reset_file (struct zlog *zl)
   if (zl->filename)
     free (zl->filename);
   zl->filename = NULL;
+  pthread_mutex_unlock (&zlog_async.out_mtx);
 
   return 1;
 }
@@ -775,6 +1232,7 @@ zlog_rotate (struct zlog *zl)
   if (zl == NULL)
     zl = zlog_default;
 
+  pthread_mutex_lock (&zlog_async.out_mtx);
   if (zl->fp)
     fclose (zl->fp);
   zl->fp = NULL;
@@ -793,6 +1251,7 @@ zlog_rotate (struct zlog *zl)
       umask(oldumask);
       if (zl->fp == NULL)
         {
+	  pthread_mutex_unlock (&zlog_async.out_mtx);
 	  zlog_err("Log rotate failed: cannot open file %s for append: %s",
 	  	   zl->filename, safe_strerror(save_errno));
 	  return -1;
@@ -800,6 +1259,7 @@ zlog_rotate (struct zlog *zl)
       logfile_fd = fileno(zl->fp);
       zl->maxlvl[ZLOG_DEST_FILE] = level;
     }
+  pthread_mutex_unlock (&zlog_async.out_mtx);
 
   return 1;
 }
@@ -892,6 +1352,10 @@ static const struct zebra_desc_table command_types[] = {
   DESC_ENTRY	(ZEBRA_ROUTER_ID_DELETE),
   DESC_ENTRY	(ZEBRA_ROUTER_ID_UPDATE),
   DESC_ENTRY	(ZEBRA_HELLO),
+  DESC_ENTRY	(ZEBRA_IPV4_NEXTHOP_LOOKUP_MRIB),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_REGISTER),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_UNREGISTER),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_UPDATE),
 };
 #undef DESC_ENTRY
 
@@ -85,6 +85,7 @@ struct zlog
   			   priority of the message? */
   int syslog_options;	/* 2nd arg to openlog */
   int timestamp_precision;	/* # of digits of subsecond precision */
+  int async;		/* written by a thread of its own? */
 };
 
 /* Message structure. */
@@ -136,6 +137,13 @@ extern void plog_debug (struct zlog *, const char *format, ...)
 
 extern void zlog_thread_info (int log_level);
 
+/* Hand messages for syslog, stdout and the file to a writer thread,
+   or stop doing so. */
+extern int zlog_set_async (struct zlog *zl, int async);
+extern void zlog_async_flush (void);
+extern void zlog_async_stats (unsigned long *written,
+			      unsigned long *dropped);
+
 /* Set logging level for the given destination.  If the log_level
    argument is ZLOG_DISABLED, then the destination is disabled.
    This function should not be used for file logging (use zlog_set_file
@@ -25,6 +25,7 @@
 #if !defined(HAVE_STDLIB_H) || (defined(GNU_LINUX) && defined(HAVE_MALLINFO))
 #include <malloc.h>
 #endif /* !HAVE_STDLIB_H || HAVE_MALLINFO */
+#include <sys/mman.h>
 
 #include "log.h"
 #include "memory.h"
@@ -58,6 +59,202 @@ zerror (const char *fname, int type, size_t size)
   abort();
 }
 
+/* Slab allocator.
+
+   Objects of the types flagged MEMORY_SLAB in memtypes.c are not
+   malloc()ed one at a time, but carved out of SLAB_SIZE blocks which
+   are mmap()ed for the type and aligned to their size, so that the
+   slab an object belongs to is found by masking its address.  That
+   saves malloc's per object header and rounding, and keeps the
+   objects of a type together rather than scattered over the heap
+   among buffers of every size, which is what fragments it.
+
+   A type's objects are all the size of its first allocation, and no
+   later allocation of the type may ask for more.  Freed objects go on
+   their slab's free list; a slab with none left in use is given back
+   to the system, unless it is the only one of its type with room.
+   Like the counters, slabs are for the main thread only. */
+
+#define SLAB_SIZE	(64 * 1024)
+
+/* Good enough for everything flagged so far. */
+#define SLAB_ALIGN	8
+#define SLAB_ROUND(S)	(((S) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+struct slab
+{
+  struct slab *next;
+  struct slab *prev;
+  struct slab_cache *cache;
+
+  /* Objects freed. */
+  void *free;
+
+  /* Objects in use, and handed out so far: the slab beyond the
+     latter has never been touched. */
+  unsigned int used;
+  unsigned int carved;
+};
+
+#define SLAB_HEAD	SLAB_ROUND (sizeof (struct slab))
+
+#define SLAB_OF(P) \
+  ((struct slab *) ((uintptr_t) (P) & ~((uintptr_t) SLAB_SIZE - 1)))
+
+struct slab_cache
+{
+  int on;
+
+  /* Object size, 0 until the type's first allocation. */
+  size_t size;
+  unsigned int per_slab;
+
+  /* Slabs with room, and full ones. */
+  struct slab *partial;
+  struct slab *full;
+
+  unsigned long slabs;
+  unsigned long used;
+};
+
+static struct slab_cache slab_cache[MTYPE_MAX];
+static int slab_initialized;
+
+static void
+slab_init (void)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      if (m->index && (m->flags & MEMORY_SLAB))
+	slab_cache[m->index].on = 1;
+
+  slab_initialized = 1;
+}
+
+/* The type's cache, if it is allocated from slabs. */
+static inline struct slab_cache *
+slab_cache_lookup (int type)
+{
+  if (! slab_initialized)
+    slab_init ();
+  return slab_cache[type].on ? &slab_cache[type] : NULL;
+}
+
+static void
+slab_link (struct slab **head, struct slab *slab)
+{
+  slab->prev = NULL;
+  slab->next = *head;
+  if (*head)
+    (*head)->prev = slab;
+  *head = slab;
+}
+
+static void
+slab_unlink (struct slab **head, struct slab *slab)
+{
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    *head = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+}
+
+static struct slab *
+slab_new (struct slab_cache *cache)
+{
+  struct slab *slab;
+  char *p, *start;
+  size_t lead;
+
+  /* Map twice the size, and trim it down to an aligned slab. */
+  p = mmap (NULL, 2 * SLAB_SIZE, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+
+  start = (char *) (((uintptr_t) p + SLAB_SIZE - 1)
+		    & ~((uintptr_t) SLAB_SIZE - 1));
+  lead = start - p;
+  if (lead)
+    munmap (p, lead);
+  munmap (start + SLAB_SIZE, SLAB_SIZE - lead);
+
+  /* Fresh from mmap, so zeroed. */
+  slab = (struct slab *) start;
+  slab->cache = cache;
+  slab_link (&cache->partial, slab);
+  cache->slabs++;
+
+  return slab;
+}
+
+static void *
+slab_alloc (struct slab_cache *cache, size_t size)
+{
+  struct slab *slab;
+  void *obj;
+
+  if (! cache->size)
+    {
+      cache->size = SLAB_ROUND (MAX (size, sizeof (void *)));
+      cache->per_slab = (SLAB_SIZE - SLAB_HEAD) / cache->size;
+      assert (cache->per_slab > 1);
+    }
+  assert (size <= cache->size);
+
+  slab = cache->partial;
+  if (! slab && ! (slab = slab_new (cache)))
+    return NULL;
+
+  if (slab->free)
+    {
+      obj = slab->free;
+      slab->free = *(void **) obj;
+    }
+  else
+    obj = (char *) slab + SLAB_HEAD + slab->carved++ * cache->size;
+
+  cache->used++;
+  if (++slab->used == cache->per_slab)
+    {
+      slab_unlink (&cache->partial, slab);
+      slab_link (&cache->full, slab);
+    }
+
+  return obj;
+}
+
+static void
+slab_free (struct slab_cache *cache, void *obj)
+{
+  struct slab *slab = SLAB_OF (obj);
+
+  /* Freed as another type than it was allocated as? */
+  assert (slab->cache == cache);
+
+  if (slab->used == cache->per_slab)
+    {
+      slab_unlink (&cache->full, slab);
+      slab_link (&cache->partial, slab);
+    }
+
+  *(void **) obj = slab->free;
+  slab->free = obj;
+  cache->used--;
+
+  if (--slab->used == 0 && (slab->prev || slab->next))
+    {
+      slab_unlink (&cache->partial, slab);
+      munmap (slab, SLAB_SIZE);
+      cache->slabs--;
+    }
+}
+
 /*
  * Allocate memory of a given size, to be tracked by a given type.
  * Effects: Returns a pointer to usable memory.  If memory cannot
@@ -66,9 +263,13 @@ zerror (const char *fname, int type, size_t size)
 void *
 zmalloc (int type, size_t size)
 {
+  struct slab_cache *cache;
   void *memory;
 
-  memory = malloc (size);
+  if ((cache = slab_cache_lookup (type)) != NULL)
+    memory = slab_alloc (cache, size);
+  else
+    memory = malloc (size);
 
   if (memory == NULL)
     zerror ("malloc", type, size);
@@ -84,9 +285,17 @@ zmalloc (int type, size_t size)
 void *
 zcalloc (int type, size_t size)
 {
+  struct slab_cache *cache;
   void *memory;
 
-  memory = calloc (1, size);
+  if ((cache = slab_cache_lookup (type)) != NULL)
+    {
+      memory = slab_alloc (cache, size);
+      if (memory)
+	memset (memory, 0, size);
+    }
+  else
+    memory = calloc (1, size);
 
   if (memory == NULL)
     zerror ("calloc", type, size);
@@ -106,8 +315,18 @@ zcalloc (int type, size_t size)
 void *
 zrealloc (int type, void *ptr, size_t size)
 {
+  struct slab_cache *cache;
   void *memory;
 
+  /* Slab objects can't grow, but can stay as they are. */
+  if ((cache = slab_cache_lookup (type)) != NULL)
+    {
+      if (ptr == NULL)
+	return zmalloc (type, size);
+      assert (size <= cache->size);
+      return ptr;
+    }
+
   memory = realloc (ptr, size);
   if (memory == NULL)
     zerror ("realloc", type, size);
@@ -126,10 +345,15 @@ zrealloc (int type, void *ptr, size_t size)
 void
 zfree (int type, void *ptr)
 {
+  struct slab_cache *cache;
+
   if (ptr != NULL)
     {
       alloc_dec (type);
-      free (ptr);
+      if ((cache = slab_cache_lookup (type)) != NULL)
+	slab_free (cache, ptr);
+      else
+	free (ptr);
     }
 }
 
@@ -144,6 +368,15 @@ zstrdup (int type, const char *str)
 {
   void *dup;
 
+  if (slab_cache_lookup (type))
+    {
+      size_t len = strlen (str) + 1;
+
+      dup = zmalloc (type, len);
+      memcpy (dup, str, len);
+      return dup;
+    }
+
   dup = strdup (str);
   if (dup == NULL)
     zerror ("strdup", type, strlen (str));
@@ -392,6 +625,49 @@ show_memory_mallinfo (struct vty *vty)
 }
 #endif /* HAVE_MALLINFO */
 
+/* Slab use by type: objects in use, room for more in the slabs
+   mapped, and the share of those slabs taken up by live objects. */
+static int
+show_memory_slab (struct vty *vty)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+  struct slab_cache *cache;
+  char buf[MTYPE_MEMSTR_LEN];
+  unsigned long slabs = 0, used = 0;
+
+  vty_out (vty, "Slab allocator statistics:%s", VTY_NEWLINE);
+  vty_out (vty, "%-30s: %6s %10s %10s %6s %10s %4s%s", "Type", "Size",
+	   "Objects", "Free", "Slabs", "Memory", "Used", VTY_NEWLINE);
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      {
+	if (! m->index || ! slab_cache[m->index].on)
+	  continue;
+	cache = &slab_cache[m->index];
+	if (! cache->slabs)
+	  continue;
+
+	vty_out (vty, "%-30s: %6lu %10lu %10lu %6lu %10s %3lu%%%s",
+		 m->format, (unsigned long) cache->size, cache->used,
+		 cache->slabs * cache->per_slab - cache->used, cache->slabs,
+		 mtype_memstr (buf, MTYPE_MEMSTR_LEN,
+			       cache->slabs * SLAB_SIZE),
+		 cache->used * cache->size / (cache->slabs * (SLAB_SIZE / 100)),
+		 VTY_NEWLINE);
+	slabs += cache->slabs;
+	used += cache->used * cache->size;
+      }
+
+  if (slabs)
+    vty_out (vty, "%-30s: %6s %10s %10s %6lu %10s %3lu%%%s", "Total", "",
+	     "", "", slabs,
+	     mtype_memstr (buf, MTYPE_MEMSTR_LEN, slabs * SLAB_SIZE),
+	     used / (slabs * (SLAB_SIZE / 100)), VTY_NEWLINE);
+  return 1;
+}
+
 DEFUN (show_memory_all,
        show_memory_all_cmd,
        "show memory all",
@@ -413,6 +689,10 @@ DEFUN (show_memory_all,
       needsep = show_memory_vty (vty, ml->list);
     }
 
+  if (needsep)
+    show_separator (vty);
+  show_memory_slab (vty);
+
   return CMD_SUCCESS;
 }
 
@@ -28,8 +28,12 @@ struct memory_list
 {
   int index;
   const char *format;
+  int flags;
 };
 
+/* memory_list flags. */
+#define MEMORY_SLAB	(1 << 0)	/* Fixed size, allocate from slabs. */
+
 struct mlist {
   struct memory_list *list;
   const char *name;
@@ -17,8 +17,8 @@ struct memory_list memory_list_lib[] =
   { MTYPE_VECTOR,		"Vector"			},
   { MTYPE_VECTOR_INDEX,		"Vector index"			},
   { MTYPE_LINK_LIST,		"Link List"			},
-  { MTYPE_LINK_NODE,		"Link Node"			},
-  { MTYPE_THREAD,		"Thread"			},
+  { MTYPE_LINK_NODE,		"Link Node",			MEMORY_SLAB },
+  { MTYPE_THREAD,		"Thread",			MEMORY_SLAB },
   { MTYPE_THREAD_MASTER,	"Thread master"			},
   { MTYPE_THREAD_STATS,		"Thread stats"			},
   { MTYPE_VTY,			"VTY"				},
@@ -36,15 +36,17 @@ struct memory_list memory_list_lib[] =
   { MTYPE_PREFIX_IPV4,		"Prefix IPv4"			},
   { MTYPE_PREFIX_IPV6,		"Prefix IPv6"			},
   { MTYPE_HASH,			"Hash"				},
-  { MTYPE_HASH_BACKET,		"Hash Bucket"			},
+  { MTYPE_HASH_BACKET,		"Hash Bucket",			MEMORY_SLAB },
   { MTYPE_HASH_INDEX,		"Hash Index"			},
   { MTYPE_ROUTE_TABLE,		"Route table"			},
-  { MTYPE_ROUTE_NODE,		"Route node"			},
+  { MTYPE_ROUTE_NODE,		"Route node",			MEMORY_SLAB },
+  { MTYPE_ROUTE_TABLE_STRIDE,	"Route table stride index"	},
   { MTYPE_DISTRIBUTE,		"Distribute list"		},
   { MTYPE_DISTRIBUTE_IFNAME,	"Dist-list ifname"		},
   { MTYPE_ACCESS_LIST,		"Access List"			},
   { MTYPE_ACCESS_LIST_STR,	"Access List Str"		},
   { MTYPE_ACCESS_FILTER,	"Access Filter"			},
+  { MTYPE_ACCESS_INDEX,		"Access List Index"		},
   { MTYPE_PREFIX_LIST,		"Prefix List"			},
   { MTYPE_PREFIX_LIST_ENTRY,	"Prefix List Entry"		},
   { MTYPE_PREFIX_LIST_STR,	"Prefix List Str"		},
@@ -54,6 +56,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_ROUTE_MAP_RULE,	"Route map rule"		},
   { MTYPE_ROUTE_MAP_RULE_STR,	"Route map rule str"		},
   { MTYPE_ROUTE_MAP_COMPILED,	"Route map compiled"		},
+  { MTYPE_ROUTE_MAP_CACHE,	"Route map cache",		MEMORY_SLAB },
   { MTYPE_CMD_TOKENS,		"Command desc"			},
   { MTYPE_KEY,			"Key"				},
   { MTYPE_KEYCHAIN,		"Key chain"			},
@@ -84,6 +87,8 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
   { MTYPE_RIB_DEST,		"RIB destination"		},
   { MTYPE_RIB_TABLE_INFO,	"RIB table info"		},
+  { MTYPE_RNH,			"Registered nexthop"		},
+  { MTYPE_DPLANE_CTX,		"Dataplane route change"	},
   { -1, NULL },
 };
 
@@ -93,34 +98,38 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_LISTENER,		"BGP listen socket details"	},
   { MTYPE_BGP_PEER,		"BGP peer"			},
   { MTYPE_BGP_PEER_HOST,	"BGP peer hostname"		},
+  { MTYPE_BGP_PEER_INDEX,	"BGP peer index map"		},
   { MTYPE_PEER_GROUP,		"Peer group"			},
   { MTYPE_PEER_DESC,		"Peer description"		},
   { MTYPE_PEER_PASSWORD,	"Peer password string"		},
-  { MTYPE_ATTR,			"BGP attribute"			},
+  { MTYPE_ATTR,			"BGP attribute",			MEMORY_SLAB },
   { MTYPE_ATTR_EXTRA,		"BGP extra attributes"		},
-  { MTYPE_AS_PATH,		"BGP aspath"			},
+  { MTYPE_AS_PATH,		"BGP aspath",			MEMORY_SLAB },
   { MTYPE_AS_SEG,		"BGP aspath seg"		},
   { MTYPE_AS_SEG_DATA,		"BGP aspath segment data"	},
   { MTYPE_AS_STR,		"BGP aspath str"		},
   { 0, NULL },
   { MTYPE_BGP_TABLE,		"BGP table"			},
-  { MTYPE_BGP_NODE,		"BGP node"			},
-  { MTYPE_BGP_ROUTE,		"BGP route"			},
-  { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info"	},
+  { MTYPE_BGP_NODE,		"BGP node",			MEMORY_SLAB },
+  { MTYPE_BGP_ROUTE,		"BGP route",			MEMORY_SLAB },
+  { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info",	MEMORY_SLAB },
   { MTYPE_BGP_CONN,		"BGP connected"			},
   { MTYPE_BGP_STATIC,		"BGP static"			},
-  { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr"			},
-  { MTYPE_BGP_ADVERTISE,	"BGP adv"			},
+  { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr",			MEMORY_SLAB },
+  { MTYPE_BGP_ADVERTISE,	"BGP adv",			MEMORY_SLAB },
   { MTYPE_BGP_SYNCHRONISE,	"BGP synchronise"		},
-  { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
+  { MTYPE_BGP_ADJ_IN,		"BGP adj in",			MEMORY_SLAB },
   { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
-  { MTYPE_BGP_MPATH_INFO,	"BGP multipath info"		},
+  { MTYPE_BGP_PEER_BITS,	"BGP node peer bitmap"		},
+  { MTYPE_BGP_MPATH_INFO,	"BGP multipath info",		MEMORY_SLAB },
+  { MTYPE_BGP_UPDGRP,		"BGP update group"		},
+  { MTYPE_BGP_UPDGRP_PKT,	"BGP update group packet"	},
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
   { MTYPE_AS_FILTER_STR,	"BGP AS filter str"		},
   { 0, NULL },
-  { MTYPE_COMMUNITY,		"community"			},
+  { MTYPE_COMMUNITY,		"community",			MEMORY_SLAB },
   { MTYPE_COMMUNITY_VAL,	"community val"			},
   { MTYPE_COMMUNITY_STR,	"community str"			},
   { 0, NULL },
@@ -142,16 +151,22 @@ struct memory_list memory_list_bgp[] =
   { 0, NULL },
   { MTYPE_TRANSIT,		"BGP transit attr"		},
   { MTYPE_TRANSIT_VAL,		"BGP transit val"		},
+  { MTYPE_BGP_ATTR_ARENA,	"BGP attribute parse arena"	},
+  { MTYPE_BGP_ATTR_CACHE,	"BGP attribute cache"		},
   { 0, NULL },
   { MTYPE_BGP_DISTANCE,		"BGP distance"			},
   { MTYPE_BGP_NEXTHOP_CACHE,	"BGP nexthop"			},
+  { MTYPE_BGP_NEXTHOP_QUERY,	"BGP nexthop lookup query"	},
   { MTYPE_BGP_CONFED_LIST,	"BGP confed list"		},
   { MTYPE_PEER_UPDATE_SOURCE,	"BGP peer update interface"	},
   { MTYPE_BGP_DAMP_INFO,	"Dampening info"		},
   { MTYPE_BGP_DAMP_ARRAY,	"BGP Dampening array"		},
   { MTYPE_BGP_REGEXP,		"BGP regexp"			},
+  { MTYPE_BGP_REGEXP_DFA,	"BGP regexp DFA"		},
   { MTYPE_BGP_AGGREGATE,	"BGP aggregate"			},
   { MTYPE_BGP_ADDR,		"BGP own address"		},
+  { MTYPE_BGP_IO_CONN,		"BGP I/O connection"		},
+  { MTYPE_BGP_IO_BUF,		"BGP I/O input buffer"		},
   { -1, NULL }
 };
 
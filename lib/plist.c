@@ -29,6 +29,7 @@
 #include "buffer.h"
 #include "stream.h"
 #include "log.h"
+#include "table.h"
 
 /* Each prefix-list's entry. */
 struct prefix_list_entry
@@ -46,8 +47,14 @@ struct prefix_list_entry
   unsigned long refcnt;
   unsigned long hitcnt;
 
+  /* Matches not yet accounted for in the refcnt of later entries. */
+  unsigned long matched;
+
   struct prefix_list_entry *next;
   struct prefix_list_entry *prev;
+
+  /* Next entry, by sequence number, with the same prefix. */
+  struct prefix_list_entry *same;
 };
 
 /* List of struct prefix_list. */
@@ -284,6 +291,139 @@ prefix_list_get (afi_t afi, const char *name)
   return plist;
 }
 
+/* Prefix-list tries.
+
+   Besides the list in sequence order, a prefix-list keeps its entries
+   in a route table per address family, indexed by the entry prefix,
+   and chained in sequence order where several share one.  Only the
+   entries on a prefix's path from the root can match it, so
+   prefix_list_apply looks at those alone and takes the one with the
+   lowest sequence number whose length range fits.
+
+   An entry's refcnt counts the applies which got as far as it, in
+   sequence order; that is, all of those not matched by an entry
+   before it.  The trie doesn't visit the entries in between, so
+   applies and matches are counted per list and entry and only turned
+   into refcnts, by prefix_list_refcnt_update, before they're shown
+   or the list changes. */
+
+static struct route_table **
+prefix_list_trie (struct prefix_list *plist, u_char family)
+{
+  switch (family)
+    {
+    case AF_INET:
+      return &plist->trie[0];
+#ifdef HAVE_IPV6
+    case AF_INET6:
+      return &plist->trie[1];
+#endif /* HAVE_IPV6 */
+    default:
+      return NULL;
+    }
+}
+
+static void
+prefix_list_trie_add (struct prefix_list *plist,
+		      struct prefix_list_entry *pentry)
+{
+  struct route_table **trie;
+  struct route_node *rn;
+  struct prefix_list_entry *prev;
+
+  trie = prefix_list_trie (plist, pentry->prefix.family);
+  if (trie == NULL)
+    return;
+  if (*trie == NULL)
+    *trie = route_table_init ();
+
+  rn = route_node_get (*trie, &pentry->prefix);
+
+  /* The node keeps one lock for all its entries. */
+  prev = rn->info;
+  if (prev)
+    route_unlock_node (rn);
+
+  if (prev == NULL || prev->seq > pentry->seq)
+    {
+      pentry->same = prev;
+      rn->info = pentry;
+      return;
+    }
+
+  while (prev->same && prev->same->seq < pentry->seq)
+    prev = prev->same;
+  pentry->same = prev->same;
+  prev->same = pentry;
+}
+
+static void
+prefix_list_trie_delete (struct prefix_list *plist,
+			 struct prefix_list_entry *pentry)
+{
+  struct route_table **trie;
+  struct route_node *rn;
+  struct prefix_list_entry *prev;
+
+  trie = prefix_list_trie (plist, pentry->prefix.family);
+  if (trie == NULL || *trie == NULL)
+    return;
+
+  rn = route_node_lookup (*trie, &pentry->prefix);
+  if (rn == NULL)
+    return;
+
+  if (rn->info == pentry)
+    rn->info = pentry->same;
+  else
+    {
+      for (prev = rn->info; prev->same != pentry; prev = prev->same)
+	;
+      prev->same = pentry->same;
+    }
+  pentry->same = NULL;
+
+  route_unlock_node (rn);
+  if (rn->info == NULL)
+    route_unlock_node (rn);
+}
+
+/* First, by sequence number, of the entries for exactly this prefix. */
+static struct prefix_list_entry *
+prefix_list_trie_lookup (struct prefix_list *plist, struct prefix *prefix)
+{
+  struct route_table **trie;
+  struct route_node *rn;
+
+  trie = prefix_list_trie (plist, prefix->family);
+  if (trie == NULL || *trie == NULL)
+    return NULL;
+
+  rn = route_node_lookup (*trie, prefix);
+  if (rn == NULL)
+    return NULL;
+  route_unlock_node (rn);
+  return rn->info;
+}
+
+static void
+prefix_list_refcnt_update (struct prefix_list *plist)
+{
+  struct prefix_list_entry *pentry;
+  unsigned long matched = 0;
+
+  if (plist->applies == 0)
+    return;
+
+  for (pentry = plist->head; pentry; pentry = pentry->next)
+    {
+      pentry->refcnt += plist->applies - matched;
+      matched += pentry->matched;
+      pentry->matched = 0;
+    }
+  plist->applies = 0;
+}
+
 /* Delete prefix-list from prefix_list_master and free it. */
 static void
 prefix_list_delete (struct prefix_list *plist)
@@ -301,6 +441,11 @@ prefix_list_delete (struct prefix_list *plist)
       plist->count--;
     }
 
+  if (plist->trie[0])
+    route_table_finish (plist->trie[0]);
+  if (plist->trie[1])
+    route_table_finish (plist->trie[1]);
+
   master = plist->master;
 
   if (plist->type == PREFIX_TYPE_NUMBER)
@@ -384,11 +529,10 @@ prefix_new_seq_get (struct prefix_list *plist)
 
   maxseq = newseq = 0;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
-    {
-      if (maxseq < pentry->seq)
-	maxseq = pentry->seq;
-    }
+  /* The list is in sequence order. */
+  pentry = plist->tail;
+  if (pentry)
+    maxseq = pentry->seq;
 
   newseq = ((maxseq / 5) * 5) + 5;
   
@@ -401,6 +545,9 @@ prefix_seq_check (struct prefix_list *plist, int seq)
 {
   struct prefix_list_entry *pentry;
 
+  if (plist->tail == NULL || plist->tail->seq < seq)
+    return NULL;
+
   for (pentry = plist->head; pentry; pentry = pentry->next)
     if (pentry->seq == seq)
       return pentry;
@@ -413,7 +560,10 @@ prefix_list_entry_lookup (struct prefix_list *plist, struct prefix *prefix,
 {
   struct prefix_list_entry *pentry;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
+  /* The trie chains entries by their masked prefix, the ones written
+     with host bits are told apart here. */
+  for (pentry = prefix_list_trie_lookup (plist, prefix); pentry;
+       pentry = pentry->same)
     if (prefix_same (&pentry->prefix, prefix) && pentry->type == type)
       {
 	if (seq >= 0 && pentry->seq != seq)
@@ -437,6 +587,10 @@ prefix_list_entry_delete (struct prefix_list *plist,
 {
   if (plist == NULL || pentry == NULL)
     return;
+
+  prefix_list_refcnt_update (plist);
+  prefix_list_trie_delete (plist, pentry);
+
   if (pentry->prev)
     pentry->prev->next = pentry->next;
   else
@@ -478,10 +632,16 @@ prefix_list_entry_add (struct prefix_list *plist,
   if (replace)
     prefix_list_entry_delete (plist, replace, 0);
 
-  /* Check insert point. */
-  for (point = plist->head; point; point = point->next)
-    if (point->seq >= pentry->seq)
-      break;
+  prefix_list_refcnt_update (plist);
+  prefix_list_trie_add (plist, pentry);
+
+  /* Check insert point, most often the end. */
+  if (plist->tail && plist->tail->seq < pentry->seq)
+    point = NULL;
+  else
+    for (point = plist->head; point; point = point->next)
+      if (point->seq >= pentry->seq)
+	break;
 
   /* In case of this is the first element of the list. */
   pentry->next = point;
@@ -564,6 +724,9 @@ enum prefix_list_type
 prefix_list_apply (struct prefix_list *plist, void *object)
 {
   struct prefix_list_entry *pentry;
+  struct prefix_list_entry *match;
+  struct route_table **trie;
+  struct route_node *rn, *node;
   struct prefix *p;
 
   p = (struct prefix *) object;
@@ -574,17 +737,36 @@ prefix_list_apply (struct prefix_list *plist, void *object)
   if (plist->count == 0)
     return PREFIX_PERMIT;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
-    {
-      pentry->refcnt++;
-      if (prefix_list_entry_match (pentry, p))
-	{
-	  pentry->hitcnt++;
-	  return pentry->type;
-	}
-    }
+  plist->applies++;
+
+  trie = prefix_list_trie (plist, p->family);
+  if (trie == NULL || *trie == NULL)
+    return PREFIX_DENY;
 
-  return PREFIX_DENY;
+  rn = route_node_match (*trie, p);
+  if (rn == NULL)
+    return PREFIX_DENY;
+
+  match = NULL;
+  for (node = rn; node; node = node->parent)
+    for (pentry = node->info; pentry; pentry = pentry->same)
+      {
+	if (match && pentry->seq > match->seq)
+	  break;
+	if (prefix_list_entry_match (pentry, p))
+	  {
+	    match = pentry;
+	    break;
+	  }
+      }
+  route_unlock_node (rn);
+
+  if (match == NULL)
+    return PREFIX_DENY;
+
+  match->hitcnt++;
+  match->matched++;
+  return match->type;
 }
 
 static void __attribute__ ((unused))
@@ -635,7 +817,8 @@ prefix_entry_dup_check (struct prefix_list *plist,
   else
     seq = new->seq;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
+  for (pentry = prefix_list_trie_lookup (plist, &new->prefix); pentry;
+       pentry = pentry->same)
     {
       if (prefix_same (&pentry->prefix, &new->prefix)
 	  && pentry->type == new->type
@@ -926,6 +1109,8 @@ vty_show_prefix_entry (struct vty *vty, afi_t afi, struct prefix_list *plist,
 {
   struct prefix_list_entry *pentry;
 
+  prefix_list_refcnt_update (plist);
+
   /* Print the name of the protocol */
   if (zlog_default)
       vty_out (vty, "%s: ", zlog_proto_names[zlog_default->protocol]);
@@ -1061,6 +1246,8 @@ vty_show_prefix_list_prefix (struct vty *vty, afi_t afi, const char *name,
       return CMD_WARNING;
     }
 
+  prefix_list_refcnt_update (plist);
+
   for (pentry = plist->head; pentry; pentry = pentry->next)
     {
       match = 0;
@@ -52,6 +52,12 @@ struct prefix_list
   struct prefix_list_entry *head;
   struct prefix_list_entry *tail;
 
+  /* The entries by prefix, for IPv4 and IPv6: see plist.c. */
+  struct route_table *trie[2];
+
+  /* prefix_list_apply calls not yet counted in the entries' refcnt. */
+  unsigned long applies;
+
   struct prefix_list *next;
   struct prefix_list *prev;
 };
@@ -66,6 +72,7 @@ struct orf_prefix
 
 /* Prototypes. */
 struct vty;
+struct route_table;
 
 extern void prefix_list_init (void);
 extern void prefix_list_reset (void);
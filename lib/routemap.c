@@ -28,6 +28,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "command.h"
 #include "vty.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* Vector for route match rules. */
 static vector route_match_vec;
@@ -47,11 +49,24 @@ struct route_map_rule
   /* Pre-compiled match rule. */
   void *value;
 
+  /* Bit for this match in the route map's cache entries, or -1. */
+  int slot;
+
   /* Linked list. */
   struct route_map_rule *next;
   struct route_map_rule *prev;
 };
 
+/* What the attribute-only matches of a route map made of the object
+   with this key.  A rule's result is known if its slot bit is set in
+   known, and is a match if it is set in match too. */
+struct route_map_cache
+{
+  unsigned long key;
+  u_int32_t known;
+  u_int32_t match;
+};
+
 /* Making route map list. */
 struct route_map_list
 {
@@ -73,6 +88,95 @@ route_map_rule_delete (struct route_map_rule_list *,
 static void
 route_map_index_delete (struct route_map_index *, int);
 
+static unsigned int
+route_map_cache_key (const void *p)
+{
+  const struct route_map_cache *cache = p;
+
+  return jhash_1word (cache->key, 0);
+}
+
+static int
+route_map_cache_cmp (const void *p1, const void *p2)
+{
+  const struct route_map_cache *c1 = p1, *c2 = p2;
+
+  return c1->key == c2->key;
+}
+
+static void *
+route_map_cache_alloc (const void *p)
+{
+  const struct route_map_cache *key = p;
+  struct route_map_cache *cache;
+
+  cache = XCALLOC (MTYPE_ROUTE_MAP_CACHE, sizeof (struct route_map_cache));
+  cache->key = key->key;
+  return cache;
+}
+
+static void
+route_map_cache_free (void *cache)
+{
+  XFREE (MTYPE_ROUTE_MAP_CACHE, cache);
+}
+
+/* Find the entry for KEY, making it if need be.  The cache is simply
+   emptied when full, as keys of attributes which have gone away are
+   never asked for again. */
+static struct route_map_cache *
+route_map_cache_get (struct route_map *map, unsigned long key)
+{
+  struct route_map_cache tmp;
+
+  if (map->cache == NULL)
+    map->cache = hash_create_open (HASH_INITIAL_SIZE, route_map_cache_key,
+                                   route_map_cache_cmp);
+  else if (map->cache->count >= RMAP_CACHE_MAX)
+    hash_clean (map->cache, route_map_cache_free);
+
+  tmp.key = key;
+  return hash_get (map->cache, &tmp, route_map_cache_alloc);
+}
+
+/* Forget what the route map's matches made of any object. */
+void
+route_map_cache_flush (struct route_map *map)
+{
+  if (map == NULL)
+    {
+      for (map = route_map_master.head; map; map = map->next)
+        route_map_cache_flush (map);
+      return;
+    }
+
+  if (map->cache)
+    hash_clean (map->cache, route_map_cache_free);
+}
+
+/* The match rules of the route map have changed: give the attribute
+   only ones their bits anew, and drop the results made with the old
+   rules. */
+static void
+route_map_cache_reset (struct route_map *map)
+{
+  struct route_map_index *index;
+  struct route_map_rule *rule;
+
+  map->cached = 0;
+  for (index = map->head; index; index = index->next)
+    for (rule = index->match_list.head; rule; rule = rule->next)
+      {
+        if ((rule->cmd->flags & RMAP_RULE_ATTR)
+            && map->cached < RMAP_CACHE_RULES)
+          rule->slot = map->cached++;
+        else
+          rule->slot = -1;
+      }
+
+  route_map_cache_flush (map);
+}
+
 /* New route map allocation. Please note route map's name must be
    specified. */
 static struct route_map *
@@ -121,6 +225,12 @@ route_map_delete (struct route_map *map)
   while ((index = map->head) != NULL)
     route_map_index_delete (index, 0);
 
+  if (map->cache)
+    {
+      hash_clean (map->cache, route_map_cache_free);
+      hash_free (map->cache);
+    }
+
   name = map->name;
 
   list = &route_map_master;
@@ -246,6 +356,20 @@ vty_show_route_map_entry (struct vty *vty, struct route_map *map)
       else if (index->exitpolicy == RMAP_EXIT)
         vty_out (vty, "    Exit routemap%s", VTY_NEWLINE);
     }
+
+  /* Results of attribute-only matches remembered */
+  if (map->cached)
+    {
+      unsigned long total = map->cache_hits + map->cache_misses;
+
+      vty_out (vty, "route-map %s, cache: %lu hits, %lu misses",
+               map->name, map->cache_hits, map->cache_misses);
+      if (total)
+        vty_out (vty, ", %lu%% hit rate",
+                 (unsigned long) (map->cache_hits * 100.0 / total));
+      vty_out (vty, ", %lu entries%s",
+               map->cache ? map->cache->count : 0UL, VTY_NEWLINE);
+    }
 }
 
 static int
@@ -318,6 +442,8 @@ route_map_index_delete (struct route_map_index *index, int notify)
   if (index->nextrm)
     XFREE (MTYPE_ROUTE_MAP_NAME, index->nextrm);
 
+  route_map_cache_reset (index->map);
+
     /* Execute event hook. */
   if (route_map_master.event_hook && notify)
     (*route_map_master.event_hook) (RMAP_EVENT_INDEX_DELETED,
@@ -384,6 +510,8 @@ route_map_index_add (struct route_map *map, enum route_map_type type,
       point->prev = index;
     }
 
+  route_map_cache_reset (map);
+
   /* Execute event hook. */
   if (route_map_master.event_hook)
     (*route_map_master.event_hook) (RMAP_EVENT_INDEX_ADDED,
@@ -569,6 +697,7 @@ route_map_add_match (struct route_map_index *index, const char *match_name,
 
   /* Add new route match rule to linked list. */
   route_map_rule_add (&index->match_list, rule);
+  route_map_cache_reset (index->map);
 
   /* Execute event hook. */
   if (route_map_master.event_hook)
@@ -597,6 +726,7 @@ route_map_delete_match (struct route_map_index *index, const char *match_name,
 	(rulecmp (rule->rule_str, match_arg) == 0 || match_arg == NULL))
       {
 	route_map_rule_delete (&index->match_list, rule);
+	route_map_cache_reset (index->map);
 	/* Execute event hook. */
 	if (route_map_master.event_hook)
 	  (*route_map_master.event_hook) (RMAP_EVENT_MATCH_DELETED,
@@ -740,9 +870,9 @@ route_map_delete_set (struct route_map_index *index, const char *set_name,
 */
 
 static route_map_result_t
-route_map_apply_match (struct route_map_rule_list *match_list,
+route_map_apply_match (struct route_map_index *index,
                        struct prefix *prefix, route_map_object_t type,
-                       void *object)
+                       void *object, struct route_map_cache *cache)
 {
   route_map_result_t ret = RMAP_NOMATCH;
   struct route_map_rule *match;
@@ -750,34 +880,60 @@ route_map_apply_match (struct route_map_rule_list *match_list,
 
   /* Check all match rule and if there is no match rule, go to the
      set statement. */
-  if (!match_list->head)
+  if (!index->match_list.head)
     ret = RMAP_MATCH;
   else
     {
-      for (match = match_list->head; match; match = match->next)
+      for (match = index->match_list.head; match; match = match->next)
         {
           /* Try each match statement in turn, If any do not return
              RMAP_MATCH, return, otherwise continue on to next match 
              statement. All match statements must match for end-result
              to be a match. */
-          ret = (*match->cmd->func_apply) (match->value, prefix,
-                                           type, object);
+          if (cache && match->slot >= 0)
+            {
+              u_int32_t bit = 1U << match->slot;
+
+              if (cache->known & bit)
+                {
+                  index->map->cache_hits++;
+                  if (! (cache->match & bit))
+                    return RMAP_NOMATCH;
+                  continue;
+                }
+
+              index->map->cache_misses++;
+              ret = (*match->cmd->func_apply) (match->value, prefix,
+                                               type, object);
+              if (ret == RMAP_MATCH || ret == RMAP_NOMATCH)
+                {
+                  cache->known |= bit;
+                  if (ret == RMAP_MATCH)
+                    cache->match |= bit;
+                }
+            }
+          else
+            ret = (*match->cmd->func_apply) (match->value, prefix,
+                                             type, object);
           if (ret != RMAP_MATCH)
             return ret;
         }
     }
-  return ret;
+  return RMAP_MATCH;
 }
 
-/* Apply route map to the object. */
-route_map_result_t
-route_map_apply (struct route_map *map, struct prefix *prefix,
-                 route_map_object_t type, void *object)
+/* Apply route map to the object, with its attributes known by KEY if
+   that is not 0. */
+static route_map_result_t
+route_map_apply_key (struct route_map *map, struct prefix *prefix,
+                     route_map_object_t type, void *object,
+                     unsigned long key)
 {
   static int recursion = 0;
   int ret = 0;
   struct route_map_index *index;
   struct route_map_rule *set;
+  struct route_map_cache *cache = NULL;
 
   if (recursion > RMAP_RECURSION_LIMIT)
     {
@@ -791,10 +947,13 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   if (map == NULL)
     return RMAP_DENYMATCH;
 
+  if (key && map->cached)
+    cache = route_map_cache_get (map, key);
+
   for (index = map->head; index; index = index->next)
     {
       /* Apply this index. */
-      ret = route_map_apply_match (&index->match_list, prefix, type, object);
+      ret = route_map_apply_match (index, prefix, type, object, cache);
 
       /* Now we apply the matrix from above */
       if (ret == RMAP_NOMATCH)
@@ -805,6 +964,14 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
           if (index->type == RMAP_PERMIT)
             /* 'action' */
             {
+              /* Sets, here or in a called route-map, may change the
+                 attributes the key stands for. */
+              if (index->set_list.head)
+                {
+                  cache = NULL;
+                  key = 0;
+                }
+
               /* permit+match must execute sets */
               for (set = index->set_list.head; set; set = set->next)
                 ret = (*set->cmd->func_apply) (set->value, prefix,
@@ -819,9 +986,12 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
                   if (nextrm) /* Target route-map found, jump to it */
                     {
                       recursion++;
-                      ret = route_map_apply (nextrm, prefix, type, object);
+                      ret = route_map_apply_key (nextrm, prefix, type,
+                                                 object, key);
                       recursion--;
                     }
+                  cache = NULL;
+                  key = 0;
 
                   /* If nextrm returned 'deny', finish. */
                   if (ret == RMAP_DENYMATCH)
@@ -864,6 +1034,27 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+/* Apply route map to the object. */
+route_map_result_t
+route_map_apply (struct route_map *map, struct prefix *prefix,
+                 route_map_object_t type, void *object)
+{
+  return route_map_apply_key (map, prefix, type, object, 0);
+}
+
+/* Apply route map to the object, remembering what its RMAP_RULE_ATTR
+   matches make of the attributes under KEY.  The caller promises that
+   every object it gives the same key has the same attributes, as far
+   as those matches can see, so a key must never be used again for
+   other attributes. */
+route_map_result_t
+route_map_apply_cached (struct route_map *map, struct prefix *prefix,
+                        route_map_object_t type, void *object,
+                        unsigned long key)
+{
+  return route_map_apply_key (map, prefix, type, object, key);
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
@@ -22,6 +22,8 @@
 #ifndef _ZEBRA_ROUTEMAP_H
 #define _ZEBRA_ROUTEMAP_H
 
+struct hash;
+
 /* Route map's type. */
 enum route_map_type
 {
@@ -88,8 +90,20 @@ struct route_map_rule_cmd
 
   /* Free allocated value by func_compile (). */
   void (*func_free)(void *);
+
+  /* RMAP_RULE_ATTR if the match looks at nothing but the object's
+     attributes, see route_map_apply_cached. */
+  int flags;
 };
 
+#define RMAP_RULE_ATTR  (1 << 0)
+
+/* Attribute-only match rules a route map remembers results for. */
+#define RMAP_CACHE_RULES  32
+
+/* Entries a route map's cache holds before it is emptied. */
+#define RMAP_CACHE_MAX    32768
+
 /* Route map apply error. */
 enum
 {
@@ -150,6 +164,13 @@ struct route_map
   /* Make linked list. */
   struct route_map *next;
   struct route_map *prev;
+
+  /* Results of the RMAP_RULE_ATTR match rules, by the key given to
+     route_map_apply_cached, and how many of those rules there are. */
+  struct hash *cache;
+  int cached;
+  unsigned long cache_hits;
+  unsigned long cache_misses;
 };
 
 /* Prototypes. */
@@ -192,6 +213,17 @@ extern route_map_result_t route_map_apply (struct route_map *map,
                                            route_map_object_t object_type,
                                            void *object);
 
+/* Apply route map to an object whose attributes KEY identifies, so
+   that the results of attribute-only matches may be remembered. */
+extern route_map_result_t route_map_apply_cached (struct route_map *map,
+                                                  struct prefix *,
+                                                  route_map_object_t object_type,
+                                                  void *object,
+                                                  unsigned long key);
+
+/* Forget remembered results, of one route map or with NULL of all. */
+extern void route_map_cache_flush (struct route_map *map);
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
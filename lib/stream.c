@@ -121,6 +121,15 @@ stream_free (struct stream *s)
   if (!s)
     return;
   
+  if (s->refcnt)
+    {
+      if (--(*s->refcnt))
+        {
+          XFREE (MTYPE_STREAM, s);
+          return;
+        }
+      XFREE (MTYPE_STREAM_DATA, s->refcnt);
+    }
   XFREE (MTYPE_STREAM_DATA, s->data);
   XFREE (MTYPE_STREAM, s);
 }
@@ -154,6 +163,31 @@ stream_dup (struct stream *s)
   return (stream_copy (new, s));
 }
 
+/* Another stream over the data of s, see "Sharing" in stream.h. */
+struct stream *
+stream_share (struct stream *s)
+{
+  struct stream *new;
+
+  STREAM_VERIFY_SANE (s);
+
+  if (s->refcnt == NULL)
+    {
+      s->refcnt = XMALLOC (MTYPE_STREAM_DATA, sizeof (unsigned int));
+      *s->refcnt = 1;
+    }
+
+  new = XCALLOC (MTYPE_STREAM, sizeof (struct stream));
+  new->getp = s->getp;
+  new->endp = s->endp;
+  new->size = s->size;
+  new->data = s->data;
+  new->refcnt = s->refcnt;
+  (*new->refcnt)++;
+
+  return new;
+}
+
 struct stream *
 stream_dupcat (struct stream *s1, struct stream *s2, size_t offset)
 {
@@ -178,6 +212,7 @@ stream_resize (struct stream *s, size_t newsize)
 {
   u_char *newdata;
   STREAM_VERIFY_SANE (s);
+  assert (s->refcnt == NULL);
   
   newdata = XREALLOC (MTYPE_STREAM_DATA, s->data, newsize);
   
@@ -980,6 +1015,62 @@ stream_fifo_clean (struct stream_fifo *fifo)
   fifo->count = 0;
 }
 
+ssize_t
+stream_fifo_writev (struct stream_fifo *fifo, int fd, unsigned int max,
+                    struct stream_fifo *done)
+{
+  struct iovec iov[STREAM_WRITEV_MAX];
+  struct stream *s;
+  unsigned int n;
+  ssize_t nbytes;
+  size_t left, len;
+
+  if (max > STREAM_WRITEV_MAX)
+    max = STREAM_WRITEV_MAX;
+
+  for (n = 0, s = fifo->head; s && n < max; s = s->next)
+    {
+      STREAM_VERIFY_SANE (s);
+      if (! STREAM_READABLE (s))
+        continue;
+      iov[n].iov_base = s->data + s->getp;
+      iov[n].iov_len = STREAM_READABLE (s);
+      n++;
+    }
+
+  if (n == 0)
+    return 0;
+
+  nbytes = writev (fd, iov, n);
+  if (nbytes <= 0)
+    return nbytes;
+
+  /* Account for what went out, across as many streams as it took. */
+  left = nbytes;
+  while ((s = fifo->head) != NULL)
+    {
+      len = STREAM_READABLE (s);
+      if (left < len)
+        {
+          s->getp += left;
+          break;
+        }
+      left -= len;
+
+      stream_fifo_pop (fifo);
+      s->next = NULL;
+      if (done)
+        stream_fifo_push (done, s);
+      else
+        stream_free (s);
+
+      if (left == 0)
+        break;
+    }
+
+  return nbytes;
+}
+
 void
 stream_fifo_free (struct stream_fifo *fifo)
 {
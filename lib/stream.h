@@ -89,6 +89,13 @@
  *
  * Best practice is to use stream_put (<stream *>, NULL, <size>) to zero out
  * any part of a stream which isn't otherwise written to.
+ *
+ * Sharing:
+ * stream_share() returns a second stream over the same data, with getp
+ * and endp of its own, so one packet can be queued to several readers
+ * without copying it.  The data is freed along with the last stream
+ * sharing it.  Shared data must be treated as read-only: putting to any
+ * stream sharing it changes what all of them see.
  */
 
 /* Stream buffer. */
@@ -104,6 +111,7 @@ struct stream
   size_t endp;		/* last valid data position */
   size_t size;		/* size of data segment */
   unsigned char *data; /* data pointer */
+  unsigned int *refcnt;	/* streams sharing data, NULL if just this one */
 };
 
 /* First in first out queue structure. */
@@ -142,6 +150,7 @@ extern struct stream *stream_new (size_t);
 extern void stream_free (struct stream *);
 extern struct stream * stream_copy (struct stream *, struct stream *src);
 extern struct stream *stream_dup (struct stream *);
+extern struct stream *stream_share (struct stream *);
 extern size_t stream_resize (struct stream *, size_t);
 extern size_t stream_get_getp (struct stream *);
 extern size_t stream_get_endp (struct stream *);
@@ -224,6 +233,18 @@ extern void stream_fifo_push (struct stream_fifo *fifo, struct stream *s);
 extern struct stream *stream_fifo_pop (struct stream_fifo *fifo);
 extern struct stream *stream_fifo_head (struct stream_fifo *fifo);
 extern void stream_fifo_clean (struct stream_fifo *fifo);
+
+/* Most streams stream_fifo_writev hands to one writev. */
+#define STREAM_WRITEV_MAX 64
+
+/* Write the readable part of up to max streams from the head of fifo
+   with a single writev.  Streams written out completely are moved to
+   done, or freed if done is NULL; getp of one written only in part is
+   moved past what went out.  Returns what writev returned, 0 if there
+   was nothing to write. */
+extern ssize_t stream_fifo_writev (struct stream_fifo *fifo, int fd,
+                                   unsigned int max,
+                                   struct stream_fifo *done);
 extern void stream_fifo_free (struct stream_fifo *fifo);
 
 #endif /* _ZEBRA_STREAM_H */
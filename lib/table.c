@@ -29,6 +29,7 @@
 
 static void route_node_delete (struct route_node *);
 static void route_table_free (struct route_table *);
+static void route_stride_build (struct route_table *);
 
 
 /*
@@ -41,6 +42,7 @@ route_table_init_with_delegate (route_table_delegate_t *delegate)
 
   rt = XCALLOC (MTYPE_ROUTE_TABLE, sizeof (struct route_table));
   rt->delegate = delegate;
+  rt->stride_min = ROUTE_TABLE_STRIDE_MIN;
   return rt;
 }
 
@@ -129,6 +131,8 @@ route_table_free (struct route_table *rt)
  
   assert (rt->count == 0);
 
+  if (rt->stride)
+    XFREE (MTYPE_ROUTE_TABLE_STRIDE, rt->stride);
   XFREE (MTYPE_ROUTE_TABLE, rt);
   return;
 }
@@ -183,6 +187,148 @@ set_link (struct route_node *node, struct route_node *new)
   new->parent = node;
 }
 
+/* Stride index.
+
+   The tree is a binary one, so a lookup in a full table walks down
+   twenty or more nodes, most of them near the top and shared by
+   every lookup: a cache miss each.  The stride index skips those.
+   For each value of an address's first ROUTE_TABLE_STRIDE_BITS bits
+   it points at the deepest node no longer than that which covers the
+   value, and lookups for prefixes at least that long start walking
+   down from there instead of from the top.
+
+   Only the tree's shape is indexed, so the index only changes when
+   nodes are added or deleted; whether a node has info is checked as
+   before, by walking back up through the parents for
+   route_node_match.  */
+
+#define ROUTE_STRIDE_SLOTS (1U << ROUTE_TABLE_STRIDE_BITS)
+
+static inline unsigned int
+route_stride_slot (const struct prefix *p)
+{
+  const u_char *pnt = &p->u.prefix;
+
+  return (pnt[0] << 8) | pnt[1];
+}
+
+/* Is node in the index? */
+static inline int
+route_stride_indexed (const struct route_table *table,
+		      const struct route_node *node)
+{
+  return table->stride
+    && node->p.family == table->stride_family
+    && node->p.prefixlen <= ROUTE_TABLE_STRIDE_BITS;
+}
+
+/* Range of slots covered by node. */
+static void
+route_stride_range (const struct route_node *node,
+		    unsigned int *first, unsigned int *last)
+{
+  unsigned int mask;
+
+  mask = ROUTE_STRIDE_SLOTS - 1;
+  mask >>= node->p.prefixlen;
+
+  *first = route_stride_slot (&node->p) & ~mask;
+  *last = *first | mask;
+}
+
+/* A node has been added to the tree.  Where both it and the slot's
+   current node cover the slot one is the other's ancestor, and the
+   longer of the two is the deeper. */
+static void
+route_stride_add (struct route_table *table, struct route_node *node)
+{
+  unsigned int i, first, last;
+
+  if (! route_stride_indexed (table, node))
+    return;
+
+  route_stride_range (node, &first, &last);
+  for (i = first; i <= last; i++)
+    if (table->stride[i] == NULL
+	|| table->stride[i]->p.prefixlen < node->p.prefixlen)
+      table->stride[i] = node;
+}
+
+/* A node is being deleted from the tree, parent is what is left above
+   it.  Nothing deeper covers the slots that point at node, or they
+   would point there instead, so they fall back to the parent. */
+static void
+route_stride_del (struct route_table *table, struct route_node *node,
+		  struct route_node *parent)
+{
+  unsigned int i, first, last;
+
+  if (! route_stride_indexed (table, node))
+    return;
+
+  route_stride_range (node, &first, &last);
+  for (i = first; i <= last; i++)
+    if (table->stride[i] == node)
+      table->stride[i] = parent;
+}
+
+static void
+route_stride_fill (struct route_table *table, struct route_node *node)
+{
+  if (node == NULL || node->p.prefixlen > ROUTE_TABLE_STRIDE_BITS)
+    return;
+
+  route_stride_add (table, node);
+  route_stride_fill (table, node->l_left);
+  route_stride_fill (table, node->l_right);
+}
+
+static void
+route_stride_build (struct route_table *table)
+{
+  u_char family = table->top->p.family;
+
+  if (family != AF_INET
+#ifdef HAVE_IPV6
+      && family != AF_INET6
+#endif /* HAVE_IPV6 */
+      )
+    return;
+
+  table->stride = XCALLOC (MTYPE_ROUTE_TABLE_STRIDE,
+			   ROUTE_STRIDE_SLOTS * sizeof (struct route_node *));
+  table->stride_family = family;
+  route_stride_fill (table, table->top);
+}
+
+/* Node to walk down from to find p. */
+static inline struct route_node *
+route_stride_start (const struct route_table *table, const struct prefix *p)
+{
+  struct route_node *node;
+
+  if (table->stride
+      && p->family == table->stride_family
+      && p->prefixlen >= ROUTE_TABLE_STRIDE_BITS
+      && (node = table->stride[route_stride_slot (p)]) != NULL)
+    return node;
+
+  return table->top;
+}
+
+/* Set the number of nodes at which the table gets a stride index, 0
+   for never.  Small tables are not worth the index's memory. */
+void
+route_table_set_stride (struct route_table *table, unsigned long min)
+{
+  table->stride_min = min;
+
+  if (table->stride && ! min)
+    XFREE (MTYPE_ROUTE_TABLE_STRIDE, table->stride);
+  else if (! table->stride && min && table->count >= min)
+    route_stride_build (table);
+}
+
 /* Lock node. */
 struct route_node *
 route_lock_node (struct route_node *node)
@@ -206,11 +352,12 @@ route_unlock_node (struct route_node *node)
 struct route_node *
 route_node_match (const struct route_table *table, const struct prefix *p)
 {
+  struct route_node *start;
   struct route_node *node;
   struct route_node *matched;
 
   matched = NULL;
-  node = table->top;
+  node = start = route_stride_start (table, p);
 
   /* Walk down tree.  If there is matched route then store it to
      matched. */
@@ -226,6 +373,15 @@ route_node_match (const struct route_table *table, const struct prefix *p)
       node = node->link[prefix_bit(&p->u.prefix, node->p.prefixlen)];
     }
 
+  /* Nodes above the start match too. */
+  if (! matched && start)
+    for (node = start->parent; node; node = node->parent)
+      if (node->info)
+	{
+	  matched = node;
+	  break;
+	}
+
   /* If matched route found, return it. */
   if (matched)
     return route_lock_node (matched);
@@ -271,7 +427,7 @@ route_node_lookup (const struct route_table *table, struct prefix *p)
   u_char prefixlen = p->prefixlen;
   const u_char *prefix = &p->u.prefix;
 
-  node = table->top;
+  node = route_stride_start (table, p);
 
   while (node && node->p.prefixlen <= prefixlen &&
 	 prefix_match (&node->p, p))
@@ -296,7 +452,7 @@ route_node_get (struct route_table *const table, struct prefix *p)
   const u_char *prefix = &p->u.prefix;
 
   match = NULL;
-  node = table->top;
+  node = route_stride_start (table, p);
   while (node && node->p.prefixlen <= prefixlen &&
 	 prefix_match (&node->p, p))
     {
@@ -314,6 +470,7 @@ route_node_get (struct route_table *const table, struct prefix *p)
 	set_link (match, new);
       else
 	table->top = new;
+      route_stride_add (table, new);
     }
   else
     {
@@ -327,17 +484,23 @@ route_node_get (struct route_table *const table, struct prefix *p)
 	set_link (match, new);
       else
 	table->top = new;
+      route_stride_add (table, new);
 
       if (new->p.prefixlen != p->prefixlen)
 	{
 	  match = new;
 	  new = route_node_set (table, p);
 	  set_link (match, new);
+	  route_stride_add (table, new);
 	  table->count++;
 	}
     }
   table->count++;
   route_lock_node (new);
+
+  if (! table->stride && table->stride_min
+      && table->count >= table->stride_min)
+    route_stride_build (table);
   
   return new;
 }
@@ -375,6 +538,7 @@ route_node_delete (struct route_node *node)
   else
     node->table->top = child;
 
+  route_stride_del (node->table, node, parent);
   node->table->count--;
 
   route_node_free (node->table, node);
@@ -49,6 +49,11 @@ struct route_table_delegate_t_
   route_table_destroy_node_func_t destroy_node;
 };
 
+/* Bits looked up directly by the stride index, and the default
+   number of nodes a table needs before it gets one. */
+#define ROUTE_TABLE_STRIDE_BITS 16
+#define ROUTE_TABLE_STRIDE_MIN  65536
+
 /* Routing table top structure. */
 struct route_table
 {
@@ -60,6 +65,16 @@ struct route_table
   route_table_delegate_t *delegate;
   
   unsigned long count;
+
+  /*
+   * Stride index: for each value of the first ROUTE_TABLE_STRIDE_BITS
+   * bits of an address of stride_family, the deepest node whose
+   * prefix covers all of them.  Built once the table has stride_min
+   * nodes.  See route_table_set_stride.
+   */
+  struct route_node **stride;
+  unsigned long stride_min;
+  u_char stride_family;
   
   /*
    * User data.
@@ -142,6 +157,7 @@ extern struct route_table *
 route_table_init_with_delegate (route_table_delegate_t *);
 
 extern void route_table_finish (struct route_table *);
+extern void route_table_set_stride (struct route_table *, unsigned long);
 extern void route_unlock_node (struct route_node *node);
 extern struct route_node *route_top (struct route_table *);
 extern struct route_node *route_next (struct route_node *);
@@ -40,6 +40,10 @@
 extern int agentx_enabled;
 #endif
 
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+
 #if defined(__APPLE__)
 #include <mach/mach.h>
 #include <mach/mach_time.h>
@@ -57,6 +61,32 @@ static unsigned short timers_inited;
 
 static struct hash *cpu_record = NULL;
 
+/* I/O multiplexer.
+
+   add and del are called as read and write threads are added, and
+   cancelled or made ready; add fails if the fd already has a thread
+   of the kind.  wait waits for I/O or for the timeout, and returns
+   the number of fds ready or -1, then process moves their threads to
+   the ready list. */
+struct thread_io
+{
+  const char *name;
+  int (*init) (struct thread_master *);
+  void (*finish) (struct thread_master *);
+  int (*add) (struct thread_master *, struct thread *);
+  void (*del) (struct thread_master *, struct thread *);
+  int (*wait) (struct thread_master *, struct timeval *);
+  void (*process) (struct thread_master *, int);
+};
+
+static const struct thread_io thread_io_select;
+#ifdef HAVE_EPOLL_CREATE1
+static const struct thread_io thread_io_epoll;
+#endif
+
+static void thread_list_free (struct thread_master *, struct thread_list *);
+static void thread_wheel_free (struct thread_master *);
+
 /* Struct timeval's tv_usec one second value.  */
 #define TIMER_SECOND_MICRO 1000000L
 
@@ -538,10 +568,57 @@ thread_master_create ()
   rv->background = pqueue_create();
   rv->timer->cmp = rv->background->cmp = thread_timer_cmp;
   rv->timer->update = rv->background->update = thread_timer_update;
+  thread_master_set_timer_wheel (rv, 1);
+
+  /* epoll if we have it, select otherwise. */
+#ifdef HAVE_EPOLL_CREATE1
+  if (thread_master_set_io (rv, THREAD_IO_EPOLL) < 0)
+#endif
+    thread_master_set_io (rv, THREAD_IO_SELECT);
 
   return rv;
 }
 
+/* Change the master's I/O multiplexer, before any read or write
+   threads are added.  Returns -1 if that is too late, or the
+   multiplexer is not available. */
+int
+thread_master_set_io (struct thread_master *m, int type)
+{
+  const struct thread_io *io, *old;
+
+  switch (type)
+    {
+    case THREAD_IO_SELECT:
+      io = &thread_io_select;
+      break;
+#ifdef HAVE_EPOLL_CREATE1
+    case THREAD_IO_EPOLL:
+      io = &thread_io_epoll;
+      break;
+#endif
+    default:
+      return -1;
+    }
+
+  if (m->read.count || m->write.count)
+    return -1;
+  if (io == m->io)
+    return 0;
+
+  old = m->io;
+  if (old)
+    old->finish (m);
+  m->io = io;
+  if (io->init (m) == 0)
+    return 0;
+
+  m->io = old;
+  if (old)
+    old->init (m);
+  return -1;
+}
+
 /* Add a new thread to the list.  */
 static void
 thread_list_add (struct thread_list *list, struct thread *thread)
@@ -623,6 +700,8 @@ thread_master_free (struct thread_master *m)
   thread_list_free (m, &m->ready);
   thread_list_free (m, &m->unuse);
   thread_queue_free (m, m->background);
+  thread_wheel_free (m);
+  m->io->finish (m);
   
   XFREE (MTYPE_THREAD_MASTER, m);
 
@@ -650,6 +729,196 @@ thread_trim_head (struct thread_list *list)
   return NULL;
 }
 
+/* Timer wheel.
+
+   Timers of whole seconds from thread_add_timer, which is what most
+   protocol timers are, hang off a wheel of THREAD_WHEEL_SLOTS lists,
+   each covering THREAD_WHEEL_TICK microseconds, rather than going
+   into the timer heap, so adding and cancelling one costs O(1)
+   however many there are.  Timers further ahead than one turn of the
+   wheel share the slots and are passed over until their turn comes.
+   Millisecond timers, and background ones, stay in the heaps.
+
+   Timers still fire no earlier and no later than they would from the
+   heap: a slot's timers are only run once they are due, and the wait
+   for the next one is taken from the timers themselves.  Only the
+   order of timers due at the same pass of the wheel may differ. */
+
+#define THREAD_WHEEL_SLOTS 4096
+#define THREAD_WHEEL_TICK  10000L
+#define THREAD_WHEEL_WORD  (sizeof (unsigned long) * CHAR_BIT)
+
+struct thread_wheel
+{
+  struct thread_list slot[THREAD_WHEEL_SLOTS];
+
+  /* Slots that are not empty. */
+  unsigned long map[THREAD_WHEEL_SLOTS / THREAD_WHEEL_WORD];
+
+  /* Tick last run. */
+  unsigned long tick;
+  unsigned long count;
+};
+
+static unsigned long
+thread_wheel_tick (struct timeval *tv)
+{
+  return tv->tv_sec * (TIMER_SECOND_MICRO / THREAD_WHEEL_TICK)
+    + tv->tv_usec / THREAD_WHEEL_TICK;
+}
+
+static void
+thread_wheel_add (struct thread_wheel *w, struct thread *thread)
+{
+  unsigned int s = thread_wheel_tick (&thread->u.sands) % THREAD_WHEEL_SLOTS;
+
+  thread_list_add (&w->slot[s], thread);
+  w->map[s / THREAD_WHEEL_WORD] |= 1UL << (s % THREAD_WHEEL_WORD);
+  w->count++;
+}
+
+static void
+thread_wheel_del (struct thread_wheel *w, struct thread *thread)
+{
+  unsigned int s = thread_wheel_tick (&thread->u.sands) % THREAD_WHEEL_SLOTS;
+
+  thread_list_delete (&w->slot[s], thread);
+  if (thread_empty (&w->slot[s]))
+    w->map[s / THREAD_WHEEL_WORD] &= ~(1UL << (s % THREAD_WHEEL_WORD));
+  w->count--;
+}
+
+/* Earliest timer on the wheel, NULL if none. */
+static struct timeval *
+thread_wheel_wait (struct thread_wheel *w, struct timeval *timer_val)
+{
+  struct thread *thread;
+  struct timeval *min = NULL;
+  struct timeval next;
+  unsigned long tick;
+  unsigned int d, s;
+
+  if (! w || ! w->count)
+    return NULL;
+
+  /* The first slot with a timer due this turn of the wheel has the
+     earliest one. */
+  for (d = 0; d < THREAD_WHEEL_SLOTS; d++)
+    {
+      tick = w->tick + d;
+      s = tick % THREAD_WHEEL_SLOTS;
+
+      if (! w->map[s / THREAD_WHEEL_WORD])
+	{
+	  d += THREAD_WHEEL_WORD - 1 - s % THREAD_WHEEL_WORD;
+	  continue;
+	}
+      if (! (w->map[s / THREAD_WHEEL_WORD] & (1UL << (s % THREAD_WHEEL_WORD))))
+	continue;
+
+      for (thread = w->slot[s].head; thread; thread = thread->next)
+	if (thread_wheel_tick (&thread->u.sands) == tick
+	    && (! min || timeval_cmp (thread->u.sands, *min) < 0))
+	  min = &thread->u.sands;
+      if (min)
+	break;
+    }
+
+  /* Otherwise come back next turn. */
+  if (! min)
+    {
+      tick = w->tick + THREAD_WHEEL_SLOTS;
+      next.tv_sec = tick / (TIMER_SECOND_MICRO / THREAD_WHEEL_TICK);
+      next.tv_usec = (tick % (TIMER_SECOND_MICRO / THREAD_WHEEL_TICK))
+	* THREAD_WHEEL_TICK;
+      min = &next;
+    }
+
+  *timer_val = timeval_subtract (*min, relative_time);
+  return timer_val;
+}
+
+/* Move the timers that are due to the ready list. */
+static unsigned int
+thread_wheel_process (struct thread_wheel *w, struct timeval *timenow)
+{
+  struct thread *thread, *next;
+  unsigned long tick, now;
+  unsigned int ready = 0;
+  unsigned int s;
+
+  if (! w)
+    return 0;
+
+  now = thread_wheel_tick (timenow);
+  if (! w->count)
+    {
+      w->tick = now;
+      return 0;
+    }
+
+  /* Go round at most once. */
+  tick = w->tick;
+  if (now - tick >= THREAD_WHEEL_SLOTS)
+    tick = now - (THREAD_WHEEL_SLOTS - 1);
+
+  for (; tick != now + 1 && w->count; tick++)
+    {
+      s = tick % THREAD_WHEEL_SLOTS;
+      for (thread = w->slot[s].head; thread; thread = next)
+	{
+	  next = thread->next;
+	  if (timeval_cmp (*timenow, thread->u.sands) < 0)
+	    continue;
+
+	  thread_wheel_del (w, thread);
+	  thread->type = THREAD_READY;
+	  thread_list_add (&thread->master->ready, thread);
+	  ready++;
+	}
+    }
+
+  /* The current tick's slot may still have timers due later in it. */
+  w->tick = now;
+  return ready;
+}
+
+static void
+thread_wheel_free (struct thread_master *m)
+{
+  unsigned int s;
+
+  if (! m->wheel)
+    return;
+
+  for (s = 0; s < THREAD_WHEEL_SLOTS; s++)
+    thread_list_free (m, &m->wheel->slot[s]);
+  XFREE (MTYPE_THREAD_MASTER, m->wheel);
+}
+
+/* Use the timer wheel for timers of whole seconds, or not.  Timers
+   already on the wheel go back to the heap when it is turned off. */
+void
+thread_master_set_timer_wheel (struct thread_master *m, int on)
+{
+  struct thread *thread;
+  unsigned int s;
+
+  if (on && ! m->wheel)
+    {
+      m->wheel = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_wheel));
+      quagga_get_relative (NULL);
+      m->wheel->tick = thread_wheel_tick (&relative_time);
+    }
+  else if (! on && m->wheel)
+    {
+      for (s = 0; s < THREAD_WHEEL_SLOTS; s++)
+	while ((thread = thread_trim_head (&m->wheel->slot[s])))
+	  pqueue_enqueue (thread, m->timer);
+      XFREE (MTYPE_THREAD_MASTER, m->wheel);
+    }
+}
+
 /* Return remain time in second. */
 unsigned long
 thread_timer_remain_second (struct thread *thread)
@@ -701,15 +970,14 @@ funcname_thread_add_read (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->readfd))
+  thread = thread_get (m, THREAD_READ, func, arg, debugargpass);
+  thread->u.fd = fd;
+  if (m->io->add (m, thread) < 0)
     {
-      zlog (NULL, LOG_WARNING, "There is already read fd [%d]", fd);
+      thread->type = THREAD_UNUSED;
+      thread_add_unuse (m, thread);
       return NULL;
     }
-
-  thread = thread_get (m, THREAD_READ, func, arg, debugargpass);
-  FD_SET (fd, &m->readfd);
-  thread->u.fd = fd;
   thread_list_add (&m->read, thread);
 
   return thread;
@@ -725,15 +993,14 @@ funcname_thread_add_write (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->writefd))
+  thread = thread_get (m, THREAD_WRITE, func, arg, debugargpass);
+  thread->u.fd = fd;
+  if (m->io->add (m, thread) < 0)
     {
-      zlog (NULL, LOG_WARNING, "There is already write fd [%d]", fd);
+      thread->type = THREAD_UNUSED;
+      thread_add_unuse (m, thread);
       return NULL;
     }
-
-  thread = thread_get (m, THREAD_WRITE, func, arg, debugargpass);
-  FD_SET (fd, &m->writefd);
-  thread->u.fd = fd;
   thread_list_add (&m->write, thread);
 
   return thread;
@@ -742,7 +1009,7 @@ funcname_thread_add_write (struct thread_master *m,
 static struct thread *
 funcname_thread_add_timer_timeval (struct thread_master *m,
                                    int (*func) (struct thread *), 
-                                  int type,
+                                  int type, int wheel,
                                   void *arg, 
                                   struct timeval *time_relative,
 				  debugargdef)
@@ -765,7 +1032,10 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
   alarm_time.tv_usec = relative_time.tv_usec + time_relative->tv_usec;
   thread->u.sands = timeval_adjust(alarm_time);
 
-  pqueue_enqueue(thread, queue);
+  if (wheel && m->wheel)
+    thread_wheel_add (m->wheel, thread);
+  else
+    pqueue_enqueue(thread, queue);
   return thread;
 }
 
@@ -784,7 +1054,7 @@ funcname_thread_add_timer (struct thread_master *m,
   trel.tv_sec = timer;
   trel.tv_usec = 0;
 
-  return funcname_thread_add_timer_timeval (m, func, THREAD_TIMER, arg, 
+  return funcname_thread_add_timer_timeval (m, func, THREAD_TIMER, 1, arg, 
                                             &trel, debugargpass);
 }
 
@@ -802,7 +1072,7 @@ funcname_thread_add_timer_msec (struct thread_master *m,
   trel.tv_sec = timer / 1000;
   trel.tv_usec = 1000*(timer % 1000);
 
-  return funcname_thread_add_timer_timeval (m, func, THREAD_TIMER, 
+  return funcname_thread_add_timer_timeval (m, func, THREAD_TIMER, 0,
                                             arg, &trel, debugargpass);
 }
 
@@ -828,7 +1098,7 @@ funcname_thread_add_background (struct thread_master *m,
       trel.tv_usec = 0;
     }
 
-  return funcname_thread_add_timer_timeval (m, func, THREAD_BACKGROUND,
+  return funcname_thread_add_timer_timeval (m, func, THREAD_BACKGROUND, 0,
                                             arg, &trel, debugargpass);
 }
 
@@ -859,16 +1129,22 @@ thread_cancel (struct thread *thread)
   switch (thread->type)
     {
     case THREAD_READ:
-      assert (FD_ISSET (thread->u.fd, &thread->master->readfd));
-      FD_CLR (thread->u.fd, &thread->master->readfd);
+      thread->master->io->del (thread->master, thread);
       list = &thread->master->read;
       break;
     case THREAD_WRITE:
-      assert (FD_ISSET (thread->u.fd, &thread->master->writefd));
-      FD_CLR (thread->u.fd, &thread->master->writefd);
+      thread->master->io->del (thread->master, thread);
       list = &thread->master->write;
       break;
     case THREAD_TIMER:
+      /* Timers on the wheel have no place in the heap. */
+      if (thread->index < 0)
+	{
+	  thread_wheel_del (thread->master->wheel, thread);
+	  thread->type = THREAD_UNUSED;
+	  thread_add_unuse (thread->master, thread);
+	  return;
+	}
       queue = thread->master->timer;
       break;
     case THREAD_EVENT:
@@ -1036,27 +1312,468 @@ thread_process (struct thread_list *list)
 }
 
 
+/* select(2).  The master's fd_sets are the ones waited for. */
+
+struct thread_select
+{
+  fd_set readfd;
+  fd_set writefd;
+  fd_set exceptfd;
+};
+
+static int
+thread_select_init (struct thread_master *m)
+{
+  m->io_data = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_select));
+  return 0;
+}
+
+static void
+thread_select_finish (struct thread_master *m)
+{
+  XFREE (MTYPE_THREAD_MASTER, m->io_data);
+}
+
+static int
+thread_select_add (struct thread_master *m, struct thread *thread)
+{
+  fd_set *fdset;
+  int fd = THREAD_FD (thread);
+
+  fdset = thread->type == THREAD_READ ? &m->readfd : &m->writefd;
+
+  if (fd < 0 || fd >= FD_SETSIZE)
+    {
+      zlog (NULL, LOG_WARNING, "Can't select on fd [%d]", fd);
+      return -1;
+    }
+
+  if (FD_ISSET (fd, fdset))
+    {
+      zlog (NULL, LOG_WARNING, "There is already %s fd [%d]",
+	    thread->type == THREAD_READ ? "read" : "write", fd);
+      return -1;
+    }
+
+  FD_SET (fd, fdset);
+  return 0;
+}
+
+static void
+thread_select_del (struct thread_master *m, struct thread *thread)
+{
+  fd_set *fdset;
+
+  fdset = thread->type == THREAD_READ ? &m->readfd : &m->writefd;
+
+  assert (FD_ISSET (THREAD_FD (thread), fdset));
+  FD_CLR (THREAD_FD (thread), fdset);
+}
+
+static int
+thread_select_wait (struct thread_master *m, struct timeval *timer_wait)
+{
+  struct thread_select *ts = m->io_data;
+  int num;
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  struct timeval snmp_timer_wait;
+  int snmpblock = 0;
+  int fdsetsize;
+#endif
+
+  /* Structure copy.  */
+  ts->readfd = m->readfd;
+  ts->writefd = m->writefd;
+  ts->exceptfd = m->exceptfd;
+
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  /* When SNMP is enabled, we may have to select() on additional
+     FD. snmp_select_info() will add them to `readfd'. The trick
+     with this function is its last argument. We need to set it to
+     0 if timer_wait is not NULL and we need to use the provided
+     new timer only if it is still set to 0. */
+  if (agentx_enabled)
+    {
+      fdsetsize = FD_SETSIZE;
+      snmpblock = 1;
+      if (timer_wait)
+        {
+          snmpblock = 0;
+          memcpy(&snmp_timer_wait, timer_wait, sizeof(struct timeval));
+        }
+      snmp_select_info(&fdsetsize, &ts->readfd, &snmp_timer_wait, &snmpblock);
+      if (snmpblock == 0)
+        timer_wait = &snmp_timer_wait;
+    }
+#endif
+  num = select (FD_SETSIZE, &ts->readfd, &ts->writefd, &ts->exceptfd,
+		timer_wait);
+
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  if (num >= 0 && agentx_enabled)
+    {
+      if (num > 0)
+        snmp_read(&ts->readfd);
+      else if (num == 0)
+        {
+          snmp_timeout();
+          run_alarms();
+        }
+      netsnmp_check_outstanding_agent_requests();
+    }
+#endif
+
+  return num;
+}
+
+static void
+thread_select_process (struct thread_master *m, int num)
+{
+  struct thread_select *ts = m->io_data;
+
+  if (num <= 0)
+    return;
+
+  /* Normal priority read thead. */
+  thread_process_fd (&m->read, &ts->readfd, &m->readfd);
+  /* Write thead. */
+  thread_process_fd (&m->write, &ts->writefd, &m->writefd);
+}
+
+static const struct thread_io thread_io_select =
+{
+  .name = "select",
+  .init = thread_select_init,
+  .finish = thread_select_finish,
+  .add = thread_select_add,
+  .del = thread_select_del,
+  .wait = thread_select_wait,
+  .process = thread_select_process,
+};
+
+#ifdef HAVE_EPOLL_CREATE1
+/* epoll(7), level triggered.  An fd is registered for whatever its
+   read and write threads want, as they are added and go away, so a
+   wait costs the number of fds ready rather than the number
+   watched, and fds are not limited to FD_SETSIZE.
+
+   Things epoll can't watch, such as regular files, are always ready,
+   as select has them. */
+
+/* Events taken per wait.  More than that stay ready for the next. */
+#define THREAD_EPOLL_EVENTS 256
+
+struct thread_epoll
+{
+  int fd;
+
+  /* Read and write thread of each fd, and whether it is one epoll
+     refused. */
+  struct thread **thread;
+  u_char *always;
+  int size;
+  int nalways;
+
+  struct epoll_event events[THREAD_EPOLL_EVENTS];
+};
+
+static int
+thread_epoll_init (struct thread_master *m)
+{
+  struct thread_epoll *te;
+  int fd;
+
+  if ((fd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    {
+      zlog_warn ("epoll_create1: %s, using select", safe_strerror (errno));
+      return -1;
+    }
+
+  te = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_epoll));
+  te->fd = fd;
+  m->io_data = te;
+  return 0;
+}
+
+static void
+thread_epoll_finish (struct thread_master *m)
+{
+  struct thread_epoll *te = m->io_data;
+
+  close (te->fd);
+  if (te->thread)
+    XFREE (MTYPE_THREAD_MASTER, te->thread);
+  if (te->always)
+    XFREE (MTYPE_THREAD_MASTER, te->always);
+  XFREE (MTYPE_THREAD_MASTER, te);
+  m->io_data = NULL;
+}
+
+/* Tell epoll what fd is wanted for now.  was is what it was told
+   before. */
+static int
+thread_epoll_ctl (struct thread_epoll *te, int fd, u_int32_t was)
+{
+  struct epoll_event ev;
+  u_int32_t want = 0;
+  int op;
+
+  if (te->always[fd])
+    return 0;
+
+  if (te->thread[2 * fd])
+    want |= EPOLLIN;
+  if (te->thread[2 * fd + 1])
+    want |= EPOLLOUT;
+
+  if (want == was)
+    return 0;
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = want;
+  ev.data.fd = fd;
+
+  op = ! was ? EPOLL_CTL_ADD : want ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+  if (epoll_ctl (te->fd, op, fd, &ev) == 0)
+    return 0;
+
+  /* Closing the fd will have taken it out behind our back. */
+  if (op == EPOLL_CTL_DEL)
+    return 0;
+  if (op == EPOLL_CTL_MOD && errno == ENOENT)
+    op = EPOLL_CTL_ADD;
+  else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+    op = EPOLL_CTL_MOD;
+  else
+    return -1;
+
+  return epoll_ctl (te->fd, op, fd, &ev);
+}
+
+static u_int32_t
+thread_epoll_events (struct thread_epoll *te, int fd)
+{
+  return (te->thread[2 * fd] ? EPOLLIN : 0)
+    | (te->thread[2 * fd + 1] ? EPOLLOUT : 0);
+}
+
+static int
+thread_epoll_add (struct thread_master *m, struct thread *thread)
+{
+  struct thread_epoll *te = m->io_data;
+  int fd = THREAD_FD (thread);
+  int write = (thread->type == THREAD_WRITE);
+  u_int32_t was;
+  int size;
+
+  if (fd < 0)
+    return -1;
+
+  if (fd >= te->size)
+    {
+      for (size = te->size ? te->size : 64; size <= fd; size *= 2)
+	;
+      te->thread = XREALLOC (MTYPE_THREAD_MASTER, te->thread,
+			     2 * size * sizeof (struct thread *));
+      te->always = XREALLOC (MTYPE_THREAD_MASTER, te->always, size);
+      memset (te->thread + 2 * te->size, 0,
+	      2 * (size - te->size) * sizeof (struct thread *));
+      memset (te->always + te->size, 0, size - te->size);
+      te->size = size;
+    }
+
+  if (te->thread[2 * fd + write])
+    {
+      zlog (NULL, LOG_WARNING, "There is already %s fd [%d]",
+	    write ? "write" : "read", fd);
+      return -1;
+    }
+
+  was = thread_epoll_events (te, fd);
+  te->thread[2 * fd + write] = thread;
+
+  if (thread_epoll_ctl (te, fd, was) < 0)
+    {
+      if (errno == EPERM && ! was)
+	{
+	  te->always[fd] = 1;
+	  te->nalways++;
+	  return 0;
+	}
+
+      zlog (NULL, LOG_WARNING, "Can't poll fd [%d]: %s", fd,
+	    safe_strerror (errno));
+      te->thread[2 * fd + write] = NULL;
+      return -1;
+    }
+
+  return 0;
+}
+
+static void
+thread_epoll_del (struct thread_master *m, struct thread *thread)
+{
+  struct thread_epoll *te = m->io_data;
+  int fd = THREAD_FD (thread);
+  int write = (thread->type == THREAD_WRITE);
+  u_int32_t was;
+
+  assert (fd < te->size && te->thread[2 * fd + write] == thread);
+
+  was = thread_epoll_events (te, fd);
+  te->thread[2 * fd + write] = NULL;
+  thread_epoll_ctl (te, fd, was);
+
+  if (te->always[fd] && ! thread_epoll_events (te, fd))
+    {
+      te->always[fd] = 0;
+      te->nalways--;
+    }
+}
+
+static int
+thread_epoll_wait (struct thread_master *m, struct timeval *timer_wait)
+{
+  struct thread_epoll *te = m->io_data;
+  int timeout = -1;
+
+  /* Round up: waking early just means waiting again. */
+  if (timer_wait)
+    timeout = timer_wait->tv_sec * 1000 + (timer_wait->tv_usec + 999) / 1000;
+  if (te->nalways)
+    timeout = 0;
+
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  /* The SNMP library wants select, so wait in select for its fds and
+     the epoll fd. */
+  if (agentx_enabled)
+    {
+      struct timeval snmp_timer_wait, zero = { 0, 0 };
+      fd_set readfd;
+      int snmpblock = 1;
+      int fdsetsize = FD_SETSIZE;
+      int num;
+
+      FD_ZERO (&readfd);
+      FD_SET (te->fd, &readfd);
+      if (te->nalways)
+	timer_wait = &zero;
+      if (timer_wait)
+        {
+          snmpblock = 0;
+          memcpy(&snmp_timer_wait, timer_wait, sizeof(struct timeval));
+        }
+      snmp_select_info(&fdsetsize, &readfd, &snmp_timer_wait, &snmpblock);
+      if (snmpblock == 0)
+        timer_wait = &snmp_timer_wait;
+
+      num = select (FD_SETSIZE, &readfd, NULL, NULL, timer_wait);
+      if (num < 0)
+	return num;
+      if (num > 0)
+        snmp_read(&readfd);
+      else
+        {
+          snmp_timeout();
+          run_alarms();
+        }
+      netsnmp_check_outstanding_agent_requests();
+
+      if (! FD_ISSET (te->fd, &readfd) && ! te->nalways)
+	return 0;
+      timeout = 0;
+    }
+#endif
+
+  return epoll_wait (te->fd, te->events, THREAD_EPOLL_EVENTS, timeout);
+}
+
+/* Move an I/O thread to the ready list. */
+static void
+thread_epoll_ready (struct thread_master *m, struct thread *thread)
+{
+  struct thread_list *list;
+
+  list = thread->type == THREAD_READ ? &m->read : &m->write;
+  thread_list_delete (list, thread);
+  thread_list_add (&m->ready, thread);
+  thread->type = THREAD_READY;
+}
+
+static void
+thread_epoll_process (struct thread_master *m, int num)
+{
+  struct thread_epoll *te = m->io_data;
+  struct thread *thread;
+  u_int32_t events, was;
+  int i, fd;
+
+  for (i = 0; i < num; i++)
+    {
+      fd = te->events[i].data.fd;
+      events = te->events[i].events;
+      was = thread_epoll_events (te, fd);
+
+      /* Errors wake both, as with select. */
+      if ((thread = te->thread[2 * fd])
+	  && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+	{
+	  te->thread[2 * fd] = NULL;
+	  thread_epoll_ready (m, thread);
+	}
+      if ((thread = te->thread[2 * fd + 1])
+	  && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+	{
+	  te->thread[2 * fd + 1] = NULL;
+	  thread_epoll_ready (m, thread);
+	}
+
+      thread_epoll_ctl (te, fd, was);
+    }
+
+  if (! te->nalways)
+    return;
+
+  for (fd = 0; fd < te->size; fd++)
+    if (te->always[fd])
+      {
+	if ((thread = te->thread[2 * fd]))
+	  thread_epoll_ready (m, thread);
+	if ((thread = te->thread[2 * fd + 1]))
+	  thread_epoll_ready (m, thread);
+	te->thread[2 * fd] = te->thread[2 * fd + 1] = NULL;
+	te->always[fd] = 0;
+	te->nalways--;
+      }
+}
+
+static const struct thread_io thread_io_epoll =
+{
+  .name = "epoll",
+  .init = thread_epoll_init,
+  .finish = thread_epoll_finish,
+  .add = thread_epoll_add,
+  .del = thread_epoll_del,
+  .wait = thread_epoll_wait,
+  .process = thread_epoll_process,
+};
+#endif /* HAVE_EPOLL_CREATE1 */
+
 /* Fetch next ready thread. */
 struct thread *
 thread_fetch (struct thread_master *m, struct thread *fetch)
 {
   struct thread *thread;
-  fd_set readfd;
-  fd_set writefd;
-  fd_set exceptfd;
   struct timeval timer_val = { .tv_sec = 0, .tv_usec = 0 };
   struct timeval timer_val_bg;
+  struct timeval timer_val_wheel;
   struct timeval *timer_wait = &timer_val;
   struct timeval *timer_wait_bg;
+  struct timeval *timer_wait_wheel;
 
   while (1)
     {
       int num = 0;
-#if defined HAVE_SNMP && defined SNMP_AGENTX
-      struct timeval snmp_timer_wait;
-      int snmpblock = 0;
-      int fdsetsize;
-#endif
       
       /* Signals pre-empt everything */
       quagga_sigevent_process ();
@@ -1075,82 +1792,47 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
       /* Normal event are the next highest priority.  */
       thread_process (&m->event);
       
-      /* Structure copy.  */
-      readfd = m->readfd;
-      writefd = m->writefd;
-      exceptfd = m->exceptfd;
-      
       /* Calculate select wait timer if nothing else to do */
       if (m->ready.count == 0)
         {
           quagga_get_relative (NULL);
           timer_wait = thread_timer_wait (m->timer, &timer_val);
           timer_wait_bg = thread_timer_wait (m->background, &timer_val_bg);
+          timer_wait_wheel = thread_wheel_wait (m->wheel, &timer_val_wheel);
           
+          if (timer_wait_wheel &&
+              (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_wheel) > 0)))
+            timer_wait = timer_wait_wheel;
           if (timer_wait_bg &&
               (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_bg) > 0)))
             timer_wait = timer_wait_bg;
         }
-      
-#if defined HAVE_SNMP && defined SNMP_AGENTX
-      /* When SNMP is enabled, we may have to select() on additional
-	 FD. snmp_select_info() will add them to `readfd'. The trick
-	 with this function is its last argument. We need to set it to
-	 0 if timer_wait is not NULL and we need to use the provided
-	 new timer only if it is still set to 0. */
-      if (agentx_enabled)
+      else
         {
-          fdsetsize = FD_SETSIZE;
-          snmpblock = 1;
-          if (timer_wait)
-            {
-              snmpblock = 0;
-              memcpy(&snmp_timer_wait, timer_wait, sizeof(struct timeval));
-            }
-          snmp_select_info(&fdsetsize, &readfd, &snmp_timer_wait, &snmpblock);
-          if (snmpblock == 0)
-            timer_wait = &snmp_timer_wait;
+          timer_val.tv_sec = timer_val.tv_usec = 0;
+          timer_wait = &timer_val;
         }
-#endif
-      num = select (FD_SETSIZE, &readfd, &writefd, &exceptfd, timer_wait);
+      
+      num = m->io->wait (m, timer_wait);
       
       /* Signals should get quick treatment */
       if (num < 0)
         {
           if (errno == EINTR)
             continue; /* signal received - process it */
-          zlog_warn ("select() error: %s", safe_strerror (errno));
+          zlog_warn ("%s() error: %s", m->io->name, safe_strerror (errno));
             return NULL;
         }
 
-#if defined HAVE_SNMP && defined SNMP_AGENTX
-      if (agentx_enabled)
-        {
-          if (num > 0)
-            snmp_read(&readfd);
-          else if (num == 0)
-            {
-              snmp_timeout();
-              run_alarms();
-            }
-          netsnmp_check_outstanding_agent_requests();
-        }
-#endif
-
       /* Check foreground timers.  Historically, they have had higher
          priority than I/O threads, so let's push them onto the ready
 	 list in front of the I/O threads. */
       quagga_get_relative (NULL);
       thread_timer_process (m->timer, &relative_time);
+      thread_wheel_process (m->wheel, &relative_time);
       
       /* Got IO, process it */
-      if (num > 0)
-        {
-          /* Normal priority read thead. */
-          thread_process_fd (&m->read, &readfd, &m->readfd);
-          /* Write thead. */
-          thread_process_fd (&m->write, &writefd, &m->writefd);
-        }
+      m->io->process (m, num);
 
 #if 0
       /* If any threads were made ready above (I/O or foreground timer),
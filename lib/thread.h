@@ -44,6 +44,8 @@ struct thread_list
 };
 
 struct pqueue;
+struct thread_io;
+struct thread_wheel;
 
 /* Master of the theads. */
 struct thread_master
@@ -51,6 +53,7 @@ struct thread_master
   struct thread_list read;
   struct thread_list write;
   struct pqueue *timer;
+  struct thread_wheel *wheel;
   struct thread_list event;
   struct thread_list ready;
   struct thread_list unuse;
@@ -58,6 +61,11 @@ struct thread_master
   fd_set readfd;
   fd_set writefd;
   fd_set exceptfd;
+
+  /* I/O multiplexer, see thread.c. */
+  const struct thread_io *io;
+  void *io_data;
+
   unsigned long alloc;
 };
 
@@ -118,6 +126,10 @@ enum quagga_clkid {
 #define THREAD_UNUSED         6
 #define THREAD_EXECUTE        7
 
+/* I/O multiplexers. */
+#define THREAD_IO_SELECT      0
+#define THREAD_IO_EPOLL       1
+
 /* Thread yield time.  */
 #define THREAD_YIELD_TIME_SLOT     10 * 1000L /* 10ms */
 
@@ -178,6 +190,8 @@ enum quagga_clkid {
 /* Prototypes. */
 extern struct thread_master *thread_master_create (void);
 extern void thread_master_free (struct thread_master *);
+extern int thread_master_set_io (struct thread_master *, int);
+extern void thread_master_set_timer_wheel (struct thread_master *, int);
 
 extern struct thread *funcname_thread_add_read (struct thread_master *, 
 				                int (*)(struct thread *),
@@ -82,6 +82,11 @@ struct zclient
   int (*ipv4_route_delete) (int, struct zclient *, uint16_t);
   int (*ipv6_route_add) (int, struct zclient *, uint16_t);
   int (*ipv6_route_delete) (int, struct zclient *, uint16_t);
+  int (*nexthop_update) (int, struct zclient *, uint16_t);
+
+  /* Called once the connection to zebra is (re)established, to let the
+     client replay any per-connection state it had registered. */
+  void (*zebra_connected) (struct zclient *);
 };
 
 /* Zebra API message flag. */
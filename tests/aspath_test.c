@@ -24,6 +24,8 @@
 #include "vty.h"
 #include "stream.h"
 #include "privs.h"
+#include "memory.h"
+#include "arena.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_aspath.h"
@@ -887,15 +889,27 @@ struct compare_tests
 static struct aspath *
 make_aspath (const u_char *data, size_t len, int use32bit)
 {
+  static struct arena *arena;
   struct stream *s = NULL;
-  struct aspath *as;
+  struct aspath *as, *as2;
   
   if (len)
     {
       s = stream_new (len);
       stream_put (s, data, len);
     }
-  as = aspath_parse (s, len, use32bit);
+  as = aspath_parse (s, len, use32bit, NULL);
+  
+  /* parsed in an arena, small enough to overflow, it is the same path */
+  if (! arena)
+    arena = arena_new (MTYPE_TMP, 64);
+  if (s)
+    stream_set_getp (s, 0);
+  as2 = aspath_parse (s, len, use32bit, arena);
+  arena_reset (arena);
+  assert (as2 == as);
+  if (as2)
+    aspath_unintern (&as2);
   
   if (s)
     stream_free (s);
@@ -1300,17 +1314,17 @@ handle_attr_test (struct aspath_tests *t)
       printf ("aspath is NULL, but should be: %s\n", t->shouldbe);
       failed++;
     }
-  if (t->shouldbe && attr.aspath && strcmp (attr.aspath->str, t->shouldbe))
+  if (t->shouldbe && attr.aspath && strcmp (aspath_print (attr.aspath), t->shouldbe))
     {
       printf ("attr str and 'shouldbe' mismatched!\n"
               "attr str:  %s\n"
               "shouldbe:  %s\n",
-              attr.aspath->str, t->shouldbe);
+              aspath_print (attr.aspath), t->shouldbe);
       failed++;
     }
   if (!t->shouldbe && attr.aspath)
     {
-      printf ("aspath should be NULL, but is: %s\n", attr.aspath->str);
+      printf ("aspath should be NULL, but is: %s\n", aspath_print (attr.aspath));
       failed++;
     }
 
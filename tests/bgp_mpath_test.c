@@ -106,6 +106,8 @@ bgp_create_fake (as_t *as, const char *name)
   bgp->rsclient = list_new ();
   //bgp->rsclient->cmp = (int (*)(void*, void*)) peer_cmp;
 
+  bgp->update_groups = list_new ();
+
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       {
@@ -294,6 +296,7 @@ setup_bgp_info_mpath_update (testcase_t *t)
 {
   int i;
   str2prefix ("42.1.1.0/24", &test_rn.p);
+  test_rn.table = bgp_table_init (AFI_IP, SAFI_UNICAST)->route_table;
   setup_bgp_mp_list (t);
   for (i = 0; i < test_mp_list_info_count; i++)
     bgp_info_add (&test_rn, &test_mp_list_info[i]);
@@ -24,6 +24,7 @@
 #include "stream.h"
 #include "privs.h"
 #include "memory.h"
+#include "arena.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_ecommunity.h"
@@ -128,11 +129,20 @@ validate (struct ecommunity *ecom, const struct test_spec *sp)
 static void
 parse_test (struct test_segment *t)
 {
-  struct ecommunity *ecom;
+  static struct arena *arena;
+  struct ecommunity *ecom, *ecom2;
   
   printf ("%s: %s\n", t->name, t->desc);
 
-  ecom = ecommunity_parse (t->data, t->len);
+  ecom = ecommunity_parse (t->data, t->len, NULL);
+
+  /* parsed in an arena, it is the same */
+  if (! arena)
+    arena = arena_new (MTYPE_TMP, 64);
+  ecom2 = ecommunity_parse (t->data, t->len, arena);
+  arena_reset (arena);
+  assert (ecom2 == ecom);
+  ecommunity_unintern (&ecom2);
 
   printf ("ecom: %s\nvalidating...:\n", ecommunity_str (ecom));
 
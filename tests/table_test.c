@@ -25,6 +25,7 @@
 
 #include "prefix.h"
 #include "table.h"
+#include "thread.h"
 
 /*
  * test_node_t
@@ -534,6 +535,318 @@ test_iter_pause (void)
   route_table_finish (table);
 }
 
+/*
+ * rand32
+ *
+ * 32 random bits; random() only gives 31.
+ */
+static u_int32_t
+rand32 (void)
+{
+  return (random () << 16) ^ random ();
+}
+
+/*
+ * random_prefix
+ *
+ * Fill in a random prefix of the given family, with lengths spread
+ * roughly like those of a full Internet table.
+ */
+static void
+random_prefix (int family, struct prefix *p)
+{
+  unsigned int r, len;
+  u_int32_t a[4];
+
+  memset (p, 0, sizeof (*p));
+  p->family = family;
+
+  r = rand32 () % 100;
+  a[0] = rand32 ();
+  a[1] = rand32 ();
+  a[2] = rand32 ();
+  a[3] = rand32 ();
+
+  if (family == AF_INET)
+    {
+      if (r < 55)
+	len = 24;
+      else if (r < 85)
+	len = 19 + r % 5;
+      else if (r < 99)
+	len = 12 + r % 7;
+      else
+	len = 8 + r % 4;
+
+      a[0] = htonl ((ntohl (a[0]) % 0xdf000000) + 0x01000000);
+      memcpy (&p->u.prefix4, a, sizeof (p->u.prefix4));
+    }
+#ifdef HAVE_IPV6
+  else
+    {
+      if (r < 45)
+	len = 48;
+      else if (r < 80)
+	len = 32 + r % 16;
+      else
+	len = 20 + r % 12;
+
+      a[0] = htonl ((ntohl (a[0]) & 0x1fffffff) | 0x20000000);
+      memcpy (&p->u.prefix6, a, sizeof (p->u.prefix6));
+    }
+#endif /* HAVE_IPV6 */
+
+  p->prefixlen = len;
+  apply_mask (p);
+}
+
+/*
+ * verify_same_node
+ *
+ * Both tables must have given the same answer.
+ */
+static void
+verify_same_node (struct route_node *rn1, struct route_node *rn2)
+{
+  assert (!rn1 == !rn2);
+  if (!rn1)
+    return;
+
+  assert (!prefix_cmp (&rn1->p, &rn2->p));
+  route_unlock_node (rn1);
+  route_unlock_node (rn2);
+}
+
+/*
+ * test_stride
+ *
+ * Adds and deletes the same random prefixes in a table with a stride
+ * index and one without, and verifies that lookups in the two give
+ * the same results.
+ */
+static void
+test_stride (int family)
+{
+  struct route_table *plain, *table;
+  struct route_node *rn1, *rn2;
+  struct prefix p;
+  int i;
+
+  printf ("\n\nTesting the stride index\n");
+  plain = route_table_init ();
+  route_table_set_stride (plain, 0);
+  table = route_table_init ();
+  route_table_set_stride (table, 1);
+
+  srandom (family);
+
+  /*
+   * Routes covering whole slots, and more than one.
+   */
+  str2prefix (family == AF_INET ? "0.0.0.0/0" : "::/0", &p);
+  for (i = 0; i < 2; i++)
+    {
+      rn1 = route_node_get (plain, &p);
+      rn1->info = rn1;
+      rn2 = route_node_get (table, &p);
+      rn2->info = rn2;
+      if (family == AF_INET)
+	str2prefix ("10.0.0.0/8", &p);
+      else
+	str2prefix ("2001::/16", &p);
+    }
+
+  for (i = 0; i < 20000; i++)
+    {
+      random_prefix (family, &p);
+      rn1 = route_node_get (plain, &p);
+      rn2 = route_node_get (table, &p);
+      assert (!prefix_cmp (&rn1->p, &rn2->p));
+
+      if (rn1->info)
+	{
+	  route_unlock_node (rn1);
+	  route_unlock_node (rn2);
+	  continue;
+	}
+      rn1->info = rn1;
+      rn2->info = rn2;
+    }
+
+  for (i = 0; i < 10000; i++)
+    {
+      random_prefix (family, &p);
+      if (i % 2)
+	p.prefixlen = ROUTE_TABLE_STRIDE_BITS + rand32 () % 8;
+      apply_mask (&p);
+
+      rn1 = route_node_lookup (plain, &p);
+      rn2 = route_node_lookup (table, &p);
+      assert (!rn1 == !rn2);
+      if (!rn1)
+	continue;
+
+      rn1->info = rn2->info = NULL;
+      route_unlock_node (rn1);
+      route_unlock_node (rn2);
+      route_unlock_node (rn1);
+      route_unlock_node (rn2);
+    }
+
+  assert (route_table_count (plain) == route_table_count (table));
+  for (rn1 = route_top (plain), rn2 = route_top (table); rn1;
+       rn1 = route_next (rn1), rn2 = route_next (rn2))
+    {
+      assert (rn2);
+      assert (!prefix_cmp (&rn1->p, &rn2->p));
+    }
+  assert (!rn2);
+
+  for (i = 0; i < 100000; i++)
+    {
+      random_prefix (family, &p);
+      if (i % 2)
+	p.prefixlen = family == AF_INET ? 32 : 128;
+
+      verify_same_node (route_node_match (plain, &p),
+			route_node_match (table, &p));
+      verify_same_node (route_node_lookup (plain, &p),
+			route_node_lookup (table, &p));
+    }
+
+  printf ("Verified stride index with %lu nodes\n", route_table_count (table));
+
+  for (rn1 = route_top (plain); rn1; rn1 = route_next (rn1))
+    if (rn1->info)
+      {
+	rn1->info = NULL;
+	route_unlock_node (rn1);
+      }
+  for (rn2 = route_top (table); rn2; rn2 = route_next (rn2))
+    if (rn2->info)
+      {
+	rn2->info = NULL;
+	route_unlock_node (rn2);
+      }
+  assert (plain->top == NULL && table->top == NULL);
+
+  route_table_finish (plain);
+  route_table_finish (table);
+}
+
+static unsigned long
+bench_msec (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000
+    + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/*
+ * bench_family
+ *
+ * Time adding, looking up and walking count random prefixes.
+ */
+static void
+bench_family (struct route_table *table, int family, int count)
+{
+  struct prefix *prefixes;
+  struct route_node *rn;
+  struct timeval start;
+  unsigned long n;
+  int i;
+
+  srandom (family);
+  prefixes = calloc (count, sizeof (struct prefix));
+  assert (prefixes);
+  for (i = 0; i < count; i++)
+    random_prefix (family, &prefixes[i]);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < count; i++)
+    {
+      rn = route_node_get (table, &prefixes[i]);
+      if (rn->info)
+	route_unlock_node (rn);
+      else
+	rn->info = rn;
+    }
+  printf ("%s: %d inserts: %lu ms, %lu nodes\n",
+	  family == AF_INET ? "ipv4" : "ipv6", count, bench_msec (&start),
+	  route_table_count (table));
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < count; i++)
+    {
+      rn = route_node_lookup (table, &prefixes[i]);
+      assert (rn);
+      route_unlock_node (rn);
+    }
+  printf ("%s: %d lookups: %lu ms\n",
+	  family == AF_INET ? "ipv4" : "ipv6", count, bench_msec (&start));
+
+  for (i = 0; i < count; i++)
+    {
+      random_prefix (family, &prefixes[i]);
+      prefixes[i].prefixlen = family == AF_INET ? 32 : 128;
+    }
+  n = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < count; i++)
+    if ((rn = route_node_match (table, &prefixes[i])))
+      {
+	route_unlock_node (rn);
+	n++;
+      }
+  printf ("%s: %d matches: %lu ms, %lu found\n",
+	  family == AF_INET ? "ipv4" : "ipv6", count, bench_msec (&start), n);
+
+  n = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (rn = route_top (table); rn; rn = route_next (rn))
+    n++;
+  printf ("%s: walk of %lu nodes: %lu ms\n",
+	  family == AF_INET ? "ipv4" : "ipv6", n, bench_msec (&start));
+
+  /* Leave the routes in place, for the RSS figure. */
+  free (prefixes);
+}
+
+/*
+ * bench
+ *
+ * Full table benchmark, "tabletest bench [plain] [count]".  Run it
+ * with and without "plain" to compare the two.  RSS is the peak, so
+ * each run measures one kind of table only.
+ */
+static void
+bench (int plain, int count)
+{
+  struct route_table *table4, *table6;
+  struct rusage ru;
+
+  printf ("%s tables, %d ipv4 and %d ipv6 prefixes\n",
+	  plain ? "Plain" : "Stride indexed", count, count / 5);
+
+  table4 = route_table_init ();
+  table6 = route_table_init ();
+  if (plain)
+    {
+      route_table_set_stride (table4, 0);
+      route_table_set_stride (table6, 0);
+    }
+
+  bench_family (table4, AF_INET, count);
+#ifdef HAVE_IPV6
+  bench_family (table6, AF_INET6, count / 5);
+#endif /* HAVE_IPV6 */
+
+  getrusage (RUSAGE_SELF, &ru);
+  printf ("max RSS: %ld kB\n", ru.ru_maxrss);
+}
+
 /*
  * run_tests
  */
@@ -543,13 +856,33 @@ run_tests (void)
   test_prefix_iter_cmp ();
   test_get_next ();
   test_iter_pause ();
+  test_stride (AF_INET);
+#ifdef HAVE_IPV6
+  test_stride (AF_INET6);
+#endif /* HAVE_IPV6 */
 }
 
 /*
  * main
  */
 int
-main (void)
+main (int argc, char **argv)
 {
+  int plain = 0;
+  int count = 800000;
+
+  if (argc > 1 && !strcmp (argv[1], "bench"))
+    {
+      for (argc -= 2, argv += 2; argc > 0; argc--, argv++)
+	if (!strcmp (*argv, "plain"))
+	  plain = 1;
+	else
+	  count = atoi (*argv);
+
+      bench (plain, count);
+      return 0;
+    }
+
   run_tests ();
+  return 0;
 }
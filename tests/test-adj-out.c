@@ -0,0 +1,314 @@
+/*
+ * Test program which announces, sends and withdraws prefixes to many
+ * peers at random through the Adj-RIB-Out, checks what it holds after
+ * each step against a plain table of what should be there, and times
+ * looking a peer up in a node as the peers a node is sent to grow.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "vty.h"
+#include "memory.h"
+#include "thread.h"
+#include "privs.h"
+#include "prefix.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+
+#define PEERS    300
+#define PREFIXES 500
+#define STEPS    400000
+#define LOOKUPS  2000000
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+/* What a peer should have of a prefix.  */
+struct model
+{
+  u_char present;
+  u_char sent;
+  u_char pending;
+#define PENDING_NONE     0
+#define PENDING_UPDATE   1
+#define PENDING_WITHDRAW 2
+};
+
+static struct peer *peers[PEERS];
+static struct bgp_node *nodes[PREFIXES];
+static struct model model[PREFIXES][PEERS];
+static struct bgp_info binfo;
+static struct attr attr;
+
+/* What bgp_update_packet_sent does once the prefix is in an UPDATE.  */
+static void
+send_update (struct peer *peer, struct bgp_adj_out *adj)
+{
+  if (adj->attr)
+    bgp_attr_unintern (&adj->attr);
+  adj->attr = bgp_attr_intern (adj->adv->baa->attr);
+  bgp_advertise_clean (peer, adj, AFI_IP, SAFI_UNICAST);
+}
+
+/* What bgp_withdraw_packet does once the prefix is in an UPDATE.  */
+static void
+send_withdraw (struct bgp_node *rn, struct peer *peer, struct bgp_adj_out *adj)
+{
+  bgp_adj_out_remove (rn, adj, peer, AFI_IP, SAFI_UNICAST);
+  bgp_unlock_node (rn);
+}
+
+static void
+step (int n, int p)
+{
+  struct bgp_node *rn = nodes[n];
+  struct peer *peer = peers[p];
+  struct model *m = &model[n][p];
+  struct bgp_adj_out *adj = bgp_adj_out_get (rn, peer);
+
+  switch (random () % 4)
+    {
+    case 0:
+    case 1:
+      bgp_adj_out_set (rn, peer, &rn->p, &attr, AFI_IP, SAFI_UNICAST, &binfo);
+      m->present = 1;
+      m->pending = PENDING_UPDATE;
+      break;
+    case 2:
+      bgp_adj_out_unset (rn, peer, &rn->p, AFI_IP, SAFI_UNICAST);
+      if (m->sent)
+	m->pending = PENDING_WITHDRAW;
+      else
+	memset (m, 0, sizeof (*m));
+      break;
+    case 3:
+      if (! adj || ! adj->adv)
+	break;
+      if (adj->adv->baa)
+	{
+	  send_update (peer, adj);
+	  m->sent = 1;
+	  m->pending = PENDING_NONE;
+	}
+      else
+	{
+	  send_withdraw (rn, peer, adj);
+	  memset (m, 0, sizeof (*m));
+	}
+      break;
+    }
+}
+
+/* Everything in the node agrees with the model.  */
+static void
+check_node (int n)
+{
+  struct bgp_node *rn = nodes[n];
+  struct bgp_adj_out *adj;
+  int p, count = 0, want = 0;
+
+  for (p = 0; p < PEERS; p++)
+    {
+      struct model *m = &model[n][p];
+
+      adj = bgp_adj_out_get (rn, peers[p]);
+      assert (!! adj == m->present);
+      assert (bgp_node_peer_bit (rn, BGP_PEER_BITS_ADVERTISED,
+				 peers[p]->index) == m->present);
+      assert (bgp_adj_out_lookup (peers[p], &rn->p, AFI_IP, SAFI_UNICAST, rn)
+	      == (m->pending ? m->pending == PENDING_UPDATE : m->sent));
+      if (! adj)
+	continue;
+      want++;
+      assert (adj->peer == peers[p]);
+      assert (!! adj->attr == m->sent);
+      assert (!! adj->adv == (m->pending != PENDING_NONE));
+      if (adj->adv)
+	{
+	  assert (adj->adv->adj == adj);
+	  assert (adj->adv->rn == rn);
+	  assert (!! adj->adv->baa == (m->pending == PENDING_UPDATE));
+	}
+    }
+
+  for (adj = bgp_adj_out_next (rn, NULL); adj; adj = bgp_adj_out_next (rn, adj))
+    count++;
+  assert (count == want);
+}
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+/* Send every prefix to the first NPEERS peers, in no particular order,
+   and time looking them up.  */
+static void
+bench (int npeers)
+{
+  static int order[PEERS];
+  struct timeval start;
+  unsigned long i, found = 0, usec, count, bytes;
+  int n, p;
+
+  for (p = 0; p < npeers; p++)
+    order[p] = p;
+  for (p = npeers - 1; p > 0; p--)
+    {
+      int q = random () % (p + 1), t = order[p];
+
+      order[p] = order[q];
+      order[q] = t;
+    }
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (n = 0; n < PREFIXES; n++)
+    for (p = 0; p < npeers; p++)
+      {
+	struct peer *peer = peers[order[p]];
+
+	bgp_adj_out_set (nodes[n], peer, &nodes[n]->p, &attr,
+			 AFI_IP, SAFI_UNICAST, &binfo);
+	send_update (peer, bgp_adj_out_get (nodes[n], peer));
+      }
+  usec = usec_since (&start);
+  count = bgp_adj_out_count (&bytes);
+  assert (count == (unsigned long) PREFIXES * npeers);
+
+  printf ("%3d peers: set %4lu ns, %3lu bytes an entry, ", npeers,
+	  usec * 1000 / count, bytes / count);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < LOOKUPS; i++)
+    found += bgp_adj_out_lookup (peers[order[i % npeers]], NULL,
+				 AFI_IP, SAFI_UNICAST,
+				 nodes[(i / npeers) % PREFIXES]);
+  usec = usec_since (&start);
+  assert (found == LOOKUPS);
+  printf ("lookup %3lu ns\n", usec * 1000 / LOOKUPS);
+
+  for (n = 0; n < PREFIXES; n++)
+    for (p = 0; p < npeers; p++)
+      {
+	bgp_adj_out_unset (nodes[n], peers[p], &nodes[n]->p,
+			   AFI_IP, SAFI_UNICAST);
+	send_withdraw (nodes[n], peers[p], bgp_adj_out_get (nodes[n], peers[p]));
+      }
+  assert (bgp_adj_out_count (NULL) == 0);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int sizes[] = { 1, 4, 8, 16, 64, PEERS };
+  struct bgp_table *table;
+  struct bgp *bgp;
+  as_t asn = 100;
+  unsigned int i;
+  int n, p, steps = STEPS;
+
+  if (argc > 1)
+    steps = atoi (argv[1]);
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+  if (bgp_get (&bgp, &asn, NULL))
+    return 1;
+
+  for (p = 0; p < PEERS; p++)
+    {
+      peers[p] = peer_create_accept (bgp);
+      peers[p]->status = Established;
+      peers[p]->host = XSTRDUP (MTYPE_BGP_PEER_HOST, "test");
+    }
+
+  /* Free some indexes and take them again, so that they are not in
+     the order the peers are.  */
+  for (p = 0; p < PEERS; p += 3)
+    peer_delete (peers[p]);
+  for (p = PEERS - 1 - (PEERS - 1) % 3; p >= 0; p -= 3)
+    {
+      peers[p] = peer_create_accept (bgp);
+      peers[p]->status = Established;
+      peers[p]->host = XSTRDUP (MTYPE_BGP_PEER_HOST, "test");
+    }
+
+  table = bgp_table_init (AFI_IP, SAFI_UNICAST);
+  for (n = 0; n < PREFIXES; n++)
+    {
+      struct prefix p4;
+
+      memset (&p4, 0, sizeof (p4));
+      p4.family = AF_INET;
+      p4.prefixlen = 24;
+      p4.u.prefix4.s_addr = htonl (0x0a000000 | (n << 8));
+      nodes[n] = bgp_node_get (table, &p4);
+    }
+
+  bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+  binfo.lock = 1;
+
+  /* Most nodes are sent to a few peers, some to many.  */
+  srandom (1);
+  for (i = 0; i < (unsigned int) steps; i++)
+    {
+      n = random () % PREFIXES;
+      p = random () % (n % 10 ? 12 : PEERS);
+      step (n, p);
+      if (i % 1000 == 0)
+	check_node (n);
+    }
+  for (n = 0; n < PREFIXES; n++)
+    check_node (n);
+  printf ("%d steps, %lu entries left\n", steps, bgp_adj_out_count (NULL));
+
+  /* Send everything still to be sent, and check it is all gone.  */
+  for (n = 0; n < PREFIXES; n++)
+    for (p = 0; p < PEERS; p++)
+      {
+	struct bgp_adj_out *adj = bgp_adj_out_get (nodes[n], peers[p]);
+
+	if (! adj)
+	  continue;
+	/* Drops both what was sent and what is pending.  */
+	bgp_adj_out_remove (nodes[n], adj, peers[p], AFI_IP, SAFI_UNICAST);
+	bgp_unlock_node (nodes[n]);
+	memset (&model[n][p], 0, sizeof (struct model));
+      }
+  for (n = 0; n < PREFIXES; n++)
+    {
+      check_node (n);
+      assert (nodes[n]->adj_out == NULL);
+    }
+
+  for (i = 0; i < array_size (sizes); i++)
+    bench (sizes[i]);
+  return 0;
+}
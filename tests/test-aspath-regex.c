@@ -0,0 +1,309 @@
+/*
+ * Test program which checks the AS path DFA of bgpd/bgp_regex.c
+ * against the C library's regexec over the printed path, for random
+ * regexes of the kind as-path access-lists are written with and random
+ * paths, and on a regex whose DFA outgrows its limit, and times the two
+ * on a few common regexes.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "vty.h"
+#include "memory.h"
+#include "thread.h"
+#include "privs.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_regex.h"
+
+#define REGEXES 3000
+#define PATHS   300
+#define MATCHES 200000
+#define LONG_PATHS 100000
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static const char *asns[] =
+{
+  "1", "2", "12", "21", "100", "701", "1299", "3356", "7018", "64512",
+  "65001", "65002", "65535", "4200000000",
+};
+
+static const char *pieces[] =
+{
+  "_", "_", "_", "^", "$", ".", ".*", ".+", "[0-9]", "[0-9]+", "[0-9]*",
+  "[^0-9]", "[1-3]", "[,{}]", "[[:digit:]]", "[^_]", " ", ",", "\\{",
+  "\\}", "}", "\\(", "\\)", "\\[", "\\]", "\\.", "\\1", "{", "*", "[]a]",
+};
+
+static const char *repeats[] =
+{
+  "", "", "", "", "*", "+", "?", "{2}", "{1,3}", "{0,}", "{,2}",
+};
+
+static void
+random_regex (char *buf, size_t size, int depth)
+{
+  int i, n = 1 + random () % 5;
+
+  for (i = 0; i < n; i++)
+    {
+      char sub[256];
+
+      switch (random () % 6)
+	{
+	case 0:
+	case 1:
+	  snprintf (sub, sizeof (sub), "%s",
+		    asns[random () % array_size (asns)]);
+	  break;
+	case 2:
+	  if (depth < 2)
+	    {
+	      char alt[100] = "";
+
+	      sub[1] = '\0';
+	      random_regex (sub + 1, 100, depth + 1);
+	      random_regex (alt, sizeof (alt), depth + 1);
+	      sub[0] = '(';
+	      strcat (sub, random () % 2 ? "|" : "");
+	      if (random () % 2)
+		strcat (sub, alt);
+	      strcat (sub, ")");
+	      break;
+	    }
+	  /* Fall through. */
+	default:
+	  snprintf (sub, sizeof (sub), "%s",
+		    pieces[random () % array_size (pieces)]);
+	  break;
+	}
+      if (strlen (buf) + strlen (sub) + 8 >= size)
+	break;
+      strcat (buf, sub);
+      strcat (buf, repeats[random () % array_size (repeats)]);
+    }
+}
+
+static struct aspath *
+random_path (void)
+{
+  static const char *open[] = { "", "", "", "", "{", "(", "[" };
+  static const char *close[] = { "", "", "", "", "}", ")", "]" };
+  char str[512] = "";
+  int seg, nseg = random () % 4;
+
+  for (seg = 0; seg < nseg; seg++)
+    {
+      int type = random () % array_size (open);
+      int i, n = 1 + random () % 4;
+
+      strcat (str, open[type]);
+      for (i = 0; i < n; i++)
+	{
+	  char as[16];
+
+	  if (random () % 3)
+	    snprintf (as, sizeof (as), "%s", asns[random () % array_size (asns)]);
+	  else
+	    snprintf (as, sizeof (as), "%lu", (unsigned long) random ());
+	  strcat (str, as);
+	  if (i < n - 1)
+	    strcat (str, type >= 4 && type != 5 ? "," : " ");
+	}
+      strcat (str, close[type]);
+      strcat (str, " ");
+    }
+  return aspath_str2aspath (str);
+}
+
+/* A sequence of 4 to 8 ASes of up to 6 digits. */
+static struct aspath *
+long_path (void)
+{
+  char str[64] = "";
+  int i, n = 4 + random () % 5;
+
+  for (i = 0; i < n; i++)
+    {
+      char as[16];
+
+      snprintf (as, sizeof (as), "%lu ", (unsigned long) random ());
+      strcat (str, as);
+    }
+  return aspath_str2aspath (str);
+}
+
+/* The DFA for this one has a state for every 14 characters seen last,
+   and grows past ASRE_DSTATES_MAX every few thousand paths, to be
+   thrown away and started again from the path's state. */
+static int
+flush_check (int npaths)
+{
+  const char *str = "1[0-9 ]{13}$";
+  struct aspath_regex *re = bgp_aspath_regcomp (str);
+  regex_t *reg = bgp_regcomp (str);
+  int j;
+
+  assert (re && reg);
+  srandom (1);
+  for (j = 0; j < npaths; j++)
+    {
+      struct aspath *path = long_path ();
+      int dfa, libc;
+
+      assert (path);
+      dfa = bgp_aspath_regexec (re, path) == 0;
+      libc = bgp_regexec (reg, path) == 0;
+      if (dfa != libc)
+	{
+	  printf ("regex \"%s\" on path \"%s\": DFA %d, regexec %d\n",
+		  str, aspath_print (path), dfa, libc);
+	  return 1;
+	}
+      aspath_free (path);
+    }
+  printf ("%s on %d long paths, as regexec\n", str, npaths);
+  bgp_aspath_regfree (re);
+  bgp_regex_free (reg);
+  return 0;
+}
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+/* Time both on common access-list regexes. */
+static void
+bench (struct aspath **paths, int npaths)
+{
+  static const char *common[] =
+  {
+    "^65001$", "_65001_", "^65001_", "_7018$", "^$", "^[0-9]+$",
+    "_(701|1299|3356)_", "^65001(_65001)*$", ".*", "_6451[2-9]_",
+  };
+  unsigned int i;
+  int j;
+
+  for (i = 0; i < array_size (common); i++)
+    {
+      struct aspath_regex *re = bgp_aspath_regcomp (common[i]);
+      regex_t *reg = bgp_regcomp (common[i]);
+      struct timeval start;
+      unsigned long usec_dfa, usec_libc, matched = 0;
+
+      assert (re && reg);
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+      for (j = 0; j < MATCHES; j++)
+	matched += bgp_aspath_regexec (re, paths[j % npaths]) == 0;
+      usec_dfa = usec_since (&start);
+
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+      for (j = 0; j < MATCHES; j++)
+	matched -= bgp_regexec (reg, paths[j % npaths]) == 0;
+      usec_libc = usec_since (&start);
+
+      assert (matched == 0);
+      printf ("%-20s DFA %4lu ns, regexec %5lu ns per path\n", common[i],
+	      usec_dfa * 1000 / MATCHES, usec_libc * 1000 / MATCHES);
+      bgp_aspath_regfree (re);
+      bgp_regex_free (reg);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  struct aspath **paths;
+  int i, j, nregex = REGEXES, nlong = LONG_PATHS, compiled = 0, refused = 0;
+  unsigned long checked = 0;
+
+  if (argc > 1)
+    nregex = atoi (argv[1]);
+  if (argc > 2)
+    nlong = atoi (argv[2]);
+
+  srandom (1);
+  paths = calloc (PATHS, sizeof (struct aspath *));
+  assert (paths);
+  for (i = 0; i < PATHS; i++)
+    {
+      paths[i] = random_path ();
+      assert (paths[i]);
+    }
+
+  for (i = 0; i < nregex; i++)
+    {
+      char str[256] = "";
+      struct aspath_regex *re;
+      regex_t *reg;
+
+      random_regex (str, sizeof (str), 0);
+
+      /* Only what bgpd would take is given to the DFA. */
+      reg = bgp_regcomp (str);
+      if (reg == NULL)
+	continue;
+      compiled++;
+
+      re = bgp_aspath_regcomp (str);
+      if (re == NULL)
+	{
+	  refused++;
+	  bgp_regex_free (reg);
+	  continue;
+	}
+
+      for (j = 0; j < PATHS; j++)
+	{
+	  int dfa = bgp_aspath_regexec (re, paths[j]) == 0;
+	  int libc = bgp_regexec (reg, paths[j]) == 0;
+
+	  if (dfa != libc)
+	    {
+	      printf ("regex \"%s\" on path \"%s\": DFA %d, regexec %d\n",
+		      str, aspath_print (paths[j]), dfa, libc);
+	      return 1;
+	    }
+	  checked++;
+	}
+      bgp_aspath_regfree (re);
+      bgp_regex_free (reg);
+    }
+  printf ("%d regexes, %d left to regexec, %lu matches checked\n",
+	  compiled, refused, checked);
+
+  if (flush_check (nlong))
+    return 1;
+
+  bench (paths, PATHS);
+
+  for (i = 0; i < PATHS; i++)
+    aspath_free (paths[i]);
+  free (paths);
+  return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ * Test program which replays the UPDATEs of an MRT stream through the
+ * attribute cache and parser, keeping what it gets in a table as bgpd
+ * would, and times getting them.  The stream is made up, with AS paths,
+ * communities and the like reused much as they are in the Internet's
+ * table, unless an MRT file of updates (BGP4MP, uncompressed) is given
+ * instead.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "vty.h"
+#include "memory.h"
+#include "thread.h"
+#include "privs.h"
+#include "stream.h"
+#include "jhash.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_dump.h"
+
+#define UPDATES  200000
+#define PATHS    30000
+#define PREFIXES 200000
+#define SLOTS    (1 << 18)
+#define ROUNDS   3
+
+#define BGP_ATTR_LARGE_COMMUNITIES 32
+#define MSG_PROTOCOL_BGP4MP_ET     17
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+/* An AS path of the made up stream, and the communities which go with
+   it. */
+struct path
+{
+  int length;
+  as_t as[12];
+  int set;
+  int communities;
+  u_int32_t community[8];
+};
+
+static struct path paths[PATHS];
+
+/* What the table holds, by prefix. */
+static struct attr *rib[SLOTS];
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+static void
+make_paths (void)
+{
+  int i, j;
+
+  for (i = 0; i < PATHS; i++)
+    {
+      struct path *path = &paths[i];
+
+      path->as[0] = 3356;
+      path->length = 2 + random () % 5;
+      for (j = 1; j < path->length; j++)
+	path->as[j] = 1 + random () % 400000;
+      /* Some prepend, some end with a set. */
+      if (random () % 10 == 0)
+	for (j = random () % 3; j >= 0; j--, path->length++)
+	  path->as[path->length] = path->as[path->length - 1];
+      path->set = (random () % 30 == 0);
+      if (random () % 10 < 6)
+	{
+	  path->communities = 1 + random () % 6;
+	  for (j = 0; j < path->communities; j++)
+	    path->community[j] = (path->as[random () % path->length] << 16)
+				 | (random () % 1000);
+	}
+    }
+}
+
+/* Put the attributes of a made up UPDATE. */
+static void
+put_attrs (struct stream *s, struct path *path, u_int32_t seq)
+{
+  int i, n;
+
+  stream_putc (s, BGP_ATTR_FLAG_TRANS);
+  stream_putc (s, BGP_ATTR_ORIGIN);
+  stream_putc (s, 1);
+  stream_putc (s, BGP_ORIGIN_IGP);
+
+  stream_putc (s, BGP_ATTR_FLAG_TRANS);
+  stream_putc (s, BGP_ATTR_AS_PATH);
+  stream_putc (s, 2 + 4 * path->length + (path->set ? 2 + 8 : 0));
+  stream_putc (s, AS_SEQUENCE);
+  stream_putc (s, path->length);
+  for (i = 0; i < path->length; i++)
+    stream_putl (s, path->as[i]);
+  if (path->set)
+    {
+      stream_putc (s, AS_SET);
+      stream_putc (s, 2);
+      stream_putl (s, 64512 + seq % 7);
+      stream_putl (s, 64512);
+    }
+
+  stream_putc (s, BGP_ATTR_FLAG_TRANS);
+  stream_putc (s, BGP_ATTR_NEXT_HOP);
+  stream_putc (s, 4);
+  stream_putl (s, 0x0a000001);
+
+  if (seq % 10 < 3)
+    {
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL);
+      stream_putc (s, BGP_ATTR_MULTI_EXIT_DISC);
+      stream_putc (s, 4);
+      stream_putl (s, seq % 100);
+    }
+
+  /* Communities in the order they came in, with now and then one more
+     making a set not seen before. */
+  n = path->communities + (path->communities && seq % 5 == 0);
+  if (n)
+    {
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL | BGP_ATTR_FLAG_TRANS);
+      stream_putc (s, BGP_ATTR_COMMUNITIES);
+      stream_putc (s, 4 * n);
+      for (i = path->communities - 1; i >= 0; i--)
+	stream_putl (s, path->community[i]);
+      if (n > path->communities)
+	stream_putl (s, (3356 << 16) | (seq % 4000));
+    }
+
+  if (seq % 20 == 0)
+    {
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL | BGP_ATTR_FLAG_TRANS);
+      stream_putc (s, BGP_ATTR_EXT_COMMUNITIES);
+      stream_putc (s, 16);
+      stream_putl (s, 0x00020d1c);
+      stream_putl (s, seq % 50);
+      stream_putl (s, 0x00020d1c);
+      stream_putl (s, 0);
+    }
+
+  /* Unknown to us, so carried as transit. */
+  if (seq % 30 == 0)
+    {
+      n = 1 + seq % 3;
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL | BGP_ATTR_FLAG_TRANS);
+      stream_putc (s, BGP_ATTR_LARGE_COMMUNITIES);
+      stream_putc (s, 12 * n);
+      for (i = 0; i < n; i++)
+	{
+	  stream_putl (s, path->as[path->length - 1]);
+	  stream_putl (s, i);
+	  stream_putl (s, seq % 10);
+	}
+    }
+}
+
+/* Make up an MRT stream of UPDATEs, as a collector would write them. */
+static struct stream *
+make_mrt (int updates)
+{
+  struct stream *s;
+  struct path *path = NULL;
+  u_int32_t seq = 0;
+  int i, j, run = 0;
+
+  s = stream_new ((size_t) updates * 256);
+  make_paths ();
+  for (i = 0; i < updates; i++)
+    {
+      size_t mrtp, bgpp, attrp;
+
+      /* Some paths are much more used than others.  Now and then the
+	 prefixes of one do not fit an UPDATE, or come one to an UPDATE,
+	 and the same attributes come in a run. */
+      if (run == 0)
+	{
+	  path = &paths[(random () % PATHS) * (random () % PATHS) / PATHS];
+	  seq = i;
+	  run = random () % 4 ? 1 : 2 + random () % 8;
+	}
+      run--;
+
+      stream_putl (s, i);
+      stream_putw (s, MSG_PROTOCOL_BGP4MP);
+      stream_putw (s, BGP4MP_MESSAGE_AS4);
+      mrtp = stream_get_endp (s);
+      stream_putl (s, 0);
+
+      stream_putl (s, 3356);
+      stream_putl (s, 65000);
+      stream_putw (s, 0);
+      stream_putw (s, AFI_IP);
+      stream_putl (s, 0x0a000001);
+      stream_putl (s, 0x0a000002);
+
+      bgpp = stream_get_endp (s);
+      for (j = 0; j < BGP_MARKER_SIZE; j++)
+	stream_putc (s, 0xff);
+      stream_putw (s, 0);
+      stream_putc (s, BGP_MSG_UPDATE);
+      stream_putw (s, 0);
+      attrp = stream_get_endp (s);
+      stream_putw (s, 0);
+      put_attrs (s, path, seq);
+      stream_putw_at (s, attrp, stream_get_endp (s) - attrp - 2);
+
+      for (j = random () % 3; j >= 0; j--)
+	{
+	  u_int32_t prefix = random () % PREFIXES;
+
+	  stream_putc (s, 24);
+	  stream_putc (s, 1 + (prefix >> 16));
+	  stream_putc (s, prefix >> 8);
+	  stream_putc (s, prefix);
+	}
+
+      stream_putw_at (s, bgpp + BGP_MARKER_SIZE, stream_get_endp (s) - bgpp);
+      stream_putl_at (s, mrtp, stream_get_endp (s) - mrtp - 4);
+    }
+  return s;
+}
+
+static struct stream *
+read_mrt (const char *file)
+{
+  struct stream *s;
+  struct stat st;
+  int fd;
+
+  fd = open (file, O_RDONLY);
+  if (fd < 0 || fstat (fd, &st) < 0)
+    {
+      perror (file);
+      exit (1);
+    }
+  s = stream_new (st.st_size);
+  if (stream_read (s, fd, st.st_size) != st.st_size)
+    {
+      perror (file);
+      exit (1);
+    }
+  close (fd);
+  return s;
+}
+
+/* Run the UPDATEs in the stream through the attribute cache and
+   bgp_attr_parse as bgp_update_receive would, and keep the attributes
+   of each in the table in place of what its first prefix had. */
+static void
+replay (struct peer *peer, struct stream *s, int round)
+{
+  struct timeval start;
+  unsigned long usec = 0, updates = 0, errors = 0;
+  unsigned long hits, misses, hits0, misses0, entries, bytes;
+
+  bgp_attr_cache_stats (&hits0, &misses0, &entries, &bytes);
+  stream_set_getp (s, 0);
+  while (STREAM_READABLE (s) >= 12)
+    {
+      u_int16_t type, subtype, afi, len, attrlen;
+      u_int32_t mrtlen;
+      size_t next;
+      int as4;
+
+      stream_forward_getp (s, 4);
+      type = stream_getw (s);
+      subtype = stream_getw (s);
+      mrtlen = stream_getl (s);
+      next = stream_get_getp (s) + mrtlen;
+      if (next > stream_get_endp (s))
+	break;
+
+      if (type == MSG_PROTOCOL_BGP4MP_ET)
+	stream_forward_getp (s, 4);
+      if ((type != MSG_PROTOCOL_BGP4MP && type != MSG_PROTOCOL_BGP4MP_ET)
+	  || (subtype != BGP4MP_MESSAGE && subtype != BGP4MP_MESSAGE_AS4))
+	{
+	  stream_set_getp (s, next);
+	  continue;
+	}
+
+      as4 = (subtype == BGP4MP_MESSAGE_AS4);
+      stream_forward_getp (s, as4 ? 8 : 4);
+      stream_forward_getp (s, 2);
+      afi = stream_getw (s);
+      stream_forward_getp (s, afi == AFI_IP6 ? 32 : 8);
+
+      stream_forward_getp (s, BGP_MARKER_SIZE);
+      len = stream_getw (s);
+      if (stream_getc (s) != BGP_MSG_UPDATE || len < BGP_MSG_UPDATE_MIN_SIZE)
+	{
+	  stream_set_getp (s, next);
+	  continue;
+	}
+      stream_forward_getp (s, stream_getw (s));
+      attrlen = stream_getw (s);
+      if (attrlen && attrlen <= BGP_MAX_PACKET_SIZE)
+	{
+	  struct attr attr, *pattr, *new;
+	  struct attr_extra extra;
+	  struct bgp_nlri mp_update, mp_withdraw;
+	  struct timeval t;
+	  size_t nlrip = stream_get_getp (s) + attrlen;
+	  int ret;
+
+	  if (as4)
+	    SET_FLAG (peer->cap, PEER_CAP_AS4_RCV);
+	  else
+	    UNSET_FLAG (peer->cap, PEER_CAP_AS4_RCV);
+	  stream_reset (peer->ibuf);
+	  stream_put (peer->ibuf, stream_pnt (s), attrlen);
+
+	  memset (&attr, 0, sizeof (struct attr));
+	  memset (&extra, 0, sizeof (struct attr_extra));
+	  memset (&mp_update, 0, sizeof (struct bgp_nlri));
+	  memset (&mp_withdraw, 0, sizeof (struct bgp_nlri));
+	  attr.extra = &extra;
+
+	  /* As bgp_update_receive does, and then as bgp_update_main does
+	     for the first prefix. */
+	  quagga_gettime (QUAGGA_CLK_MONOTONIC, &t);
+	  ret = BGP_ATTR_PARSE_PROCEED;
+	  if ((pattr = bgp_attr_cache_get (peer, attrlen)) == NULL)
+	    {
+	      pattr = &attr;
+	      ret = bgp_attr_parse (peer, &attr, attrlen,
+				    &mp_update, &mp_withdraw);
+	      if (ret == BGP_ATTR_PARSE_PROCEED)
+		pattr = bgp_attr_cache_set (peer, &attr);
+	    }
+
+	  if (ret == BGP_ATTR_PARSE_PROCEED && nlrip < next)
+	    {
+	      u_int32_t slot;
+
+	      if (pattr->refcnt)
+		new = bgp_attr_ref (pattr);
+	      else
+		new = bgp_attr_intern (pattr);
+	      usec += usec_since (&t);
+
+	      slot = jhash (STREAM_DATA (s) + nlrip, MIN (next - nlrip, 4), 0);
+	      if (rib[slot % SLOTS])
+		bgp_attr_unintern (&rib[slot % SLOTS]);
+	      rib[slot % SLOTS] = new;
+	      quagga_gettime (QUAGGA_CLK_MONOTONIC, &t);
+	    }
+	  else if (ret != BGP_ATTR_PARSE_PROCEED)
+	    errors++;
+
+	  bgp_attr_unintern_sub (&attr);
+	  bgp_attr_parse_reset ();
+	  usec += usec_since (&t);
+	  updates++;
+	}
+      stream_set_getp (s, next);
+    }
+
+  bgp_attr_cache_stats (&hits, &misses, &entries, &bytes);
+  hits -= hits0;
+  misses -= misses0;
+  printf ("round %d: %lu updates, %lu errors, %lu ns an update, "
+	  "%lu AS paths, %lu communities, %lu attributes, "
+	  "%lu%% cache hits\n", round,
+	  updates, errors, updates ? usec * 1000 / updates : 0,
+	  aspath_count (), community_count (), attr_count (),
+	  hits + misses ? hits * 100 / (hits + misses) : 0);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct bgp *bgp;
+  struct peer *peer;
+  struct stream *s;
+  as_t asn = 65000;
+  unsigned long aspaths;
+  int i, updates = UPDATES;
+
+  if (argc > 1 && ! isdigit ((int) argv[1][0]))
+    s = read_mrt (argv[1]);
+  else
+    {
+      if (argc > 1)
+	updates = atoi (argv[1]);
+      srandom (1);
+      s = make_mrt (updates);
+    }
+
+  bgp_master_init ();
+  master = bm->master;
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+  if (bgp_get (&bgp, &asn, NULL))
+    return 1;
+
+  peer = peer_create_accept (bgp);
+  peer->host = XSTRDUP (MTYPE_BGP_PEER_HOST, "test");
+  peer->as = 3356;
+  peer->sort = BGP_PEER_EBGP;
+  aspaths = aspath_count ();
+
+  for (i = 1; i <= ROUNDS; i++)
+    replay (peer, s, i);
+
+  /* Nothing is left once the table and the cache are emptied. */
+  for (i = 0; i < SLOTS; i++)
+    if (rib[i])
+      bgp_attr_unintern (&rib[i]);
+  bgp_attr_cache_flush (peer);
+  assert (attr_count () == 0);
+  assert (aspath_count () == aspaths);
+  assert (community_count () == 0);
+
+  stream_free (s);
+  return 0;
+}
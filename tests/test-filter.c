@@ -0,0 +1,369 @@
+/*
+ * Test program which configures access-lists of zebra-style, cisco
+ * standard and cisco extended filters, and checks what access_list_apply
+ * decides for a set of routes against a plain walk of the filters in
+ * order, before and after deleting some of them and adding them back.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "command.h"
+#include "memory.h"
+#include "prefix.h"
+#include "filter.h"
+#include "thread.h"
+#include "vty.h"
+
+#define ENTRIES 1000
+#define ROUTES  20000
+
+struct thread_master *master;
+
+enum entry_kind
+{
+  ENTRY_ZEBRA,
+  ENTRY_STANDARD,
+  ENTRY_EXTENDED,
+};
+
+struct entry
+{
+  enum entry_kind kind;
+  int permit;
+
+  /* Zebra-style. */
+  int exact;
+  struct prefix p;
+
+  /* Cisco-style, the bits under the wildcards cleared. */
+  struct in_addr addr;
+  struct in_addr addr_mask;
+  struct in_addr mask;
+  struct in_addr mask_mask;
+};
+
+static struct vty *vty;
+
+static u_int32_t
+rand32 (void)
+{
+  return ((u_int32_t) random () << 16) ^ (u_int32_t) random ();
+}
+
+/* Mostly /24s, some shorter, like a full table. */
+static void
+random_prefix (struct prefix *p)
+{
+  static const u_char lens[] = { 24, 24, 24, 24, 24, 24, 23, 22, 22, 21,
+				 20, 19, 18, 17, 16, 16, 12, 8 };
+
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = lens[random () % array_size (lens)];
+  p->u.prefix4.s_addr = htonl (rand32 ());
+  apply_mask (p);
+}
+
+static u_int32_t
+netmask (int len)
+{
+  struct in_addr mask;
+
+  masklen2ip (len, &mask);
+  return mask.s_addr;
+}
+
+/* A filter of KIND about route R, which it matches mostly. */
+static void
+random_entry (struct entry *e, enum entry_kind kind, struct prefix *r)
+{
+  int len;
+
+  memset (e, 0, sizeof (*e));
+  e->kind = kind;
+  e->permit = (random () % 4 != 0);
+
+  switch (kind)
+    {
+    case ENTRY_ZEBRA:
+      e->p = *r;
+      if (e->p.prefixlen > 8 && random () % 2)
+	{
+	  e->p.prefixlen -= random () % 4;
+	  apply_mask (&e->p);
+	}
+      e->exact = (random () % 4 == 0);
+      break;
+
+    case ENTRY_EXTENDED:
+      /* A range of prefix lengths, or just the one. */
+      len = r->prefixlen;
+      e->mask_mask.s_addr = 0;
+      if (random () % 2)
+	e->mask_mask.s_addr = netmask (len) & ~netmask (len - random () % 4);
+      e->mask.s_addr = netmask (len) & ~e->mask_mask.s_addr;
+      /* Fall through. */
+    case ENTRY_STANDARD:
+      /* Wildcards are contiguous but for a few. */
+      len = 8 + random () % 25;
+      e->addr_mask.s_addr = ~netmask (len);
+      if (random () % 8 == 0)
+	e->addr_mask.s_addr |= htonl (0x00ff0000);
+      e->addr.s_addr = r->u.prefix4.s_addr & ~e->addr_mask.s_addr;
+      break;
+    }
+}
+
+/* What the configuration commands would refuse as a duplicate. */
+static int
+entry_same (struct entry *a, struct entry *b)
+{
+  if (a->kind != b->kind || a->permit != b->permit)
+    return 0;
+  if (a->kind == ENTRY_ZEBRA)
+    return a->exact == b->exact && prefix_same (&a->p, &b->p);
+  if (a->addr.s_addr != b->addr.s_addr
+      || a->addr_mask.s_addr != b->addr_mask.s_addr)
+    return 0;
+  return a->kind == ENTRY_STANDARD
+	 || (a->mask.s_addr == b->mask.s_addr
+	     && a->mask_mask.s_addr == b->mask_mask.s_addr);
+}
+
+static int
+entry_match (struct entry *e, struct prefix *p)
+{
+  if (e->kind == ENTRY_ZEBRA)
+    {
+      if (e->exact && e->p.prefixlen != p->prefixlen)
+	return 0;
+      return prefix_match (&e->p, p);
+    }
+  if ((p->u.prefix4.s_addr & ~e->addr_mask.s_addr) != e->addr.s_addr)
+    return 0;
+  return e->kind == ENTRY_STANDARD
+	 || (netmask (p->prefixlen) & ~e->mask_mask.s_addr) == e->mask.s_addr;
+}
+
+/* What walking the filters in order decides. */
+static enum filter_type
+linear_apply (struct entry *e, int n, struct prefix *p)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (entry_match (&e[i], p))
+      return e[i].permit ? FILTER_PERMIT : FILTER_DENY;
+  return FILTER_DENY;
+}
+
+static void
+config (const char *format, ...)
+{
+  char line[256];
+  va_list args;
+  vector vline;
+  int ret;
+
+  va_start (args, format);
+  vsnprintf (line, sizeof (line), format, args);
+  va_end (args);
+
+  vline = cmd_make_strvec (line);
+  vty->node = CONFIG_NODE;
+  ret = cmd_execute_command (vline, vty, NULL, 0);
+  cmd_free_strvec (vline);
+  if (ret != CMD_SUCCESS)
+    {
+      printf ("\"%s\" failed: %d\n", line, ret);
+      exit (1);
+    }
+}
+
+/* Add, or with SET 0 delete, filter E of list NAME. */
+static void
+entry_config (const char *name, struct entry *e, int set)
+{
+  char addr[INET_ADDRSTRLEN], addr_mask[INET_ADDRSTRLEN];
+  char mask[INET_ADDRSTRLEN], mask_mask[INET_ADDRSTRLEN];
+  const char *no = set ? "" : "no ";
+  const char *type = e->permit ? "permit" : "deny";
+
+  switch (e->kind)
+    {
+    case ENTRY_ZEBRA:
+      inet_ntop (AF_INET, &e->p.u.prefix4, addr, sizeof (addr));
+      config ("%saccess-list %s %s %s/%d%s", no, name, type, addr,
+	      e->p.prefixlen, e->exact ? " exact-match" : "");
+      break;
+    case ENTRY_STANDARD:
+      inet_ntop (AF_INET, &e->addr, addr, sizeof (addr));
+      inet_ntop (AF_INET, &e->addr_mask, addr_mask, sizeof (addr_mask));
+      config ("%saccess-list %s %s %s %s", no, name, type, addr, addr_mask);
+      break;
+    case ENTRY_EXTENDED:
+      inet_ntop (AF_INET, &e->addr, addr, sizeof (addr));
+      inet_ntop (AF_INET, &e->addr_mask, addr_mask, sizeof (addr_mask));
+      inet_ntop (AF_INET, &e->mask, mask, sizeof (mask));
+      inet_ntop (AF_INET, &e->mask_mask, mask_mask, sizeof (mask_mask));
+      config ("%saccess-list %s %s ip %s %s %s %s", no, name, type, addr,
+	      addr_mask, mask, mask_mask);
+      break;
+    }
+}
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+/* Apply list NAME to every route, and compare with walking ENTRIES. */
+static void
+check (const char *name, const char *step, struct entry *entries,
+       int nentries, struct prefix *routes, int nroutes)
+{
+  struct access_list *access;
+  struct timeval start;
+  enum filter_type *result;
+  unsigned long usec, permitted;
+  int i;
+
+  result = calloc (nroutes, sizeof (enum filter_type));
+  assert (result);
+
+  access = access_list_lookup (AFI_IP, name);
+  assert (access);
+
+  permitted = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < nroutes; i++)
+    {
+      result[i] = access_list_apply (access, &routes[i]);
+      permitted += (result[i] == FILTER_PERMIT);
+    }
+  usec = usec_since (&start);
+
+  for (i = 0; i < nroutes; i++)
+    if (linear_apply (entries, nentries, &routes[i]) != result[i])
+      {
+	printf ("%s, %s: %s/%d is %s, in order %s\n", name, step,
+		inet_ntoa (routes[i].u.prefix4), routes[i].prefixlen,
+		result[i] == FILTER_PERMIT ? "permitted" : "denied",
+		result[i] == FILTER_PERMIT ? "denied" : "permitted");
+	exit (1);
+      }
+
+  printf ("%s, %s: %d filters, %lu of %d routes permitted, %lu ns each, "
+	  "as in order\n", name, step, nentries, permitted, nroutes,
+	  usec * 1000 / nroutes);
+  free (result);
+}
+
+/* Fill list NAME with filters of KIND, then delete every other one,
+   and add those back at the end. */
+static void
+bench (const char *name, enum entry_kind kind, int nentries,
+       struct prefix *routes, int nroutes)
+{
+  struct entry *entries, *deleted;
+  int i, n, ndeleted;
+
+  entries = calloc (nentries, sizeof (struct entry));
+  deleted = calloc (nentries, sizeof (struct entry));
+  assert (entries && deleted);
+
+  /* Duplicates are refused; keep the filters as added. */
+  for (n = 0, i = 0; i < nentries; i++)
+    {
+      struct entry *e = &entries[n];
+      int j;
+
+      random_entry (e, kind, &routes[random () % nroutes]);
+      for (j = 0; j < n; j++)
+	if (entry_same (&entries[j], e))
+	  break;
+      entry_config (name, e, 1);
+      if (j == n)
+	n++;
+    }
+  nentries = n;
+  check (name, "added", entries, nentries, routes, nroutes);
+
+  for (n = 0, ndeleted = 0, i = 0; i < nentries; i++)
+    if (i % 2)
+      entries[n++] = entries[i];
+    else
+      {
+	entry_config (name, &entries[i], 0);
+	deleted[ndeleted++] = entries[i];
+      }
+  nentries = n;
+  check (name, "deleted", entries, nentries, routes, nroutes);
+
+  for (i = 0; i < ndeleted; i++)
+    {
+      entry_config (name, &deleted[i], 1);
+      entries[nentries++] = deleted[i];
+    }
+  check (name, "added back", entries, nentries, routes, nroutes);
+
+  /* Deleting them all deletes the list. */
+  for (i = 0; i < nentries; i++)
+    entry_config (name, &entries[i], 0);
+  assert (access_list_lookup (AFI_IP, name) == NULL);
+  printf ("%s: deleted\n", name);
+
+  free (entries);
+  free (deleted);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prefix *routes;
+  int i, nentries = ENTRIES, nroutes = ROUTES;
+
+  if (argc > 1)
+    nentries = atoi (argv[1]);
+  if (argc > 2)
+    nroutes = atoi (argv[2]);
+
+  master = thread_master_create ();
+  cmd_init (1);
+  access_list_init ();
+  vty = vty_new ();
+  vty->type = VTY_TERM;
+
+  srandom (1);
+  routes = calloc (nroutes, sizeof (struct prefix));
+  assert (routes);
+  for (i = 0; i < nroutes; i++)
+    random_prefix (&routes[i]);
+
+  bench ("zebra", ENTRY_ZEBRA, nentries, routes, nroutes);
+  bench ("1", ENTRY_STANDARD, nentries, routes, nroutes);
+  bench ("101", ENTRY_EXTENDED, nentries, routes, nroutes);
+
+  free (routes);
+  return 0;
+}
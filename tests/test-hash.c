@@ -0,0 +1,230 @@
+/*
+ * Test program which checks and times the chained and the open
+ * addressing variants of lib/hash.c, with keys shaped like interned
+ * AS paths and attributes, reporting the slowest single insert as
+ * well as the totals, since that is where the chained hash's
+ * expansion shows.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "hash.h"
+#include "jhash.h"
+#include "thread.h"
+
+#define KEYS 1000000
+
+struct thread_master *master;
+
+/* Like an AS path: a few ASes, most paths short. */
+struct path_key
+{
+  unsigned int len;
+  u_int32_t as[10];
+};
+
+static unsigned int
+path_key_make (const void *p)
+{
+  const struct path_key *k = p;
+
+  return jhash2 (k->as, k->len, 0x1234567);
+}
+
+static int
+path_cmp (const void *p1, const void *p2)
+{
+  const struct path_key *k1 = p1, *k2 = p2;
+
+  return k1->len == k2->len
+	 && ! memcmp (k1->as, k2->as, k1->len * sizeof (u_int32_t));
+}
+
+/* Like an attribute: a few words, and pointers to interned parts. */
+struct attr_key
+{
+  u_int32_t nexthop;
+  u_int32_t med;
+  u_int32_t local_pref;
+  u_int32_t origin;
+  void *aspath;
+  void *community;
+};
+
+static unsigned int
+attr_key_make (const void *p)
+{
+  const struct attr_key *k = p;
+  unsigned int key;
+
+  key = jhash_3words (k->nexthop, k->med, k->local_pref, k->origin);
+  return jhash_2words ((uintptr_t) k->aspath, (uintptr_t) k->community, key);
+}
+
+static int
+attr_cmp (const void *p1, const void *p2)
+{
+  return ! memcmp (p1, p2, sizeof (struct attr_key));
+}
+
+static void *
+key_intern (const void *p)
+{
+  return (void *) p;
+}
+
+static void
+count_entry (struct hash_backet *hb, void *arg)
+{
+  (*(unsigned long *) arg)++;
+}
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+static void
+bench (const char *name, int open, void **keys, unsigned long nkeys,
+       unsigned int (*hash_key) (const void *),
+       int (*hash_cmp) (const void *, const void *))
+{
+  struct hash *hash;
+  struct timeval start, op;
+  void **found;
+  unsigned long i, count, worst, usec;
+
+  found = calloc (nkeys, sizeof (void *));
+  assert (found);
+
+  if (open)
+    hash = hash_create_open (HASH_INITIAL_SIZE, hash_key, hash_cmp);
+  else
+    hash = hash_create (hash_key, hash_cmp);
+
+  /* Duplicate keys intern to the first of them. */
+  worst = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < nkeys; i++)
+    {
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &op);
+      found[i] = hash_get (hash, keys[i], key_intern);
+      usec = usec_since (&op);
+      worst = MAX (worst, usec);
+    }
+  usec = usec_since (&start);
+  printf ("%s: %lu inserts: %lu ms, slowest %lu us, %lu entries\n",
+	  name, nkeys, usec / 1000, worst, hash->count);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < nkeys; i++)
+    {
+      void *data = hash_lookup (hash, keys[i]);
+      assert (data == found[i]);
+    }
+  printf ("%s: %lu lookups: %lu ms\n", name, nkeys,
+	  usec_since (&start) / 1000);
+
+  /* Release every other entry, and look them all up again. */
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < nkeys; i += 2)
+    if (found[i] == keys[i])
+      {
+	void *data = hash_release (hash, keys[i]);
+	assert (data == keys[i]);
+      }
+  printf ("%s: releases: %lu ms, %lu entries left\n", name,
+	  usec_since (&start) / 1000, hash->count);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < nkeys; i++)
+    {
+      void *data = hash_lookup (hash, keys[i]);
+      assert (data == NULL || data == found[i]);
+      if (found[i] == keys[i])
+	assert ((data != NULL) == (i % 2));
+    }
+  printf ("%s: %lu lookups, half missing: %lu ms\n", name, nkeys,
+	  usec_since (&start) / 1000);
+
+  count = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  hash_iterate (hash, count_entry, &count);
+  assert (count == hash->count);
+  printf ("%s: iterate: %lu ms\n", name, usec_since (&start) / 1000);
+
+  hash_clean (hash, NULL);
+  assert (hash->count == 0);
+  hash_free (hash);
+  free (found);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct path_key *paths;
+  struct attr_key *attrs;
+  void **keys;
+  unsigned long i, j, nkeys = KEYS;
+
+  if (argc > 1)
+    nkeys = strtoul (argv[1], NULL, 10);
+
+  srandom (1);
+  paths = calloc (nkeys, sizeof (struct path_key));
+  attrs = calloc (nkeys, sizeof (struct attr_key));
+  keys = calloc (nkeys, sizeof (void *));
+  assert (paths && attrs && keys);
+
+  for (i = 0; i < nkeys; i++)
+    {
+      paths[i].len = 1 + random () % 4 + (random () % 4 ? 0 : random () % 6);
+      for (j = 0; j < paths[i].len; j++)
+	paths[i].as[j] = random () % 4 ? random () % 65536 : random ();
+    }
+
+  for (i = 0; i < nkeys; i++)
+    {
+      attrs[i].nexthop = random () % 64;
+      attrs[i].med = random () % 4 ? 0 : random ();
+      attrs[i].local_pref = 100;
+      attrs[i].origin = random () % 3;
+      attrs[i].aspath = &paths[random () % nkeys];
+      attrs[i].community = random () % 2 ? NULL : &paths[random () % 1000];
+    }
+
+  for (i = 0; i < nkeys; i++)
+    keys[i] = &paths[i];
+  bench ("aspath, chained", 0, keys, nkeys, path_key_make, path_cmp);
+  bench ("aspath, open", 1, keys, nkeys, path_key_make, path_cmp);
+
+  for (i = 0; i < nkeys; i++)
+    keys[i] = &attrs[i];
+  bench ("attr, chained", 0, keys, nkeys, attr_key_make, attr_cmp);
+  bench ("attr, open", 1, keys, nkeys, attr_key_make, attr_cmp);
+
+  free (paths);
+  free (attrs);
+  free (keys);
+  return 0;
+}
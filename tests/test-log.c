@@ -0,0 +1,127 @@
+/*
+ * Test program which measures how many messages a second can be
+ * logged to a file, written by the logging thread itself and handed to
+ * the asynchronous writer, and checks that every message either got to
+ * the file or was counted as dropped.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "log.h"
+#include "thread.h"
+
+#define MESSAGES 200000
+
+struct thread_master *master;
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+static unsigned long
+count_lines (const char *path)
+{
+  FILE *fp;
+  unsigned long lines = 0;
+  int c;
+
+  fp = fopen (path, "r");
+  assert (fp);
+  while ((c = getc (fp)) != EOF)
+    lines += (c == '\n');
+  fclose (fp);
+  return lines;
+}
+
+/* Log like "debug bgp updates" does, a line per prefix. */
+static void
+bench (const char *name, const char *path, unsigned long messages,
+       int async, int pace)
+{
+  struct timeval start;
+  unsigned long i, usec, lines, written, dropped, dropped0;
+
+  unlink (path);
+  zlog_set_file (NULL, path, LOG_DEBUG);
+  zlog_set_async (NULL, async);
+  zlog_async_stats (&written, &dropped0);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < messages; i++)
+    {
+      zlog_debug ("10.0.0.%lu rcvd UPDATE w/ attr: nexthop 10.0.0.1, "
+		  "origin i, path 65001 %lu 3356", i % 256, i % 65536);
+      zlog_debug ("10.0.0.%lu rcvd 10.%lu.%lu.0/24", i % 256,
+		  (i >> 8) % 256, i % 256);
+      if (pace && i % pace == 0)
+	usleep (100);
+    }
+  usec = usec_since (&start);
+  zlog_async_flush ();
+  zlog_async_stats (&written, &dropped);
+  dropped -= dropped0;
+
+  printf ("%s: %lu messages in %lu ms, %lu per second for the caller",
+	  name, 2 * messages, usec / 1000,
+	  (unsigned long) (2 * messages * 1000000.0 / usec));
+  if (async)
+    printf (", %lu per second written, %lu dropped",
+	    (unsigned long) ((2 * messages - dropped) * 1000000.0
+			     / usec_since (&start)), dropped);
+  printf ("\n");
+
+  zlog_set_async (NULL, 0);
+  zlog_reset_file (NULL);
+
+  /* The drops are noted in a line of their own, each batch. */
+  lines = count_lines (path);
+  assert (lines >= 2 * messages - dropped);
+  assert (dropped || lines == 2 * messages);
+  unlink (path);
+}
+
+int
+main (int argc, char **argv)
+{
+  char path[] = "/tmp/test-log.XXXXXX";
+  unsigned long messages = MESSAGES;
+  int fd;
+
+  if (argc > 1)
+    messages = strtoul (argv[1], NULL, 10);
+
+  fd = mkstemp (path);
+  assert (fd >= 0);
+  close (fd);
+
+  zlog_default = openzlog ("test-log", ZLOG_NONE, LOG_NDELAY, LOG_DAEMON);
+  zlog_set_level (NULL, ZLOG_DEST_MONITOR, ZLOG_DISABLED);
+
+  bench ("synchronous", path, messages, 0, 0);
+  bench ("asynchronous", path, messages, 1, 0);
+  bench ("asynchronous, paced", path, messages, 1, 100);
+
+  closezlog (zlog_default);
+  return 0;
+}
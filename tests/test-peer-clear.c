@@ -0,0 +1,208 @@
+/*
+ * Test program which fills a table the size of the Internet's with
+ * paths from the peers of a route server, each of which sends only a
+ * small part of it and is sent some, then takes sessions down and
+ * times finding the nodes with something of theirs to clear, checking
+ * that it finds exactly those, and then clearing them.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "vty.h"
+#include "memory.h"
+#include "thread.h"
+#include "privs.h"
+#include "prefix.h"
+#include "linklist.h"
+#include "workqueue.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+#include "bgpd/bgp_fsm.h"
+
+#define PEERS    200
+#define PREFIXES 500000
+#define PATHS    4
+#define SENT     3
+#define DOWN     20
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct peer *peers[PEERS];
+static unsigned long routes[PEERS];
+static unsigned long sent[PEERS];
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+/* The peers taken down are Idle, and the paths they had gone.  */
+static int
+cleared (void)
+{
+  struct work_queue *wq = bm->process_main_queue;
+  int p;
+
+  for (p = 0; p < DOWN; p++)
+    if (peers[p]->status != Idle)
+      return 0;
+  return ! wq || (! wq->thread && listcount (wq->items) == 0);
+}
+
+/* A few peers send most of the table, the rest a little of it each.  */
+static int
+random_peer (void)
+{
+  if (random () % 2)
+    return random () % 4;
+  return 4 + random () % (PEERS - 4);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct bgp *bgp;
+  struct bgp_table *table;
+  struct timeval start;
+  struct attr attr;
+  as_t asn = 100;
+  unsigned long usec, bytes, queued = 0, paths = 0, adjs = 0;
+  int n, p, i, prefixes = PREFIXES;
+
+  if (argc > 1)
+    prefixes = atoi (argv[1]);
+
+  bgp_master_init ();
+  master = bm->master;
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+  if (bgp_get (&bgp, &asn, NULL))
+    return 1;
+  table = bgp->rib[AFI_IP][SAFI_UNICAST];
+  bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+
+  for (p = 0; p < PEERS; p++)
+    {
+      peers[p] = peer_create_accept (bgp);
+      peers[p]->status = Established;
+      peers[p]->host = XSTRDUP (MTYPE_BGP_PEER_HOST, "test");
+    }
+
+  srandom (1);
+  for (n = 0; n < prefixes; n++)
+    {
+      struct bgp_node *rn;
+      struct prefix p4;
+
+      memset (&p4, 0, sizeof (p4));
+      p4.family = AF_INET;
+      p4.prefixlen = 24;
+      p4.u.prefix4.s_addr = htonl (0x01000000 + (n << 8));
+      rn = bgp_node_get (table, &p4);
+
+      for (i = 0; i < 1 + (int) (random () % PATHS); i++)
+	{
+	  struct bgp_info *ri, *ri2;
+
+	  p = random_peer ();
+	  for (ri2 = rn->info; ri2; ri2 = ri2->next)
+	    if (ri2->peer == peers[p])
+	      break;
+	  if (ri2)
+	    continue;
+
+	  ri = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+	  ri->peer = peers[p];
+	  bgp_info_add (rn, ri);
+	  routes[p]++;
+	  paths++;
+	}
+
+      /* Nodes already sent to the peer stay in its Adj-RIB-Out.  */
+      for (i = 0; i < SENT; i++)
+	{
+	  p = random_peer ();
+	  if (bgp_adj_out_get (rn, peers[p]))
+	    continue;
+	  bgp_adj_out_set (rn, peers[p], &rn->p, &attr, AFI_IP, SAFI_UNICAST,
+			   rn->info);
+	  sent[p]++;
+	  adjs++;
+	}
+      bgp_unlock_node (rn);
+    }
+  bgp_peer_bits_count (&bytes);
+  printf ("%d prefixes, %lu paths from %d peers and %lu sent to them, "
+	  "%lu bytes of bitmaps a node\n", prefixes, paths, PEERS, adjs,
+	  bytes / prefixes);
+
+  /* Take sessions down, the big ones first.  */
+  for (p = 0; p < DOWN; p++)
+    {
+      if (p == 0 || p == 4)
+	{
+	  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+	  queued = 0;
+	}
+      bgp_fsm_change_status (peers[p], Clearing);
+      assert (peers[p]->clear_node_queue->items->count == routes[p]);
+      queued += routes[p];
+      if (p == 3 || p == DOWN - 1)
+	{
+	  int down = p == 3 ? 4 : DOWN - 4;
+
+	  usec = usec_since (&start);
+	  printf ("%2d %s peers down: %6lu nodes queued in %4lu ms, "
+		  "%3lu ms a peer\n", down, p == 3 ? "big" : "small",
+		  queued, usec / 1000, usec / 1000 / down);
+	}
+    }
+
+  /* Clear them, and check nothing of theirs is left.  */
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  while (! cleared ())
+    {
+      struct thread thread;
+
+      if (thread_fetch (master, &thread))
+	thread_call (&thread);
+    }
+  usec = usec_since (&start);
+  for (p = 0; p < DOWN; p++)
+    {
+      assert (peers[p]->paths[AFI_IP][SAFI_UNICAST] == NULL);
+      assert (peers[p]->adjcount[AFI_IP][SAFI_UNICAST] == 0);
+      adjs -= sent[p];
+    }
+  for (p = DOWN; p < PEERS; p++)
+    assert (peers[p]->adjcount[AFI_IP][SAFI_UNICAST] == sent[p]);
+  assert (bgp_adj_out_count (NULL) == adjs);
+  printf ("%2d peers cleared in %4lu ms\n", DOWN, usec / 1000);
+  return 0;
+}
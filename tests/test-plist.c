@@ -0,0 +1,246 @@
+/*
+ * Test program which applies a large prefix-list to a table the size
+ * of the Internet's, and checks what it decides against a plain walk
+ * of the entries in sequence order, which it also times on a sample.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+
+#include "command.h"
+#include "memory.h"
+#include "prefix.h"
+#include "plist.h"
+#include "thread.h"
+
+#define ENTRIES 60000
+#define ROUTES  800000
+#define SAMPLE  5000
+
+struct thread_master *master;
+
+struct entry
+{
+  struct orf_prefix orf;
+  int permit;
+};
+
+static u_int32_t
+rand32 (void)
+{
+  return ((u_int32_t) random () << 16) ^ (u_int32_t) random ();
+}
+
+/* Mostly /24s, some shorter, like a full table. */
+static void
+random_prefix (struct prefix *p)
+{
+  static const u_char lens[] = { 24, 24, 24, 24, 24, 24, 23, 22, 22, 21,
+				 20, 19, 18, 17, 16, 16, 12, 8 };
+
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = lens[random () % array_size (lens)];
+  p->u.prefix4.s_addr = htonl (rand32 ());
+  apply_mask (p);
+}
+
+/* What walking the entries in sequence order decides. */
+static enum prefix_list_type
+linear_apply (struct entry *e, int n, struct prefix *p)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      if (! prefix_match (&e[i].orf.p, p))
+	continue;
+      if (! e[i].orf.le && ! e[i].orf.ge)
+	{
+	  if (e[i].orf.p.prefixlen != p->prefixlen)
+	    continue;
+	}
+      else
+	{
+	  if (e[i].orf.le && p->prefixlen > e[i].orf.le)
+	    continue;
+	  if (e[i].orf.ge && p->prefixlen < e[i].orf.ge)
+	    continue;
+	}
+      return e[i].permit ? PREFIX_PERMIT : PREFIX_DENY;
+    }
+  return PREFIX_DENY;
+}
+
+static unsigned long
+usec_since (struct timeval *start)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return timeval_elapsed (now, *start);
+}
+
+/* Entries are kept as written, host bits and all, and two that only
+   differ there are not the same entry. */
+static void
+host_bits_check (void)
+{
+  struct prefix_list *plist;
+  struct orf_prefix a, b;
+  char name[] = "host-bits";
+
+  memset (&a, 0, sizeof (a));
+  memset (&b, 0, sizeof (b));
+  a.seq = b.seq = -1;
+  str2prefix ("10.1.1.1/8", &a.p);
+  str2prefix ("10.2.2.2/8", &b.p);
+
+  assert (prefix_bgp_orf_set (name, AFI_IP, &a, 1, 1) == CMD_SUCCESS);
+  assert (prefix_bgp_orf_set (name, AFI_IP, &b, 1, 1) == CMD_SUCCESS);
+  plist = prefix_list_lookup (AFI_ORF_PREFIX, name);
+  assert (plist && plist->count == 2);
+
+  /* Deleting one leaves the other, which only it deletes. */
+  assert (prefix_bgp_orf_set (name, AFI_IP, &b, 1, 0) == CMD_SUCCESS);
+  assert (plist->count == 1);
+  assert (prefix_bgp_orf_set (name, AFI_IP, &b, 1, 0) != CMD_SUCCESS);
+  assert (prefix_bgp_orf_set (name, AFI_IP, &a, 1, 0) == CMD_SUCCESS);
+  printf ("entries differing in host bits kept apart\n");
+
+  prefix_bgp_orf_remove_all (name);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prefix_list *plist;
+  struct prefix *routes;
+  struct entry *entries;
+  struct timeval start;
+  enum prefix_list_type *result;
+  unsigned long i, usec, permitted;
+  int n, nentries = ENTRIES, nroutes = ROUTES;
+  char name[] = "bench";
+
+  if (argc > 1)
+    nentries = atoi (argv[1]);
+  if (argc > 2)
+    nroutes = atoi (argv[2]);
+
+  srandom (1);
+  routes = calloc (nroutes, sizeof (struct prefix));
+  entries = calloc (nentries, sizeof (struct entry));
+  result = calloc (nroutes, sizeof (enum prefix_list_type));
+  assert (routes && entries && result);
+
+  for (i = 0; i < (unsigned long) nroutes; i++)
+    random_prefix (&routes[i]);
+
+  /* Customer routes: some exact, most a covering block "le 24", and
+     a few more specifics denied ahead of them. */
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (n = 0; n < nentries; n++)
+    {
+      struct entry *e = &entries[n];
+
+      e->orf.seq = 5 * (n + 1);
+      e->permit = 1;
+      e->orf.p = routes[random () % nroutes];
+      switch (random () % 8)
+	{
+	case 0:
+	case 1:
+	  break;
+	case 2:
+	  e->permit = 0;
+	  e->orf.le = 32;
+	  if (e->orf.p.prefixlen == 32)
+	    e->orf.le = 0;
+	  break;
+	default:
+	  if (e->orf.p.prefixlen > 12)
+	    {
+	      e->orf.p.prefixlen -= random () % 4;
+	      apply_mask (&e->orf.p);
+	    }
+	  e->orf.le = 24;
+	  if (e->orf.p.prefixlen >= 24)
+	    e->orf.le = 0;
+	  break;
+	}
+
+      /* Duplicates are refused; keep the entries as added. */
+      if (prefix_bgp_orf_set (name, AFI_IP, &e->orf, e->permit, 1)
+	  != CMD_SUCCESS)
+	{
+	  n--;
+	  nentries--;
+	}
+    }
+  printf ("%d entries added in %lu ms\n", nentries,
+	  usec_since (&start) / 1000);
+
+  plist = prefix_list_lookup (AFI_ORF_PREFIX, name);
+  assert (plist && plist->count == nentries);
+
+  permitted = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < (unsigned long) nroutes; i++)
+    {
+      result[i] = prefix_list_apply (plist, &routes[i]);
+      permitted += result[i] == PREFIX_PERMIT;
+    }
+  usec = usec_since (&start);
+  printf ("%d routes applied in %lu ms, %lu ns each, %lu permitted\n",
+	  nroutes, usec / 1000, usec * 1000 / nroutes, permitted);
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < SAMPLE && i < (unsigned long) nroutes; i++)
+    assert (linear_apply (entries, nentries, &routes[i]) == result[i]);
+  usec = usec_since (&start);
+  printf ("walking the entries in order would take %lu ns each\n",
+	  usec * 1000 / i);
+
+  /* Remove every other entry, and check again. */
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (n = 0; n < nentries; n += 2)
+    {
+      int ret = prefix_bgp_orf_set (name, AFI_IP, &entries[n].orf,
+				    entries[n].permit, 0);
+      assert (ret == CMD_SUCCESS);
+    }
+  for (n = 0; n < nentries / 2; n++)
+    entries[n] = entries[2 * n + 1];
+  nentries /= 2;
+  assert (plist->count == nentries);
+  printf ("%d entries removed in %lu ms\n", nentries,
+	  usec_since (&start) / 1000);
+
+  for (i = 0; i < SAMPLE && i < (unsigned long) nroutes; i++)
+    assert (linear_apply (entries, nentries, &routes[i])
+	    == prefix_list_apply (plist, &routes[i]));
+
+  prefix_bgp_orf_remove_all (name);
+  host_bits_check ();
+
+  free (routes);
+  free (entries);
+  free (result);
+  return 0;
+}
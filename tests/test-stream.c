@@ -52,7 +52,13 @@ print_stream (struct stream *s)
 int
 main (void)
 {
-  struct stream *s;
+  struct stream *s, *t;
+  struct stream_fifo *fifo, *done;
+  u_char buf[64];
+  int fds[2];
+  ssize_t nbytes;
+  size_t total, accounted;
+  int i;
   
   s = stream_new (1024);
   
@@ -72,5 +78,53 @@ main (void)
   printf ("l: 0x%x\n", stream_getl (s));
   printf ("q: 0x%lx\n", stream_getq (s));
   
+  /* A shared stream reads the same data with a getp of its own, and
+     keeps it after the original is gone. */
+  t = stream_share (s);
+  stream_set_getp (t, 0);
+  stream_free (s);
+  print_stream (t);
+
+  /* Write several streams, shared or not, with one writev. */
+  fifo = stream_fifo_new ();
+  stream_fifo_push (fifo, stream_share (t));
+  s = stream_new (4);
+  stream_putl (s, 0xcafef00d);
+  stream_fifo_push (fifo, s);
+  stream_fifo_push (fifo, t);
+
+  if (pipe (fds) < 0)
+    return 1;
+  nbytes = stream_fifo_writev (fifo, fds[1], STREAM_WRITEV_MAX, NULL);
+  printf ("writev: %ld, left: %lu\n", (long) nbytes,
+          (unsigned long) fifo->count);
+  nbytes = read (fds[0], buf, sizeof (buf));
+  printf ("read: %ld, 0x%x 0x%x 0x%x\n", (long) nbytes,
+          buf[14], buf[15], buf[18]);
+  stream_fifo_free (fifo);
+
+  /* Until the pipe is full: what went out must be accounted for
+     exactly, the last stream written only in part. */
+  fifo = stream_fifo_new ();
+  done = stream_fifo_new ();
+  for (i = 0; i < 32; i++)
+    {
+      s = stream_new (20000);
+      stream_put (s, NULL, 20000);
+      stream_fifo_push (fifo, s);
+    }
+  fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL) | O_NONBLOCK);
+  total = 0;
+  while ((nbytes = stream_fifo_writev (fifo, fds[1], 4, done)) > 0)
+    total += nbytes;
+  accounted = done->count * 20000;
+  if (stream_fifo_head (fifo))
+    accounted += stream_get_getp (stream_fifo_head (fifo));
+  printf ("partial: %s\n",
+          (total == accounted && fifo->count + done->count == 32
+           && errno == EAGAIN) ? "ok" : "wrong");
+  stream_fifo_free (fifo);
+  stream_fifo_free (done);
+
   return 0;
 }
@@ -0,0 +1,158 @@
+/*
+ * Test program which measures what it costs the thread library to
+ * wake up for one ready fd while thousands of others are idle, with
+ * each of its I/O multiplexers.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+#include <sys/resource.h>
+
+#include "thread.h"
+
+#define IDLE_FDS 4000
+#define WAKEUPS  100000
+
+struct thread_master *master;
+
+static int active[2];
+static unsigned long woken;
+
+static int
+idle_read (struct thread *thread)
+{
+  /* Nobody writes to these. */
+  assert (0);
+  return 0;
+}
+
+static int
+active_read (struct thread *thread)
+{
+  char c;
+  ssize_t n;
+
+  n = read (THREAD_FD (thread), &c, 1);
+  assert (n == 1);
+  woken++;
+
+  thread_add_read (master, active_read, NULL, THREAD_FD (thread));
+  n = write (active[1], &c, 1);
+  assert (n == 1);
+  return 0;
+}
+
+static void
+bench (int io, const char *name, int nidle, unsigned long wakeups)
+{
+  struct thread **idle;
+  struct thread thread;
+  struct timeval start, stop;
+  unsigned long msec;
+  int *fds;
+  int i, sv[2];
+  ssize_t n;
+
+  master = thread_master_create ();
+  if (thread_master_set_io (master, io) < 0)
+    {
+      printf ("%s: not available\n", name);
+      thread_master_free (master);
+      return;
+    }
+
+  idle = calloc (nidle, sizeof (struct thread *));
+  fds = calloc (nidle, 2 * sizeof (int));
+  assert (idle && fds);
+
+  /* select can only watch fds below FD_SETSIZE. */
+  for (i = 0; i < nidle; i++)
+    {
+      if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+	break;
+      if (io == THREAD_IO_SELECT && sv[1] >= FD_SETSIZE - 8)
+	{
+	  close (sv[0]);
+	  close (sv[1]);
+	  break;
+	}
+      fds[2 * i] = sv[0];
+      fds[2 * i + 1] = sv[1];
+      idle[i] = thread_add_read (master, idle_read, NULL, sv[1]);
+      assert (idle[i]);
+    }
+  nidle = i;
+
+  i = pipe (active);
+  assert (i == 0);
+  thread_add_read (master, active_read, NULL, active[0]);
+  n = write (active[1], "x", 1);
+  assert (n == 1);
+
+  woken = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  while (woken < wakeups && thread_fetch (master, &thread))
+    thread_call (&thread);
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &stop);
+
+  assert (woken == wakeups);
+  msec = timeval_elapsed (stop, start) / 1000;
+  printf ("%s: %lu wakeups with %d idle fds took %lu.%03lu seconds, "
+	  "%lu ns each.\n", name, wakeups, nidle, msec / 1000, msec % 1000,
+	  msec * 1000000 / wakeups);
+
+  for (i = 0; i < nidle; i++)
+    {
+      thread_cancel (idle[i]);
+      close (fds[2 * i]);
+      close (fds[2 * i + 1]);
+    }
+  close (active[0]);
+  close (active[1]);
+  free (idle);
+  free (fds);
+  thread_master_free (master);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct rlimit rl;
+  int nidle = IDLE_FDS;
+  unsigned long wakeups = WAKEUPS;
+
+  if (argc > 1)
+    nidle = atoi (argv[1]);
+  if (argc > 2)
+    wakeups = strtoul (argv[2], NULL, 10);
+
+  /* Two fds per idle socket pair. */
+  if (getrlimit (RLIMIT_NOFILE, &rl) == 0
+      && rl.rlim_cur < (rlim_t) 2 * nidle + 64)
+    {
+      rl.rlim_cur = MIN (rl.rlim_max, (rlim_t) 2 * nidle + 64);
+      setrlimit (RLIMIT_NOFILE, &rl);
+      nidle = MIN ((rlim_t) nidle, (rl.rlim_cur - 64) / 2);
+    }
+
+  bench (THREAD_IO_SELECT, "select", nidle, wakeups);
+  bench (THREAD_IO_EPOLL, "epoll", nidle, wakeups);
+
+  fflush (stdout);
+  return 0;
+}
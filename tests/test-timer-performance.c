@@ -1,6 +1,6 @@
 /*
- * Test program which measures the time it takes to schedule and
- * remove timers.
+ * Test program which measures the time it takes to schedule, remove
+ * and run timers, in the timer heap and on the timer wheel.
  *
  * Copyright (C) 2013 by Open Source Routing.
  * Copyright (C) 2013 by Internet Systems Consortium, Inc. ("ISC")
@@ -36,22 +36,49 @@
 
 struct thread_master *master;
 
+static int expired;
+
 static int dummy_func(struct thread *thread)
 {
+  expired++;
   return 0;
 }
 
-int main(int argc, char **argv)
+static unsigned long msec_since(struct timeval *tv_start)
+{
+  struct timeval tv_stop;
+
+  quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_stop);
+  return timeval_elapsed(tv_stop, *tv_start) / 1000;
+}
+
+/* Time SCHEDULE_TIMERS timers of random length being added, then
+ * REMOVE_TIMERS of them cancelled, then SCHEDULE_TIMERS more due
+ * straight away being run.  Millisecond timers are always in the heap,
+ * timers of whole seconds are on the wheel if it is on. */
+static void bench(const char *name, int wheel, int msec)
 {
   struct prng *prng;
   int i;
   struct thread **timers;
-  struct timeval tv_start, tv_lap, tv_stop;
-  unsigned long t_schedule, t_remove;
+  long *intervals;
+  int *indexes;
+  struct thread t;
+  struct timeval tv_start;
+  unsigned long t_schedule, t_remove, t_expire;
 
   master = thread_master_create();
+  thread_master_set_timer_wheel(master, wheel);
   prng = prng_new(0);
   timers = calloc(SCHEDULE_TIMERS, sizeof(*timers));
+  intervals = calloc(SCHEDULE_TIMERS, sizeof(*intervals));
+  indexes = calloc(REMOVE_TIMERS, sizeof(*indexes));
+
+  /* the random numbers too */
+  for (i = 0; i < SCHEDULE_TIMERS; i++)
+    intervals[i] = prng_rand(prng) % (100 * SCHEDULE_TIMERS);
+  for (i = 0; i < REMOVE_TIMERS; i++)
+    indexes[i] = prng_rand(prng) % SCHEDULE_TIMERS;
 
   /* create thread structures so they won't be allocated during the
    * time measurement */
@@ -64,41 +91,65 @@ int main(int argc, char **argv)
 
   for (i = 0; i < SCHEDULE_TIMERS; i++)
     {
-      long interval_msec;
-
-      interval_msec = prng_rand(prng) % (100 * SCHEDULE_TIMERS);
-      timers[i] = thread_add_timer_msec(master, dummy_func,
-                                        NULL, interval_msec);
+      if (msec)
+        timers[i] = thread_add_timer_msec(master, dummy_func, NULL,
+                                          intervals[i]);
+      else
+        timers[i] = thread_add_timer(master, dummy_func, NULL,
+                                     intervals[i] / 1000);
     }
 
-  quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_lap);
+  t_schedule = msec_since(&tv_start);
+  quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_start);
 
   for (i = 0; i < REMOVE_TIMERS; i++)
     {
-      int index;
+      int index = indexes[i];
 
-      index = prng_rand(prng) % SCHEDULE_TIMERS;
       if (timers[index])
         thread_cancel(timers[index]);
       timers[index] = NULL;
     }
 
-  quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_stop);
+  t_remove = msec_since(&tv_start);
 
-  t_schedule = 1000 * (tv_lap.tv_sec - tv_start.tv_sec);
-  t_schedule += (tv_lap.tv_usec - tv_start.tv_usec) / 1000;
+  /* Make room for the ones to run. */
+  for (i = 0; i < SCHEDULE_TIMERS; i++)
+    if (timers[i])
+      thread_cancel(timers[i]);
 
-  t_remove = 1000 * (tv_stop.tv_sec - tv_lap.tv_sec);
-  t_remove += (tv_stop.tv_usec - tv_lap.tv_usec) / 1000;
+  quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_start);
 
-  printf("Scheduling %d random timers took %ld.%03ld seconds.\n",
-         SCHEDULE_TIMERS, t_schedule/1000, t_schedule%1000);
-  printf("Removing %d random timers took %ld.%03ld seconds.\n",
-         REMOVE_TIMERS, t_remove/1000, t_remove%1000);
+  expired = 0;
+  for (i = 0; i < SCHEDULE_TIMERS; i++)
+    if (msec)
+      thread_add_timer_msec(master, dummy_func, NULL, 0);
+    else
+      thread_add_timer(master, dummy_func, NULL, 0);
+  while (expired < SCHEDULE_TIMERS && thread_fetch(master, &t))
+    thread_call(&t);
+
+  t_expire = msec_since(&tv_start);
+
+  printf("%s: scheduling %d random timers took %ld.%03ld seconds.\n",
+         name, SCHEDULE_TIMERS, t_schedule/1000, t_schedule%1000);
+  printf("%s: removing %d random timers took %ld.%03ld seconds.\n",
+         name, REMOVE_TIMERS, t_remove/1000, t_remove%1000);
+  printf("%s: scheduling and running %d timers took %ld.%03ld seconds.\n",
+         name, SCHEDULE_TIMERS, t_expire/1000, t_expire%1000);
   fflush(stdout);
 
   free(timers);
+  free(intervals);
+  free(indexes);
   thread_master_free(master);
   prng_free(prng);
+}
+
+int main(int argc, char **argv)
+{
+  bench("Heap, msec", 0, 1);
+  bench("Heap, seconds", 0, 0);
+  bench("Wheel, seconds", 1, 0);
   return 0;
 }
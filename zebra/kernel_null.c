@@ -26,6 +26,7 @@
 
 #include "zebra/zserv.h"
 #include "zebra/rt.h"
+#include "zebra/rt_netlink.h"
 #include "zebra/redistribute.h"
 #include "zebra/connected.h"
 
@@ -70,3 +71,9 @@ void kernel_init (void) { return; }
 #else
 void route_read (void) { return; }
 #endif
+
+#ifdef HAVE_NETLINK
+int netlink_batch_available (void) { return 1; }
+void netlink_batch_flush (void) { return; }
+void netlink_batch_show (struct vty *vty) { return; }
+#endif /* HAVE_NETLINK */
@@ -40,6 +40,8 @@
 #include "zebra/irdp.h"
 #include "zebra/rtadv.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/zebra_rnh.h"
+#include "zebra/zebra_dplane.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -170,6 +172,7 @@ sigint (void)
 
   if (!retain_mode)
     rib_close ();
+  zebra_dplane_finish ();
 #ifdef HAVE_IRDP
   irdp_finish();
 #endif
@@ -322,6 +325,7 @@ main (int argc, char **argv)
   /* Zebra related initialize. */
   zebra_init ();
   rib_init ();
+  zebra_rnh_init ();
   zebra_if_init ();
   zebra_debug_init ();
   router_id_init();
@@ -383,6 +387,10 @@ main (int argc, char **argv)
   /* Output pid of zebra. */
   pid_output (pid_file);
 
+  /* Threads do not survive daemon(), start the dataplane thread now.
+     Route changes made until here went to the kernel inline. */
+  zebra_dplane_init (&zserv_privs);
+
   /* After we have successfully acquired the pidfile, we can be sure
   *  about being the only copy of zebra process, which is submitting
   *  changes to the FIB.
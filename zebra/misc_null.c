@@ -30,6 +30,9 @@ void ifstat_update_sysctl (void); // { return; }
 #include "zebra/irdp.h"
 #include "zebra/interface.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/rib.h"
+#include "zebra/zserv.h"
+#include "zebra/zebra_rnh.h"
 
 //void ifstat_update_proc (void) { return; }
 
@@ -48,3 +51,9 @@ zfpm_trigger_update (struct route_node *rn, const char *reason)
 {
   return;
 }
+
+void
+zebra_rnh_trigger (struct prefix *p)
+{
+  return;
+}
@@ -79,6 +79,9 @@ struct rib
   u_char nexthop_num;
   u_char nexthop_active_num;
   u_char nexthop_fib_num;
+
+  /* Last change handed to the dataplane thread, see zebra_dplane.c. */
+  u_int32_t dplane_seq;
 };
 
 /* meta-queue structure:
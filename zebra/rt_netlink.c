@@ -36,12 +36,15 @@
 #include "rib.h"
 #include "thread.h"
 #include "privs.h"
+#include "vty.h"
+#include "workqueue.h"
 
 #include "zebra/zserv.h"
 #include "zebra/rt.h"
 #include "zebra/redistribute.h"
 #include "zebra/interface.h"
 #include "zebra/debug.h"
+#include "zebra/zebra_dplane.h"
 
 #include "rt_netlink.h"
 
@@ -58,7 +61,8 @@ struct nlsock
   struct sockaddr_nl snl;
   const char *name;
 } netlink      = { -1, 0, {0}, "netlink-listen"},     /* kernel messages */
-  netlink_cmd  = { -1, 0, {0}, "netlink-cmd"};        /* command channel */
+  netlink_cmd  = { -1, 0, {0}, "netlink-cmd"},        /* command channel */
+  netlink_batch = { -1, 0, {0}, "netlink-batch"};     /* route changes */
 
 static const struct message nlmsg_str[] = {
   {RTM_NEWROUTE, "RTM_NEWROUTE"},
@@ -129,13 +133,13 @@ netlink_recvbuf (struct nlsock *nl, uint32_t newsize)
   /* Try force option (linux >= 2.6.14) and fall back to normal set */
   if ( zserv_privs.change (ZPRIVS_RAISE) )
     zlog_err ("routing_socket: Can't raise privileges");
-  ret = setsockopt(nl->sock, SOL_SOCKET, SO_RCVBUFFORCE, &nl_rcvbufsize,
-		   sizeof(nl_rcvbufsize));
+  ret = setsockopt(nl->sock, SOL_SOCKET, SO_RCVBUFFORCE, &newsize,
+		   sizeof(newsize));
   if ( zserv_privs.change (ZPRIVS_LOWER) )
     zlog_err ("routing_socket: Can't lower privileges");
   if (ret < 0)
-     ret = setsockopt(nl->sock, SOL_SOCKET, SO_RCVBUF, &nl_rcvbufsize,
-		      sizeof(nl_rcvbufsize));
+     ret = setsockopt(nl->sock, SOL_SOCKET, SO_RCVBUF, &newsize,
+		      sizeof(newsize));
   if (ret < 0)
     {
       zlog (NULL, LOG_ERR, "Can't set %s receive buffer size: %s", nl->name,
@@ -397,7 +401,9 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *),
           /* skip unsolicited messages originating from command socket
            * linux sets the originators port-id for {NEW|DEL}ADDR messages,
            * so this has to be checked here. */
-          if (nl != &netlink_cmd && h->nlmsg_pid == netlink_cmd.snl.nl_pid
+          if (nl != &netlink_cmd
+              && (h->nlmsg_pid == netlink_cmd.snl.nl_pid
+                  || h->nlmsg_pid == netlink_batch.snl.nl_pid)
               && (h->nlmsg_type != RTM_NEWADDR && h->nlmsg_type != RTM_DELADDR))
             {
               if (IS_ZEBRA_DEBUG_KERNEL)
@@ -1337,6 +1343,10 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   };
   int save_errno;
 
+  /* Route changes queued before this go first. */
+  if (nl == &netlink_cmd)
+    zebra_dplane_sync ();
+
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
@@ -1373,6 +1383,319 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   return netlink_parse_info (netlink_talk_filter, nl);
 }
 
+/* Route changes are not sent to the kernel one at a time.  They are
+ * collected in a batch, sent with a single sendmsg() on a socket of
+ * their own once the dataplane thread has gone through its work or the
+ * batch is full, and the ACKs are read back right away.  An error is
+ * mapped back to the rib it was about, the dataplane thread's copy, whose
+ * nexthops then lose their FIB flag just as if kernel_add_ipv4 had
+ * failed.
+ *
+ * All of this runs in the dataplane thread, see zebra_dplane.c.
+ */
+#define NL_BATCH_BUF_SIZE	(128 * 1024)
+#define NL_BATCH_MAX		1024
+
+/* Receive buffer holding the ACKs of a full batch. */
+#define NL_BATCH_RCVBUF_SIZE	(NL_BATCH_MAX * 1024)
+
+struct nl_batch_entry
+{
+  u_int32_t seq;
+  int cmd;
+  struct prefix p;
+
+  /* Owned by the dataplane thread until the batch is flushed. */
+  struct rib *rib;
+};
+
+static struct
+{
+  /* Messages not sent yet. */
+  char buf[NL_BATCH_BUF_SIZE];
+  size_t len;
+
+  /* Sent but not acknowledged messages, then the queued ones.  A ring
+     of count entries from head. */
+  struct nl_batch_entry entry[NL_BATCH_MAX];
+  unsigned int head;
+  unsigned int count;
+  unsigned int queued;
+
+  /* Statistics. */
+  unsigned long batches;
+  unsigned long messages;
+  unsigned long acks;
+  unsigned long errors;
+  unsigned long lost;
+  unsigned int last_batch;
+  unsigned int max_batch;
+} nl_batch;
+
+#define NL_BATCH_ENTRY(i) (&nl_batch.entry[(nl_batch.head + (i)) % NL_BATCH_MAX])
+
+static void
+netlink_batch_pop (void)
+{
+  nl_batch.head = (nl_batch.head + 1) % NL_BATCH_MAX;
+  nl_batch.count--;
+}
+
+/* Installing the route of ENTRY failed. */
+static void
+netlink_batch_install_failed (struct nl_batch_entry *entry)
+{
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  for (ALL_NEXTHOPS_RO(entry->rib->nexthop, nexthop, tnexthop, recursing))
+    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+}
+
+/* The kernel answered message SEQ with ERROR, 0 being an ACK. */
+static void
+netlink_batch_ack (u_int32_t seq, int error)
+{
+  struct nl_batch_entry *entry;
+  char buf[INET6_ADDRSTRLEN];
+
+  /* Older messages whose ACK was lost, the receive buffer overran. */
+  while (nl_batch.count > nl_batch.queued
+	 && (int32_t)(NL_BATCH_ENTRY (0)->seq - seq) < 0)
+    {
+      nl_batch.lost++;
+      netlink_batch_pop ();
+    }
+
+  if (nl_batch.count == nl_batch.queued || NL_BATCH_ENTRY (0)->seq != seq)
+    return;
+
+  entry = NL_BATCH_ENTRY (0);
+
+  if (! error)
+    nl_batch.acks++;
+  else if ((entry->cmd == RTM_DELROUTE
+	    && (-error == ENODEV || -error == ESRCH))
+	   || (entry->cmd == RTM_NEWROUTE && -error == EEXIST))
+    {
+      /* Races in link handling, see netlink_parse_info. */
+      if (IS_ZEBRA_DEBUG_KERNEL)
+	zlog_debug ("%s: error: %s type=%s(%u), seq=%u, %s/%d",
+		    netlink_batch.name, safe_strerror (-error),
+		    lookup (nlmsg_str, entry->cmd), entry->cmd, seq,
+		    inet_ntop (entry->p.family, &entry->p.u.prefix,
+			       buf, sizeof (buf)), entry->p.prefixlen);
+    }
+  else
+    {
+      nl_batch.errors++;
+      zlog_err ("%s error: %s, type=%s(%u), seq=%u, %s/%d",
+		netlink_batch.name, safe_strerror (-error),
+		lookup (nlmsg_str, entry->cmd), entry->cmd, seq,
+		inet_ntop (entry->p.family, &entry->p.u.prefix,
+			   buf, sizeof (buf)), entry->p.prefixlen);
+      if (entry->cmd == RTM_NEWROUTE)
+	netlink_batch_install_failed (entry);
+    }
+
+  netlink_batch_pop ();
+}
+
+/* Read the ACKs of the batches sent so far.  The kernel has processed
+   a batch by the time sendmsg() returns, so once the socket is empty
+   any ACK still missing has been dropped. */
+static void
+netlink_batch_drain (void)
+{
+  char buf[NL_PKT_BUF_SIZE];
+  struct iovec iov = { .iov_base = buf, .iov_len = sizeof buf };
+  struct sockaddr_nl snl;
+  struct msghdr msg = {
+    .msg_name = (void *) &snl,
+    .msg_namelen = sizeof snl,
+    .msg_iov = &iov,
+    .msg_iovlen = 1
+  };
+  struct nlmsghdr *h;
+  struct nlmsgerr *err;
+  int status;
+
+  while (1)
+    {
+      status = recvmsg (netlink_batch.sock, &msg, 0);
+      if (status < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno == EWOULDBLOCK || errno == EAGAIN)
+	    break;
+	  zlog (NULL, LOG_ERR, "%s recvmsg overrun: %s",
+		netlink_batch.name, safe_strerror (errno));
+	  continue;
+	}
+      if (status == 0)
+	break;
+
+      for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
+	   h = NLMSG_NEXT (h, status))
+	{
+	  if (h->nlmsg_type != NLMSG_ERROR)
+	    continue;
+
+	  if (h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+	    {
+	      zlog (NULL, LOG_ERR, "%s error: message truncated",
+		    netlink_batch.name);
+	      continue;
+	    }
+
+	  err = (struct nlmsgerr *) NLMSG_DATA (h);
+	  netlink_batch_ack (err->msg.nlmsg_seq, err->error);
+	}
+    }
+
+  while (nl_batch.count > nl_batch.queued)
+    {
+      nl_batch.lost++;
+      netlink_batch_pop ();
+    }
+}
+
+/* Send the queued route messages in one go, and read their ACKs. */
+void
+netlink_batch_flush (void)
+{
+  struct sockaddr_nl snl;
+  struct iovec iov = {
+    .iov_base = (void *) nl_batch.buf,
+    .iov_len = nl_batch.len
+  };
+  struct msghdr msg = {
+    .msg_name = (void *) &snl,
+    .msg_namelen = sizeof snl,
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+  };
+  int status;
+  int save_errno;
+
+  if (! nl_batch.queued)
+    return;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: sending %u messages, %lu bytes", netlink_batch.name,
+		nl_batch.queued, (unsigned long) nl_batch.len);
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  status = sendmsg (netlink_batch.sock, &msg, 0);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  if (status < 0)
+    {
+      unsigned int i;
+
+      zlog (NULL, LOG_ERR, "%s sendmsg() error: %s", netlink_batch.name,
+	    safe_strerror (save_errno));
+
+      /* None of the queued messages made it. */
+      for (i = nl_batch.count - nl_batch.queued; i < nl_batch.count; i++)
+	if (NL_BATCH_ENTRY (i)->cmd == RTM_NEWROUTE)
+	  netlink_batch_install_failed (NL_BATCH_ENTRY (i));
+      nl_batch.errors += nl_batch.queued;
+      nl_batch.count -= nl_batch.queued;
+    }
+  else
+    {
+      nl_batch.batches++;
+      nl_batch.messages += nl_batch.queued;
+      nl_batch.last_batch = nl_batch.queued;
+      if (nl_batch.queued > nl_batch.max_batch)
+	nl_batch.max_batch = nl_batch.queued;
+    }
+
+  nl_batch.len = 0;
+  nl_batch.queued = 0;
+
+  netlink_batch_drain ();
+}
+
+/* Queue route message N about rib RIB for prefix P. */
+static int
+netlink_batch_add (struct nlmsghdr *n, struct prefix *p, struct rib *rib)
+{
+  struct nl_batch_entry *entry;
+
+  /* Without the batch socket there is no dataplane thread either, and
+     this is the main thread. */
+  if (netlink_batch.sock < 0)
+    return netlink_talk (n, &netlink_cmd);
+
+  if (nl_batch.len + NLMSG_ALIGN (n->nlmsg_len) > NL_BATCH_BUF_SIZE
+      || nl_batch.count == NL_BATCH_MAX)
+    netlink_batch_flush ();
+
+  n->nlmsg_seq = ++netlink_batch.seq;
+  n->nlmsg_flags |= NLM_F_ACK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: queue type %s(%u), seq=%u", netlink_batch.name,
+		lookup (nlmsg_str, n->nlmsg_type), n->nlmsg_type,
+		n->nlmsg_seq);
+
+  memcpy (nl_batch.buf + nl_batch.len, n, n->nlmsg_len);
+  nl_batch.len += NLMSG_ALIGN (n->nlmsg_len);
+
+  entry = NL_BATCH_ENTRY (nl_batch.count);
+  entry->seq = n->nlmsg_seq;
+  entry->cmd = n->nlmsg_type;
+  prefix_copy (&entry->p, p);
+  entry->rib = rib;
+  nl_batch.count++;
+  nl_batch.queued++;
+
+  return 0;
+}
+
+int
+netlink_batch_available (void)
+{
+  return netlink_batch.sock >= 0;
+}
+
+void
+netlink_batch_show (struct vty *vty)
+{
+  if (netlink_batch.sock < 0)
+    {
+      vty_out (vty, "Netlink route batching is not available%s",
+	       VTY_NEWLINE);
+      return;
+    }
+
+  vty_out (vty, "Netlink route batching, up to %u messages or %u bytes%s",
+	   NL_BATCH_MAX, NL_BATCH_BUF_SIZE, VTY_NEWLINE);
+  vty_out (vty, "  Queued messages:   %10u (%lu bytes)%s", nl_batch.queued,
+	   (unsigned long) nl_batch.len, VTY_NEWLINE);
+  vty_out (vty, "  Batches sent:      %10lu%s", nl_batch.batches,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Messages sent:     %10lu%s", nl_batch.messages,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Last batch size:   %10u%s", nl_batch.last_batch,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Largest batch:     %10u%s", nl_batch.max_batch,
+	   VTY_NEWLINE);
+  vty_out (vty, "  ACKs:              %10lu%s", nl_batch.acks, VTY_NEWLINE);
+  vty_out (vty, "  Errors:            %10lu%s", nl_batch.errors,
+	   VTY_NEWLINE);
+  vty_out (vty, "  ACKs lost:         %10lu%s", nl_batch.lost, VTY_NEWLINE);
+}
+
 /* Routing table change via netlink interface. */
 // not used!
 /*
@@ -1664,7 +1987,6 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                          int family)
 {
   int bytelen;
-  struct sockaddr_nl snl;
   struct nexthop *nexthop = NULL, *tnexthop;
   int recursing;
   int nexthop_num;
@@ -1831,12 +2153,8 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 
 skip:
 
-  /* Destination netlink address. */
-  memset (&snl, 0, sizeof snl);
-  snl.nl_family = AF_NETLINK;
-
-  /* Talk to netlink socket. */
-  return netlink_talk (&req.n, &netlink_cmd);
+  /* Queue for the kernel, errors are reported asynchronously. */
+  return netlink_batch_add (&req.n, p, rib);
 }
 
 int
@@ -1941,24 +2259,26 @@ kernel_read (struct thread *thread)
 }
 
 /* Filter out messages from self that occur on listener socket,
-   caused by our actions on the command socket
+   caused by our actions on the command and batch sockets
  */
-static void netlink_install_filter (int sock, __u32 pid)
+static void netlink_install_filter (int sock, __u32 pid, __u32 batch_pid)
 {
   struct sock_filter filter[] = {
     /* 0: ldh [4]	          */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_H, offsetof(struct nlmsghdr, nlmsg_type)),
-    /* 1: jeq 0x18 jt 3 jf 6  */
+    /* 1: jeq 0x18 jt 3 jf 7  */
     BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_NEWROUTE), 1, 0),
-    /* 2: jeq 0x19 jt 3 jf 6  */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 3),
+    /* 2: jeq 0x19 jt 3 jf 7  */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 4),
     /* 3: ldw [12]		  */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_W, offsetof(struct nlmsghdr, nlmsg_pid)),
-    /* 4: jeq XX  jt 5 jf 6   */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 0, 1),
-    /* 5: ret 0    (skip)     */
+    /* 4: jeq XX  jt 6 jf 5   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 1, 0),
+    /* 5: jeq YY  jt 6 jf 7   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(batch_pid), 0, 1),
+    /* 6: ret 0    (skip)     */
     BPF_STMT(BPF_RET|BPF_K, 0),
-    /* 6: ret 0xffff (keep)   */
+    /* 7: ret 0xffff (keep)   */
     BPF_STMT(BPF_RET|BPF_K, 0xffff),
   };
 
@@ -1984,6 +2304,7 @@ kernel_init (void)
 #endif /* HAVE_IPV6 */
   netlink_socket (&netlink, groups);
   netlink_socket (&netlink_cmd, 0);
+  netlink_socket (&netlink_batch, 0);
 
   /* Register kernel socket. */
   if (netlink.sock > 0)
@@ -1997,9 +2318,22 @@ kernel_init (void)
       if (nl_rcvbufsize)
 	netlink_recvbuf (&netlink, nl_rcvbufsize);
 
-      netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid);
+      netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid,
+			      netlink_batch.snl.nl_pid);
       thread_add_read (zebrad.master, kernel_read, NULL, netlink.sock);
     }
+
+  /* Route changes go through the batch socket, whose ACKs are read
+     without blocking by the dataplane thread. */
+  if (netlink_batch.sock > 0)
+    {
+      if (fcntl (netlink_batch.sock, F_SETFL, O_NONBLOCK) < 0)
+	zlog (NULL, LOG_ERR, "Can't set %s socket flags: %s",
+	      netlink_batch.name, safe_strerror (errno));
+
+      netlink_recvbuf (&netlink_batch, MAX (nl_rcvbufsize,
+					    NL_BATCH_RCVBUF_SIZE));
+    }
 }
 
 /*
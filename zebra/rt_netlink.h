@@ -24,6 +24,8 @@
 
 #ifdef HAVE_NETLINK
 
+#include "vty.h"
+
 #define NL_PKT_BUF_SIZE 8192
 
 extern int
@@ -40,6 +42,10 @@ nl_msg_type_to_str (uint16_t msg_type);
 extern const char *
 nl_rtproto_to_str (u_char rtproto);
 
+extern int netlink_batch_available (void);
+extern void netlink_batch_flush (void);
+extern void netlink_batch_show (struct vty *);
+
 
 #endif /* HAVE_NETLINK */
 
@@ -35,6 +35,7 @@
 #include "zebra/debug.h"
 #include "zebra/router-id.h"
 #include "zebra/interface.h"
+#include "zebra/zebra_dplane.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -315,6 +316,9 @@ main (int argc, char **argv)
       exit (1);
     }
 
+  /* Threads do not survive daemon(). */
+  zebra_dplane_init (NULL);
+
   /* Needed for BSD routing socket. */
   pid = getpid ();
 
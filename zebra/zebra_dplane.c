@@ -0,0 +1,702 @@
+/* Zebra dataplane thread.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* rib_process does not program the kernel itself.  Every install or
+ * uninstall becomes a context holding the prefix and a private copy of
+ * the rib and its nexthops, which is queued and handed to a thread of
+ * its own once the rib work queue is done.  That thread calls the usual
+ * kernel_* functions on the copies, so any kernel method works, and
+ * passes the contexts back through a pipe read from the thread loop,
+ * where the FIB flags the kernel method left on the copy are applied to
+ * the rib if it is still there and nothing newer was queued for it.
+ *
+ * The FIB flags of an installed rib are set when it is queued, the way
+ * the kernel methods set them, so that routes resolving over it in the
+ * same run see it; the answer of the dataplane thread then corrects
+ * them.
+ *
+ * Only the main thread allocates or frees memory.  The dataplane thread
+ * touches nothing but the contexts it holds and the kernel interface.
+ * What it logs goes to syslog, the file and stdout but not to terminal
+ * monitors, which are the main thread's.
+ *
+ * The main thread still makes some kernel changes itself, such as
+ * interface addresses.  zebra_dplane_sync lets it wait for the route
+ * changes queued before to reach the kernel first, so that they are
+ * made in the order zebra made them.
+ */
+
+#include <zebra.h>
+#include <pthread.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "thread.h"
+#include "network.h"
+#include "privs.h"
+#include "log.h"
+#include "vty.h"
+#include "workqueue.h"
+
+#include "zebra/rib.h"
+#include "zebra/rt.h"
+#include "zebra/zserv.h"
+#include "zebra/zebra_rnh.h"
+#include "zebra/zebra_dplane.h"
+#ifdef HAVE_NETLINK
+#include "zebra/rt_netlink.h"
+#endif /* HAVE_NETLINK */
+
+extern struct zebra_t zebrad;
+
+/* Hand the queued changes over without waiting for the rib work queue
+   once this many have piled up. */
+#define DPLANE_BATCH_MAX	1024
+
+enum dplane_op
+{
+  DPLANE_OP_INSTALL,
+  DPLANE_OP_UNINSTALL,
+};
+
+struct dplane_ctx
+{
+  struct dplane_ctx *next;
+
+  enum dplane_op op;
+  u_int32_t seq;
+  struct prefix p;
+  afi_t afi;
+  safi_t safi;
+
+  /* What the kernel method works on. */
+  struct rib rib;
+
+  /* The rib the change is for.  Only compared with the ribs of the
+     node, it may be gone by the time the answer comes back. */
+  struct rib *orig;
+
+  /* Return value of the kernel method. */
+  int ret;
+};
+
+struct dplane_list
+{
+  struct dplane_ctx *head;
+  struct dplane_ctx **tail;
+  unsigned int count;
+};
+
+static struct
+{
+  pthread_t thread;
+  int running;
+
+  /* Guards requests, results, stop, busy and the statistics of the
+     dataplane thread. */
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+
+  /* Signalled when the dataplane thread has nothing left to do. */
+  pthread_cond_t idle;
+
+  /* Main thread only. */
+  struct dplane_list pending;
+  struct thread *t_submit;
+  struct thread *t_read;
+  u_int32_t seq;
+
+  struct dplane_list requests;
+  struct dplane_list results;
+  int stop;
+  int busy;
+
+  /* Written to by the dataplane thread when results was empty. */
+  int pipe[2];
+
+  /* Statistics, main thread. */
+  unsigned long installs;
+  unsigned long uninstalls;
+  unsigned long failures;
+  unsigned long stale;
+
+  /* Statistics, dataplane thread. */
+  unsigned long batches;
+  unsigned int last_batch;
+  unsigned int max_batch;
+} dplane =
+{
+  .mtx = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+  .idle = PTHREAD_COND_INITIALIZER,
+};
+
+static int (*dplane_privs_change_orig) (zebra_privs_ops_t);
+static pthread_mutex_t dplane_privs_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int dplane_privs_raised;
+
+/* Both threads raise and lower privileges now.  Serialise that, and
+   leave them raised while either thread still needs them, setuid
+   style privileges being for the whole process. */
+static int
+dplane_privs_change (zebra_privs_ops_t op)
+{
+  int ret = 0;
+
+  pthread_mutex_lock (&dplane_privs_mtx);
+  if (op == ZPRIVS_RAISE)
+    {
+      ret = dplane_privs_change_orig (op);
+      if (! ret)
+	dplane_privs_raised++;
+    }
+  else if (op == ZPRIVS_LOWER)
+    {
+      if (dplane_privs_raised > 0)
+	dplane_privs_raised--;
+      if (! dplane_privs_raised)
+	ret = dplane_privs_change_orig (op);
+    }
+  else
+    ret = dplane_privs_change_orig (op);
+  pthread_mutex_unlock (&dplane_privs_mtx);
+
+  return ret;
+}
+
+static void
+dplane_list_init (struct dplane_list *list)
+{
+  list->head = NULL;
+  list->tail = &list->head;
+  list->count = 0;
+}
+
+static void
+dplane_list_add (struct dplane_list *list, struct dplane_ctx *ctx)
+{
+  ctx->next = NULL;
+  *list->tail = ctx;
+  list->tail = &ctx->next;
+  list->count++;
+}
+
+/* Move all of FROM to the end of TO. */
+static void
+dplane_list_splice (struct dplane_list *to, struct dplane_list *from)
+{
+  if (! from->head)
+    return;
+
+  *to->tail = from->head;
+  to->tail = from->tail;
+  to->count += from->count;
+  dplane_list_init (from);
+}
+
+static struct nexthop *
+dplane_nexthop_copy (struct nexthop *nexthop)
+{
+  struct nexthop *head = NULL, *last = NULL, *new;
+
+  for (; nexthop; nexthop = nexthop->next)
+    {
+      new = XMALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      memcpy (new, nexthop, sizeof (struct nexthop));
+      if (nexthop->ifname)
+	new->ifname = XSTRDUP (0, nexthop->ifname);
+      new->resolved = dplane_nexthop_copy (nexthop->resolved);
+
+      new->next = NULL;
+      new->prev = last;
+      if (last)
+	last->next = new;
+      else
+	head = new;
+      last = new;
+    }
+
+  return head;
+}
+
+static void
+dplane_nexthop_free (struct nexthop *nexthop)
+{
+  struct nexthop *next;
+
+  for (; nexthop; nexthop = next)
+    {
+      next = nexthop->next;
+      if (nexthop->ifname)
+	XFREE (0, nexthop->ifname);
+      dplane_nexthop_free (nexthop->resolved);
+      XFREE (MTYPE_NEXTHOP, nexthop);
+    }
+}
+
+/* Give the FIB flags of FROM to TO, two copies of the same nexthops.
+   Return 1 if any of them changed. */
+static int
+dplane_nexthop_fib_copy (struct nexthop *to, struct nexthop *from)
+{
+  int changed = 0;
+
+  for (; to && from; to = to->next, from = from->next)
+    {
+      if (CHECK_FLAG (to->flags, NEXTHOP_FLAG_FIB)
+	  != CHECK_FLAG (from->flags, NEXTHOP_FLAG_FIB))
+	{
+	  to->flags ^= NEXTHOP_FLAG_FIB;
+	  changed = 1;
+	}
+      if (dplane_nexthop_fib_copy (to->resolved, from->resolved))
+	changed = 1;
+    }
+
+  return changed;
+}
+
+static struct dplane_ctx *
+dplane_ctx_new (enum dplane_op op, struct route_node *rn, struct rib *rib)
+{
+  rib_table_info_t *info = rn->table->info;
+  struct dplane_ctx *ctx;
+
+  ctx = XCALLOC (MTYPE_DPLANE_CTX, sizeof (struct dplane_ctx));
+  ctx->op = op;
+  ctx->seq = rib->dplane_seq = ++dplane.seq;
+  prefix_copy (&ctx->p, &rn->p);
+  ctx->afi = info->afi;
+  ctx->safi = info->safi;
+  ctx->orig = rib;
+
+  memcpy (&ctx->rib, rib, sizeof (struct rib));
+  ctx->rib.next = ctx->rib.prev = NULL;
+  ctx->rib.nexthop = dplane_nexthop_copy (rib->nexthop);
+
+  return ctx;
+}
+
+static void
+dplane_ctx_free (struct dplane_ctx *ctx)
+{
+  dplane_nexthop_free (ctx->rib.nexthop);
+  XFREE (MTYPE_DPLANE_CTX, ctx);
+}
+
+/* Dataplane thread. */
+
+static void
+dplane_ctx_process (struct dplane_ctx *ctx)
+{
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  ctx->ret = 0;
+
+  switch (ctx->op)
+    {
+    case DPLANE_OP_INSTALL:
+      switch (PREFIX_FAMILY (&ctx->p))
+	{
+	case AF_INET:
+	  ctx->ret = kernel_add_ipv4 (&ctx->p, &ctx->rib);
+	  break;
+#ifdef HAVE_IPV6
+	case AF_INET6:
+	  ctx->ret = kernel_add_ipv6 (&ctx->p, &ctx->rib);
+	  break;
+#endif /* HAVE_IPV6 */
+	}
+
+      /* This condition is never met, if we are using rt_socket.c */
+      if (ctx->ret < 0)
+	for (ALL_NEXTHOPS_RO(ctx->rib.nexthop, nexthop, tnexthop, recursing))
+	  UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      break;
+
+    case DPLANE_OP_UNINSTALL:
+      switch (PREFIX_FAMILY (&ctx->p))
+	{
+	case AF_INET:
+	  ctx->ret = kernel_delete_ipv4 (&ctx->p, &ctx->rib);
+	  break;
+#ifdef HAVE_IPV6
+	case AF_INET6:
+	  ctx->ret = kernel_delete_ipv6 (&ctx->p, &ctx->rib);
+	  break;
+#endif /* HAVE_IPV6 */
+	}
+      break;
+    }
+}
+
+static void *
+dplane_thread_main (void *arg)
+{
+  struct dplane_list work;
+  struct dplane_ctx *ctx;
+  int notify;
+
+  pthread_mutex_lock (&dplane.mtx);
+  while (1)
+    {
+      while (! dplane.requests.head && ! dplane.stop)
+	pthread_cond_wait (&dplane.cond, &dplane.mtx);
+
+      /* Stopping, but only once everything handed over is done. */
+      if (! dplane.requests.head)
+	break;
+
+      dplane_list_init (&work);
+      dplane_list_splice (&work, &dplane.requests);
+      dplane.busy = 1;
+      pthread_mutex_unlock (&dplane.mtx);
+
+      for (ctx = work.head; ctx; ctx = ctx->next)
+	dplane_ctx_process (ctx);
+
+#ifdef HAVE_NETLINK
+      /* Failed route changes clear the FIB flags of their copy here. */
+      netlink_batch_flush ();
+#endif /* HAVE_NETLINK */
+
+      pthread_mutex_lock (&dplane.mtx);
+      dplane.batches++;
+      dplane.last_batch = work.count;
+      if (work.count > dplane.max_batch)
+	dplane.max_batch = work.count;
+
+      notify = (dplane.results.head == NULL);
+      dplane_list_splice (&dplane.results, &work);
+      if (notify && write (dplane.pipe[1], "", 1) < 0 && errno != EAGAIN)
+	zlog_err ("%s: write: %s", __func__, safe_strerror (errno));
+
+      dplane.busy = 0;
+      if (! dplane.requests.head)
+	pthread_cond_broadcast (&dplane.idle);
+    }
+  pthread_mutex_unlock (&dplane.mtx);
+
+  return NULL;
+}
+
+/* Main thread. */
+
+/* The dataplane thread is done with CTX. */
+static void
+dplane_ctx_result (struct dplane_ctx *ctx)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+  int fib = 0;
+
+  if (ctx->op == DPLANE_OP_INSTALL)
+    {
+      for (ALL_NEXTHOPS_RO(ctx->rib.nexthop, nexthop, tnexthop, recursing))
+	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+	  fib = 1;
+      if (! fib)
+	dplane.failures++;
+    }
+  else if (ctx->ret < 0)
+    dplane.failures++;
+
+  table = vrf_table (ctx->afi, ctx->safi, 0);
+  if (! table)
+    return;
+
+  rn = route_node_lookup (table, &ctx->p);
+  if (! rn)
+    {
+      dplane.stale++;
+      return;
+    }
+
+  RNODE_FOREACH_RIB (rn, rib)
+    if (rib == ctx->orig)
+      break;
+
+  /* Uninstalled ribs lost their FIB flags when queued. */
+  if (! rib || CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+      || rib->dplane_seq != ctx->seq)
+    dplane.stale++;
+  else if (ctx->op == DPLANE_OP_INSTALL
+	   && dplane_nexthop_fib_copy (rib->nexthop, ctx->rib.nexthop))
+    zebra_rnh_trigger (&rn->p);
+
+  route_unlock_node (rn);
+}
+
+static int
+dplane_read (struct thread *thread)
+{
+  struct dplane_list done;
+  struct dplane_ctx *ctx, *next;
+  char buf[64];
+
+  dplane.t_read = thread_add_read (zebrad.master, dplane_read, NULL,
+				   dplane.pipe[0]);
+
+  while (read (dplane.pipe[0], buf, sizeof buf) > 0)
+    ;
+
+  dplane_list_init (&done);
+  pthread_mutex_lock (&dplane.mtx);
+  dplane_list_splice (&done, &dplane.results);
+  pthread_mutex_unlock (&dplane.mtx);
+
+  for (ctx = done.head; ctx; ctx = next)
+    {
+      next = ctx->next;
+      dplane_ctx_result (ctx);
+      dplane_ctx_free (ctx);
+    }
+
+  return 0;
+}
+
+/* Hand the queued changes to the dataplane thread. */
+void
+zebra_dplane_submit (void)
+{
+  THREAD_OFF (dplane.t_submit);
+
+  if (! dplane.pending.head)
+    return;
+
+  pthread_mutex_lock (&dplane.mtx);
+  dplane_list_splice (&dplane.requests, &dplane.pending);
+  pthread_cond_signal (&dplane.cond);
+  pthread_mutex_unlock (&dplane.mtx);
+}
+
+/* Wait for the changes queued so far to reach the kernel, before one
+   the main thread makes itself.  Without the thread they are made as
+   they are queued. */
+void
+zebra_dplane_sync (void)
+{
+  if (! dplane.running)
+    return;
+
+  zebra_dplane_submit ();
+
+  pthread_mutex_lock (&dplane.mtx);
+  while (dplane.requests.head || dplane.busy)
+    pthread_cond_wait (&dplane.idle, &dplane.mtx);
+  pthread_mutex_unlock (&dplane.mtx);
+}
+
+/* Changes made outside of the rib work queue.  While the queue has
+   work they keep piling up, meta_queue_complete submits them when the
+   queue is done. */
+static int
+dplane_submit_event (struct thread *thread)
+{
+  dplane.t_submit = NULL;
+
+  if (zebrad.ribq && listcount (zebrad.ribq->items)
+      && dplane.pending.count < DPLANE_BATCH_MAX)
+    return 0;
+
+  zebra_dplane_submit ();
+  return 0;
+}
+
+static void
+dplane_enqueue (struct dplane_ctx *ctx)
+{
+  if (! dplane.running)
+    {
+      /* No thread (yet or any more), do it the old way. */
+      dplane_ctx_process (ctx);
+#ifdef HAVE_NETLINK
+      netlink_batch_flush ();
+#endif /* HAVE_NETLINK */
+      dplane_ctx_result (ctx);
+      dplane_ctx_free (ctx);
+      return;
+    }
+
+  dplane_list_add (&dplane.pending, ctx);
+
+  if (dplane.pending.count >= DPLANE_BATCH_MAX)
+    zebra_dplane_submit ();
+  else if (! dplane.t_submit)
+    dplane.t_submit = thread_add_event (zebrad.master, dplane_submit_event,
+					NULL, 0);
+}
+
+void
+dplane_route_install (struct route_node *rn, struct rib *rib)
+{
+  struct dplane_ctx *ctx;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  int discard;
+
+  dplane.installs++;
+
+  ctx = dplane_ctx_new (DPLANE_OP_INSTALL, rn, rib);
+
+  for (ALL_NEXTHOPS_RO(ctx->rib.nexthop, nexthop, tnexthop, recursing))
+    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+
+  discard = CHECK_FLAG (rib->flags, ZEBRA_FLAG_BLACKHOLE | ZEBRA_FLAG_REJECT);
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+	&& (discard || CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE)))
+      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    else
+      UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+
+  dplane_enqueue (ctx);
+}
+
+void
+dplane_route_uninstall (struct route_node *rn, struct rib *rib)
+{
+  struct dplane_ctx *ctx;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  dplane.uninstalls++;
+
+  /* The copy keeps the FIB flags, they tell what to delete. */
+  ctx = dplane_ctx_new (DPLANE_OP_UNINSTALL, rn, rib);
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+
+  dplane_enqueue (ctx);
+}
+
+void
+zebra_dplane_show (struct vty *vty)
+{
+  unsigned int requests, results;
+  unsigned long batches;
+  unsigned int last_batch, max_batch;
+
+  pthread_mutex_lock (&dplane.mtx);
+  requests = dplane.requests.count;
+  results = dplane.results.count;
+  batches = dplane.batches;
+  last_batch = dplane.last_batch;
+  max_batch = dplane.max_batch;
+  pthread_mutex_unlock (&dplane.mtx);
+
+  vty_out (vty, "Dataplane thread %s%s",
+	   dplane.running ? "running" : "not running", VTY_NEWLINE);
+  vty_out (vty, "  Queued changes:    %10u%s", dplane.pending.count,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Handed over:       %10u%s", requests, VTY_NEWLINE);
+  vty_out (vty, "  Results waiting:   %10u%s", results, VTY_NEWLINE);
+  vty_out (vty, "  Installs:          %10lu%s", dplane.installs,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Uninstalls:        %10lu%s", dplane.uninstalls,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Failures:          %10lu%s", dplane.failures,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Stale results:     %10lu%s", dplane.stale, VTY_NEWLINE);
+  vty_out (vty, "  Batches:           %10lu (last %u, largest %u)%s",
+	   batches, last_batch, max_batch, VTY_NEWLINE);
+}
+
+void
+zebra_dplane_init (struct zebra_privs_t *privs)
+{
+  sigset_t set, oset;
+  int ret;
+
+  dplane_list_init (&dplane.pending);
+  dplane_list_init (&dplane.requests);
+  dplane_list_init (&dplane.results);
+
+#ifdef HAVE_NETLINK
+  /* The thread sends route changes on the batch socket only. */
+  if (! netlink_batch_available ())
+    {
+      zlog_err ("%s: no netlink batch socket, programming the kernel inline",
+		__func__);
+      return;
+    }
+#endif /* HAVE_NETLINK */
+
+  if (pipe (dplane.pipe) < 0)
+    {
+      zlog_err ("%s: pipe: %s, programming the kernel inline", __func__,
+		safe_strerror (errno));
+      return;
+    }
+  set_nonblocking (dplane.pipe[0]);
+  set_nonblocking (dplane.pipe[1]);
+
+  if (privs)
+    {
+      dplane_privs_change_orig = privs->change;
+      privs->change = dplane_privs_change;
+    }
+
+  /* Signals are for the main thread. */
+  sigfillset (&set);
+  pthread_sigmask (SIG_SETMASK, &set, &oset);
+  ret = pthread_create (&dplane.thread, NULL, dplane_thread_main, NULL);
+  pthread_sigmask (SIG_SETMASK, &oset, NULL);
+
+  if (ret)
+    {
+      zlog_err ("%s: pthread_create: %s, programming the kernel inline",
+		__func__, safe_strerror (ret));
+      close (dplane.pipe[0]);
+      close (dplane.pipe[1]);
+      return;
+    }
+
+  dplane.running = 1;
+  dplane.t_read = thread_add_read (zebrad.master, dplane_read, NULL,
+				   dplane.pipe[0]);
+}
+
+/* Let the dataplane thread finish what it was handed, and stop it. */
+void
+zebra_dplane_finish (void)
+{
+  if (! dplane.running)
+    return;
+
+  zebra_dplane_submit ();
+
+  pthread_mutex_lock (&dplane.mtx);
+  dplane.stop = 1;
+  pthread_cond_signal (&dplane.cond);
+  pthread_mutex_unlock (&dplane.mtx);
+
+  pthread_join (dplane.thread, NULL);
+  dplane.running = 0;
+
+  THREAD_OFF (dplane.t_read);
+}
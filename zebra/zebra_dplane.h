@@ -0,0 +1,37 @@
+/* Zebra dataplane thread.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_DPLANE_H
+#define _ZEBRA_DPLANE_H
+
+#include "privs.h"
+#include "table.h"
+#include "vty.h"
+#include "zebra/rib.h"
+
+extern void zebra_dplane_init (struct zebra_privs_t *);
+extern void zebra_dplane_finish (void);
+extern void zebra_dplane_submit (void);
+extern void zebra_dplane_sync (void);
+extern void dplane_route_install (struct route_node *, struct rib *);
+extern void dplane_route_uninstall (struct route_node *, struct rib *);
+extern void zebra_dplane_show (struct vty *);
+
+#endif /* _ZEBRA_DPLANE_H */
@@ -41,6 +41,8 @@
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/zebra_rnh.h"
+#include "zebra/zebra_dplane.h"
 
 /* Default rtm_table for all clients */
 extern struct zebra_t zebrad;
@@ -1202,10 +1204,10 @@ nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
 
 
 
+/* Install the route into kernel, through the dataplane thread. */
 static void
 rib_install_kernel (struct route_node *rn, struct rib *rib)
 {
-  int ret = 0;
   struct nexthop *nexthop, *tnexthop;
   rib_table_info_t *info = rn->table->info;
   int recursing;
@@ -1222,31 +1224,13 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
    * the kernel.
    */
   zfpm_trigger_update (rn, "installing in kernel");
-  switch (PREFIX_FAMILY (&rn->p))
-    {
-    case AF_INET:
-      ret = kernel_add_ipv4 (&rn->p, rib);
-      break;
-#ifdef HAVE_IPV6
-    case AF_INET6:
-      ret = kernel_add_ipv6 (&rn->p, rib);
-      break;
-#endif /* HAVE_IPV6 */
-    }
-
-  /* This condition is never met, if we are using rt_socket.c */
-  if (ret < 0)
-    {
-      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
-	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
-    }
+  dplane_route_install (rn, rib);
 }
 
-/* Uninstall the route from kernel. */
-static int
+/* Uninstall the route from kernel, through the dataplane thread. */
+static void
 rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
 {
-  int ret = 0;
   struct nexthop *nexthop, *tnexthop;
   rib_table_info_t *info = rn->table->info;
   int recursing;
@@ -1255,7 +1239,7 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
     {
       for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
         SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
-      return ret;
+      return;
     }
 
   /*
@@ -1263,23 +1247,7 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
    * the kernel.
    */
   zfpm_trigger_update (rn, "uninstalling from kernel");
-
-  switch (PREFIX_FAMILY (&rn->p))
-    {
-    case AF_INET:
-      ret = kernel_delete_ipv4 (&rn->p, rib);
-      break;
-#ifdef HAVE_IPV6
-    case AF_INET6:
-      ret = kernel_delete_ipv6 (&rn->p, rib);
-      break;
-#endif /* HAVE_IPV6 */
-    }
-
-  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
-    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
-
-  return ret;
+  dplane_route_uninstall (rn, rib);
 }
 
 /* Uninstall the route from kernel. */
@@ -1471,7 +1439,10 @@ rib_process (struct route_node *rn)
       if (CHECK_FLAG (select->flags, ZEBRA_FLAG_CHANGED))
         {
           if (info->safi == SAFI_UNICAST)
-	    zfpm_trigger_update (rn, "updating existing route");
+	    {
+	      zfpm_trigger_update (rn, "updating existing route");
+	      zebra_rnh_trigger (&rn->p);
+	    }
 
           redistribute_delete (&rn->p, select);
           if (! RIB_SYSTEM_ROUTE (select))
@@ -1515,7 +1486,10 @@ rib_process (struct route_node *rn)
 	rnode_debug (rn, "Removing existing route, fib %p", fib);
 
       if (info->safi == SAFI_UNICAST)
-        zfpm_trigger_update (rn, "removing existing route");
+        {
+          zfpm_trigger_update (rn, "removing existing route");
+          zebra_rnh_trigger (&rn->p);
+        }
 
       redistribute_delete (&rn->p, fib);
       if (! RIB_SYSTEM_ROUTE (fib))
@@ -1536,7 +1510,10 @@ rib_process (struct route_node *rn)
 	rnode_debug (rn, "Adding route, select %p", select);
 
       if (info->safi == SAFI_UNICAST)
-        zfpm_trigger_update (rn, "new route selected");
+        {
+          zfpm_trigger_update (rn, "new route selected");
+          zebra_rnh_trigger (&rn->p);
+        }
 
       /* Set real nexthop. */
       nexthop_active_update (rn, select, 1);
@@ -1734,6 +1711,14 @@ meta_queue_new (void)
   return new;
 }
 
+/* All queued route nodes processed: hand what is left of the route
+   changes to the dataplane thread. */
+static void
+meta_queue_complete (struct work_queue *dummy)
+{
+  zebra_dplane_submit ();
+}
+
 /* initialise zebra rib work queue */
 static void
 rib_queue_init (struct zebra_t *zebra)
@@ -1750,6 +1735,7 @@ rib_queue_init (struct zebra_t *zebra)
   /* fill in the work queue spec */
   zebra->ribq->spec.workfunc = &meta_queue_process;
   zebra->ribq->spec.errorfunc = NULL;
+  zebra->ribq->spec.completion_func = &meta_queue_complete;
   /* XXX: TODO: These should be runtime configurable via vty */
   zebra->ribq->spec.max_retries = 3;
   zebra->ribq->spec.hold = rib_process_hold_time;
@@ -3280,7 +3266,6 @@ rib_sweep_table (struct route_table *table)
   struct route_node *rn;
   struct rib *rib;
   struct rib *next;
-  int ret = 0;
 
   if (table)
     for (rn = route_top (table); rn; rn = route_next (rn))
@@ -3292,9 +3277,8 @@ rib_sweep_table (struct route_table *table)
 	  if (rib->type == ZEBRA_ROUTE_KERNEL && 
 	      CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELFROUTE))
 	    {
-	      ret = rib_uninstall_kernel (rn, rib);
-	      if (! ret)
-                rib_delnode (rn, rib);
+	      rib_uninstall_kernel (rn, rib);
+	      rib_delnode (rn, rib);
 	    }
 	}
 }
@@ -0,0 +1,313 @@
+/* Zebra registered nexthop tracking.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Clients such as bgpd register the nexthop addresses they depend on
+ * with ZEBRA_NEXTHOP_REGISTER.  Whenever rib_process changes what is
+ * selected for a prefix, the registered addresses covered by it are
+ * queued, resolved again once the current work is done, and the
+ * clients get a ZEBRA_NEXTHOP_UPDATE for every address whose
+ * resolution actually changed.  This replaces periodic polling with
+ * ZEBRA_IPV4_NEXTHOP_LOOKUP.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "linklist.h"
+#include "thread.h"
+#include "log.h"
+
+#include "zebra/rib.h"
+#include "zebra/zserv.h"
+#include "zebra/debug.h"
+#include "zebra/zebra_rnh.h"
+
+extern struct zebra_t zebrad;
+
+/* Registered addresses, per address family. */
+static struct route_table *rnh_table[AFI_MAX];
+
+/* Addresses waiting to be resolved again. */
+static struct list *rnh_queue;
+static struct thread *t_rnh_process;
+
+static void
+rnh_nexthop_free (struct nexthop *nexthop)
+{
+  struct nexthop *next;
+
+  for (; nexthop; nexthop = next)
+    {
+      next = nexthop->next;
+      XFREE (MTYPE_NEXTHOP, nexthop);
+    }
+}
+
+static int
+rnh_nexthop_same (struct nexthop *next1, struct nexthop *next2)
+{
+  for (; next1 && next2; next1 = next1->next, next2 = next2->next)
+    if (next1->type != next2->type
+	|| next1->ifindex != next2->ifindex
+	|| memcmp (&next1->gate, &next2->gate, sizeof (union g_addr)))
+      return 0;
+
+  return next1 == next2;
+}
+
+/* Resolve the address of RNH the same way ZEBRA_IPV4_NEXTHOP_LOOKUP and
+   ZEBRA_IPV6_NEXTHOP_LOOKUP do, and store the result.  Return 1 if it is
+   different from the previous one. */
+static int
+rnh_resolve (struct rnh *rnh)
+{
+  struct prefix *p = &rnh->node->p;
+  struct rib *rib = NULL;
+  struct nexthop *nexthop, *new;
+  struct nexthop *head = NULL, *last = NULL;
+  u_int32_t metric = 0;
+  u_char num = 0;
+  int changed;
+
+  if (p->family == AF_INET)
+    rib = rib_match_ipv4_safi (p->u.prefix4, SAFI_UNICAST, 1, NULL);
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6)
+    rib = rib_match_ipv6 (&p->u.prefix6);
+#endif /* HAVE_IPV6 */
+
+  if (rib)
+    {
+      metric = rib->metric;
+
+      /* Top chain only, as for the lookup. */
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+	  {
+	    new = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+	    new->type = nexthop->type;
+	    new->ifindex = nexthop->ifindex;
+	    new->gate = nexthop->gate;
+
+	    new->prev = last;
+	    if (last)
+	      last->next = new;
+	    else
+	      head = new;
+	    last = new;
+	    num++;
+	  }
+    }
+
+  changed = (metric != rnh->metric
+	     || num != rnh->nexthop_num
+	     || ! rnh_nexthop_same (head, rnh->nexthop));
+
+  rnh_nexthop_free (rnh->nexthop);
+  rnh->nexthop = head;
+  rnh->nexthop_num = num;
+  rnh->metric = metric;
+
+  return changed;
+}
+
+static void
+rnh_free (struct rnh *rnh)
+{
+  if (rnh->queued)
+    listnode_delete (rnh_queue, rnh);
+
+  rnh_nexthop_free (rnh->nexthop);
+  list_delete (rnh->client_list);
+
+  rnh->node->info = NULL;
+  route_unlock_node (rnh->node);
+
+  XFREE (MTYPE_RNH, rnh);
+}
+
+static int
+rnh_process (struct thread *t)
+{
+  struct listnode *node, *cnode;
+  struct rnh *rnh;
+  struct zserv *client;
+  char buf[INET6_ADDRSTRLEN];
+
+  t_rnh_process = NULL;
+
+  while ((node = listhead (rnh_queue)) != NULL)
+    {
+      rnh = listgetdata (node);
+      list_delete_node (rnh_queue, node);
+      rnh->queued = 0;
+
+      if (! rnh_resolve (rnh))
+	continue;
+
+      if (IS_ZEBRA_DEBUG_EVENT)
+	zlog_debug ("nexthop %s: %s, metric %u, %d nexthop(s)",
+		    inet_ntop (rnh->node->p.family, &rnh->node->p.u.prefix,
+			       buf, sizeof (buf)),
+		    rnh->nexthop_num ? "reachable" : "unreachable",
+		    rnh->metric, rnh->nexthop_num);
+
+      for (ALL_LIST_ELEMENTS_RO (rnh->client_list, cnode, client))
+	zsend_nexthop_update (client, rnh);
+    }
+
+  return 0;
+}
+
+static void
+rnh_enqueue (struct rnh *rnh)
+{
+  if (rnh->queued)
+    return;
+
+  rnh->queued = 1;
+  listnode_add (rnh_queue, rnh);
+
+  if (! t_rnh_process)
+    t_rnh_process = thread_add_event (zebrad.master, rnh_process, NULL, 0);
+}
+
+static struct route_table *
+rnh_table_get (struct prefix *p)
+{
+  afi_t afi = family2afi (p->family);
+
+  if (afi != AFI_IP && afi != AFI_IP6)
+    return NULL;
+
+  return rnh_table[afi];
+}
+
+/* Called by rib_process whenever the route selected for P changes.
+   Only registered addresses within P can resolve differently. */
+void
+zebra_rnh_trigger (struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *rn;
+
+  table = rnh_table_get (p);
+  if (! table || ! route_table_count (table))
+    return;
+
+  /* Hold the top of the subtree: it is the walk's limit and may
+     otherwise be removed under us if it has no info. */
+  top = route_node_get (table, p);
+  route_lock_node (top);
+
+  for (rn = top; rn; rn = route_next_until (rn, top))
+    if (rn->info)
+      rnh_enqueue (rn->info);
+
+  route_unlock_node (top);
+}
+
+void
+zebra_rnh_register (struct zserv *client, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rnh *rnh;
+
+  table = rnh_table_get (p);
+  if (! table)
+    return;
+
+  rn = route_node_get (table, p);
+  if (rn->info)
+    {
+      rnh = rn->info;
+      route_unlock_node (rn);
+    }
+  else
+    {
+      rnh = XCALLOC (MTYPE_RNH, sizeof (struct rnh));
+      rnh->node = rn;
+      rnh->client_list = list_new ();
+      rn->info = rnh;
+      rnh_resolve (rnh);
+    }
+
+  if (! listnode_lookup (rnh->client_list, client))
+    listnode_add (rnh->client_list, client);
+
+  /* The client wants to know where it stands right away. */
+  zsend_nexthop_update (client, rnh);
+}
+
+void
+zebra_rnh_unregister (struct zserv *client, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rnh *rnh;
+
+  table = rnh_table_get (p);
+  if (! table)
+    return;
+
+  rn = route_node_lookup (table, p);
+  if (! rn)
+    return;
+
+  rnh = rn->info;
+  route_unlock_node (rn);
+
+  if (! rnh)
+    return;
+
+  listnode_delete (rnh->client_list, client);
+  if (! listcount (rnh->client_list))
+    rnh_free (rnh);
+}
+
+/* Drop every registration of a client going away. */
+void
+zebra_rnh_client_close (struct zserv *client)
+{
+  struct route_node *rn;
+  struct rnh *rnh;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (rn = route_top (rnh_table[afi]); rn; rn = route_next (rn))
+      if ((rnh = rn->info) != NULL)
+	{
+	  listnode_delete (rnh->client_list, client);
+	  if (! listcount (rnh->client_list))
+	    rnh_free (rnh);
+	}
+}
+
+void
+zebra_rnh_init (void)
+{
+  rnh_table[AFI_IP] = route_table_init ();
+  rnh_table[AFI_IP6] = route_table_init ();
+  rnh_queue = list_new ();
+}
@@ -0,0 +1,55 @@
+/* Zebra registered nexthop tracking.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_RNH_H
+#define _ZEBRA_RNH_H
+
+#include "prefix.h"
+#include "table.h"
+
+/* A nexthop address clients asked to be told about.  The resolution
+ * below is what was last sent to them: the metric of the route the
+ * address resolves over and its FIB nexthops, nexthop_num == 0 meaning
+ * unreachable.
+ */
+struct rnh
+{
+  /* Node in the registration table, keyed by host prefix. */
+  struct route_node *node;
+
+  /* Registered clients (struct zserv). */
+  struct list *client_list;
+
+  u_int32_t metric;
+  u_char nexthop_num;
+  struct nexthop *nexthop;
+
+  /* On the re-evaluation queue. */
+  u_char queued;
+};
+
+extern void zebra_rnh_init (void);
+extern int zsend_nexthop_update (struct zserv *, struct rnh *);
+extern void zebra_rnh_register (struct zserv *, struct prefix *);
+extern void zebra_rnh_unregister (struct zserv *, struct prefix *);
+extern void zebra_rnh_client_close (struct zserv *);
+extern void zebra_rnh_trigger (struct prefix *);
+
+#endif /* _ZEBRA_RNH_H */
@@ -29,6 +29,8 @@
 #include "rib.h"
 
 #include "zebra/zserv.h"
+#include "zebra/rt_netlink.h"
+#include "zebra/zebra_dplane.h"
 
 static int do_show_ip_route(struct vty *vty, safi_t safi);
 static void vty_show_ip_route_detail (struct vty *vty, struct route_node *rn,
@@ -2360,6 +2362,30 @@ static int config_write_vty(struct vty *vty)
   return 1;
 }   
 
+#ifdef HAVE_NETLINK
+DEFUN (show_zebra_netlink,
+       show_zebra_netlink_cmd,
+       "show zebra netlink",
+       SHOW_STR
+       "Zebra information\n"
+       "Netlink route programming\n")
+{
+  netlink_batch_show (vty);
+  return CMD_SUCCESS;
+}
+#endif /* HAVE_NETLINK */
+
+DEFUN (show_zebra_dplane,
+       show_zebra_dplane_cmd,
+       "show zebra dplane",
+       SHOW_STR
+       "Zebra information\n"
+       "Dataplane thread\n")
+{
+  zebra_dplane_show (vty);
+  return CMD_SUCCESS;
+}
+
 /* table node for protocol filtering */
 static struct cmd_node protocol_node = { PROTOCOL_NODE, "", 1 };
 
@@ -2468,4 +2494,11 @@ zebra_vty_init (void)
   install_element (VIEW_NODE, &show_ipv6_mroute_cmd);
   install_element (ENABLE_NODE, &show_ipv6_mroute_cmd);
 #endif /* HAVE_IPV6 */
+
+#ifdef HAVE_NETLINK
+  install_element (VIEW_NODE, &show_zebra_netlink_cmd);
+  install_element (ENABLE_NODE, &show_zebra_netlink_cmd);
+#endif /* HAVE_NETLINK */
+  install_element (VIEW_NODE, &show_zebra_dplane_cmd);
+  install_element (ENABLE_NODE, &show_zebra_dplane_cmd);
 }
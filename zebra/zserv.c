@@ -42,6 +42,7 @@
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/ipforward.h"
+#include "zebra/zebra_rnh.h"
 
 /* Event list of zebra. */
 enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
@@ -732,6 +733,64 @@ zsend_ipv4_import_lookup (struct zserv *client, struct prefix_ipv4 *p)
   return zebra_server_send_message(client);
 }
 
+/* Nexthop tracking.  Send the current resolution of a registered
+   address, in the format of the nexthop lookup replies prefixed with
+   the address family. */
+int
+zsend_nexthop_update (struct zserv *client, struct rnh *rnh)
+{
+  struct stream *s;
+  struct prefix *p;
+  struct nexthop *nexthop;
+
+  p = &rnh->node->p;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_NEXTHOP_UPDATE);
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
+  stream_putl (s, rnh->metric);
+  stream_putc (s, rnh->nexthop_num);
+
+  for (nexthop = rnh->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      stream_putc (s, nexthop->type);
+      switch (nexthop->type)
+	{
+	case ZEBRA_NEXTHOP_IPV4:
+	  stream_put_in_addr (s, &nexthop->gate.ipv4);
+	  break;
+	case ZEBRA_NEXTHOP_IPV4_IFINDEX:
+	  stream_put_in_addr (s, &nexthop->gate.ipv4);
+	  stream_putl (s, nexthop->ifindex);
+	  break;
+#ifdef HAVE_IPV6
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_put (s, &nexthop->gate.ipv6, 16);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	  stream_put (s, &nexthop->gate.ipv6, 16);
+	  stream_putl (s, nexthop->ifindex);
+	  break;
+#endif /* HAVE_IPV6 */
+	case ZEBRA_NEXTHOP_IFINDEX:
+	case ZEBRA_NEXTHOP_IFNAME:
+	  stream_putl (s, nexthop->ifindex);
+	  break;
+	default:
+	  /* do nothing */
+	  break;
+	}
+    }
+
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message(client);
+}
+
 /* Router-id is updated. Send ZEBRA_ROUTER_ID_ADD to client. */
 int
 zsend_router_id_update (struct zserv *client, struct prefix *p)
@@ -1164,6 +1223,49 @@ zread_ipv6_nexthop_lookup (struct zserv *client, u_short length)
 }
 #endif /* HAVE_IPV6 */
 
+/* Register or unregister nexthop addresses for tracking.  The message
+   is a list of addresses, each as address family and address. */
+static int
+zread_nexthop_register (int command, struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct prefix p;
+  size_t end;
+
+  s = client->ibuf;
+  end = stream_get_getp (s) + length;
+
+  while (stream_get_getp (s) < end)
+    {
+      memset (&p, 0, sizeof (struct prefix));
+      p.family = stream_getc (s);
+      if (p.family == AF_INET)
+	{
+	  p.prefixlen = IPV4_MAX_BITLEN;
+	  p.u.prefix4.s_addr = stream_get_ipv4 (s);
+	}
+#ifdef HAVE_IPV6
+      else if (p.family == AF_INET6)
+	{
+	  p.prefixlen = IPV6_MAX_BITLEN;
+	  stream_get (&p.u.prefix6, s, 16);
+	}
+#endif /* HAVE_IPV6 */
+      else
+	{
+	  zlog_warn ("%s: unknown address family %d", __func__, p.family);
+	  return -1;
+	}
+
+      if (command == ZEBRA_NEXTHOP_REGISTER)
+	zebra_rnh_register (client, &p);
+      else
+	zebra_rnh_unregister (client, &p);
+    }
+
+  return 0;
+}
+
 /* Register zebra server router-id information.  Send current router-id */
 static int
 zread_router_id_add (struct zserv *client, u_short length)
@@ -1241,6 +1343,9 @@ zebra_client_close (struct zserv *client)
       client->sock = -1;
     }
 
+  /* Forget the nexthops it was tracking. */
+  zebra_rnh_client_close (client);
+
   /* Free stream buffers. */
   if (client->ibuf)
     stream_free (client->ibuf);
@@ -1445,6 +1550,10 @@ zebra_client_read (struct thread *thread)
     case ZEBRA_IPV4_IMPORT_LOOKUP:
       zread_ipv4_import_lookup (client, length);
       break;
+    case ZEBRA_NEXTHOP_REGISTER:
+    case ZEBRA_NEXTHOP_UNREGISTER:
+      zread_nexthop_register (command, client, length);
+      break;
     case ZEBRA_HELLO:
       zread_hello (client);
       break;